@@ -35,6 +35,13 @@ SET(WITH_HDF5 ${WITH_HDF5}
     CACHE BOOL "Build HDF5 import/export ?"
     FORCE)
     
+IF(NOT DEFINED WITH_OPENMP)
+    SET(WITH_OPENMP "ON")
+ENDIF()
+SET(WITH_OPENMP ${WITH_OPENMP}
+    CACHE BOOL "Use OpenMP for multi-threaded algorithms (if supported by the compiler) ?"
+    FORCE)
+    
 IF(NOT DEFINED WITH_VIGRANUMPY)
     SET(WITH_VIGRANUMPY "ON")
 ENDIF()
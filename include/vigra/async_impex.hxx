@@ -0,0 +1,408 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_ASYNC_IMPEX_HXX
+#define VIGRA_ASYNC_IMPEX_HXX
+
+#include <string>
+#include "config.hxx"
+#include "error.hxx"
+#include "utilities.hxx"
+#include "basicimage.hxx"
+#include "copyimage.hxx"
+#include "impex.hxx"
+#include "multi_array.hxx"
+#include "multi_impex.hxx"
+
+namespace vigra {
+
+/** \addtogroup VigraImpex
+*/
+//@{
+
+namespace detail {
+
+struct AsyncExportState;
+
+    // A unit of work for AsyncImageExporter: owns a copy of the data
+    // and encodes it when run() is called by the worker thread.
+struct AsyncExportJob
+{
+    virtual ~AsyncExportJob() {}
+
+    virtual void run() = 0;
+
+        // called by the worker thread after run(), before the
+        // corresponding ExportFuture becomes ready
+    virtual void finished(bool /* success */, std::string const & /* message */) {}
+};
+
+template <class Image>
+class AsyncImageExportJob
+: public AsyncExportJob
+{
+  public:
+    template <class SrcIterator, class SrcAccessor>
+    AsyncImageExportJob(SrcIterator sul, SrcIterator slr, SrcAccessor sget,
+                        ImageExportInfo const & info)
+    : image_(slr - sul),
+      info_(info)
+    {
+        copyImage(sul, slr, sget, image_.upperLeft(), image_.accessor());
+    }
+
+    void run()
+    {
+        exportImage(srcImageRange(image_), info_);
+    }
+
+  private:
+    Image image_;
+    ImageExportInfo info_;
+};
+
+template <class T>
+class AsyncVolumeExportJob
+: public AsyncExportJob
+{
+  public:
+    template <class Stride>
+    AsyncVolumeExportJob(MultiArrayView<3, T, Stride> const & volume,
+                         VolumeExportInfo const & info)
+    : volume_(volume),
+      info_(info)
+    {}
+
+    void run()
+    {
+        exportVolume(volume_, info_);
+    }
+
+  private:
+    MultiArray<3, T> volume_;
+    VolumeExportInfo info_;
+};
+
+template <class Job, class Callback>
+class AsyncExportJobWithCallback
+: public Job
+{
+  public:
+    template <class A1, class A2, class A3>
+    AsyncExportJobWithCallback(A1 const & a1, A2 const & a2, A3 const & a3,
+                               ImageExportInfo const & info, Callback const & callback)
+    : Job(a1, a2, a3, info),
+      callback_(callback)
+    {}
+
+    template <class A1>
+    AsyncExportJobWithCallback(A1 const & a1, VolumeExportInfo const & info,
+                               Callback const & callback)
+    : Job(a1, info),
+      callback_(callback)
+    {}
+
+    void finished(bool success, std::string const & message)
+    {
+        callback_(success, message);
+    }
+
+  private:
+    Callback callback_;
+};
+
+} // namespace detail
+
+/** \brief Handle to the result of an asynchronous export.
+
+    Returned by the export functions of \ref vigra::AsyncImageExporter.
+    Copies of an ExportFuture refer to the same export job.
+
+    <b>\#include</b> \<vigra/async_impex.hxx\><br>
+    Namespace: vigra
+*/
+class ExportFuture
+{
+  public:
+        /** Construct an invalid future (not associated with any job).
+        */
+    VIGRA_EXPORT ExportFuture();
+
+    VIGRA_EXPORT ExportFuture(ExportFuture const & other);
+
+    VIGRA_EXPORT ~ExportFuture();
+
+    VIGRA_EXPORT ExportFuture & operator=(ExportFuture const & other);
+
+        /** True if the future is associated with an export job.
+        */
+    VIGRA_EXPORT bool isValid() const;
+
+        /** True if the job has finished (successfully or not).
+            Never blocks.
+        */
+    VIGRA_EXPORT bool isReady() const;
+
+        /** Block until the job has finished. If the export failed,
+            throw a <tt>std::runtime_error</tt> with the message of the
+            original exception.
+        */
+    VIGRA_EXPORT void wait() const;
+
+        /** Block until the job has finished and return whether it succeeded
+            (does not throw).
+        */
+    VIGRA_EXPORT bool succeeded() const;
+
+        /** Block until the job has finished and return the error message
+            (empty if the export succeeded).
+        */
+    VIGRA_EXPORT std::string errorMessage() const;
+
+  private:
+    friend class AsyncImageExporter;
+    friend class AsyncImageExporterImpl;
+
+    explicit ExportFuture(detail::AsyncExportState * state);
+
+    detail::AsyncExportState * state_;
+};
+
+class AsyncImageExporterImpl;
+
+/** \brief Encode images and volumes on a background thread.
+
+    The export functions of this class copy the given data, hand the copy to
+    a worker thread and return immediately with an \ref vigra::ExportFuture.
+    The worker encodes the jobs in the order of submission with the ordinary
+    exportImage() and exportVolume() functions, so that the files are identical
+    to those written synchronously. This allows to overlap computation with
+    encoding and compression, e.g. in a batch pipeline.
+
+    The queue is bounded: at most <tt>capacity()</tt> jobs may be pending
+    (queued or being encoded). When the queue is full, the export functions
+    block until the oldest job has finished, which also bounds the memory
+    used by the copies. The default capacity of 2 amounts to double buffering:
+    one image is encoded while the next one is being computed.
+
+    Errors are reported through the future (see ExportFuture::wait()) and,
+    optionally, a completion callback. The callback must be a functor
+    with signature <tt>void operator()(bool success, std::string const & message)</tt>.
+    It is called on the worker thread, before the future becomes ready.
+
+    The destructor waits until all pending jobs are finished.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/async_impex.hxx\><br>
+    Namespace: vigra
+
+    \code
+    vigra::AsyncImageExporter exporter;
+    std::vector<vigra::ExportFuture> results;
+
+    for(int k = 0; k < frames; ++k)
+    {
+        vigra::FImage frame(w, h);
+        ... // compute frame k
+
+        // returns immediately (unless two frames are still being encoded)
+        results.push_back(exporter.exportImage(srcImageRange(frame),
+                                               vigra::ImageExportInfo(filenames[k].c_str())));
+    }
+
+    exporter.waitAll();
+    for(int k = 0; k < frames; ++k)
+        results[k].wait();   // throws if the export of frame k failed
+    \endcode
+*/
+class AsyncImageExporter
+{
+  public:
+        /** Create an exporter with a queue of the given capacity (at least 1)
+            and start the worker thread.
+        */
+    VIGRA_EXPORT explicit AsyncImageExporter(unsigned int capacity = 2);
+
+        /** Wait for all pending jobs and stop the worker thread.
+        */
+    VIGRA_EXPORT ~AsyncImageExporter();
+
+        /** Export an image asynchronously (see exportImage() for the
+            meaning of the arguments).
+        */
+    template <class SrcIterator, class SrcAccessor>
+    ExportFuture exportImage(SrcIterator sul, SrcIterator slr, SrcAccessor sget,
+                             ImageExportInfo const & info)
+    {
+        typedef detail::AsyncImageExportJob<BasicImage<typename SrcAccessor::value_type> > Job;
+        reserve();
+        return submit(createJob<Job>(sul, slr, sget, info));
+    }
+
+    template <class SrcIterator, class SrcAccessor>
+    ExportFuture exportImage(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                             ImageExportInfo const & info)
+    {
+        return exportImage(src.first, src.second, src.third, info);
+    }
+
+        /** Export an image asynchronously and call <tt>callback(success, message)</tt>
+            on the worker thread when the export has finished.
+        */
+    template <class SrcIterator, class SrcAccessor, class Callback>
+    ExportFuture exportImage(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                             ImageExportInfo const & info, Callback const & callback)
+    {
+        typedef detail::AsyncImageExportJob<BasicImage<typename SrcAccessor::value_type> > Base;
+        typedef detail::AsyncExportJobWithCallback<Base, Callback> Job;
+        reserve();
+        return submit(createJob<Job>(src.first, src.second, src.third, info, callback));
+    }
+
+        /** Export a volume asynchronously (see exportVolume() for the
+            meaning of the arguments).
+        */
+    template <class T, class Stride>
+    ExportFuture exportVolume(MultiArrayView<3, T, Stride> const & volume,
+                              VolumeExportInfo const & info)
+    {
+        typedef detail::AsyncVolumeExportJob<T> Job;
+        reserve();
+        return submit(createJob<Job>(volume, info));
+    }
+
+        /** Export a volume asynchronously and call <tt>callback(success, message)</tt>
+            on the worker thread when the export has finished.
+        */
+    template <class T, class Stride, class Callback>
+    ExportFuture exportVolume(MultiArrayView<3, T, Stride> const & volume,
+                              VolumeExportInfo const & info, Callback const & callback)
+    {
+        typedef detail::AsyncExportJobWithCallback<detail::AsyncVolumeExportJob<T>, Callback> Job;
+        reserve();
+        return submit(createJob<Job>(volume, info, callback));
+    }
+
+        /** Block until all pending jobs have finished.
+        */
+    VIGRA_EXPORT void waitAll();
+
+        /** Number of jobs that are queued or being encoded.
+        */
+    VIGRA_EXPORT unsigned int pending() const;
+
+        /** Maximum number of pending jobs.
+        */
+    VIGRA_EXPORT unsigned int capacity() const;
+
+  private:
+    AsyncImageExporter(AsyncImageExporter const &);
+    AsyncImageExporter & operator=(AsyncImageExporter const &);
+
+        // wait for a free slot in the queue
+    VIGRA_EXPORT void reserve();
+        // give back a reserved slot when the job could not be created
+    VIGRA_EXPORT void release();
+        // enqueue the job in the reserved slot (takes ownership)
+    VIGRA_EXPORT ExportFuture submit(detail::AsyncExportJob * job);
+
+        // the copy is made after reserve(), so that no more than
+        // capacity() copies exist at any time
+    template <class Job, class A1, class A2>
+    detail::AsyncExportJob * createJob(A1 const & a1, A2 const & a2)
+    {
+        try
+        {
+            return new Job(a1, a2);
+        }
+        catch(...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    template <class Job, class A1, class A2, class A3>
+    detail::AsyncExportJob * createJob(A1 const & a1, A2 const & a2, A3 const & a3)
+    {
+        try
+        {
+            return new Job(a1, a2, a3);
+        }
+        catch(...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    template <class Job, class A1, class A2, class A3, class A4>
+    detail::AsyncExportJob * createJob(A1 const & a1, A2 const & a2, A3 const & a3, A4 const & a4)
+    {
+        try
+        {
+            return new Job(a1, a2, a3, a4);
+        }
+        catch(...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    template <class Job, class A1, class A2, class A3, class A4, class A5>
+    detail::AsyncExportJob * createJob(A1 const & a1, A2 const & a2, A3 const & a3,
+                                       A4 const & a4, A5 const & a5)
+    {
+        try
+        {
+            return new Job(a1, a2, a3, a4, a5);
+        }
+        catch(...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    AsyncImageExporterImpl * pimpl_;
+};
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_ASYNC_IMPEX_HXX
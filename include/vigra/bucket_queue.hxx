@@ -40,10 +40,54 @@
 #include "config.hxx"
 #include "error.hxx"
 #include "array_vector.hxx"
-#include <queue>
+#include <vector>
 
 namespace vigra {
 
+namespace detail {
+
+    // First-in first-out queue for a single bucket. Unlike std::queue (which 
+    // is based on std::deque), it doesn't allocate memory while it is empty,
+    // so that queues with many (e.g. 65536) buckets are cheap to create.
+    // Memory is reused after the bucket ran empty.
+template <class T>
+class BucketQueueBucket
+{
+    std::vector<T> data_;
+    std::size_t front_;
+    
+  public:
+    BucketQueueBucket()
+    : front_(0)
+    {}
+    
+    std::size_t size() const
+    {
+        return data_.size() - front_;
+    }
+    
+    T const & front() const
+    {
+        return data_[front_];
+    }
+    
+    void push(T const & v)
+    {
+        data_.push_back(v);
+    }
+    
+    void pop()
+    {
+        if(++front_ == data_.size())
+        {
+            data_.clear();
+            front_ = 0;
+        }
+    }
+};
+
+} // namespace detail
+
 /** \brief Priority queue implemented using bucket sort.
 
     This template implements functionality similar to <tt><a href="http://www.sgi.com/tech/stl/priority_queue.html">std::priority_queue</a></tt>,
@@ -68,7 +112,7 @@ template <class ValueType,
           bool Ascending = false>  // std::priority_queue is descending
 class BucketQueue
 {
-    ArrayVector<std::queue<ValueType> > buckets_;
+    ArrayVector<detail::BucketQueueBucket<ValueType> > buckets_;
     std::size_t size_;
     std::ptrdiff_t top_;
     
@@ -152,7 +196,7 @@ class BucketQueue
 template <class ValueType> 
 class BucketQueue<ValueType, true> // ascending queue
 {
-    ArrayVector<std::queue<ValueType> > buckets_;
+    ArrayVector<detail::BucketQueueBucket<ValueType> > buckets_;
     std::size_t size_;
     std::ptrdiff_t top_;
     
@@ -0,0 +1,164 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef VIGRA_BYTESWAP_HXX
+#define VIGRA_BYTESWAP_HXX
+
+#include <cstring>
+#include <algorithm>
+#include "config.hxx"
+#include "sized_int.hxx"
+
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+# define VIGRA_BYTESWAP_SSE2
+# define VIGRA_BYTESWAP_SSSE3
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define VIGRA_BYTESWAP_SSE2
+#endif
+
+namespace vigra {
+
+namespace detail {
+
+inline bool hostIsLittleEndian()
+{
+    static const UInt16 one = 1;
+    return *reinterpret_cast<UInt8 const *>(&one) == 1;
+}
+
+#ifdef VIGRA_BYTESWAP_SSE2
+
+    // Reverse the bytes of all 16-, 32- or 64-bit words in a vector register
+    // (the dummy argument selects the word size).
+#ifdef VIGRA_BYTESWAP_SSSE3
+
+inline __m128i byteSwapVector(__m128i v, UInt16)
+{
+    return _mm_shuffle_epi8(v, _mm_set_epi8(14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1));
+}
+
+inline __m128i byteSwapVector(__m128i v, UInt32)
+{
+    return _mm_shuffle_epi8(v, _mm_set_epi8(12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3));
+}
+
+inline __m128i byteSwapVector(__m128i v, UInt64)
+{
+    return _mm_shuffle_epi8(v, _mm_set_epi8(8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7));
+}
+
+#else // SSE2 only: reverse the order of the 16-bit halves, then swap their bytes
+
+inline __m128i byteSwapVector(__m128i v, UInt16)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+inline __m128i byteSwapVector(__m128i v, UInt32)
+{
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return byteSwapVector(v, UInt16());
+}
+
+inline __m128i byteSwapVector(__m128i v, UInt64)
+{
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return byteSwapVector(v, UInt16());
+}
+
+#endif // VIGRA_BYTESWAP_SSSE3
+
+#endif // VIGRA_BYTESWAP_SSE2
+
+template <class T>
+inline void byteSwapArrayImpl(UInt8 * data, std::size_t count)
+{
+    std::size_t k = 0;
+#ifdef VIGRA_BYTESWAP_SSE2
+    const std::size_t perVector = 16 / sizeof(T);
+    for(; k + 2*perVector <= count; k += 2*perVector, data += 32)
+    {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data)),
+                v1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data), byteSwapVector(v0, T()));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + 16), byteSwapVector(v1, T()));
+    }
+#endif
+    for(; k < count; ++k, data += sizeof(T))
+    {
+        T v;
+        std::memcpy(&v, data, sizeof(T));
+        T r = 0;
+        for(unsigned int b = 0; b < sizeof(T); ++b)
+            r |= ((v >> (8*b)) & 0xff) << (8*(sizeof(T)-1-b));
+        std::memcpy(data, &r, sizeof(T));
+    }
+}
+
+    // Reverse the byte order of 'count' scalars of 'scalarSize' bytes each.
+    // 16-, 32- and 64-bit scalars are swapped with SSE2/SSSE3 instructions 
+    // when the compiler targets them, other sizes one scalar at a time.
+inline void byteSwapArray(void * data, std::size_t count, std::size_t scalarSize)
+{
+    UInt8 * p = static_cast<UInt8 *>(data);
+    switch(scalarSize)
+    {
+      case 1:
+        break;
+      case 2:
+        byteSwapArrayImpl<UInt16>(p, count);
+        break;
+      case 4:
+        byteSwapArrayImpl<UInt32>(p, count);
+        break;
+      case 8:
+        byteSwapArrayImpl<UInt64>(p, count);
+        break;
+      default:
+        for(std::size_t k = 0; k < count; ++k, p += scalarSize)
+            std::reverse(p, p + scalarSize);
+    }
+}
+
+} // namespace detail
+
+} // namespace vigra
+
+#endif // VIGRA_BYTESWAP_HXX
@@ -179,6 +179,32 @@ namespace vigra
 
         virtual unsigned int getOffset() const = 0;
 
+        // Select a reduced-resolution version of the image, downsampled by
+        // 2^level in either direction (with the size rounded up). On success,
+        // getWidth() and getHeight() return the size of the level. Must be
+        // called before setRegion() and the first nextScanline(). Returns
+        // false if the codec cannot do this.
+        virtual bool setLevel( unsigned int level )
+        {
+            return level == 0;
+        }
+
+        // Restrict decoding to the given region of interest. On success,
+        // getWidth() and getHeight() return the size of the region, and
+        // the scanlines only cover the region. Must be called before the
+        // first nextScanline(). Returns false if the codec cannot do this.
+        virtual bool setRegion( const vigra::Diff2D & /*upperLeft*/,
+                                const vigra::Size2D & /*size*/ )
+        {
+            return false;
+        }
+
+        // Number of threads the codec may use internally (negative
+        // means "as many as available", see actualThreadCount()).
+        virtual void setThreadCount( int /*count*/ )
+        {
+        }
+
         virtual const void * currentScanlineOfBand( unsigned int ) const = 0;
         virtual void nextScanline() = 0;
 
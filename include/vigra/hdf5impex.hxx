@@ -37,6 +37,10 @@
 #define VIGRA_HDF5IMPEX_HXX
 
 #include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <limits>
 
 #define H5Gcreate_vers 2
 #define H5Gopen_vers 2
@@ -67,11 +71,21 @@
 # include <hdf5_hl.h>
 #endif
 
+// HDF5 1.10.3 and later can read and write raw (compressed) chunks directly, 
+// so that we can run zlib in parallel
+#if defined(H5_HAVE_FILTER_DEFLATE) && defined(H5_VERSION_GE)
+# if H5_VERSION_GE(1,10,3)
+#  define VIGRA_HDF5_DIRECT_CHUNK_IO
+#  include <zlib.h>
+# endif
+#endif
+
 #include "impex.hxx"
 #include "multi_array.hxx"
 #include "multi_impex.hxx"
 #include "utilities.hxx"
 #include "error.hxx"
+#include "threading.hxx"
 
 namespace vigra {
 
@@ -423,6 +437,292 @@ VIGRA_H5_UNSIGNED_DATATYPE(unsigned long long)
 
 #undef VIGRA_H5_UNSIGNED_DATATYPE
 
+    // Advance the coordinate 'c' in scan order within the box [begin, end).
+    // Returns false when the end of the box has been reached.
+template <class Shape>
+inline bool nextCoordinateInBox(Shape & c, Shape const & begin, Shape const & end)
+{
+    for(unsigned int k=0; k<Shape::static_size; ++k)
+    {
+        if(++c[k] < end[k])
+            return true;
+        c[k] = begin[k];
+    }
+    return false;
+}
+
+    // Chunk cache and dataset handle cache of HDF5File.
+    //
+    // Chunks are stored decompressed and converted to the memory data type 
+    // they were requested with. When the total size of the chunks exceeds
+    // the capacity, the least recently used chunks are discarded. Copies
+    // of the cache start empty (dataset handles cannot be shared).
+class HDF5ChunkCache
+{
+  public:
+    typedef std::vector<MultiArrayIndex> ChunkIndex;
+
+    struct Dataset
+    {
+        hid_t handle;
+        ArrayVector<hsize_t> shape;       // HDF5 order
+        ArrayVector<hsize_t> chunkShape;  // HDF5 order, empty if the dataset is not chunked
+    };
+
+    struct Key
+    {
+        std::string dataset;
+        hid_t datatype;
+        ChunkIndex index;       // VIGRA order
+
+        Key(std::string const & d = std::string(), hid_t t = 0)
+        : dataset(d),
+          datatype(t)
+        {}
+
+        template <class Shape>
+        Key & setIndex(Shape const & s)
+        {
+            index.assign(s.begin(), s.end());
+            return *this;
+        }
+
+        bool operator<(Key const & k) const
+        {
+            if(dataset != k.dataset)
+                return dataset < k.dataset;
+            if(datatype != k.datatype)
+                return datatype < k.datatype;
+            return index < k.index;
+        }
+    };
+
+    HDF5ChunkCache()
+    : capacity_(0), size_(0),
+      hits_(0), misses_(0), prefetches_(0)
+    {}
+
+    HDF5ChunkCache(HDF5ChunkCache const & other)
+    : capacity_(other.capacity_), size_(0),
+      hits_(0), misses_(0), prefetches_(0),
+      readAhead_(other.readAhead_)
+    {}
+
+    HDF5ChunkCache & operator=(HDF5ChunkCache const & other)
+    {
+        if(this != &other)
+        {
+            closeDatasets();
+            clear();
+            capacity_ = other.capacity_;
+            readAhead_ = other.readAhead_;
+        }
+        return *this;
+    }
+
+    ~HDF5ChunkCache()
+    {
+        closeDatasets();
+    }
+
+    Dataset * findDataset(std::string const & name)
+    {
+        std::map<std::string, Dataset>::iterator i = datasets_.find(name);
+        return i == datasets_.end()
+                   ? 0
+                   : &i->second;
+    }
+
+        // take ownership of an open dataset handle and query its layout
+    Dataset & addDataset(std::string const & name, hid_t handle)
+    {
+        Dataset & d = datasets_[name];
+        d.handle = handle;
+
+        HDF5Handle dataspace(H5Dget_space(handle), &H5Sclose, "HDF5File: unable to get dataspace.");
+        int dimensions = H5Sget_simple_extent_ndims(dataspace);
+        d.shape.resize(dimensions);
+        H5Sget_simple_extent_dims(dataspace, d.shape.begin(), NULL);
+
+        HDF5Handle plist(H5Dget_create_plist(handle), &H5Pclose, "HDF5File: unable to get property list.");
+        d.chunkShape.clear();
+        if(H5Pget_layout(plist) == H5D_CHUNKED)
+        {
+            d.chunkShape.resize(dimensions);
+            H5Pget_chunk(plist, dimensions, d.chunkShape.begin());
+        }
+        return d;
+    }
+
+        // forget everything about a dataset (it is about to be deleted or replaced)
+    void invalidate(std::string const & name)
+    {
+        std::map<std::string, Dataset>::iterator i = datasets_.find(name);
+        if(i != datasets_.end())
+        {
+            H5Dclose(i->second.handle);
+            datasets_.erase(i);
+        }
+        dropChunks(name, ChunkIndex(), ChunkIndex());
+    }
+
+    void closeDatasets()
+    {
+        std::map<std::string, Dataset>::iterator i = datasets_.begin();
+        for(; i != datasets_.end(); ++i)
+            H5Dclose(i->second.handle);
+        datasets_.clear();
+    }
+
+        // look up a chunk and update the statistics (returns 0 on a miss)
+    ArrayVector<char> const * find(Key const & key)
+    {
+        ChunkIterator i = chunks_.find(key);
+        if(i == chunks_.end())
+        {
+            ++misses_;
+            return 0;
+        }
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, i->second.lruPosition);
+        return &i->second.data;
+    }
+
+    bool contains(Key const & key) const
+    {
+        return chunks_.find(key) != chunks_.end();
+    }
+
+        // store a chunk (the data are swapped into the cache, leaving 'data' empty)
+    void insert(Key const & key, ArrayVector<char> & data)
+    {
+        if(data.size() > capacity_ || contains(key))
+            return;
+        while(size_ + data.size() > capacity_)
+            evict();
+        Entry & e = chunks_[key];
+        e.data.swap(data);
+        lru_.push_front(key);
+        e.lruPosition = lru_.begin();
+        size_ += e.data.size();
+    }
+
+        // drop the chunks of a dataset whose index lies in [begin, end) 
+        // (all chunks of the dataset when the range is empty)
+    void dropChunks(std::string const & name, ChunkIndex const & begin, ChunkIndex const & end)
+    {
+        ChunkIterator i = chunks_.lower_bound(Key(name, std::numeric_limits<hid_t>::min()));
+        while(i != chunks_.end() && i->first.dataset == name)
+        {
+            bool inside = true;
+            for(unsigned int k=0; k<begin.size(); ++k)
+                if(i->first.index[k] < begin[k] || i->first.index[k] >= end[k])
+                    inside = false;
+            if(inside)
+            {
+                size_ -= i->second.data.size();
+                lru_.erase(i->second.lruPosition);
+                chunks_.erase(i++);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    void clear()
+    {
+        chunks_.clear();
+        lru_.clear();
+        size_ = 0;
+    }
+
+    void setCapacity(std::size_t bytes)
+    {
+        capacity_ = bytes;
+        while(size_ > capacity_)
+            evict();
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    void setReadAhead(std::string const & name, int dimension, int chunkCount)
+    {
+        if(chunkCount == 0)
+            readAhead_.erase(name);
+        else
+            readAhead_[name] = std::make_pair(dimension, chunkCount);
+    }
+
+    bool readAhead(std::string const & name, int & dimension, int & chunkCount) const
+    {
+        std::map<std::string, std::pair<int, int> >::const_iterator i = readAhead_.find(name);
+        if(i == readAhead_.end())
+            return false;
+        dimension = i->second.first;
+        chunkCount = i->second.second;
+        return true;
+    }
+
+    void countPrefetch()
+    {
+        ++prefetches_;
+    }
+
+    std::size_t hits() const
+    {
+        return hits_;
+    }
+
+    std::size_t misses() const
+    {
+        return misses_;
+    }
+
+    std::size_t prefetches() const
+    {
+        return prefetches_;
+    }
+
+    void resetStatistics()
+    {
+        hits_ = misses_ = prefetches_ = 0;
+    }
+
+  private:
+    struct Entry
+    {
+        ArrayVector<char> data;
+        std::list<Key>::iterator lruPosition;
+    };
+
+    typedef std::map<Key, Entry>::iterator ChunkIterator;
+
+    void evict()
+    {
+        ChunkIterator i = chunks_.find(lru_.back());
+        size_ -= i->second.data.size();
+        chunks_.erase(i);
+        lru_.pop_back();
+    }
+
+    std::size_t capacity_, size_;
+    std::size_t hits_, misses_, prefetches_;
+    std::map<std::string, Dataset> datasets_;
+    std::map<Key, Entry> chunks_;
+    std::list<Key> lru_;
+    std::map<std::string, std::pair<int, int> > readAhead_;
+};
+
 } // namespace detail
 
 
@@ -458,6 +758,31 @@ file.read("dataset", in_multi_array);
 
 \endcode
 
+<b>Chunk cache:</b>
+Reading many small, overlapping blocks from a compressed, chunked dataset 
+via readBlock() would decompress the same chunks over and over again. 
+HDF5File can therefore keep the most recently used chunks in memory in 
+decompressed form (see setChunkCacheSize()). In addition, chunks adjacent 
+to each requested block can be loaded in advance when the access direction 
+is known (see setReadAhead()). The cache is disabled by default.
+
+<b>Parallel compression:</b>
+When VIGRA is compiled with OpenMP and HDF5 (version 1.10.3 or later) supports
+direct chunk I/O, write() and read() of compressed datasets run zlib on 
+several threads when requested by setThreadCount(). The chunks are passed to HDF5
+in compressed form, so the files are indistinguishable from those written
+by the serial code path.
+\code
+HDF5File file("/path/to/file", HDF5File::Open);
+file.setChunkCacheSize(256*1024*1024);     // use up to 256 MB
+file.setReadAhead("/volume", 2, 2);        // we are going to scan along z
+
+for(int z=0; z<depth; z+=4)
+    file.readBlock("/volume", Shape3(0,0,z), Shape3(w,h,4), block);
+    
+std::cerr << file.chunkCacheHits() << " hits, " << file.chunkCacheMisses() << " misses.\n";
+\endcode
+
 <b>\#include</b> \<vigra/hdf5impex.hxx\><br>
 Namespace: vigra
 */
@@ -471,6 +796,18 @@ class HDF5File
     HDF5Handle cGroupHandle_;
 
 
+    // open dataset handles and decompressed chunks (must be destroyed before the file handle)
+    detail::HDF5ChunkCache chunkCache_;
+
+
+    // number of threads for chunk compression and decompression
+    int threadCount_;
+
+
+    // number of chunks transferred by direct chunk I/O
+    std::size_t directChunkWrites_, directChunkReads_;
+
+
     // datastructure to hold a list of dataset and group names
     struct lsOpData
     {
@@ -520,6 +857,9 @@ class HDF5File
     to "/".
     */
     HDF5File(std::string filename, OpenMode mode)
+    : threadCount_(1),
+      directChunkWrites_(0),
+      directChunkReads_(0)
     {
         std::string errorMessage = "HDF5File: Could not create file '" + filename + "'.";
         fileHandle_ = HDF5Handle(createFile_(filename, mode), &H5Fclose, errorMessage.c_str());
@@ -737,6 +1077,39 @@ class HDF5File
 
 
 
+    /** \brief Get the chunk shape of a certain dataset.
+      The chunk shape is returned in the same order as \ref getDatasetShape().
+      If the dataset is not chunked, the result is empty.
+      If the first character is a "/", the path will be interpreted as absolute path,
+      otherwise it will be interpreted as path relative to the current group.
+     */
+    inline ArrayVector<hsize_t> getChunkShape(std::string datasetName)
+    {
+        // make datasetName clean
+        datasetName = get_absolute_path(datasetName);
+
+        std::string errorMessage = "HDF5File::getChunkShape(): Unable to open dataset '" + datasetName + "'.";
+        HDF5Handle datasetHandle = HDF5Handle(getDatasetHandle_(datasetName), &H5Dclose, errorMessage.c_str());
+        HDF5Handle plist(H5Dget_create_plist(datasetHandle), &H5Pclose, 
+                         "HDF5File::getChunkShape(): Unable to get property list.");
+
+        ArrayVector<hsize_t> shape;
+        if(H5Pget_layout(plist) != H5D_CHUNKED)
+            return shape;
+
+        int dimensions = H5Pget_chunk(plist, 0, 0);
+        ArrayVector<hsize_t> chunks(dimensions);
+        H5Pget_chunk(plist, dimensions, chunks.begin());
+
+        // invert the dimensions to guarantee c-order
+        for(int i=dimensions-1; i>=0; --i)
+            shape.push_back(chunks[i]);
+        return shape;
+    }
+
+
+
+
     /** \brief Obtain the HDF5 handle of a dataset.
      */
     inline hid_t getDatasetHandle(std::string dataset_name)
@@ -1356,6 +1729,7 @@ class HDF5File
         hid_t parent = openCreateGroup_(groupname);
 
         // delete the dataset if it already exists
+        chunkCache_.invalidate(datasetName);
         deleteDataset_(parent, setname);
 
         // create dataspace
@@ -1410,6 +1784,116 @@ class HDF5File
     }
 
 
+
+
+    /** \brief Set the number of threads used to compress and decompress chunks.
+
+        Applies to write() and read() of entire arrays into datasets with zlib 
+        compression (see the class description). 1 (the default) switches parallel
+        compression off, negative values mean \ref vigra::defaultThreadCount().
+     */
+    inline void setThreadCount(int threadCount)
+    {
+        threadCount_ = threadCount;
+    }
+
+    /** \brief Get the number of threads used to compress and decompress chunks
+        (negative means \ref vigra::defaultThreadCount()).
+     */
+    inline int threadCount() const
+    {
+        return threadCount_;
+    }
+
+    /** \brief Number of chunks that write() has compressed in parallel and 
+        passed to HDF5 by direct chunk I/O.
+     */
+    inline std::size_t directChunkWrites() const
+    {
+        return directChunkWrites_;
+    }
+
+    /** \brief Number of chunks that read() has obtained by direct chunk I/O 
+        and decompressed in parallel.
+     */
+    inline std::size_t directChunkReads() const
+    {
+        return directChunkReads_;
+    }
+
+
+
+
+    /** \brief Set the capacity of the chunk cache in bytes.
+    
+        readBlock() keeps the decompressed chunks of chunked datasets in an LRU 
+        cache of (at most) the given size, so that subsequent reads of overlapping 
+        or nearby blocks need not decompress them again. writeBlock() writes 
+        through and discards the affected chunks from the cache. A size of 0 
+        (the default) disables the cache. Note that the cache is not 
+        aware of modifications by other HDF5File objects referring to the same file.
+     */
+    inline void setChunkCacheSize(std::size_t bytes)
+    {
+        chunkCache_.setCapacity(bytes);
+    }
+
+    /** \brief Get the capacity of the chunk cache in bytes.
+     */
+    inline std::size_t chunkCacheSize() const
+    {
+        return chunkCache_.capacity();
+    }
+
+    /** \brief Declare the direction in which a dataset will be traversed.
+
+        Whenever readBlock() accesses <tt>datasetName</tt>, the next <tt>chunkCount</tt>
+        chunks along <tt>dimension</tt> (in VIGRA's axis order) beyond the requested block 
+        are loaded into the chunk cache as well. Negative <tt>chunkCount</tt> means reading 
+        ahead in negative direction, zero switches read-ahead off. This has only an effect
+        when the chunk cache is enabled (see setChunkCacheSize()).
+     */
+    inline void setReadAhead(std::string datasetName, int dimension, int chunkCount)
+    {
+        chunkCache_.setReadAhead(get_absolute_path(datasetName), dimension, chunkCount);
+    }
+
+    /** \brief Number of chunks requested by readBlock() that were found in the cache.
+     */
+    inline std::size_t chunkCacheHits() const
+    {
+        return chunkCache_.hits();
+    }
+
+    /** \brief Number of chunks requested by readBlock() that had to be read from the file.
+     */
+    inline std::size_t chunkCacheMisses() const
+    {
+        return chunkCache_.misses();
+    }
+
+    /** \brief Number of chunks that were loaded by read-ahead.
+     */
+    inline std::size_t chunkCachePrefetches() const
+    {
+        return chunkCache_.prefetches();
+    }
+
+    /** \brief Reset the hit, miss and prefetch counters of the chunk cache.
+     */
+    inline void resetChunkCacheStatistics()
+    {
+        chunkCache_.resetStatistics();
+    }
+
+    /** \brief Discard all chunks from the chunk cache.
+     */
+    inline void clearChunkCache()
+    {
+        chunkCache_.clear();
+    }
+
+
   private:
 
     /* Simple extension of std::string for splitting into two parts
@@ -1862,6 +2346,7 @@ class HDF5File
         }
 
         // delete dataset, if it already exists
+        chunkCache_.invalidate(datasetName);
         deleteDataset_(groupHandle, setname.c_str());
 
         // set up properties list
@@ -1890,8 +2375,17 @@ class HDF5File
         // create dataset
         HDF5Handle datasetHandle (H5Dcreate(groupHandle, setname.c_str(), datatype, dataspace,H5P_DEFAULT, plist, H5P_DEFAULT), &H5Dclose, "HDF5File::write(): Can not create dataset.");
 
-        // Write the data to the HDF5 dataset as is
-        H5Dwrite( datasetHandle, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, array.data());
+#ifdef VIGRA_HDF5_DIRECT_CHUNK_IO
+        if(chunkSize[0] > 0 && compressionParameter > 0 && actualThreadCount(threadCount_) > 1)
+        {
+            writeChunksParallel_(datasetHandle, array, chunkSize, compressionParameter);
+        }
+        else
+#endif
+        {
+            // Write the data to the HDF5 dataset as is
+            H5Dwrite( datasetHandle, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, array.data());
+        }
 
         if(groupHandle != cGroupHandle_)
         {
@@ -1951,6 +2445,11 @@ class HDF5File
         vigra_precondition(shape == array.shape(),
                            "HDF5File::read(): Array shape disagrees with dataset shape.");
 
+#ifdef VIGRA_HDF5_DIRECT_CHUNK_IO
+        if(actualThreadCount(threadCount_) > 1 && readChunksParallel_(datasetHandle, array, datatype, numBandsOfType))
+            return;
+#endif
+
         // simply read in the data as is
         H5Dread( datasetHandle, datatype, H5S_ALL, H5S_ALL, H5P_DEFAULT, array.data() ); // .data() possible since void pointer!
     }
@@ -1958,60 +2457,298 @@ class HDF5File
 
 
 
-    /* Read a single value.
-      This functions allows to read a single datum of atomic datatype (int, long, double)
-      from the HDF5 file. So it is not nescessary to create a MultiArray
-      of size 1 to read a single number.
+#ifdef VIGRA_HDF5_DIRECT_CHUNK_IO
 
-      If the first character of datasetName is a "/", the path will be interpreted as absolute path,
-      otherwise it will be interpreted as path relative to the current group.
+    /* Compress the chunks of 'array' with zlib in parallel and pass them to HDF5 
+       by direct chunk writes. The dataset must have been created with the given chunk 
+       shape and the deflate filter as its only filter. The HDF5 calls themselves are 
+       serialized, since the HDF5 library is in general not thread-safe.
      */
-    template<class T>
-    inline void readAtomic(std::string datasetName, T & data)
+    template<unsigned int N, class T>
+    inline void writeChunksParallel_(hid_t datasetHandle, const MultiArrayView<N, T, UnstridedArrayTag> & array, 
+                                     typename MultiArrayShape<N>::type const & chunkShape, int compressionParameter)
     {
-        // make datasetName clean
-        datasetName = get_absolute_path(datasetName);
+        typedef typename MultiArrayShape<N>::type Shape;
 
-        MultiArray<1,T> array(MultiArrayShape<1>::type(1));
-        read_(datasetName, array, detail::getH5DataType<T>(), 1);
-        data = array[0];
-    }
-    inline void readAtomic(std::string datasetName, std::string & data)
-    {
-        // make datasetName clean
-        datasetName = get_absolute_path(datasetName);
+        Shape shape = array.shape(),
+              chunkCount = (shape + chunkShape - Shape(1)) / chunkShape;
+        MultiArrayIndex totalCount = prod(chunkCount);
+        int threadCount = actualThreadCount(threadCount_);
+        uLong chunkBytes = prod(chunkShape) * sizeof(T);
 
-        MultiArray<1,const char *> array(MultiArrayShape<1>::type(1));
-        read_(datasetName, array, detail::getH5DataType<const char *>(), 1);
-        data = std::string(array[0]);
+        ThreadExceptionCollector errors;
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(threadCount)
+#endif
+        {
+            MultiArray<N, T> chunk(chunkShape);
+            ArrayVector<Bytef> compressed(compressBound(chunkBytes));
+
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for(MultiArrayIndex k = 0; k < totalCount; ++k)
+            {
+                try
+                {
+                    if(errors.failed())
+                        continue;
+
+                    // gather the chunk, padding it at the array border
+                    Shape c, start;
+                    MultiArrayIndex i = k;
+                    for(unsigned int d = 0; d < N; ++d)
+                    {
+                        c[d] = i % chunkCount[d];
+                        i /= chunkCount[d];
+                    }
+                    start = c * chunkShape;
+                    Shape size = min(chunkShape, shape - start);
+                    if(size != chunkShape)
+                        chunk.init(T());
+                    chunk.subarray(Shape(), size).copy(array.subarray(start, start + size));
+
+                    uLongf compressedSize = compressed.size();
+                    vigra_postcondition(compress2(compressed.begin(), &compressedSize, (Bytef const *)chunk.data(), 
+                                                  chunkBytes, compressionParameter) == Z_OK,
+                        "HDF5File::write(): zlib compression failed.");
+
+                    hsize_t offset[N+1];
+                    for(unsigned int d = 0; d < N; ++d)
+                        offset[d] = start[N-1-d];
+                    offset[N] = 0;
+
+                    herr_t status;
+#ifdef _OPENMP
+                    #pragma omp critical(vigra_hdf5_io)
+#endif
+                    {
+                        status = H5Dwrite_chunk(datasetHandle, H5P_DEFAULT, 0, offset, compressedSize, compressed.begin());
+                        if(status >= 0)
+                            ++directChunkWrites_;
+                    }
+                    vigra_postcondition(status >= 0,
+                        "HDF5File::write(): Unable to write chunk.");
+                }
+                catch(std::exception & e)
+                {
+                    errors.capture(e);
+                }
+            }
+        }
+        errors.rethrow();
     }
 
 
 
 
-    /* low-level write function to write vigra unstrided MultiArray data into a sub-block of a dataset
+    /* Read the chunks of a deflate-compressed dataset with direct chunk reads 
+       and decompress them in parallel. Returns false (without reading anything) 
+       when the dataset's layout or filters don't permit this, or when some chunks 
+       were never written (the ordinary read then supplies the fill value).
      */
     template<unsigned int N, class T>
-    inline void writeBlock_(std::string datasetName, typename MultiArrayShape<N>::type &blockOffset, const MultiArrayView<N, T, UnstridedArrayTag> & array, const hid_t datatype, const int numBandsOfType)
+    inline bool readChunksParallel_(hid_t datasetHandle, MultiArrayView<N, T, UnstridedArrayTag> array, 
+                                    const hid_t datatype, const int numBandsOfType)
     {
-        // open dataset if it exists
-        std::string errorMessage = "HDF5File::writeBlock(): Error opening dataset '" + datasetName + "'.";
-        HDF5Handle datasetHandle (getDatasetHandle_(datasetName), &H5Dclose, errorMessage.c_str());
+        typedef typename MultiArrayShape<N>::type Shape;
 
+        int dimensions = N + (numBandsOfType > 1);
+
+        // the dataset must be chunked and compressed with zlib only
+        HDF5Handle plist(H5Dget_create_plist(datasetHandle), &H5Pclose, "HDF5File::read(): unable to get property list.");
+        if(H5Pget_layout(plist) != H5D_CHUNKED || H5Pget_nfilters(plist) != 1)
+            return false;
+        unsigned int flags = 0, filterConfig = 0;
+        std::size_t nelements = 0;
+        if(H5Pget_filter2(plist, 0, &flags, &nelements, NULL, 0, NULL, &filterConfig) != H5Z_FILTER_DEFLATE)
+            return false;
+
+        // the stored type must equal the requested one (no conversion)
+        HDF5Handle filetype(H5Dget_type(datasetHandle), &H5Tclose, "HDF5File::read(): unable to get data type.");
+        if(H5Tequal(filetype, datatype) <= 0)
+            return false;
+
+        hsize_t cSize[N+1];
+        H5Pget_chunk(plist, dimensions, cSize);
+        if(numBandsOfType > 1 && cSize[N] != (hsize_t)numBandsOfType)
+            return false;
+
+        Shape shape = array.shape(), chunkShape;
+        for(unsigned int d = 0; d < N; ++d)
+            chunkShape[d] = cSize[N-1-d];
+        Shape chunkCount = (shape + chunkShape - Shape(1)) / chunkShape;
+        MultiArrayIndex totalCount = prod(chunkCount);
+        int threadCount = actualThreadCount(threadCount_);
+        uLong chunkBytes = prod(chunkShape) * sizeof(T);
+
+        // all chunks must have been written (H5Dget_space_status() can't tell, 
+        // since it compares the compressed size with the uncompressed one)
+        for(MultiArrayIndex k = 0; k < totalCount; ++k)
+        {
+            hsize_t offset[N+1], storageSize = 0;
+            MultiArrayIndex i = k;
+            for(unsigned int d = 0; d < N; ++d)
+            {
+                offset[N-1-d] = (i % chunkCount[d]) * chunkShape[d];
+                i /= chunkCount[d];
+            }
+            offset[N] = 0;
+            herr_t status;
+            H5E_BEGIN_TRY  // unwritten chunks are no error here
+            {
+                status = H5Dget_chunk_storage_size(datasetHandle, offset, &storageSize);
+            }
+            H5E_END_TRY;
+            if(status < 0 || storageSize == 0)
+                return false;
+        }
+
+        ThreadExceptionCollector errors;
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(threadCount)
+#endif
+        {
+            MultiArray<N, T> chunk(chunkShape);
+            ArrayVector<Bytef> compressed;
+
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for(MultiArrayIndex k = 0; k < totalCount; ++k)
+            {
+                try
+                {
+                    if(errors.failed())
+                        continue;
+
+                    Shape c, start;
+                    MultiArrayIndex i = k;
+                    for(unsigned int d = 0; d < N; ++d)
+                    {
+                        c[d] = i % chunkCount[d];
+                        i /= chunkCount[d];
+                    }
+                    start = c * chunkShape;
+
+                    hsize_t offset[N+1];
+                    for(unsigned int d = 0; d < N; ++d)
+                        offset[d] = start[N-1-d];
+                    offset[N] = 0;
+
+                    herr_t status;
+                    hsize_t storageSize = 0;
+                    uint32_t filterMask = 0;
+#ifdef _OPENMP
+                    #pragma omp critical(vigra_hdf5_io)
+#endif
+                    {
+                        status = H5Dget_chunk_storage_size(datasetHandle, offset, &storageSize);
+                        if(status >= 0)
+                        {
+                            compressed.resize(storageSize);
+                            status = H5Dread_chunk(datasetHandle, H5P_DEFAULT, offset, &filterMask, compressed.begin());
+                            if(status >= 0)
+                                ++directChunkReads_;
+                        }
+                    }
+                    vigra_postcondition(status >= 0,
+                        "HDF5File::read(): Unable to read chunk.");
+
+                    if(filterMask & 1) 
+                    {
+                        // the deflate filter was skipped for this chunk
+                        vigra_postcondition(storageSize == chunkBytes,
+                            "HDF5File::read(): Chunk has wrong size.");
+                        std::copy(compressed.begin(), compressed.end(), (Bytef *)chunk.data());
+                    }
+                    else
+                    {
+                        uLongf size = chunkBytes;
+                        vigra_postcondition(uncompress((Bytef *)chunk.data(), &size, compressed.begin(), storageSize) == Z_OK &&
+                                            size == chunkBytes,
+                            "HDF5File::read(): zlib decompression failed.");
+                    }
+
+                    Shape size = min(chunkShape, shape - start);
+                    array.subarray(start, start + size).copy(chunk.subarray(Shape(), size));
+                }
+                catch(std::exception & e)
+                {
+                    errors.capture(e);
+                }
+            }
+        }
+        errors.rethrow();
+
+        return true;
+    }
+
+#endif // VIGRA_HDF5_DIRECT_CHUNK_IO
+
+
+
+
+    /* Read a single value.
+      This functions allows to read a single datum of atomic datatype (int, long, double)
+      from the HDF5 file. So it is not nescessary to create a MultiArray
+      of size 1 to read a single number.
+
+      If the first character of datasetName is a "/", the path will be interpreted as absolute path,
+      otherwise it will be interpreted as path relative to the current group.
+     */
+    template<class T>
+    inline void readAtomic(std::string datasetName, T & data)
+    {
+        // make datasetName clean
+        datasetName = get_absolute_path(datasetName);
+
+        MultiArray<1,T> array(MultiArrayShape<1>::type(1));
+        read_(datasetName, array, detail::getH5DataType<T>(), 1);
+        data = array[0];
+    }
+    inline void readAtomic(std::string datasetName, std::string & data)
+    {
+        // make datasetName clean
+        datasetName = get_absolute_path(datasetName);
+
+        MultiArray<1,const char *> array(MultiArrayShape<1>::type(1));
+        read_(datasetName, array, detail::getH5DataType<const char *>(), 1);
+        data = std::string(array[0]);
+    }
+
+
+
+
+    /* low-level write function to write vigra unstrided MultiArray data into a sub-block of a dataset
+     */
+    template<unsigned int N, class T>
+    inline void writeBlock_(std::string datasetName, typename MultiArrayShape<N>::type &blockOffset, const MultiArrayView<N, T, UnstridedArrayTag> & array, const hid_t datatype, const int numBandsOfType)
+    {
+        // open dataset if it exists
+        std::string errorMessage = "HDF5File::writeBlock(): Error opening dataset '" + datasetName + "'.";
+        detail::HDF5ChunkCache::Dataset & dataset = getCachedDataset_(datasetName, errorMessage);
+        hid_t datasetHandle = dataset.handle;
+
+
+        // hyperslab parameters for position, size, ...
+        // (non-scalar data have an additional dimension for the bands)
+        int dimensions = N + (numBandsOfType > 1);
+        hsize_t boffset [N+1];
+        hsize_t bshape [N+1];
+        hsize_t bones [N+1];
 
-        // hyperslab parameters for position, size, ...
-        hsize_t boffset [N];
-        hsize_t bshape [N];
-        hsize_t bones [N];
-
         for(int i = 0; i < N; i++){
             boffset[i] = blockOffset[N-1-i];
             bshape[i] = array.size(N-1-i);
             bones[i] = 1;
         }
+        boffset[N] = 0;
+        bshape[N] = numBandsOfType;
+        bones[N] = 1;
 
         // create a target dataspace in memory with the shape of the desired block
-        HDF5Handle memspace_handle (H5Screate_simple(N,bshape,NULL),&H5Sclose,"Unable to get origin dataspace");
+        HDF5Handle memspace_handle (H5Screate_simple(dimensions,bshape,NULL),&H5Sclose,"Unable to get origin dataspace");
 
         // get file dataspace and select the desired block
         HDF5Handle dataspaceHandle (H5Dget_space(datasetHandle),&H5Sclose,"Unable to create target dataspace");
@@ -2019,6 +2756,19 @@ class HDF5File
 
         // Write the data to the HDF5 dataset as is
         H5Dwrite( datasetHandle, datatype, memspace_handle, dataspaceHandle, H5P_DEFAULT, array.data()); // .data() possible since void pointer!
+
+        // discard cached copies of the chunks we have just overwritten
+        if(chunkCache_.size() > 0 && dataset.chunkShape.size() > 0 && array.size() > 0)
+        {
+            detail::HDF5ChunkCache::ChunkIndex chunkBegin(N), chunkEnd(N);
+            for(int k = 0; k < N; ++k)
+            {
+                MultiArrayIndex c = dataset.chunkShape[N-1-k];
+                chunkBegin[k] = blockOffset[k] / c;
+                chunkEnd[k] = (blockOffset[k] + array.shape(k) - 1) / c + 1;
+            }
+            chunkCache_.dropChunks(datasetName, chunkBegin, chunkEnd);
+        }
     }
 
 
@@ -2029,12 +2779,10 @@ class HDF5File
     template<unsigned int N, class T>
     inline void readBlock_(std::string datasetName, typename MultiArrayShape<N>::type &blockOffset, typename MultiArrayShape<N>::type &blockShape, MultiArrayView<N, T, UnstridedArrayTag> &array, const hid_t datatype, const int numBandsOfType)
     {
-        //Prepare to read without using HDF5ImportInfo
-        //ArrayVector<hsize_t> dimshape = getDatasetShape(datasetName) ;
-        hssize_t dimensions = getDatasetDimensions(datasetName);
-
         std::string errorMessage ("HDF5File::readBlock(): Unable to open dataset '" + datasetName + "'.");
-        HDF5Handle datasetHandle (getDatasetHandle_(datasetName), &H5Dclose, errorMessage.c_str());
+        detail::HDF5ChunkCache::Dataset & dataset = getCachedDataset_(datasetName, errorMessage);
+        hid_t datasetHandle = dataset.handle;
+        hssize_t dimensions = dataset.shape.size();
 
 
         int offset = (numBandsOfType > 1);
@@ -2045,10 +2793,16 @@ class HDF5File
         vigra_precondition(blockShape == array.shape(),
              "readHDF5_block(): Array shape disagrees with block size.");
 
+        if(chunkCache_.capacity() > 0 && dataset.chunkShape.size() > 0)
+        {
+            readBlockCached_(datasetName, dataset, blockOffset, array, datatype, numBandsOfType);
+            return;
+        }
+
         // hyperslab parameters for position, size, ...
-        hsize_t boffset [N];
-        hsize_t bshape [N];
-        hsize_t bones [N];
+        hsize_t boffset [N+1];
+        hsize_t bshape [N+1];
+        hsize_t bones [N+1];
 
         for(int i = 0; i < N; i++){
             // virgra and hdf5 use different indexing
@@ -2058,9 +2812,13 @@ class HDF5File
             //boffset[i] = blockOffset[N-1-i];
             bones[i] = 1;
         }
+        // the bands of non-scalar data are the last HDF5 dimension
+        boffset[N] = 0;
+        bshape[N] = numBandsOfType;
+        bones[N] = 1;
 
         // create a target dataspace in memory with the shape of the desired block
-        HDF5Handle memspace_handle (H5Screate_simple(N,bshape,NULL),&H5Sclose,"Unable to create target dataspace");
+        HDF5Handle memspace_handle (H5Screate_simple(dimensions,bshape,NULL),&H5Sclose,"Unable to create target dataspace");
 
         // get file dataspace and select the desired block
         HDF5Handle dataspaceHandle (H5Dget_space(datasetHandle),&H5Sclose,"Unable to get dataspace");
@@ -2070,8 +2828,825 @@ class HDF5File
         H5Dread( datasetHandle, datatype, memspace_handle, dataspaceHandle, H5P_DEFAULT, array.data() ); // .data() possible since void pointer!
     }
 
+
+
+
+    /* get the cached handle and layout of a dataset, open the dataset if necessary
+     */
+    inline detail::HDF5ChunkCache::Dataset & getCachedDataset_(std::string const & datasetName, std::string const & errorMessage)
+    {
+        detail::HDF5ChunkCache::Dataset * dataset = chunkCache_.findDataset(datasetName);
+        if(dataset == 0)
+        {
+            hid_t handle = getDatasetHandle_(datasetName);
+            if(handle < 0)
+                vigra_fail(errorMessage.c_str());
+            dataset = &chunkCache_.addDataset(datasetName, handle);
+        }
+        return *dataset;
+    }
+
+
+
+
+    /* read the chunk starting at chunkStart (with the given shape, which is smaller than the 
+       nominal chunk shape at the dataset border) into buffer
+     */
+    template<unsigned int N>
+    inline void readChunk_(detail::HDF5ChunkCache::Dataset const & dataset, 
+                           typename MultiArrayShape<N>::type const & chunkStart, 
+                           typename MultiArrayShape<N>::type const & chunkShape, 
+                           ArrayVector<char> & buffer, const hid_t datatype, const int numBandsOfType)
+    {
+        int dimensions = dataset.shape.size();
+        hsize_t boffset [N+1];
+        hsize_t bshape [N+1];
+        hsize_t bones [N+1];
+        std::size_t size = numBandsOfType * H5Tget_size(datatype);
+
+        for(int i = 0; i < N; i++){
+            boffset[i] = chunkStart[N-1-i];
+            bshape[i] = chunkShape[N-1-i];
+            bones[i] = 1;
+            size *= chunkShape[N-1-i];
+        }
+        boffset[N] = 0;
+        bshape[N] = numBandsOfType;
+        bones[N] = 1;
+
+        if(buffer.size() != size)
+            buffer.resize(size);
+
+        HDF5Handle memspace_handle (H5Screate_simple(dimensions,bshape,NULL),&H5Sclose,"Unable to create target dataspace");
+        HDF5Handle dataspaceHandle (H5Dget_space(dataset.handle),&H5Sclose,"Unable to get dataspace");
+        H5Sselect_hyperslab(dataspaceHandle, H5S_SELECT_SET, boffset, bones, bones, bshape);
+
+        vigra_postcondition(H5Dread(dataset.handle, datatype, memspace_handle, dataspaceHandle, H5P_DEFAULT, buffer.data()) >= 0,
+            "HDF5File::readBlock(): Unable to read chunk.");
+    }
+
+
+
+
+    /* read a block chunk by chunk via the chunk cache
+     */
+    template<unsigned int N, class T>
+    inline void readBlockCached_(std::string const & datasetName, detail::HDF5ChunkCache::Dataset const & dataset,
+                                 typename MultiArrayShape<N>::type const & blockOffset, 
+                                 MultiArrayView<N, T, UnstridedArrayTag> &array, 
+                                 const hid_t datatype, const int numBandsOfType)
+    {
+        typedef typename MultiArrayShape<N>::type Shape;
+        
+        if(array.size() == 0)
+            return;
+
+        Shape shape, chunkShape, blockEnd = blockOffset + array.shape();
+        for(int k = 0; k < N; ++k)
+        {
+            shape[k] = dataset.shape[N-1-k];
+            chunkShape[k] = dataset.chunkShape[N-1-k];
+            vigra_precondition(blockOffset[k] >= 0 && blockEnd[k] <= shape[k],
+                 "HDF5File::readBlock(): Block exceeds the dataset.");
+        }
+
+        Shape chunkCount  = (shape + chunkShape - Shape(1)) / chunkShape,
+              chunkBegin  = blockOffset / chunkShape,
+              chunkEnd    = (blockEnd - Shape(1)) / chunkShape + Shape(1);
+
+        detail::HDF5ChunkCache::Key key(datasetName, datatype);
+        ArrayVector<char> buffer;
+
+        Shape c = chunkBegin;
+        do
+        {
+            Shape start = c * chunkShape,
+                  cshape = min(chunkShape, shape - start);
+            ArrayVector<char> const * data = chunkCache_.find(key.setIndex(c));
+            if(data == 0)
+            {
+                readChunk_<N>(dataset, start, cshape, buffer, datatype, numBandsOfType);
+                data = &buffer;
+            }
+
+            MultiArrayView<N, T, UnstridedArrayTag> chunk(cshape, (T*)data->data());
+            Shape from = max(blockOffset, start),
+                  to   = min(blockEnd, start + cshape);
+            array.subarray(from - blockOffset, to - blockOffset).copy(chunk.subarray(from - start, to - start));
+
+            if(data == &buffer)
+                chunkCache_.insert(key, buffer);
+        }
+        while(detail::nextCoordinateInBox(c, chunkBegin, chunkEnd));
+
+        // load the next chunks in the declared access direction
+        int dim = 0, count = 0;
+        if(!chunkCache_.readAhead(datasetName, dim, count) || dim < 0 || dim >= (int)N)
+            return;
+        if(count > 0)
+        {
+            chunkBegin[dim] = chunkEnd[dim];
+            chunkEnd[dim] = std::min<MultiArrayIndex>(chunkEnd[dim] + count, chunkCount[dim]);
+        }
+        else
+        {
+            chunkEnd[dim] = chunkBegin[dim];
+            chunkBegin[dim] = std::max<MultiArrayIndex>(chunkBegin[dim] + count, 0);
+        }
+        if(chunkBegin[dim] >= chunkEnd[dim])
+            return;
+
+        c = chunkBegin;
+        do
+        {
+            if(chunkCache_.contains(key.setIndex(c)))
+                continue;
+            Shape start = c * chunkShape;
+            readChunk_<N>(dataset, start, min(chunkShape, shape - start), buffer, datatype, numBandsOfType);
+            chunkCache_.insert(key, buffer);
+            chunkCache_.countPrefetch();
+        }
+        while(detail::nextCoordinateInBox(c, chunkBegin, chunkEnd));
+    }
+
 };  /* class HDF5File */
 
+/********************************************************/
+/*                                                      */
+/*               HDF5BlockSource, HDF5BlockSink         */
+/*                                                      */
+/********************************************************/
+
+/** \brief Read blocks of an HDF5 dataset.
+
+    Adapter that allows to use an HDF5 dataset as the source of 
+    \ref blockwiseFilterMultiArray(), so that arrays larger than the 
+    available memory can be filtered (see \ref vigra::MultiArrayBlockSource
+    for the required interface). <tt>T</tt> is the pixel type of the blocks 
+    in memory, HDF5 converts the data type when necessary. Vector valued 
+    pixel types (<tt>TinyVector</tt>, <tt>RGBValue</tt>) refer to datasets with 
+    an additional dimension for the bands.
+
+    <b>\#include</b> \<vigra/hdf5impex.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int N, class T>
+class HDF5BlockSource
+{
+  public:
+    typedef T value_type;
+    typedef typename MultiArrayShape<N>::type shape_type;
+    
+        /** Read from dataset <tt>datasetName</tt> in <tt>file</tt>. The file object 
+            must remain valid during the lifetime of this object.
+        */
+    HDF5BlockSource(HDF5File & file, std::string const & datasetName)
+    : file_(&file),
+      dataset_name_(datasetName)
+    {
+        ArrayVector<hsize_t> s = file.getDatasetShape(datasetName);
+        int offset = s.size() == N + 1 
+                         ? 1 
+                         : 0;
+        vigra_precondition(s.size() == N + offset,
+            "HDF5BlockSource(): dataset has wrong dimension.");
+        for(unsigned int k=0; k<N; ++k)
+            shape_[k] = s[k+offset];
+    }
+    
+    shape_type shape() const
+    {
+        return shape_;
+    }
+    
+    void readBlock(shape_type const & offset, 
+                   MultiArrayView<N, value_type, UnstridedArrayTag> block) const
+    {
+        file_->readBlock(dataset_name_, offset, block.shape(), block);
+    }
+    
+  private:
+    HDF5File * file_;
+    std::string dataset_name_;
+    shape_type shape_;
+};
+
+/** \brief Write blocks into an HDF5 dataset.
+
+    Adapter that allows to use an HDF5 dataset as the destination of 
+    \ref blockwiseFilterMultiArray() (see \ref vigra::MultiArrayBlockSink
+    for the required interface). The dataset must already exist with the 
+    appropriate shape, e.g. created by \ref HDF5File::createDataset() 
+    (with an additional dimension for the bands when <tt>T</tt> is vector valued).
+
+    <b>\#include</b> \<vigra/hdf5impex.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int N, class T>
+class HDF5BlockSink
+{
+  public:
+    typedef T value_type;
+    typedef typename MultiArrayShape<N>::type shape_type;
+    
+        /** Write into dataset <tt>datasetName</tt> in <tt>file</tt>. The file object 
+            must remain valid during the lifetime of this object.
+        */
+    HDF5BlockSink(HDF5File & file, std::string const & datasetName)
+    : file_(&file),
+      dataset_name_(datasetName)
+    {}
+    
+    void writeBlock(shape_type const & offset, 
+                    MultiArrayView<N, value_type, UnstridedArrayTag> const & block)
+    {
+        file_->writeBlock(dataset_name_, offset, block);
+    }
+    
+  private:
+    HDF5File * file_;
+    std::string dataset_name_;
+};
+
+
+/********************************************************/
+/*                                                      */
+/*               HDF5Array, HDF5ArrayView               */
+/*                                                      */
+/********************************************************/
+
+template <unsigned int M, class T, unsigned int N>
+class HDF5ArrayView;
+
+/** \brief Lazy array backed by an HDF5 dataset.
+
+    The array provides element and block access to a dataset without reading 
+    it into memory. The data are loaded on demand in units of chunks (by default, 
+    the chunks of the dataset) and kept in a cache of bounded size. Modified chunks 
+    are written back to the file when they are evicted from the cache, when 
+    \ref flush() is called, and when the array is destroyed. Views to parts of 
+    the array are obtained by <tt>subarray()</tt> and <tt>bind()</tt>, see 
+    \ref vigra::HDF5ArrayView.
+    
+    The array (and its views) follow the interface of \ref vigra::MultiArrayBlockSource 
+    and \ref vigra::MultiArrayBlockSink, so they can be processed by 
+    \ref blockwiseFilterMultiArray() and \ref transformMultiArrayBlockwise() 
+    in <tt>\<vigra/multi_blockwise.hxx\></tt>. This allows to run filters and 
+    point operators on datasets that are much larger than the RAM.
+    
+    <tt>T</tt> is the pixel type in memory, HDF5 converts the data type when 
+    necessary. Vector valued pixel types (<tt>TinyVector</tt>, <tt>RGBValue</tt>) 
+    refer to datasets with an additional dimension for the bands. The dataset must 
+    already exist, e.g. created by \ref HDF5File::createDataset(). The file object 
+    must remain valid during the lifetime of the array and its views. Since HDF5
+    is not thread-safe, the array must not be accessed by several threads
+    at the same time.
+    
+    <b>Usage:</b>
+    
+    \code
+    HDF5File file("volume.h5", HDF5File::Open);
+    HDF5Array<3, float> volume(file, "raw", 256 << 20);  // cache up to 256 MB of chunks
+    
+    float v = volume.getItem(Shape3(100, 200, 300));
+    volume.setItem(Shape3(100, 200, 300), 2.0f*v);
+    
+    // read a slice
+    MultiArray<2, float> slice(Shape2(volume.shape(0), volume.shape(1)));
+    volume.bind<2>(300).readBlock(Shape2(), slice);
+    
+    // filter the volume into another dataset, one block at a time
+    file.createDataset<3, float>("smoothed", volume.shape(), 0.0f, Shape3(64,64,64));
+    HDF5Array<3, float> smoothed(file, "smoothed");
+    blockwiseFilterMultiArray(volume, smoothed, GaussianSmoothBlockFilter(2.0), Shape3(256,256,256));
+    smoothed.flush();
+    \endcode
+    
+    <b>\#include</b> \<vigra/hdf5impex.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int N, class T>
+class HDF5Array
+{
+  public:
+    typedef T value_type;
+    typedef typename MultiArrayShape<N>::type shape_type;
+    typedef shape_type difference_type;
+    typedef HDF5ArrayView<N, T, N> view_type;
+    
+        /** Access dataset <tt>datasetName</tt> in <tt>file</tt>, caching at most 
+            <tt>cacheSize</tt> bytes (but at least one chunk). When <tt>chunkShape</tt> 
+            is zero, the chunk shape of the dataset is used (or blocks of 
+            size 64 along each axis when the dataset is not chunked). Other 
+            chunk shapes should be multiples of the dataset's chunks.
+        */
+    HDF5Array(HDF5File & file, std::string const & datasetName, 
+              std::size_t cacheSize = 64 << 20, shape_type const & chunkShape = shape_type())
+    : file_(&file),
+      name_(datasetName),
+      capacity_(cacheSize),
+      cached_bytes_(0),
+      chunks_read_(0),
+      chunks_written_(0),
+      last_index_(-1),
+      last_chunk_(0)
+    {
+        ArrayVector<hsize_t> s = file.getDatasetShape(datasetName);
+        int offset = s.size() == N + 1 
+                         ? 1 
+                         : 0;
+        vigra_precondition(s.size() == N + offset,
+            "HDF5Array(): dataset has wrong dimension.");
+        ArrayVector<hsize_t> c = file.getChunkShape(datasetName);
+        for(unsigned int k=0; k<N; ++k)
+        {
+            shape_[k] = s[k+offset];
+            if(chunkShape[k] > 0)
+                chunk_shape_[k] = chunkShape[k];
+            else if(c.size() == s.size())
+                chunk_shape_[k] = c[k+offset];
+            else
+                chunk_shape_[k] = std::min<MultiArrayIndex>(64, std::max<MultiArrayIndex>(shape_[k], 1));
+            chunk_count_[k] = (shape_[k] + chunk_shape_[k] - 1) / chunk_shape_[k];
+        }
+    }
+    
+        /** Write modified chunks back to the file. Errors are ignored, 
+            call \ref flush() to get them reported.
+        */
+    ~HDF5Array()
+    {
+        try
+        {
+            flush();
+        }
+        catch(...)
+        {}
+    }
+    
+        /** The shape of the array.
+        */
+    shape_type const & shape() const
+    {
+        return shape_;
+    }
+    
+        /** The length of the array along dimension <tt>n</tt>.
+        */
+    MultiArrayIndex shape(int n) const
+    {
+        return shape_[n];
+    }
+    
+        /** The number of elements in the array.
+        */
+    MultiArrayIndex size() const
+    {
+        return prod(shape_);
+    }
+    
+        /** The shape of the units in which the data are loaded.
+        */
+    shape_type const & chunkShape() const
+    {
+        return chunk_shape_;
+    }
+    
+        /** The name of the dataset.
+        */
+    std::string const & name() const
+    {
+        return name_;
+    }
+    
+        /** Read the element at position <tt>p</tt>.
+        */
+    value_type getItem(shape_type const & p) const
+    {
+        checkPoint_(p);
+        Chunk & chunk = getChunk_(p / chunk_shape_, false);
+        return chunk.data[p - chunk.start];
+    }
+    
+        /** Set the element at position <tt>p</tt>.
+        */
+    void setItem(shape_type const & p, value_type const & v)
+    {
+        checkPoint_(p);
+        Chunk & chunk = getChunk_(p / chunk_shape_, false);
+        chunk.data[p - chunk.start] = v;
+        chunk.dirty = true;
+    }
+    
+        /** Fill <tt>block</tt> with the data starting at <tt>offset</tt>.
+        */
+    template <class Stride>
+    void readBlock(shape_type const & offset, 
+                   MultiArrayView<N, value_type, Stride> block) const
+    {
+        copyBlock_(offset, block, false);
+    }
+    
+        /** Store <tt>block</tt> at <tt>offset</tt>. Chunks that are entirely 
+            overwritten are not read from the file.
+        */
+    template <class Stride>
+    void writeBlock(shape_type const & offset, 
+                    MultiArrayView<N, value_type, Stride> const & block)
+    {
+        copyBlock_(offset, block, true);
+    }
+    
+        /** Get a view to the subarray <tt>[begin, end)</tt>.
+        */
+    view_type subarray(shape_type const & begin, shape_type const & end)
+    {
+        return view_type(*this).subarray(begin, end);
+    }
+    
+        /** Get a view to the hyperplane where the coordinate of dimension 
+            <tt>K</tt> equals <tt>d</tt>.
+        */
+    template <unsigned int K>
+    HDF5ArrayView<N-1, T, N> bind(MultiArrayIndex d)
+    {
+        return view_type(*this).bindAt(K, d);
+    }
+    
+        /** Get a view to the hyperplane where the coordinate of dimension 
+            <tt>n</tt> equals <tt>d</tt>.
+        */
+    HDF5ArrayView<N-1, T, N> bindAt(unsigned int n, MultiArrayIndex d)
+    {
+        return view_type(*this).bindAt(n, d);
+    }
+    
+        /** Write all modified chunks back to the file.
+        */
+    void flush()
+    {
+        typename ChunkMap::iterator i = chunks_.begin();
+        for(; i != chunks_.end(); ++i)
+            writeBack_(i->second);
+    }
+    
+        /** Set the capacity of the cache in bytes. Chunks are evicted 
+            (and written back when modified) as necessary.
+        */
+    void setCacheSize(std::size_t bytes)
+    {
+        capacity_ = bytes;
+        evict_(0);
+    }
+    
+        /** Get the capacity of the cache in bytes.
+        */
+    std::size_t cacheSize() const
+    {
+        return capacity_;
+    }
+    
+        /** The number of chunks currently held in memory.
+        */
+    std::size_t cachedChunks() const
+    {
+        return chunks_.size();
+    }
+    
+        /** The number of chunks read from the file so far.
+        */
+    std::size_t chunksRead() const
+    {
+        return chunks_read_;
+    }
+    
+        /** The number of chunks written to the file so far.
+        */
+    std::size_t chunksWritten() const
+    {
+        return chunks_written_;
+    }
+    
+  private:
+    struct Chunk
+    {
+        MultiArray<N, T> data;
+        shape_type start;
+        bool dirty;
+        std::list<MultiArrayIndex>::iterator lru;
+    };
+    
+    typedef std::map<MultiArrayIndex, Chunk> ChunkMap;
+    
+        // not copyable: copies would have to share the modified chunks
+    HDF5Array(HDF5Array const &);
+    HDF5Array & operator=(HDF5Array const &);
+    
+    void checkPoint_(shape_type const & p) const
+    {
+        for(unsigned int k=0; k<N; ++k)
+            vigra_precondition(0 <= p[k] && p[k] < shape_[k],
+                "HDF5Array: coordinate out of range.");
+    }
+    
+    std::size_t chunkBytes_(Chunk const & chunk) const
+    {
+        return chunk.data.size() * sizeof(T);
+    }
+    
+    void writeBack_(Chunk & chunk) const
+    {
+        if(!chunk.dirty)
+            return;
+        file_->writeBlock(name_, chunk.start, chunk.data);
+        chunk.dirty = false;
+        ++chunks_written_;
+    }
+    
+        // evict least recently used chunks until 'required' more bytes fit into the cache
+    void evict_(std::size_t required) const
+    {
+        while(!lru_.empty() && cached_bytes_ + required > capacity_)
+        {
+            typename ChunkMap::iterator i = chunks_.find(lru_.back());
+            writeBack_(i->second);
+            cached_bytes_ -= chunkBytes_(i->second);
+            if(i->first == last_index_)
+                last_index_ = -1;
+            chunks_.erase(i);
+            lru_.pop_back();
+        }
+    }
+    
+        // get the chunk with the given chunk coordinates, loading it when 'overwrite' is false
+    Chunk & getChunk_(shape_type const & c, bool overwrite) const
+    {
+        MultiArrayIndex index = 0;
+        for(int k=N-1; k>=0; --k)
+            index = index*chunk_count_[k] + c[k];
+        if(index == last_index_)
+            return *last_chunk_;
+        
+        typename ChunkMap::iterator i = chunks_.find(index);
+        if(i != chunks_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, i->second.lru);
+        }
+        else
+        {
+            shape_type start = c * chunk_shape_,
+                       size = min(chunk_shape_, shape_ - start);
+            evict_(prod(size) * sizeof(T));
+            i = chunks_.insert(std::make_pair(index, Chunk())).first;
+            Chunk & chunk = i->second;
+            chunk.data.reshape(size);
+            chunk.start = start;
+            chunk.dirty = false;
+            if(!overwrite)
+            {
+                try
+                {
+                    file_->readBlock(name_, start, size, chunk.data);
+                }
+                catch(...)
+                {
+                    chunks_.erase(i);
+                    throw;
+                }
+                ++chunks_read_;
+            }
+            lru_.push_front(index);
+            chunk.lru = lru_.begin();
+            cached_bytes_ += chunkBytes_(chunk);
+        }
+        last_index_ = index;
+        last_chunk_ = &i->second;
+        return i->second;
+    }
+    
+    template <class Stride>
+    void copyBlock_(shape_type const & offset, MultiArrayView<N, T, Stride> block, bool write) const
+    {
+        shape_type end = offset + block.shape();
+        for(unsigned int k=0; k<N; ++k)
+        {
+            vigra_precondition(0 <= offset[k] && offset[k] <= end[k] && end[k] <= shape_[k],
+                "HDF5Array: block out of range.");
+            if(offset[k] == end[k])
+                return;
+        }
+        
+        shape_type chunkBegin = offset / chunk_shape_,
+                   chunkEnd = (end - shape_type(1)) / chunk_shape_ + shape_type(1),
+                   c = chunkBegin;
+        do
+        {
+            shape_type start = c * chunk_shape_,
+                       stop = min(start + chunk_shape_, shape_),
+                       from = max(offset, start),
+                       to = min(end, stop);
+            if(write)
+            {
+                Chunk & chunk = getChunk_(c, from == start && to == stop);
+                chunk.data.subarray(from - start, to - start) = block.subarray(from - offset, to - offset);
+                chunk.dirty = true;
+            }
+            else
+            {
+                Chunk & chunk = getChunk_(c, false);
+                block.subarray(from - offset, to - offset) = chunk.data.subarray(from - start, to - start);
+            }
+        }
+        while(detail::nextCoordinateInBox(c, chunkBegin, chunkEnd));
+    }
+    
+    template <unsigned int, class, unsigned int>
+    friend class HDF5ArrayView;
+    
+    HDF5File * file_;
+    std::string name_;
+    shape_type shape_, chunk_shape_, chunk_count_;
+    std::size_t capacity_;
+    
+    mutable ChunkMap chunks_;
+    mutable std::list<MultiArrayIndex> lru_;  // most recently used first
+    mutable std::size_t cached_bytes_, chunks_read_, chunks_written_;
+    mutable MultiArrayIndex last_index_;
+    mutable Chunk * last_chunk_;
+};
+
+/** \brief View to a part of an \ref vigra::HDF5Array.
+
+    Views are created by <tt>HDF5Array::subarray()</tt> and <tt>HDF5Array::bind()</tt>
+    (and the same functions of the views themselves). A view of dimension 
+    <tt>M</tt> refers to an <tt>M</tt>-dimensional box within the 
+    <tt>N</tt>-dimensional array and provides the same element and block access 
+    as the array. In particular, views can be passed to \ref blockwiseFilterMultiArray() 
+    in order to process only a part of a dataset. Views do not own data and become
+    invalid when the array is destroyed.
+
+    <b>\#include</b> \<vigra/hdf5impex.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int M, class T, unsigned int N>
+class HDF5ArrayView
+{
+  public:
+    typedef T value_type;
+    typedef typename MultiArrayShape<M>::type shape_type;
+    typedef shape_type difference_type;
+    typedef typename MultiArrayShape<N>::type array_shape_type;
+    
+        /** View to the entire array (only for <tt>M == N</tt>).
+        */
+    explicit HDF5ArrayView(HDF5Array<N, T> & array)
+    : array_(&array),
+      offset_(),
+      shape_(array.shape())
+    {
+        for(unsigned int k=0; k<M; ++k)
+            axes_[k] = k;
+    }
+    
+        /** The shape of the view.
+        */
+    shape_type const & shape() const
+    {
+        return shape_;
+    }
+    
+        /** The length of the view along dimension <tt>n</tt>.
+        */
+    MultiArrayIndex shape(int n) const
+    {
+        return shape_[n];
+    }
+    
+        /** The number of elements in the view.
+        */
+    MultiArrayIndex size() const
+    {
+        return prod(shape_);
+    }
+    
+        /** Read the element at position <tt>p</tt> of the view.
+        */
+    value_type getItem(shape_type const & p) const
+    {
+        return array_->getItem(toArray_(p));
+    }
+    
+        /** Set the element at position <tt>p</tt> of the view.
+        */
+    void setItem(shape_type const & p, value_type const & v)
+    {
+        array_->setItem(toArray_(p), v);
+    }
+    
+        /** Fill <tt>block</tt> with the data starting at <tt>offset</tt>.
+        */
+    template <class Stride>
+    void readBlock(shape_type const & offset, 
+                   MultiArrayView<M, value_type, Stride> block) const
+    {
+        checkBlock_(offset, block.shape());
+        array_->copyBlock_(toArray_(offset), expand_(block), false);
+    }
+    
+        /** Store <tt>block</tt> at <tt>offset</tt>.
+        */
+    template <class Stride>
+    void writeBlock(shape_type const & offset, 
+                    MultiArrayView<M, value_type, Stride> const & block)
+    {
+        checkBlock_(offset, block.shape());
+        array_->copyBlock_(toArray_(offset), expand_(block), true);
+    }
+    
+        /** Get a view to the subarray <tt>[begin, end)</tt> of this view.
+        */
+    HDF5ArrayView subarray(shape_type const & begin, shape_type const & end) const
+    {
+        checkBlock_(begin, end - begin);
+        HDF5ArrayView res(*this);
+        res.offset_ = toArray_(begin);
+        res.shape_ = end - begin;
+        return res;
+    }
+    
+        /** Get a view to the hyperplane where the coordinate of dimension 
+            <tt>K</tt> equals <tt>d</tt>.
+        */
+    template <unsigned int K>
+    HDF5ArrayView<M-1, T, N> bind(MultiArrayIndex d) const
+    {
+        return bindAt(K, d);
+    }
+    
+        /** Get a view to the hyperplane where the coordinate of dimension 
+            <tt>n</tt> equals <tt>d</tt>.
+        */
+    HDF5ArrayView<M-1, T, N> bindAt(unsigned int n, MultiArrayIndex d) const
+    {
+        vigra_precondition(n < M && 0 <= d && d < shape_[n],
+            "HDF5ArrayView::bindAt(): index out of range.");
+        HDF5ArrayView<M-1, T, N> res;
+        res.array_ = array_;
+        res.offset_ = offset_;
+        res.offset_[axes_[n]] += d;
+        for(unsigned int k=0, j=0; k<M; ++k)
+        {
+            if(k == n)
+                continue;
+            res.shape_[j] = shape_[k];
+            res.axes_[j++] = axes_[k];
+        }
+        return res;
+    }
+    
+  private:
+    template <unsigned int, class, unsigned int>
+    friend class HDF5ArrayView;
+    
+    HDF5ArrayView()
+    : array_(0)
+    {}
+    
+    void checkBlock_(shape_type const & offset, shape_type const & shape) const
+    {
+        for(unsigned int k=0; k<M; ++k)
+            vigra_precondition(0 <= offset[k] && 0 <= shape[k] && offset[k] + shape[k] <= shape_[k],
+                "HDF5ArrayView: block out of range.");
+    }
+    
+    array_shape_type toArray_(shape_type const & p) const
+    {
+        array_shape_type res(offset_);
+        for(unsigned int k=0; k<M; ++k)
+            res[axes_[k]] += p[k];
+        return res;
+    }
+    
+        // N-dimensional view to the data of 'block' with singleton axes at the bound dimensions
+    template <class Stride>
+    MultiArrayView<N, T, StridedArrayTag> expand_(MultiArrayView<M, T, Stride> const & block) const
+    {
+        array_shape_type shape(1), stride(1);
+        for(unsigned int k=0; k<M; ++k)
+        {
+            shape[axes_[k]] = block.shape(k);
+            stride[axes_[k]] = block.stride(k);
+        }
+        return MultiArrayView<N, T, StridedArrayTag>(shape, stride, block.data());
+    }
+    
+    HDF5Array<N, T> * array_;
+    array_shape_type offset_;
+    shape_type shape_;
+    TinyVector<int, M> axes_;
+};
+
+
 
 
 
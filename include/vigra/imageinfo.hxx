@@ -523,6 +523,73 @@ class ImageImportInfo
          **/
     VIGRA_EXPORT const ICCProfile & getICCProfile() const;
 
+        /** Select a reduced-resolution level for subsequent imports.
+
+            Level <tt>k</tt> is the image downsampled by <tt>2^k</tt> in
+            either direction, its size is rounded up (so level 0 is the
+            original image). This also resets the region of interest
+            to the whole level, so that <tt>getRegion().size()</tt> is the
+            size of the level.
+
+            The "TIFF" codec reads pyramid levels that are stored in the file
+            as additional directories, the "JPEG" codec uses DCT scaling for
+            levels up to 3. In all other cases, every <tt>2^k</tt>-th pixel of
+            every <tt>2^k</tt>-th row is taken from the original image, without
+            prior smoothing.
+         **/
+    VIGRA_EXPORT ImageImportInfo & setLevel(int level);
+
+        /** Get the reduced-resolution level (see setLevel()).
+         **/
+    VIGRA_EXPORT int getLevel() const;
+
+        /** Restrict subsequent imports to a region of interest.
+
+            Only the pixels inside <tt>region</tt> will be imported by
+            importImage(), and the destination image must have the size
+            of the region. The region is given in the coordinates of the current
+            level (see setLevel()) and must be inside it. By default,
+            the whole image is imported.
+
+            Codecs that support it ("TIFF") decode only the tiles or strips
+            that intersect the region. For all other codecs, the rows
+            outside the region are skipped while the file is streamed,
+            and decoding stops after the last row of the region.
+
+            <b> Usage:</b>
+
+            \code
+            vigra::ImageImportInfo info("slide.tif");
+
+            // preview, downsampled by 8
+            info.setLevel(3);
+            vigra::BRGBImage preview(info.getRegion().size());
+            importImage(info, destImage(preview));
+
+            // full-resolution tile
+            info.setLevel(0);
+            info.setRegion(vigra::Rect2D(vigra::Point2D(1000, 2000), vigra::Size2D(512, 512)));
+            vigra::BRGBImage tile(info.getRegion().size());
+            importImage(info, destImage(tile));
+            \endcode
+         **/
+    VIGRA_EXPORT ImageImportInfo & setRegion(Rect2D const & region);
+
+        /** Get the region of interest (see setRegion()).
+         **/
+    VIGRA_EXPORT Rect2D getRegion() const;
+
+        /** Set the number of threads a codec may use for decoding
+            (default: 1, negative means "as many as available").
+            This is currently used by the "TIFF" codec to decode
+            several tiles or strips in parallel.
+         **/
+    VIGRA_EXPORT ImageImportInfo & setThreadCount(int count);
+
+        /** Get the number of decoding threads (see setThreadCount()).
+         **/
+    VIGRA_EXPORT int getThreadCount() const;
+
   private:
     std::string m_filename, m_filetype, m_pixeltype;
     int m_width, m_height, m_num_bands, m_num_extra_bands;
@@ -530,6 +597,8 @@ class ImageImportInfo
     Diff2D m_pos;
     Size2D m_canvas_size;
     ICCProfile m_icc_profile;
+    Rect2D m_region;
+    int m_level, m_thread_count;
 };
 
 // return a decoder for a given ImageImportInfo object
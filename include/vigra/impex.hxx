@@ -353,6 +353,8 @@ namespace vigra
         const size_type width = dec->getWidth();
         const size_type height = dec->getHeight();
 
+        const size_type offset = dec->getOffset();
+
         SrcValueType const * scanline;
         // MIHAL no default constructor available for cachedfileimages.
         DstRowIterator xs = ys.rowIterator();
@@ -361,8 +363,8 @@ namespace vigra
             dec->nextScanline();
             xs = ys.rowIterator();
             scanline = static_cast< SrcValueType const * >(dec->currentScanlineOfBand(0));
-            for( size_type x = 0; x < width; ++x, ++xs )
-                a.set( scanline[x], xs );
+            for( size_type x = 0; x < width; ++x, ++xs, scanline += offset )
+                a.set( *scanline, xs );
         }
     } // read_band()
 
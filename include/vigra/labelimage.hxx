@@ -43,9 +43,174 @@
 #include "stdimage.hxx"
 #include "union_find.hxx"
 #include "sized_int.hxx"
+#include "threading.hxx"
 
 namespace vigra {
 
+namespace detail {
+
+    // Label an image by splitting it into strips of 'blockHeight' rows.
+    // The strips are labeled independently (in parallel when compiled with OpenMP)
+    // by 'policy.label()', and regions touching across a strip boundary are merged 
+    // when 'policy.connected()' holds for the two pixels. The result is identical to
+    // labeling the whole image at once. Pixels where 'policy.isBackground()' holds 
+    // are left untouched. 
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor, class StripPolicy>
+unsigned int labelImageBlockwise(SrcIterator upperlefts, SrcIterator lowerrights, SrcAccessor sa,
+                                 DestIterator upperleftd, DestAccessor da,
+                                 bool eight_neighbors, StripPolicy const & policy, 
+                                 int blockHeight, int threadCount)
+{
+    typedef typename DestAccessor::value_type LabelType;
+    
+    int w = lowerrights.x - upperlefts.x;
+    int h = lowerrights.y - upperlefts.y;
+    
+    if(h <= blockHeight)
+        return policy.label(upperlefts, lowerrights, sa, upperleftd, da, eight_neighbors);
+    
+    int blockCount = (h + blockHeight - 1) / blockHeight;
+    threadCount = actualThreadCount(threadCount);
+    
+    // pass 1: label the strips independently
+    ArrayVector<unsigned int> offsets(blockCount+1, 0u);
+    ThreadExceptionCollector errors;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount) if(threadCount > 1)
+#endif
+    for(int b = 0; b < blockCount; ++b)
+    {
+        try
+        {
+            int y0 = b*blockHeight, y1 = std::min(y0 + blockHeight, h);
+            offsets[b+1] = policy.label(upperlefts + Diff2D(0, y0), upperlefts + Diff2D(w, y1), sa, 
+                                        upperleftd + Diff2D(0, y0), da, eight_neighbors);
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+    
+    for(int b = 0; b < blockCount; ++b)
+    {
+        vigra_invariant(offsets[b+1] <= NumericTraits<LabelType>::max() - offsets[b],
+            "connected components: Need more labels than can be represented in the destination type.");
+        offsets[b+1] += offsets[b];
+    }
+    
+    // pass 2: merge regions that are connected across the strip boundaries
+    UnionFindArray<LabelType> labels((LabelType)(offsets[blockCount] + 1));
+    int dxmax = eight_neighbors ? 1 : 0;
+    for(int b = 1; b < blockCount; ++b)
+    {
+        int y = b*blockHeight;
+        SrcIterator xs = upperlefts + Diff2D(0, y);
+        DestIterator xd = upperleftd + Diff2D(0, y);
+        for(int x = 0; x != w; ++x, ++xs.x, ++xd.x)
+        {
+            if(policy.isBackground(sa(xs)))
+                continue;
+            for(int dx = -dxmax; dx <= dxmax; ++dx)
+            {
+                if(x + dx < 0 || x + dx >= w)
+                    continue;
+                Diff2D neighbor(dx, -1);
+                if(policy.connected(sa(xs), sa(xs, neighbor)))
+                {
+                    labels.makeUnion((LabelType)(da(xd) + offsets[b]), 
+                                     (LabelType)(da(xd, neighbor) + offsets[b-1]));
+                }
+            }
+        }
+    }
+    
+    unsigned int count = labels.makeContiguous();
+    
+    // pass 3: assign the final labels
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount) if(threadCount > 1)
+#endif
+    for(int y = 0; y < h; ++y)
+    {
+        LabelType offset = (LabelType)offsets[y / blockHeight];
+        SrcIterator xs = upperlefts + Diff2D(0, y);
+        DestIterator xd = upperleftd + Diff2D(0, y);
+        for(int x = 0; x != w; ++x, ++xs.x, ++xd.x)
+        {
+            if(!policy.isBackground(sa(xs)))
+                da.set(labels[(LabelType)(da(xd) + offset)], xd);
+        }
+    }
+    return count;
+}
+
+    // strip height giving about four strips per thread
+inline int labelImageBlockHeight(int height, int threadCount)
+{
+    return std::max(1, (height + 4*threadCount - 1) / (4*threadCount));
+}
+
+template <class EqualityFunctor>
+struct LabelImagePolicy
+{
+    EqualityFunctor equal_;
+    
+    LabelImagePolicy(EqualityFunctor equal)
+    : equal_(equal)
+    {}
+    
+    template <class SrcIterator, class SrcAccessor,
+              class DestIterator, class DestAccessor>
+    unsigned int label(SrcIterator upperlefts, SrcIterator lowerrights, SrcAccessor sa,
+                       DestIterator upperleftd, DestAccessor da, bool eight_neighbors) const;
+    
+    template <class T>
+    bool isBackground(T const &) const
+    {
+        return false;
+    }
+    
+    template <class T>
+    bool connected(T const & u, T const & v) const
+    {
+        return equal_(u, v);
+    }
+};
+
+template <class ValueType, class EqualityFunctor>
+struct LabelImageWithBackgroundPolicy
+{
+    ValueType background_;
+    EqualityFunctor equal_;
+    
+    LabelImageWithBackgroundPolicy(ValueType background, EqualityFunctor equal)
+    : background_(background),
+      equal_(equal)
+    {}
+    
+    template <class SrcIterator, class SrcAccessor,
+              class DestIterator, class DestAccessor>
+    unsigned int label(SrcIterator upperlefts, SrcIterator lowerrights, SrcAccessor sa,
+                       DestIterator upperleftd, DestAccessor da, bool eight_neighbors) const;
+    
+    template <class T>
+    bool isBackground(T const & u) const
+    {
+        return equal_(u, background_);
+    }
+    
+    template <class T>
+    bool connected(T const & u, T const & v) const
+    {
+        return equal_(u, v);
+    }
+};
+
+} // namespace detail
+
 /** \addtogroup Labeling Connected Components Labeling
      The 2-dimensional connected components algorithms may use either 4 or 8 connectivity.
      By means of a functor the merge criterium can be defined arbitrarily.
@@ -289,6 +454,146 @@ unsigned int labelImage(triple<SrcIterator, SrcIterator, SrcAccessor> src,
                  std::equal_to<typename SrcAccessor::value_type>());
 }
 
+template <class EqualityFunctor>
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+unsigned int 
+detail::LabelImagePolicy<EqualityFunctor>::label(SrcIterator upperlefts, SrcIterator lowerrights, SrcAccessor sa,
+                                                 DestIterator upperleftd, DestAccessor da, bool eight_neighbors) const
+{
+    return labelImage(upperlefts, lowerrights, sa, upperleftd, da, eight_neighbors, equal_);
+}
+
+/********************************************************/
+/*                                                      */
+/*                  labelImageParallel                  */
+/*                                                      */
+/********************************************************/
+
+/** \brief Find the connected components of a segmented image using several threads.
+
+    <b> Declarations:</b>
+
+    pass arguments explicitly:
+    \code
+    namespace vigra {
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor>
+        unsigned int labelImageParallel(SrcIterator upperlefts,
+                                        SrcIterator lowerrights, SrcAccessor sa,
+                                        DestIterator upperleftd, DestAccessor da,
+                                        bool eight_neighbors, int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor,
+                  class EqualityFunctor>
+        unsigned int labelImageParallel(SrcIterator upperlefts,
+                                        SrcIterator lowerrights, SrcAccessor sa,
+                                        DestIterator upperleftd, DestAccessor da,
+                                        bool eight_neighbors, EqualityFunctor equal,
+                                        int threadCount);
+    }
+    \endcode
+
+    use argument objects in conjunction with \ref ArgumentObjectFactories :
+    \code
+    namespace vigra {
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor>
+        unsigned int labelImageParallel(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                                        pair<DestIterator, DestAccessor> dest,
+                                        bool eight_neighbors, int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor,
+                  class EqualityFunctor>
+        unsigned int labelImageParallel(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                                        pair<DestIterator, DestAccessor> dest,
+                                        bool eight_neighbors, EqualityFunctor equal,
+                                        int threadCount);
+    }
+    \endcode
+
+    Computes the same labeling as \ref labelImage(). When VIGRA is compiled with 
+    OpenMP, the image is split into horizontal strips which are labeled 
+    concurrently. Regions touching across strip boundaries are then merged by means 
+    of a global union-find array, and a parallel relabeling pass produces
+    the consecutive labels. <tt>threadCount</tt> specifies the number 
+    of threads (default: 1, negative: use \ref vigra::defaultThreadCount()). Without OpenMP,
+    the function is equivalent to \ref labelImage().
+
+    Return:  the number of regions found (= largest region label)
+
+    <b> Usage:</b>
+
+        <b>\#include</b> \<vigra/labelimage.hxx\><br>
+    Namespace: vigra
+
+    \code
+    vigra::BImage src(w,h);
+    vigra::IImage labels(w,h);
+    ...
+    // find 8-connected regions using all available threads
+    vigra::labelImageParallel(srcImageRange(src), destImage(labels), true, -1);
+    \endcode
+*/
+doxygen_overloaded_function(template <...> unsigned int labelImageParallel)
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class EqualityFunctor>
+unsigned int labelImageParallel(SrcIterator upperlefts,
+                                SrcIterator lowerrights, SrcAccessor sa,
+                                DestIterator upperleftd, DestAccessor da,
+                                bool eight_neighbors, EqualityFunctor equal,
+                                int threadCount)
+{
+    threadCount = actualThreadCount(threadCount);
+    if(threadCount <= 1)
+        return labelImage(upperlefts, lowerrights, sa, upperleftd, da, eight_neighbors, equal);
+    return detail::labelImageBlockwise(upperlefts, lowerrights, sa, upperleftd, da, eight_neighbors,
+                                       detail::LabelImagePolicy<EqualityFunctor>(equal),
+                                       detail::labelImageBlockHeight(lowerrights.y - upperlefts.y, threadCount), 
+                                       threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+inline
+unsigned int labelImageParallel(SrcIterator upperlefts,
+                                SrcIterator lowerrights, SrcAccessor sa,
+                                DestIterator upperleftd, DestAccessor da,
+                                bool eight_neighbors, int threadCount = 1)
+{
+    return labelImageParallel(upperlefts, lowerrights, sa, upperleftd, da, eight_neighbors,
+                              std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class EqualityFunctor>
+inline
+unsigned int labelImageParallel(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                                pair<DestIterator, DestAccessor> dest,
+                                bool eight_neighbors, EqualityFunctor equal,
+                                int threadCount)
+{
+    return labelImageParallel(src.first, src.second, src.third,
+                              dest.first, dest.second, eight_neighbors, equal, threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+inline
+unsigned int labelImageParallel(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                                pair<DestIterator, DestAccessor> dest,
+                                bool eight_neighbors, int threadCount = 1)
+{
+    return labelImageParallel(src.first, src.second, src.third,
+                              dest.first, dest.second, eight_neighbors,
+                              std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
 /********************************************************/
 /*                                                      */
 /*             labelImageWithBackground                 */
@@ -591,6 +896,150 @@ unsigned int labelImageWithBackground(
                             std::equal_to<typename SrcAccessor::value_type>());
 }
 
+template <class ValueType, class EqualityFunctor>
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+unsigned int 
+detail::LabelImageWithBackgroundPolicy<ValueType, EqualityFunctor>::label(
+                    SrcIterator upperlefts, SrcIterator lowerrights, SrcAccessor sa,
+                    DestIterator upperleftd, DestAccessor da, bool eight_neighbors) const
+{
+    return labelImageWithBackground(upperlefts, lowerrights, sa, upperleftd, da, 
+                                    eight_neighbors, background_, equal_);
+}
+
+/********************************************************/
+/*                                                      */
+/*           labelImageWithBackgroundParallel           */
+/*                                                      */
+/********************************************************/
+
+/** \brief Find the connected components of a segmented image,
+    excluding the background from labeling, using several threads.
+
+    <b> Declarations:</b>
+
+    pass arguments explicitly:
+    \code
+    namespace vigra {
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor,
+                  class ValueType>
+        unsigned int labelImageWithBackgroundParallel(SrcIterator upperlefts,
+                                                      SrcIterator lowerrights, SrcAccessor sa,
+                                                      DestIterator upperleftd, DestAccessor da,
+                                                      bool eight_neighbors, ValueType background_value,
+                                                      int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor,
+                  class ValueType, class EqualityFunctor>
+        unsigned int labelImageWithBackgroundParallel(SrcIterator upperlefts,
+                                                      SrcIterator lowerrights, SrcAccessor sa,
+                                                      DestIterator upperleftd, DestAccessor da,
+                                                      bool eight_neighbors, ValueType background_value,
+                                                      EqualityFunctor equal, int threadCount);
+    }
+    \endcode
+
+    use argument objects in conjunction with \ref ArgumentObjectFactories :
+    \code
+    namespace vigra {
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor,
+                  class ValueType>
+        unsigned int labelImageWithBackgroundParallel(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                                                      pair<DestIterator, DestAccessor> dest,
+                                                      bool eight_neighbors, ValueType background_value,
+                                                      int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,
+                  class DestIterator, class DestAccessor,
+                  class ValueType, class EqualityFunctor>
+        unsigned int labelImageWithBackgroundParallel(triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                                                      pair<DestIterator, DestAccessor> dest,
+                                                      bool eight_neighbors, ValueType background_value,
+                                                      EqualityFunctor equal, int threadCount);
+    }
+    \endcode
+
+    Computes the same labeling as \ref labelImageWithBackground(), using the 
+    strip decomposition described in \ref labelImageParallel(). Background
+    pixels remain untouched in the destination image.
+
+    Return:  the number of regions found (= largest region label)
+*/
+doxygen_overloaded_function(template <...> unsigned int labelImageWithBackgroundParallel)
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class ValueType, class EqualityFunctor>
+unsigned int labelImageWithBackgroundParallel(
+    SrcIterator upperlefts,
+    SrcIterator lowerrights, SrcAccessor sa,
+    DestIterator upperleftd, DestAccessor da,
+    bool eight_neighbors,
+    ValueType background_value, EqualityFunctor equal,
+    int threadCount)
+{
+    threadCount = actualThreadCount(threadCount);
+    if(threadCount <= 1)
+        return labelImageWithBackground(upperlefts, lowerrights, sa, upperleftd, da, 
+                                        eight_neighbors, background_value, equal);
+    return detail::labelImageBlockwise(upperlefts, lowerrights, sa, upperleftd, da, eight_neighbors,
+                                       detail::LabelImageWithBackgroundPolicy<ValueType, EqualityFunctor>(background_value, equal),
+                                       detail::labelImageBlockHeight(lowerrights.y - upperlefts.y, threadCount), 
+                                       threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class ValueType>
+inline
+unsigned int labelImageWithBackgroundParallel(
+    SrcIterator upperlefts,
+    SrcIterator lowerrights, SrcAccessor sa,
+    DestIterator upperleftd, DestAccessor da,
+    bool eight_neighbors,
+    ValueType background_value, int threadCount = 1)
+{
+    return labelImageWithBackgroundParallel(upperlefts, lowerrights, sa, upperleftd, da,
+                            eight_neighbors, background_value,
+                            std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class ValueType, class EqualityFunctor>
+inline
+unsigned int labelImageWithBackgroundParallel(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src,
+    pair<DestIterator, DestAccessor> dest,
+    bool eight_neighbors,
+    ValueType background_value, EqualityFunctor equal,
+    int threadCount)
+{
+    return labelImageWithBackgroundParallel(src.first, src.second, src.third,
+                                            dest.first, dest.second,
+                                            eight_neighbors, background_value, equal, threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class ValueType>
+inline
+unsigned int labelImageWithBackgroundParallel(
+    triple<SrcIterator, SrcIterator, SrcAccessor> src,
+    pair<DestIterator, DestAccessor> dest,
+    bool eight_neighbors,
+    ValueType background_value, int threadCount = 1)
+{
+    return labelImageWithBackgroundParallel(src.first, src.second, src.third,
+                            dest.first, dest.second,
+                            eight_neighbors, background_value,
+                            std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
 /********************************************************/
 /*                                                      */
 /*            regionImageToCrackEdgeImage               */
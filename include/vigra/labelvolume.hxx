@@ -40,9 +40,193 @@
 #include "voxelneighborhood.hxx"
 #include "multi_array.hxx"
 #include "union_find.hxx"
+#include "threading.hxx"
 
 namespace vigra{
 
+namespace detail {
+
+    // Label a volume by splitting it into slabs of 'blockDepth' slices along z.
+    // The slabs are labeled independently (in parallel when compiled with OpenMP)
+    // by 'policy.label()', and regions touching across a slab face are merged 
+    // when 'policy.connected()' holds for the two voxels. Since the labels of 
+    // every slab and the global union-find array are ordered by the scan order 
+    // position of each region's first voxel, the result is identical to labeling
+    // the whole volume at once. Voxels where 'policy.isBackground()' holds 
+    // keep label 0. 
+template <class SrcIterator, class SrcAccessor, class SrcShape,
+          class DestIterator, class DestAccessor, class SlabPolicy>
+unsigned int labelVolumeBlockwise(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                  DestIterator d_Iter, DestAccessor da,
+                                  SlabPolicy const & policy, int blockDepth, int threadCount)
+{
+    typedef typename DestAccessor::value_type LabelType;
+    typedef typename SlabPolicy::Neighborhood Neighborhood3D;
+    
+    int w = srcShape[0], h = srcShape[1], d = srcShape[2];
+    
+    if(d <= blockDepth)
+        return policy.label(s_Iter, srcShape, sa, d_Iter, da);
+    
+    int blockCount = (d + blockDepth - 1) / blockDepth;
+    threadCount = actualThreadCount(threadCount);
+    
+    // pass 1: label the slabs independently
+    ArrayVector<unsigned int> offsets(blockCount+1, 0u);
+    ThreadExceptionCollector errors;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount) if(threadCount > 1)
+#endif
+    for(int b = 0; b < blockCount; ++b)
+    {
+        try
+        {
+            int z0 = b*blockDepth, z1 = std::min(z0 + blockDepth, d);
+            SrcIterator sb = s_Iter;
+            sb.dim2() += z0;
+            DestIterator db = d_Iter;
+            db.dim2() += z0;
+            SrcShape blockShape(srcShape);
+            blockShape[2] = z1 - z0;
+            offsets[b+1] = policy.label(sb, blockShape, sa, db, da);
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+    
+    for(int b = 0; b < blockCount; ++b)
+    {
+        vigra_invariant(offsets[b+1] <= NumericTraits<LabelType>::max() - offsets[b],
+            "connected components: Need more labels than can be represented in the destination type.");
+        offsets[b+1] += offsets[b];
+    }
+    
+    // pass 2: merge regions that are connected across the slab faces
+    UnionFindArray<LabelType> labels((LabelType)(offsets[blockCount] + 1));
+    for(int b = 1; b < blockCount; ++b)
+    {
+        int z = b*blockDepth;
+        for(int y = 0; y != h; ++y)
+        {
+            for(int x = 0; x != w; ++x)
+            {
+                Diff3D p(x, y, z);
+                if(policy.isBackground(sa(s_Iter, p)))
+                    continue;
+                NeighborOffsetCirculator<Neighborhood3D> nc(Neighborhood3D::CausalFirst);
+                for(int k = 0; k < Neighborhood3D::DirectionCount; ++k, ++nc)
+                {
+                    Diff3D q = p + *nc;
+                    if((*nc)[2] != -1 || q[0] < 0 || q[0] >= w || q[1] < 0 || q[1] >= h)
+                        continue;
+                    if(policy.connected(sa(s_Iter, p), sa(s_Iter, q), nc))
+                    {
+                        labels.makeUnion((LabelType)(da(d_Iter, p) + offsets[b]), 
+                                         (LabelType)(da(d_Iter, q) + offsets[b-1]));
+                    }
+                }
+            }
+        }
+    }
+    
+    unsigned int count = labels.makeContiguous();
+    
+    // pass 3: assign the final labels
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount) if(threadCount > 1)
+#endif
+    for(int z = 0; z < d; ++z)
+    {
+        LabelType offset = (LabelType)offsets[z / blockDepth];
+        SrcIterator ys = s_Iter;
+        ys.dim2() += z;
+        DestIterator yd = d_Iter;
+        yd.dim2() += z;
+        for(int y = 0; y != h; ++y, ++ys.dim1(), ++yd.dim1())
+        {
+            SrcIterator xs(ys);
+            DestIterator xd(yd);
+            for(int x = 0; x != w; ++x, ++xs.dim0(), ++xd.dim0())
+            {
+                if(!policy.isBackground(sa(xs)))
+                    da.set(labels[(LabelType)(da(xd) + offset)], xd);
+            }
+        }
+    }
+    return count;
+}
+
+    // slab depth giving about four slabs per thread
+inline int labelVolumeBlockDepth(int depth, int threadCount)
+{
+    return std::max(1, (depth + 4*threadCount - 1) / (4*threadCount));
+}
+
+template <class Neighborhood3D, class EqualityFunctor>
+struct LabelVolumePolicy
+{
+    typedef Neighborhood3D Neighborhood;
+    
+    EqualityFunctor equal_;
+    
+    LabelVolumePolicy(EqualityFunctor equal)
+    : equal_(equal)
+    {}
+    
+    template <class SrcIterator, class SrcShape, class SrcAccessor,
+              class DestIterator, class DestAccessor>
+    unsigned int label(SrcIterator s, SrcShape shape, SrcAccessor sa,
+                       DestIterator d, DestAccessor da) const;
+    
+    template <class T>
+    bool isBackground(T const &) const
+    {
+        return false;
+    }
+    
+    template <class T>
+    bool connected(T const & u, T const & v, NeighborOffsetCirculator<Neighborhood3D> const &) const
+    {
+        return equal_(u, v);
+    }
+};
+
+template <class Neighborhood3D, class ValueType, class EqualityFunctor>
+struct LabelVolumeWithBackgroundPolicy
+{
+    typedef Neighborhood3D Neighborhood;
+    
+    ValueType background_;
+    EqualityFunctor equal_;
+    
+    LabelVolumeWithBackgroundPolicy(ValueType background, EqualityFunctor equal)
+    : background_(background),
+      equal_(equal)
+    {}
+    
+    template <class SrcIterator, class SrcShape, class SrcAccessor,
+              class DestIterator, class DestAccessor>
+    unsigned int label(SrcIterator s, SrcShape shape, SrcAccessor sa,
+                       DestIterator d, DestAccessor da) const;
+    
+    template <class T>
+    bool isBackground(T const & u) const
+    {
+        return equal_(u, background_);
+    }
+    
+    template <class T>
+    bool connected(T const & u, T const & v, NeighborOffsetCirculator<Neighborhood3D> const &) const
+    {
+        return equal_(u, v);
+    }
+};
+
+} // namespace detail
+
 /** \addtogroup Labeling Connected Components Labeling
      The 3-dimensional connected components algorithms may use either 6 or 26 connectivity.
      By means of a functor the merge criterium can be defined arbitrarily.
@@ -325,6 +509,149 @@ unsigned int labelVolumeSix(triple<SrcIterator, SrcShape, SrcAccessor> src,
     return labelVolume(src.first, src.second, src.third, dest.first, dest.second, NeighborCode3DSix(), std::equal_to<typename SrcAccessor::value_type>());
 }
 
+template <class Neighborhood3D, class EqualityFunctor>
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+unsigned int 
+detail::LabelVolumePolicy<Neighborhood3D, EqualityFunctor>::label(SrcIterator s, SrcShape shape, SrcAccessor sa,
+                                                                  DestIterator d, DestAccessor da) const
+{
+    return labelVolume(s, shape, sa, d, da, Neighborhood3D(), equal_);
+}
+
+/********************************************************/
+/*                                                      */
+/*                  labelVolumeParallel                 */
+/*                                                      */
+/********************************************************/
+
+/** \brief Find the connected components of a segmented volume 
+     using several threads.
+     
+    <b> Declarations:</b>
+
+    pass arguments explicitly:
+    \code
+    namespace vigra {
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D>
+        unsigned int labelVolumeParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                         DestIterator d_Iter, DestAccessor da,
+                                         Neighborhood3D neighborhood3D, int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D, class EqualityFunctor>
+        unsigned int labelVolumeParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                         DestIterator d_Iter, DestAccessor da,
+                                         Neighborhood3D neighborhood3D, EqualityFunctor equal,
+                                         int threadCount);
+    }
+    \endcode
+
+    use argument objects in conjunction with \ref ArgumentObjectFactories :
+    \code
+    namespace vigra {
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D>
+        unsigned int labelVolumeParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                         pair<DestIterator, DestAccessor> dest,
+                                         Neighborhood3D neighborhood3D, int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D, class EqualityFunctor>
+        unsigned int labelVolumeParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                         pair<DestIterator, DestAccessor> dest,
+                                         Neighborhood3D neighborhood3D, EqualityFunctor equal,
+                                         int threadCount);
+    }
+    \endcode
+    
+    Computes the same labeling as \ref labelVolume(). When VIGRA is compiled with 
+    OpenMP, the volume is split into slabs along the z-axis which are labeled 
+    concurrently. Regions touching across slab faces are then merged by means 
+    of a global union-find array, and a parallel relabeling pass produces
+    the consecutive labels. <tt>threadCount</tt> specifies the number 
+    of threads (default: 1, negative: use \ref vigra::defaultThreadCount()). Without OpenMP,
+    the function is equivalent to \ref labelVolume().
+
+    Return:  the number of regions found (= largest region label)
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/labelvolume.hxx\><br>
+    Namespace: vigra
+
+    \code
+    typedef vigra::MultiArray<3,int> IntVolume;
+    IntVolume src(IntVolume::difference_type(w,h,d));
+    IntVolume dest(IntVolume::difference_type(w,h,d));
+    
+    // find 26-connected regions using all available threads
+    int max_region_label = vigra::labelVolumeParallel(srcMultiArrayRange(src), destMultiArray(dest), 
+                                                      NeighborCode3DTwentySix(), -1);
+    \endcode
+*/
+doxygen_overloaded_function(template <...> unsigned int labelVolumeParallel)
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D, class EqualityFunctor>
+unsigned int labelVolumeParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                 DestIterator d_Iter, DestAccessor da,
+                                 Neighborhood3D neighborhood3D, EqualityFunctor equal,
+                                 int threadCount)
+{
+    threadCount = actualThreadCount(threadCount);
+    if(threadCount <= 1)
+        return labelVolume(s_Iter, srcShape, sa, d_Iter, da, neighborhood3D, equal);
+    return detail::labelVolumeBlockwise(s_Iter, srcShape, sa, d_Iter, da,
+                                        detail::LabelVolumePolicy<Neighborhood3D, EqualityFunctor>(equal),
+                                        detail::labelVolumeBlockDepth(srcShape[2], threadCount), threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D>
+inline
+unsigned int labelVolumeParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                 DestIterator d_Iter, DestAccessor da,
+                                 Neighborhood3D neighborhood3D, int threadCount = 1)
+{
+    return labelVolumeParallel(s_Iter, srcShape, sa, d_Iter, da, neighborhood3D, 
+                               std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D, class EqualityFunctor>
+inline
+unsigned int labelVolumeParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                 pair<DestIterator, DestAccessor> dest,
+                                 Neighborhood3D neighborhood3D, EqualityFunctor equal,
+                                 int threadCount)
+{
+    return labelVolumeParallel(src.first, src.second, src.third, dest.first, dest.second, 
+                               neighborhood3D, equal, threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D>
+inline
+unsigned int labelVolumeParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                 pair<DestIterator, DestAccessor> dest,
+                                 Neighborhood3D neighborhood3D, int threadCount = 1)
+{
+    return labelVolumeParallel(src.first, src.second, src.third, dest.first, dest.second, 
+                               neighborhood3D, std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
 
 
 
@@ -588,6 +915,155 @@ unsigned int labelVolumeWithBackground(SrcIterator s_Iter, SrcShape srcShape, Sr
     return count;
 }
 
+template <class Neighborhood3D, class ValueType, class EqualityFunctor>
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor>
+unsigned int 
+detail::LabelVolumeWithBackgroundPolicy<Neighborhood3D, ValueType, EqualityFunctor>::label(
+                      SrcIterator s, SrcShape shape, SrcAccessor sa,
+                      DestIterator d, DestAccessor da) const
+{
+    return labelVolumeWithBackground(s, shape, sa, d, da, Neighborhood3D(), background_, equal_);
+}
+
+/********************************************************/
+/*                                                      */
+/*           labelVolumeWithBackgroundParallel          */
+/*                                                      */
+/********************************************************/
+
+/** \brief Find the connected components of a segmented volume,
+     excluding the background from labeling, using several threads.
+
+    <b> Declarations:</b>
+
+    pass arguments explicitly:
+    \code
+    namespace vigra {
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D, class ValueType>
+        unsigned int labelVolumeWithBackgroundParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                                       DestIterator d_Iter, DestAccessor da,
+                                                       Neighborhood3D neighborhood3D, ValueType background_value,
+                                                       int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D, class ValueType, class EqualityFunctor>
+        unsigned int labelVolumeWithBackgroundParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                                       DestIterator d_Iter, DestAccessor da,
+                                                       Neighborhood3D neighborhood3D, ValueType background_value,
+                                                       EqualityFunctor equal, int threadCount);
+    }
+    \endcode
+
+    use argument objects in conjunction with \ref ArgumentObjectFactories :
+    \code
+    namespace vigra {
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D, class ValueType>
+        unsigned int labelVolumeWithBackgroundParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                                       pair<DestIterator, DestAccessor> dest,
+                                                       Neighborhood3D neighborhood3D, ValueType background_value,
+                                                       int threadCount = 1);
+
+        template <class SrcIterator, class SrcAccessor,class SrcShape,
+                  class DestIterator, class DestAccessor,
+                  class Neighborhood3D, class ValueType, class EqualityFunctor>
+        unsigned int labelVolumeWithBackgroundParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                                       pair<DestIterator, DestAccessor> dest,
+                                                       Neighborhood3D neighborhood3D, ValueType background_value,
+                                                       EqualityFunctor equal, int threadCount);
+    }
+    \endcode
+
+    Computes the same labeling as \ref labelVolumeWithBackground(), using the 
+    slab decomposition described in \ref labelVolumeParallel(). 
+
+    Return:  the number of regions found (= largest region label)
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/labelvolume.hxx\><br>
+    Namespace: vigra
+
+    \code
+    typedef vigra::MultiArray<3,int> IntVolume;
+    IntVolume src(IntVolume::difference_type(w,h,d));
+    IntVolume dest(IntVolume::difference_type(w,h,d));
+
+    // find 6-connected foreground regions using 4 threads
+    int max_region_label = vigra::labelVolumeWithBackgroundParallel(
+              srcMultiArrayRange(src), destMultiArray(dest), NeighborCode3DSix(), 0, 4);
+    \endcode
+*/
+doxygen_overloaded_function(template <...> unsigned int labelVolumeWithBackgroundParallel)
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D,
+          class ValueType, class EqualityFunctor>
+unsigned int labelVolumeWithBackgroundParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                               DestIterator d_Iter, DestAccessor da,
+                                               Neighborhood3D neighborhood3D,
+                                               ValueType backgroundValue, EqualityFunctor equal,
+                                               int threadCount)
+{
+    threadCount = actualThreadCount(threadCount);
+    if(threadCount <= 1)
+        return labelVolumeWithBackground(s_Iter, srcShape, sa, d_Iter, da, neighborhood3D, backgroundValue, equal);
+    return detail::labelVolumeBlockwise(s_Iter, srcShape, sa, d_Iter, da,
+                                        detail::LabelVolumeWithBackgroundPolicy<Neighborhood3D, ValueType, EqualityFunctor>(backgroundValue, equal),
+                                        detail::labelVolumeBlockDepth(srcShape[2], threadCount), threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D,
+          class ValueType>
+inline
+unsigned int labelVolumeWithBackgroundParallel(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                               DestIterator d_Iter, DestAccessor da,
+                                               Neighborhood3D neighborhood3D, ValueType backgroundValue,
+                                               int threadCount = 1)
+{
+    return labelVolumeWithBackgroundParallel(s_Iter, srcShape, sa, d_Iter, da, neighborhood3D, backgroundValue, 
+                                             std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D,
+          class ValueType, class EqualityFunctor>
+inline
+unsigned int labelVolumeWithBackgroundParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                               pair<DestIterator, DestAccessor> dest,
+                                               Neighborhood3D neighborhood3D, ValueType backgroundValue, 
+                                               EqualityFunctor equal, int threadCount)
+{
+    return labelVolumeWithBackgroundParallel(src.first, src.second, src.third, dest.first, dest.second, 
+                                             neighborhood3D, backgroundValue, equal, threadCount);
+}
+
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D,
+          class ValueType>
+inline
+unsigned int labelVolumeWithBackgroundParallel(triple<SrcIterator, SrcShape, SrcAccessor> src,
+                                               pair<DestIterator, DestAccessor> dest,
+                                               Neighborhood3D neighborhood3D, ValueType backgroundValue,
+                                               int threadCount = 1)
+{
+    return labelVolumeWithBackgroundParallel(src.first, src.second, src.third, dest.first, dest.second, 
+                                             neighborhood3D, backgroundValue, 
+                                             std::equal_to<typename SrcAccessor::value_type>(), threadCount);
+}
+
 //@}
 
 } //end of namespace vigra
@@ -0,0 +1,320 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef VIGRA_MAPPED_MULTI_ARRAY_HXX
+#define VIGRA_MAPPED_MULTI_ARRAY_HXX
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include "config.hxx"
+#include "error.hxx"
+#include "sized_int.hxx"
+#include "numerictraits.hxx"
+#include "array_vector.hxx"
+#include "multi_array.hxx"
+#include "byteswap.hxx"
+
+#ifdef _WIN32
+# include "windows.h"
+#else
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace vigra {
+
+namespace detail {
+
+    // Read-only, copy-on-write mapping of a part of a file into memory.
+class MemoryMapping
+{
+  public:
+    MemoryMapping()
+    : base_(0), data_(0), length_(0)
+#ifdef _WIN32
+      , file_(INVALID_HANDLE_VALUE), mapping_(0)
+#endif
+    {}
+
+    ~MemoryMapping()
+    {
+        close();
+    }
+
+        // map 'length' bytes starting at 'offset', return false if the file is too short
+    bool open(std::string const & filename, std::ptrdiff_t offset, std::size_t length)
+    {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, 
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        vigra_precondition(file_ != INVALID_HANDLE_VALUE,
+            "MappedMultiArray: unable to open file '" + filename + "'.");
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file_, &fileSize) || fileSize.QuadPart < (LONGLONG)(offset + length))
+        {
+            close();
+            return false;
+        }
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        std::ptrdiff_t alignedOffset = offset - offset % info.dwAllocationGranularity;
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(mapping_ != 0)
+            base_ = MapViewOfFile(mapping_, FILE_MAP_COPY, 
+                                  (DWORD)((UInt64)alignedOffset >> 32), (DWORD)(alignedOffset & 0xffffffff),
+                                  length + (offset - alignedOffset));
+        if(base_ == 0)
+        {
+            close();
+            vigra_fail("MappedMultiArray: unable to map file '" + filename + "'.");
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        vigra_precondition(fd >= 0,
+            "MappedMultiArray: unable to open file '" + filename + "'.");
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size < (off_t)(offset + length))
+        {
+            ::close(fd);
+            return false;
+        }
+        std::ptrdiff_t alignedOffset = offset - offset % sysconf(_SC_PAGESIZE);
+        void * base = mmap(0, length + (offset - alignedOffset), PROT_READ | PROT_WRITE, 
+                           MAP_PRIVATE, fd, (off_t)alignedOffset);
+        ::close(fd); // the mapping keeps its own reference to the file
+        vigra_postcondition(base != MAP_FAILED,
+            "MappedMultiArray: unable to map file '" + filename + "'.");
+        base_ = base;
+#endif
+        length_ = length + (offset - alignedOffset);
+        data_ = static_cast<char *>(base_) + (offset - alignedOffset);
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if(base_ != 0)
+            UnmapViewOfFile(base_);
+        if(mapping_ != 0)
+            CloseHandle(mapping_);
+        if(file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = 0;
+#else
+        if(base_ != 0)
+            munmap(base_, length_);
+#endif
+        base_ = 0;
+        data_ = 0;
+        length_ = 0;
+    }
+
+    char * data() const
+    {
+        return data_;
+    }
+
+  private:
+    MemoryMapping(MemoryMapping const &);
+    MemoryMapping & operator=(MemoryMapping const &);
+
+    void * base_;
+    char * data_;
+    std::size_t length_;
+#ifdef _WIN32
+    HANDLE file_, mapping_;
+#endif
+};
+
+} // namespace detail
+
+/********************************************************/
+/*                                                      */
+/*                   MappedMultiArray                   */
+/*                                                      */
+/********************************************************/
+
+/** \brief Array view to raw data in a memory-mapped file.
+
+    Maps the part of a file that contains an array of the given shape 
+    (stored in scan order, i.e. with the first index running fastest)
+    into memory and exposes it as a \ref vigra::MultiArrayView. Opening
+    even very large files is almost instantaneous because the operating system 
+    reads the pages only when they are accessed for the first time.
+    
+    The mapping is private: the array can be modified, but changes are never 
+    written back to the file. When the byte order of the file differs from the host's, 
+    the data are byte-swapped in the mapped pages (which reads the entire data).
+    When the data are not suitably aligned for <tt>T</tt> within the file, 
+    they are copied into an internal buffer instead (see \ref isMapped()).
+    Vector valued element types (e.g. <tt>TinyVector</tt>) are byte-swapped 
+    component-wise.
+    
+    The view remains valid until the object is destroyed or remapped. 
+    Objects of this class cannot be copied.
+    
+    <b>Usage:</b>
+    
+    \code
+    // 512 x 512 x 2000 16-bit volume stored after a 1024 byte header
+    MappedMultiArray<3, UInt16> volume("volume.raw", Shape3(512, 512, 2000), 1024, 
+                                       MappedMultiArray<3, UInt16>::BigEndian);
+    
+    UInt16 maximum = *argMax(volume.begin(), volume.end());
+    \endcode
+    
+    See also \ref mapVolume() in <tt>\<vigra/multi_impex.hxx\></tt> and 
+    \ref mapSIF() in <tt>\<vigra/sifImport.hxx\></tt>.
+    
+    <b>\#include</b> \<vigra/mapped_multi_array.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int N, class T>
+class MappedMultiArray
+: public MultiArrayView<N, T, UnstridedArrayTag>
+{
+  public:
+    typedef MultiArrayView<N, T, UnstridedArrayTag> view_type;
+    typedef typename view_type::difference_type difference_type;
+    typedef typename view_type::pointer pointer;
+    
+        /** Byte order of the data in the file.
+        */
+    enum ByteOrder { NativeByteOrder, LittleEndian, BigEndian };
+    
+        /** Construct an empty array.
+        */
+    MappedMultiArray()
+    : mapped_(false)
+    {}
+    
+        /** Map an array of the given shape starting at byte <tt>offset</tt>
+            of file <tt>filename</tt> (see \ref map()).
+        */
+    MappedMultiArray(std::string const & filename, difference_type const & shape, 
+                     std::ptrdiff_t offset = 0, ByteOrder byteOrder = NativeByteOrder)
+    : mapped_(false)
+    {
+        map(filename, shape, offset, byteOrder);
+    }
+    
+        /** Map an array of the given shape starting at byte <tt>offset</tt>
+            of file <tt>filename</tt>, replacing the previous contents. 
+            Throws a \ref vigra::PreconditionViolation if the file cannot be 
+            opened or is too short.
+        */
+    void map(std::string const & filename, difference_type const & shape, 
+             std::ptrdiff_t offset = 0, ByteOrder byteOrder = NativeByteOrder)
+    {
+        unmap();
+        
+        std::size_t count = prod(shape),
+                    bytes = count * sizeof(T);
+        vigra_precondition(offset >= 0,
+            "MappedMultiArray::map(): offset must be non-negative.");
+        if(count == 0)
+        {
+            this->m_shape = shape;
+            this->m_stride = detail::defaultStride<view_type::actual_dimension>(shape);
+            return;
+        }
+        bool ok = mapping_.open(filename, offset, bytes);
+        vigra_precondition(ok,
+            "MappedMultiArray::map(): file '" + filename + "' is too short for the requested array.");
+        
+        char * data = mapping_.data();
+        if(reinterpret_cast<std::size_t>(data) % sizeof(typename NumericTraits<T>::ValueType) == 0)
+        {
+            mapped_ = true;
+        }
+        else
+        {
+            buffer_.resize(count);
+            std::memcpy(buffer_.data(), data, bytes);
+            mapping_.close();
+            data = reinterpret_cast<char *>(buffer_.data());
+        }
+        
+        if(byteOrder != NativeByteOrder && (byteOrder == LittleEndian) != detail::hostIsLittleEndian())
+        {
+            std::size_t scalarSize = sizeof(typename NumericTraits<T>::ValueType);
+            detail::byteSwapArray(data, bytes / scalarSize, scalarSize);
+        }
+        
+        this->m_shape = shape;
+        this->m_stride = detail::defaultStride<view_type::actual_dimension>(shape);
+        this->m_ptr = reinterpret_cast<pointer>(data);
+    }
+    
+        /** Release the mapping (the view becomes empty).
+        */
+    void unmap()
+    {
+        mapping_.close();
+        ArrayVector<T>().swap(buffer_);
+        mapped_ = false;
+        this->m_shape = difference_type();
+        this->m_stride = difference_type();
+        this->m_ptr = 0;
+    }
+    
+        /** True when the view refers to the memory-mapped file directly,
+            false when the data had to be copied.
+        */
+    bool isMapped() const
+    {
+        return mapped_;
+    }
+    
+  private:
+    MappedMultiArray(MappedMultiArray const &);
+    MappedMultiArray & operator=(MappedMultiArray const &);
+    
+    detail::MemoryMapping mapping_;
+    ArrayVector<T> buffer_;
+    bool mapped_;
+};
+
+} // namespace vigra
+
+#endif // VIGRA_MAPPED_MULTI_ARRAY_HXX
@@ -0,0 +1,697 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_MULTI_BLOCKWISE_HXX
+#define VIGRA_MULTI_BLOCKWISE_HXX
+
+#include <algorithm>
+#include "multi_array.hxx"
+#include "multi_convolution.hxx"
+#include "multi_pointoperators.hxx"
+#include "threading.hxx"
+
+namespace vigra {
+
+namespace detail {
+
+    // radius of the kernel created by Kernel1D::initGaussianDerivative(sigma, order)
+inline int gaussianKernelRadius(double sigma, int order = 0)
+{
+    if(sigma == 0.0)
+        return 0;
+    Kernel1D<double> kernel;
+    if(order == 0)
+        kernel.initGaussian(sigma);
+    else
+        kernel.initGaussianDerivative(sigma, order);
+    return std::max(kernel.right(), -kernel.left());
+}
+
+} // namespace detail
+
+/** \addtogroup MultiArrayConvolutionFilters
+*/
+//@{
+
+/********************************************************/
+/*                                                      */
+/*                MultiArrayBlockSource                 */
+/*                                                      */
+/********************************************************/
+
+/** \brief Read blocks of an array that resides in memory.
+
+    Adapter that makes a \ref vigra::MultiArrayView usable as the source of 
+    \ref blockwiseFilterMultiArray(). Other sources (e.g. \ref vigra::HDF5BlockSource
+    and \ref vigra::HDF5Array in <tt>\<vigra/hdf5impex.hxx\></tt>) provide the same interface:
+    
+    \code
+    typedef ... value_type;   // the pixel type of the source
+    typedef ... shape_type;   // MultiArrayShape<N>::type
+    
+    shape_type shape() const;
+    
+    // fill 'block' with the data starting at 'offset' 
+    void readBlock(shape_type const & offset, 
+                   MultiArrayView<N, value_type, UnstridedArrayTag> block) const;
+    \endcode
+    
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int N, class T, class Stride = StridedArrayTag>
+class MultiArrayBlockSource
+{
+  public:
+    typedef T value_type;
+    typedef typename MultiArrayShape<N>::type shape_type;
+    
+    MultiArrayBlockSource(MultiArrayView<N, T, Stride> const & array)
+    : array_(array)
+    {}
+    
+    shape_type shape() const
+    {
+        return array_.shape();
+    }
+    
+    void readBlock(shape_type const & offset, 
+                   MultiArrayView<N, value_type, UnstridedArrayTag> block) const
+    {
+        block = array_.subarray(offset, offset + block.shape());
+    }
+    
+  private:
+    MultiArrayView<N, T, Stride> array_;
+};
+
+/********************************************************/
+/*                                                      */
+/*                 MultiArrayBlockSink                  */
+/*                                                      */
+/********************************************************/
+
+/** \brief Write blocks into an array that resides in memory.
+
+    Adapter that makes a \ref vigra::MultiArrayView usable as the destination of 
+    \ref blockwiseFilterMultiArray(). Other destinations (e.g. \ref vigra::HDF5BlockSink
+    and \ref vigra::HDF5Array in <tt>\<vigra/hdf5impex.hxx\></tt>) provide the same interface:
+    
+    \code
+    typedef ... value_type;   // the pixel type of the destination
+    typedef ... shape_type;   // MultiArrayShape<N>::type
+    
+    // store 'block' at 'offset' 
+    void writeBlock(shape_type const & offset, 
+                    MultiArrayView<N, value_type, UnstridedArrayTag> const & block);
+    \endcode
+    
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+template <unsigned int N, class T, class Stride = StridedArrayTag>
+class MultiArrayBlockSink
+{
+  public:
+    typedef T value_type;
+    typedef typename MultiArrayShape<N>::type shape_type;
+    
+    MultiArrayBlockSink(MultiArrayView<N, T, Stride> const & array)
+    : array_(array)
+    {}
+    
+    shape_type shape() const
+    {
+        return array_.shape();
+    }
+    
+    void writeBlock(shape_type const & offset, 
+                    MultiArrayView<N, value_type, UnstridedArrayTag> const & block)
+    {
+        array_.subarray(offset, offset + block.shape()) = block;
+    }
+    
+  private:
+    MultiArrayView<N, T, Stride> array_;
+};
+
+/********************************************************/
+/*                                                      */
+/*                 blockwise filter functors            */
+/*                                                      */
+/********************************************************/
+
+/** \brief Gaussian smoothing for \ref blockwiseFilterMultiArray().
+
+    Calls \ref gaussianSmoothMultiArray() on each block. Filters for 
+    \ref blockwiseFilterMultiArray() must provide <tt>halo()</tt>, the number of 
+    pixels each block must be enlarged by (on all sides) to compute the results 
+    in the block's interior exactly, and an <tt>operator()</tt> that filters
+    a block (including halo) into an output array of the same shape.
+    The filters in this file convolve each block with a single thread,
+    since the blocks themselves are distributed over the threads.
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+class GaussianSmoothBlockFilter
+{
+  public:
+    GaussianSmoothBlockFilter(double sigma)
+    : sigma_(sigma)
+    {}
+    
+    int halo() const
+    {
+        return detail::gaussianKernelRadius(sigma_);
+    }
+    
+    template <unsigned int N, class T1, class T2>
+    void operator()(MultiArrayView<N, T1, UnstridedArrayTag> const & src,
+                    MultiArrayView<N, T2, UnstridedArrayTag> dest) const
+    {
+        gaussianSmoothMultiArray(srcMultiArrayRange(src), destMultiArray(dest), sigma_, 1);
+    }
+    
+    double sigma_;
+};
+
+/** \brief Gaussian gradient for \ref blockwiseFilterMultiArray().
+
+    Calls \ref gaussianGradientMultiArray() on each block. The destination 
+    must have a vector valued element type with N elements.
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+class GaussianGradientBlockFilter
+{
+  public:
+    GaussianGradientBlockFilter(double sigma)
+    : sigma_(sigma)
+    {}
+    
+    int halo() const
+    {
+        return std::max(detail::gaussianKernelRadius(sigma_), 
+                        detail::gaussianKernelRadius(sigma_, 1));
+    }
+    
+    template <unsigned int N, class T1, class T2>
+    void operator()(MultiArrayView<N, T1, UnstridedArrayTag> const & src,
+                    MultiArrayView<N, T2, UnstridedArrayTag> dest) const
+    {
+        gaussianGradientMultiArray(srcMultiArrayRange(src), destMultiArray(dest), sigma_, 1);
+    }
+    
+    double sigma_;
+};
+
+/** \brief Hessian of Gaussian for \ref blockwiseFilterMultiArray().
+
+    Calls \ref hessianOfGaussianMultiArray() on each block. The destination 
+    must have a vector valued element type with N*(N+1)/2 elements.
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+class HessianOfGaussianBlockFilter
+{
+  public:
+    HessianOfGaussianBlockFilter(double sigma)
+    : sigma_(sigma)
+    {}
+    
+    int halo() const
+    {
+        return std::max(detail::gaussianKernelRadius(sigma_), 
+                        std::max(detail::gaussianKernelRadius(sigma_, 1),
+                                 detail::gaussianKernelRadius(sigma_, 2)));
+    }
+    
+    template <unsigned int N, class T1, class T2>
+    void operator()(MultiArrayView<N, T1, UnstridedArrayTag> const & src,
+                    MultiArrayView<N, T2, UnstridedArrayTag> dest) const
+    {
+        hessianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(dest), sigma_, 1);
+    }
+    
+    double sigma_;
+};
+
+/** \brief Structure tensor for \ref blockwiseFilterMultiArray().
+
+    Calls \ref structureTensorMultiArray() on each block. The destination 
+    must have a vector valued element type with N*(N+1)/2 elements. The halo
+    is the sum of the halos of the inner and outer scale.
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+class StructureTensorBlockFilter
+{
+  public:
+    StructureTensorBlockFilter(double innerScale, double outerScale)
+    : inner_scale_(innerScale),
+      outer_scale_(outerScale)
+    {}
+    
+    int halo() const
+    {
+        return GaussianGradientBlockFilter(inner_scale_).halo() + 
+               detail::gaussianKernelRadius(outer_scale_);
+    }
+    
+    template <unsigned int N, class T1, class T2>
+    void operator()(MultiArrayView<N, T1, UnstridedArrayTag> const & src,
+                    MultiArrayView<N, T2, UnstridedArrayTag> dest) const
+    {
+        structureTensorMultiArray(srcMultiArrayRange(src), destMultiArray(dest), 
+                                  inner_scale_, outer_scale_, 1);
+    }
+    
+    double inner_scale_, outer_scale_;
+};
+
+/** \brief Point operator for \ref blockwiseFilterMultiArray().
+
+    Calls \ref transformMultiArray() with the given functor on each block.
+    Since the halo is zero, source and destination may refer to the same
+    array (e.g. an \ref vigra::HDF5Array that is transformed in-place).
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    Namespace: vigra
+*/
+template <class Functor>
+class TransformBlockFilter
+{
+  public:
+    TransformBlockFilter(Functor const & f)
+    : f_(f)
+    {}
+    
+    int halo() const
+    {
+        return 0;
+    }
+    
+    template <unsigned int N, class T1, class T2>
+    void operator()(MultiArrayView<N, T1, UnstridedArrayTag> const & src,
+                    MultiArrayView<N, T2, UnstridedArrayTag> dest) const
+    {
+        transformMultiArray(srcMultiArrayRange(src), destMultiArray(dest), f_);
+    }
+    
+    Functor f_;
+};
+
+/********************************************************/
+/*                                                      */
+/*                blockwiseFilterMultiArray             */
+/*                                                      */
+/********************************************************/
+
+/** \brief Apply a filter to a large array block by block.
+
+    The array provided by <tt>source</tt> is divided into blocks of the given
+    <tt>blockShape</tt> (blocks at the upper borders may be smaller). Each block
+    is read with a halo of <tt>filter.halo()</tt> pixels on all sides (clipped 
+    at the array border), filtered in memory, and the interior of the result 
+    is passed to <tt>sink.writeBlock()</tt>. Since the halo covers the support 
+    of the filter's kernels, the result is identical to filtering the entire
+    array at once, but only a few blocks must be held in memory at any time.
+    This allows to filter volumes that are much larger than the RAM when the 
+    source and destination reside on disk, for example in HDF5 files 
+    (see \ref vigra::HDF5BlockSource and \ref vigra::HDF5BlockSink).
+    
+    The blocks are distributed over <tt>threadCount</tt> threads when compiled with 
+    OpenMP (default: 1, negative: use all available threads, see \ref ParallelProcessing). 
+    Each thread holds its own block buffers, so that the memory consumption 
+    grows with the number of threads. Calls to the source and the sink are serialized,
+    so they need not be thread-safe.
+    
+    Source and sink must follow the interface of \ref vigra::MultiArrayBlockSource
+    and \ref vigra::MultiArrayBlockSink. Available filters are 
+    \ref vigra::GaussianSmoothBlockFilter, \ref vigra::GaussianGradientBlockFilter,
+    \ref vigra::HessianOfGaussianBlockFilter, \ref vigra::StructureTensorBlockFilter,
+    and \ref vigra::TransformBlockFilter.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <class BlockSource, class BlockSink, class BlockFilter>
+        void
+        blockwiseFilterMultiArray(BlockSource const & source, BlockSink & sink,
+                                  BlockFilter const & filter,
+                                  typename BlockSource::shape_type const & blockShape,
+                                  int threadCount = 1);
+    }
+    \endcode
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    <b>\#include</b> \<vigra/hdf5impex.hxx\>
+
+    \code
+    HDF5File file("volume.h5", HDF5File::Open);
+    HDF5BlockSource<3, UInt8> source(file, "raw");
+    
+    file.createDataset<3, float>("smoothed", source.shape(), 0.0f, Shape3(64,64,64));
+    HDF5BlockSink<3, float> sink(file, "smoothed");
+    
+    blockwiseFilterMultiArray(source, sink, GaussianSmoothBlockFilter(2.0), Shape3(256,256,256));
+    \endcode
+    
+    For arrays in memory, there are convenience functions like
+    \ref gaussianSmoothMultiArrayBlockwise().
+*/
+template <class BlockSource, class BlockSink, class BlockFilter>
+void
+blockwiseFilterMultiArray(BlockSource const & source, BlockSink & sink,
+                          BlockFilter const & filter,
+                          typename BlockSource::shape_type const & blockShape,
+                          int threadCount = 1)
+{
+    typedef typename BlockSource::shape_type Shape;
+    typedef typename BlockSource::value_type SrcType;
+    typedef typename BlockSink::value_type DestType;
+    enum { N = Shape::static_size };
+    
+    Shape shape(source.shape()), blocks;
+    int halo = filter.halo();
+    MultiArrayIndex blockCount = 1;
+    for(int k=0; k<N; ++k)
+    {
+        vigra_precondition(blockShape[k] > 0,
+            "blockwiseFilterMultiArray(): block shape must be positive.");
+        if(shape[k] <= 0)
+            return;
+        blocks[k] = (shape[k] + blockShape[k] - 1) / blockShape[k];
+        blockCount *= blocks[k];
+    }
+
+    threadCount = actualThreadCount(threadCount);
+    ThreadExceptionCollector errors;
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(threadCount) if(threadCount > 1 && blockCount > 1)
+#endif
+    {
+        MultiArray<N, SrcType> in;
+        MultiArray<N, DestType> out, core;
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for(MultiArrayIndex b = 0; b < blockCount; ++b)
+        {
+            try
+            {
+                // determine the block and its halo
+                Shape begin, end, outerBegin, outerEnd;
+                MultiArrayIndex r = b;
+                for(int k=0; k<N; ++k)
+                {
+                    begin[k] = (r % blocks[k]) * blockShape[k];
+                    end[k] = std::min(begin[k] + blockShape[k], shape[k]);
+                    r /= blocks[k];
+                    
+                    outerBegin[k] = std::max<MultiArrayIndex>(begin[k] - halo, 0);
+                    outerEnd[k] = std::min<MultiArrayIndex>(end[k] + halo, shape[k]);
+                    // enlarge blocks that are clipped at the border such that the
+                    // lines are at least as long as the kernels (as with the full array)
+                    MultiArrayIndex missing = 2*halo + 1 - (outerEnd[k] - outerBegin[k]);
+                    if(missing > 0)
+                    {
+                        outerEnd[k] = std::min<MultiArrayIndex>(outerEnd[k] + missing, shape[k]);
+                        outerBegin[k] = std::max<MultiArrayIndex>(outerEnd[k] - 2*halo - 1, 0);
+                    }
+                }
+                
+                if(in.shape() != outerEnd - outerBegin)
+                {
+                    in.reshape(outerEnd - outerBegin);
+                    out.reshape(outerEnd - outerBegin);
+                }
+                // sources and sinks need not be thread-safe (e.g. HDF5)
+#ifdef _OPENMP
+                #pragma omp critical(vigra_blockwise_io)
+#endif
+                source.readBlock(outerBegin, in);
+                
+                filter(in, out);
+                
+                core = out.subarray(begin - outerBegin, end - outerBegin);
+#ifdef _OPENMP
+                #pragma omp critical(vigra_blockwise_io)
+#endif
+                sink.writeBlock(begin, core);
+            }
+            catch(std::exception & e)
+            {
+                errors.capture(e);
+            }
+        }
+    }
+    errors.rethrow();
+}
+
+/********************************************************/
+/*                                                      */
+/*          gaussianSmoothMultiArrayBlockwise           */
+/*                                                      */
+/********************************************************/
+
+/** \brief Blockwise (and possibly parallel) version of \ref gaussianSmoothMultiArray().
+
+    The result is identical to \ref gaussianSmoothMultiArray(), but computed 
+    by \ref blockwiseFilterMultiArray() with blocks of the given shape.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        void
+        gaussianSmoothMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                          MultiArrayView<N, T2, S2> dest, double sigma,
+                                          typename MultiArrayShape<N>::type const & blockShape,
+                                          int threadCount = 1);
+    }
+    \endcode
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\>
+
+    \code
+    MultiArray<3, float> source(shape), dest(shape);
+    ...
+    gaussianSmoothMultiArrayBlockwise(source, dest, 2.0, Shape3(128, 128, 128));
+    \endcode
+*/
+template <unsigned int N, class T1, class S1, class T2, class S2>
+void
+gaussianSmoothMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                  MultiArrayView<N, T2, S2> dest, double sigma,
+                                  typename MultiArrayShape<N>::type const & blockShape,
+                                  int threadCount = 1)
+{
+    vigra_precondition(source.shape() == dest.shape(),
+        "gaussianSmoothMultiArrayBlockwise(): shape mismatch between input and output.");
+    MultiArrayBlockSink<N, T2, S2> sink(dest);
+    blockwiseFilterMultiArray(MultiArrayBlockSource<N, T1, S1>(source), sink, 
+                              GaussianSmoothBlockFilter(sigma), blockShape, threadCount);
+}
+
+/** \brief Blockwise (and possibly parallel) version of \ref gaussianGradientMultiArray().
+
+    The result is identical to \ref gaussianGradientMultiArray(), but computed 
+    by \ref blockwiseFilterMultiArray() with blocks of the given shape.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        void
+        gaussianGradientMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                            MultiArrayView<N, T2, S2> dest, double sigma,
+                                            typename MultiArrayShape<N>::type const & blockShape,
+                                            int threadCount = 1);
+    }
+    \endcode
+*/
+template <unsigned int N, class T1, class S1, class T2, class S2>
+void
+gaussianGradientMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                    MultiArrayView<N, T2, S2> dest, double sigma,
+                                    typename MultiArrayShape<N>::type const & blockShape,
+                                    int threadCount = 1)
+{
+    vigra_precondition(source.shape() == dest.shape(),
+        "gaussianGradientMultiArrayBlockwise(): shape mismatch between input and output.");
+    MultiArrayBlockSink<N, T2, S2> sink(dest);
+    blockwiseFilterMultiArray(MultiArrayBlockSource<N, T1, S1>(source), sink, 
+                              GaussianGradientBlockFilter(sigma), blockShape, threadCount);
+}
+
+/** \brief Blockwise (and possibly parallel) version of \ref hessianOfGaussianMultiArray().
+
+    The result is identical to \ref hessianOfGaussianMultiArray(), but computed 
+    by \ref blockwiseFilterMultiArray() with blocks of the given shape.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        void
+        hessianOfGaussianMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                             MultiArrayView<N, T2, S2> dest, double sigma,
+                                             typename MultiArrayShape<N>::type const & blockShape,
+                                             int threadCount = 1);
+    }
+    \endcode
+*/
+template <unsigned int N, class T1, class S1, class T2, class S2>
+void
+hessianOfGaussianMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                     MultiArrayView<N, T2, S2> dest, double sigma,
+                                     typename MultiArrayShape<N>::type const & blockShape,
+                                     int threadCount = 1)
+{
+    vigra_precondition(source.shape() == dest.shape(),
+        "hessianOfGaussianMultiArrayBlockwise(): shape mismatch between input and output.");
+    MultiArrayBlockSink<N, T2, S2> sink(dest);
+    blockwiseFilterMultiArray(MultiArrayBlockSource<N, T1, S1>(source), sink, 
+                              HessianOfGaussianBlockFilter(sigma), blockShape, threadCount);
+}
+
+/** \brief Blockwise (and possibly parallel) version of \ref structureTensorMultiArray().
+
+    The result is identical to \ref structureTensorMultiArray(), but computed 
+    by \ref blockwiseFilterMultiArray() with blocks of the given shape.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        void
+        structureTensorMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                           MultiArrayView<N, T2, S2> dest, 
+                                           double innerScale, double outerScale,
+                                           typename MultiArrayShape<N>::type const & blockShape,
+                                           int threadCount = 1);
+    }
+    \endcode
+*/
+template <unsigned int N, class T1, class S1, class T2, class S2>
+void
+structureTensorMultiArrayBlockwise(MultiArrayView<N, T1, S1> const & source,
+                                   MultiArrayView<N, T2, S2> dest, 
+                                   double innerScale, double outerScale,
+                                   typename MultiArrayShape<N>::type const & blockShape,
+                                   int threadCount = 1)
+{
+    vigra_precondition(source.shape() == dest.shape(),
+        "structureTensorMultiArrayBlockwise(): shape mismatch between input and output.");
+    MultiArrayBlockSink<N, T2, S2> sink(dest);
+    blockwiseFilterMultiArray(MultiArrayBlockSource<N, T1, S1>(source), sink, 
+                              StructureTensorBlockFilter(innerScale, outerScale), 
+                              blockShape, threadCount);
+}
+
+/********************************************************/
+/*                                                      */
+/*             transformMultiArrayBlockwise             */
+/*                                                      */
+/********************************************************/
+
+/** \brief Apply a point operator to a large array block by block.
+
+    Reads the blocks of <tt>source</tt>, applies <tt>f</tt> to each element
+    by \ref transformMultiArray(), and passes the results to <tt>sink</tt>
+    (see \ref blockwiseFilterMultiArray() for the block source and sink
+    interfaces and the meaning of <tt>threadCount</tt>). Source and sink may 
+    be the same object, so that datasets on disk can be transformed in-place.
+
+    <b> Declaration:</b>
+
+    \code
+    namespace vigra {
+        template <class BlockSource, class BlockSink, class Functor>
+        void
+        transformMultiArrayBlockwise(BlockSource const & source, BlockSink & sink,
+                                     Functor const & f,
+                                     typename BlockSource::shape_type const & blockShape,
+                                     int threadCount = 1);
+    }
+    \endcode
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_blockwise.hxx\><br>
+    <b>\#include</b> \<vigra/hdf5impex.hxx\>
+
+    \code
+    HDF5File file("volume.h5", HDF5File::Open);
+    HDF5Array<3, float> volume(file, "raw");
+    
+    // scale the dataset in-place
+    using namespace vigra::functor;
+    transformMultiArrayBlockwise(volume, volume, Arg1()*Param(2.0f), Shape3(256,256,256));
+    volume.flush();
+    \endcode
+*/
+template <class BlockSource, class BlockSink, class Functor>
+void
+transformMultiArrayBlockwise(BlockSource const & source, BlockSink & sink,
+                             Functor const & f,
+                             typename BlockSource::shape_type const & blockShape,
+                             int threadCount = 1)
+{
+    blockwiseFilterMultiArray(source, sink, TransformBlockFilter<Functor>(f), 
+                              blockShape, threadCount);
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_MULTI_BLOCKWISE_HXX
@@ -0,0 +1,466 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_MULTI_FEATURE_BANK_HXX
+#define VIGRA_MULTI_FEATURE_BANK_HXX
+
+#include <algorithm>
+#include <cmath>
+#include "multi_array.hxx"
+#include "multi_convolution.hxx"
+#include "multi_tensorutilities.hxx"
+#include "array_vector.hxx"
+
+namespace vigra {
+
+/** \addtogroup MultiArrayConvolutionFilters
+*/
+//@{
+
+/********************************************************/
+/*                                                      */
+/*                 MultiArrayFeatureBank                */
+/*                                                      */
+/********************************************************/
+
+/** \brief Compute a set of Gaussian filter features at several scales in one go.
+
+    This class computes the classical pixel features for random forest 
+    classification of N-dimensional scalar arrays. The requested features are 
+    written into the columns of a feature matrix with one row per pixel
+    (in scan order of the array), i.e. in the layout that \ref vigra::RandomForest 
+    expects in <tt>learn()</tt> and <tt>predictProbabilities()</tt>.
+    
+    Available features (number of columns in parentheses):
+    <ul>
+    <li> <tt>GaussianSmoothing</tt>: \ref gaussianSmoothMultiArray() (1)
+    <li> <tt>GaussianGradientMagnitude</tt>: norm of \ref gaussianGradientMultiArray() (1)
+    <li> <tt>LaplacianOfGaussian</tt>: \ref laplacianOfGaussianMultiArray() (1)
+    <li> <tt>HessianOfGaussianEigenvalues</tt>: eigenvalues of 
+         \ref hessianOfGaussianMultiArray() in descending order (N)
+    <li> <tt>StructureTensorEigenvalues</tt>: eigenvalues of 
+         \ref structureTensorMultiArray() in descending order (N). 
+         \ref add() uses the given scale as inner scale and half of it as outer scale,
+         use \ref addStructureTensorEigenvalues() to specify both scales.
+    </ul>
+    
+    In contrast to calling the individual filter functions, all Gaussian 
+    derivatives of the same scale are computed from shared partial results:
+    the separable convolutions are organized as a tree whose inner nodes
+    (the array convolved along the first k dimensions) are reused by all 
+    derivatives with the same orders in these dimensions. For example, all 
+    10 derivatives up to second order of a 3D volume require 19 instead of 30 
+    1D convolution passes. The results are the same as those of the individual 
+    functions (up to round-off in the case of <tt>GaussianSmoothing</tt>, 
+    where the kernel is represented with type <tt>T</tt> instead of <tt>double</tt>). 
+    All temporary arrays are allocated once and reused for all scales and 
+    subsequent calls to \ref compute() with the same shape. The convolutions
+    are parallelized as described in \ref separableConvolveMultiArray().
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_feature_bank.hxx\><br>
+    Namespace: vigra
+
+    \code
+    MultiArray<3, float> volume(shape);
+    ...
+    MultiArrayFeatureBank<3> bank;
+    double scales[] = { 0.7, 1.0, 1.6, 3.5 };
+    for(int k=0; k<4; ++k)
+    {
+        bank.add(MultiArrayFeatureBank<3>::GaussianSmoothing, scales[k]);
+        bank.add(MultiArrayFeatureBank<3>::GaussianGradientMagnitude, scales[k]);
+        bank.add(MultiArrayFeatureBank<3>::HessianOfGaussianEigenvalues, scales[k]);
+    }
+    
+    MultiArray<2, float> features(MultiArrayShape<2>::type(volume.size(), bank.featureCount()));
+    bank.compute(volume, features);
+    
+    MultiArray<2, float> probabilities(MultiArrayShape<2>::type(volume.size(), rf.class_count()));
+    rf.predictProbabilities(features, probabilities);
+    \endcode
+*/
+template <unsigned int N, class T = float>
+class MultiArrayFeatureBank
+{
+  public:
+    enum { M = N*(N+1)/2 };
+    
+        /** The available features.
+        */
+    enum FeatureType { GaussianSmoothing, 
+                       GaussianGradientMagnitude, 
+                       LaplacianOfGaussian,
+                       HessianOfGaussianEigenvalues, 
+                       StructureTensorEigenvalues };
+    
+    typedef T value_type;
+    typedef typename MultiArrayShape<N>::type shape_type;
+    typedef TinyVector<T, N> Vector;
+    typedef TinyVector<T, M> Tensor;
+    typedef TinyVector<int, N> Orders;
+    
+    MultiArrayFeatureBank()
+    : feature_count_(0)
+    {}
+    
+        /** Request a feature at the given scale. The feature's columns
+            follow the columns of the previously requested features.
+        */
+    MultiArrayFeatureBank & add(FeatureType feature, double scale)
+    {
+        return add(feature, scale, 0.5*scale);
+    }
+    
+        /** Request structure tensor eigenvalues with the given inner and outer scale.
+        */
+    MultiArrayFeatureBank & addStructureTensorEigenvalues(double innerScale, double outerScale)
+    {
+        return add(StructureTensorEigenvalues, innerScale, outerScale);
+    }
+    
+        /** Total number of columns of the feature matrix.
+        */
+    int featureCount() const
+    {
+        return feature_count_;
+    }
+    
+        /** Number of requested features.
+        */
+    int size() const
+    {
+        return (int)requests_.size();
+    }
+    
+        /** Number of columns occupied by a feature.
+        */
+    static int columnCount(FeatureType feature)
+    {
+        return feature == HessianOfGaussianEigenvalues || feature == StructureTensorEigenvalues
+                   ? N
+                   : 1;
+    }
+    
+        /** Compute all requested features of <tt>src</tt> and write them into 
+            <tt>features</tt>, which must have shape 
+            <tt>(src.size(), featureCount())</tt>.
+        */
+    template <class U, class S, class C>
+    void compute(MultiArrayView<N, U, S> const & src, MultiArrayView<2, T, C> features);
+    
+  private:
+    struct Request
+    {
+        FeatureType feature;
+        double scale, outer_scale;
+        int column;
+    };
+    
+    MultiArrayFeatureBank & add(FeatureType feature, double scale, double outerScale)
+    {
+        vigra_precondition(scale > 0.0 && outerScale >= 0.0,
+            "MultiArrayFeatureBank::add(): Scale must be positive.");
+        Request r;
+        r.feature = feature;
+        r.scale = scale;
+        r.outer_scale = outerScale;
+        r.column = feature_count_;
+        requests_.push_back(r);
+        feature_count_ += columnCount(feature);
+        return *this;
+    }
+    
+    template <class C>
+    static MultiArrayView<N, T, StridedArrayTag> 
+    column(MultiArrayView<2, T, C> features, int c, shape_type const & shape)
+    {
+        shape_type stride;
+        stride[0] = features.stride(0);
+        for(unsigned int k=1; k<N; ++k)
+            stride[k] = stride[k-1]*shape[k-1];
+        return MultiArrayView<N, T, StridedArrayTag>(shape, stride, &features(0, c));
+    }
+    
+    template <class C>
+    void copyChannels(MultiArrayView<N, Vector, UnstridedArrayTag> const & src, 
+                      MultiArrayView<2, T, C> features, int c)
+    {
+        for(unsigned int k=0; k<N; ++k)
+        {
+            MultiArrayView<N, T, StridedArrayTag> dest = column(features, c+k, src.shape());
+            copyMultiArray(srcMultiArrayRange(src, VectorElementAccessor<VectorAccessor<Vector> >(k)),
+                           destMultiArray(dest));
+        }
+    }
+    
+    ArrayVector<Request> requests_;
+    int feature_count_;
+    
+    // scratch arrays, reused between scales and calls
+    ArrayVector<MultiArray<N, T> > levels_;
+    MultiArray<N, Vector> gradient_, eigenvalues_;
+    MultiArray<N, Tensor> hessian_, tensor_;
+};
+
+template <unsigned int N, class T>
+template <class U, class S, class C>
+void 
+MultiArrayFeatureBank<N, T>::compute(MultiArrayView<N, U, S> const & src, 
+                                     MultiArrayView<2, T, C> features)
+{
+    using namespace functor;
+    typedef typename NumericTraits<T>::RealPromote KernelType;
+    
+    shape_type shape(src.shape());
+    vigra_precondition(features.shape(0) == src.size() && features.shape(1) == feature_count_,
+        "MultiArrayFeatureBank::compute(): feature matrix has wrong shape.");
+    if(src.size() == 0)
+        return;
+    
+    levels_.resize(N);
+    for(unsigned int k=0; k<N; ++k)
+        if(levels_[k].shape() != shape)
+            levels_[k].reshape(shape);
+    
+    // collect the distinct scales of the Gaussian derivatives 
+    // (the inner scale in case of the structure tensor)
+    ArrayVector<double> scales;
+    for(unsigned int r=0; r<requests_.size(); ++r)
+        if(std::find(scales.begin(), scales.end(), requests_[r].scale) == scales.end())
+            scales.push_back(requests_[r].scale);
+    
+    for(unsigned int s=0; s<scales.size(); ++s)
+    {
+        double scale = scales[s];
+        bool needSmoothing = false, needGradient = false, needHessian = false;
+        for(unsigned int r=0; r<requests_.size(); ++r)
+        {
+            if(requests_[r].scale != scale)
+                continue;
+            switch(requests_[r].feature)
+            {
+              case GaussianSmoothing:
+                needSmoothing = true;
+                break;
+              case GaussianGradientMagnitude:
+              case StructureTensorEigenvalues:
+                needGradient = true;
+                break;
+              case LaplacianOfGaussian:
+              case HessianOfGaussianEigenvalues:
+                needHessian = true;
+                break;
+            }
+        }
+        
+        // the derivatives to compute, and where to put them
+        ArrayVector<Orders> leaves;
+        ArrayVector<int> channels;
+        if(needSmoothing)
+        {
+            leaves.push_back(Orders(0));
+            channels.push_back(-1);
+        }
+        if(needGradient)
+        {
+            if(gradient_.shape() != shape)
+                gradient_.reshape(shape);
+            for(unsigned int i=0; i<N; ++i)
+            {
+                Orders o(0);
+                o[i] = 1;
+                leaves.push_back(o);
+                channels.push_back(i);
+            }
+        }
+        if(needHessian)
+        {
+            if(hessian_.shape() != shape)
+                hessian_.reshape(shape);
+            for(unsigned int b=0, i=0; i<N; ++i)
+            {
+                for(unsigned int j=i; j<N; ++j, ++b)
+                {
+                    Orders o(0);
+                    ++o[i];
+                    ++o[j];
+                    leaves.push_back(o);
+                    channels.push_back(b);
+                }
+            }
+        }
+        
+        Kernel1D<KernelType> kernels[3];
+        kernels[0].initGaussian(scale);
+        kernels[1].initGaussianDerivative(scale, 1);
+        kernels[2].initGaussianDerivative(scale, 2);
+        
+        // traverse the derivatives such that each node of the convolution 
+        // tree is computed only once: 'levels_[k]' holds the array convolved 
+        // along dimensions 0...k with the kernels given by 'current[0...k]'
+        Orders current(-1);
+        for(int leaf = 0; leaf < (int)leaves.size(); ++leaf)
+        {
+            // find the best leaf to compute next (longest common prefix with the current one)
+            int best = leaf, bestPrefix = -1;
+            for(int l = leaf; l < (int)leaves.size(); ++l)
+            {
+                int prefix = 0;
+                while(prefix < (int)N && leaves[l][prefix] == current[prefix])
+                    ++prefix;
+                if(prefix > bestPrefix)
+                {
+                    best = l;
+                    bestPrefix = prefix;
+                }
+            }
+            std::swap(leaves[leaf], leaves[best]);
+            std::swap(channels[leaf], channels[best]);
+            
+            Orders const & o = leaves[leaf];
+            for(int k = bestPrefix; k < (int)N; ++k)
+            {
+                if(k == 0)
+                    convolveMultiArrayOneDimension(srcMultiArrayRange(src), 
+                                                   destMultiArray(levels_[0]),
+                                                   0, kernels[o[0]]);
+                else
+                    convolveMultiArrayOneDimension(srcMultiArrayRange(levels_[k-1]), 
+                                                   destMultiArray(levels_[k]),
+                                                   k, kernels[o[k]]);
+                current[k] = o[k];
+            }
+            
+            MultiArray<N, T> const & result = levels_[N-1];
+            int order = 0;
+            for(unsigned int k=0; k<N; ++k)
+                order += o[k];
+            if(order == 0)
+            {
+                for(unsigned int r=0; r<requests_.size(); ++r)
+                {
+                    if(requests_[r].scale == scale && requests_[r].feature == GaussianSmoothing)
+                    {
+                        MultiArrayView<N, T, StridedArrayTag> dest = column(features, requests_[r].column, shape);
+                        dest = result;
+                    }
+                }
+            }
+            else if(order == 1)
+            {
+                copyMultiArray(srcMultiArrayRange(result), 
+                               destMultiArray(gradient_, VectorElementAccessor<VectorAccessor<Vector> >(channels[leaf])));
+            }
+            else
+            {
+                copyMultiArray(srcMultiArrayRange(result), 
+                               destMultiArray(hessian_, VectorElementAccessor<VectorAccessor<Tensor> >(channels[leaf])));
+            }
+        }
+        
+        // derive the features from the derivatives
+        bool hessianEigenvaluesDone = false;
+        for(unsigned int r=0; r<requests_.size(); ++r)
+        {
+            if(requests_[r].scale != scale)
+                continue;
+            int c = requests_[r].column;
+            switch(requests_[r].feature)
+            {
+              case GaussianGradientMagnitude:
+              {
+                MultiArrayView<N, T, StridedArrayTag> dest = column(features, c, shape);
+                transformMultiArray(srcMultiArrayRange(gradient_), destMultiArray(dest), 
+                                    norm(Arg1()));
+                break;
+              }
+              case LaplacianOfGaussian:
+              {
+                // same order of summation as in laplacianOfGaussianMultiArray()
+                MultiArrayView<N, T, StridedArrayTag> dest = column(features, c, shape);
+                for(unsigned int b=0, i=0; i<N; b += N-i, ++i)
+                {
+                    if(i == 0)
+                        copyMultiArray(srcMultiArrayRange(hessian_, VectorElementAccessor<VectorAccessor<Tensor> >(b)),
+                                       destMultiArray(dest));
+                    else
+                        combineTwoMultiArrays(srcMultiArrayRange(dest), 
+                                              srcMultiArray(hessian_, VectorElementAccessor<VectorAccessor<Tensor> >(b)),
+                                              destMultiArray(dest), Arg1() + Arg2());
+                }
+                break;
+              }
+              case HessianOfGaussianEigenvalues:
+              {
+                if(!hessianEigenvaluesDone)
+                {
+                    if(eigenvalues_.shape() != shape)
+                        eigenvalues_.reshape(shape);
+                    tensorEigenvaluesMultiArray(srcMultiArrayRange(hessian_), destMultiArray(eigenvalues_));
+                    hessianEigenvaluesDone = true;
+                }
+                copyChannels(eigenvalues_, features, c);
+                break;
+              }
+              case StructureTensorEigenvalues:
+              {
+                // same as structureTensorMultiArray()
+                if(tensor_.shape() != shape)
+                    tensor_.reshape(shape);
+                if(eigenvalues_.shape() != shape)
+                    eigenvalues_.reshape(shape);
+                transformMultiArray(srcMultiArrayRange(gradient_), destMultiArray(tensor_), 
+                                    detail::StructurTensorFunctor<N, Tensor>());
+                gaussianSmoothMultiArray(srcMultiArrayRange(tensor_), destMultiArray(tensor_), 
+                                         requests_[r].outer_scale);
+                tensorEigenvaluesMultiArray(srcMultiArrayRange(tensor_), destMultiArray(eigenvalues_));
+                hessianEigenvaluesDone = false;
+                copyChannels(eigenvalues_, features, c);
+                break;
+              }
+              default:
+                break;
+            }
+        }
+    }
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_MULTI_FEATURE_BANK_HXX
@@ -49,6 +49,8 @@
 #include "impex.hxx"
 #include "multi_array.hxx"
 #include "multi_pointoperators.hxx"
+#include "mapped_multi_array.hxx"
+#include "threading.hxx"
 
 #ifdef _MSC_VER
 # include <direct.h>
@@ -56,6 +58,12 @@
 # include <unistd.h>
 #endif
 
+#ifdef _WIN32
+# include "windows.h"
+#else
+# include <sys/time.h>
+#endif
+
 namespace vigra {
 
 /** \addtogroup VolumeImpex Import/export of volume data.
@@ -63,6 +71,76 @@ namespace vigra {
 
 //@{
 
+/** \brief Throughput of a volume import or export.
+
+    Filled by the variants of \ref importVolume() and \ref exportVolume() that 
+    accept a thread count.
+
+    <b>\#include</b> \<vigra/multi_impex.hxx\><br>
+    Namespace: vigra
+**/
+struct VolumeIOStatistics
+{
+    VolumeIOStatistics()
+    : slices(0), threads(0), megabytes(0.0), seconds(0.0)
+    {}
+
+        /** Slices per second.
+         **/
+    double slicesPerSecond() const
+    {
+        return seconds > 0.0 ? slices / seconds : 0.0;
+    }
+
+        /** Megabytes (of the volume in memory) per second.
+         **/
+    double megabytesPerSecond() const
+    {
+        return seconds > 0.0 ? megabytes / seconds : 0.0;
+    }
+
+        /// number of slices read or written
+    MultiArrayIndex slices;
+        /// number of threads used
+    int threads;
+        /// size of the volume in memory
+    double megabytes;
+        /// elapsed (wall clock) time
+    double seconds;
+};
+
+namespace detail {
+
+    // wall clock time in seconds
+inline double volumeIOClock()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + t.tv_usec / 1000000.0;
+#endif
+}
+
+template <class T>
+inline void
+setVolumeIOStatistics(VolumeIOStatistics * statistics, MultiArrayShape<3>::type const & shape,
+                      int threads, double startTime)
+{
+    if(statistics == 0)
+        return;
+    statistics->slices = shape[2];
+    statistics->threads = threads;
+    statistics->megabytes = prod(shape) * (double)sizeof(T) / (1024.0*1024.0);
+    statistics->seconds = volumeIOClock() - startTime;
+}
+
+} // namespace detail
+
 /** \brief Argument object for the function importVolume().
 
     See \ref importVolume() for usage example. This object can be used
@@ -162,11 +240,18 @@ class VolumeImportInfo
     VIGRA_EXPORT const std::string &description() const;
 
     template <class T, class Stride>
-    void importImpl(MultiArrayView <3, T, Stride> &volume) const;
+    void importImpl(MultiArrayView <3, T, Stride> &volume, int threadCount = 1,
+                    VolumeIOStatistics * statistics = 0) const;
+
+    template <class T>
+    void mapImpl(MappedMultiArray<3, T> &volume) const;
 
   protected:
     void getVolumeInfoFromFirstSlice(const std::string &filename);
 
+    template <class T, class Stride>
+    void importSlice(MultiArrayView <3, T, Stride> &volume, int i) const;
+
     size_type shape_;
     Resolution resolution_;
     //PixelType pixelType_;
@@ -380,107 +465,72 @@ class VolumeExportInfo
     double fromMin_, fromMax_, toMin_, toMax_;
 };
 
-namespace detail {
-
-template <class DestIterator, class Shape, class T>
-inline void
-readVolumeImpl(DestIterator d, Shape const & shape, std::ifstream & s, ArrayVector<T> & buffer, MetaInt<0>)
-{
-    s.read((char*)buffer.begin(), shape[0]*sizeof(T));
-
-    DestIterator dend = d + shape[0];
-    int k = 0;
-    for(; d < dend; ++d, k++)
-    {
-        *d = buffer[k];
-    }
-}
-
-template <class DestIterator, class Shape, class T, int N>
-void
-readVolumeImpl(DestIterator d, Shape const & shape, std::ifstream & s, ArrayVector<T> & buffer, MetaInt<N>)
-{
-    DestIterator dend = d + shape[N];
-    for(; d < dend; ++d)
-    {
-        readVolumeImpl(d.begin(), shape, s, buffer, MetaInt<N-1>());
-    }
-}
-
-} // namespace detail
 
 template <class T, class Stride>
-void VolumeImportInfo::importImpl(MultiArrayView <3, T, Stride> &volume) const
+void VolumeImportInfo::importImpl(MultiArrayView <3, T, Stride> &volume, int threadCount,
+                                  VolumeIOStatistics * statistics) const
 {
     vigra_precondition(this->shape() == volume.shape(), "importVolume(): Volume must be shaped according to VolumeImportInfo.");
 
+    double startTime = detail::volumeIOClock();
+    threadCount = actualThreadCount(threadCount);
+    int sliceCount = (int)numbers_.size();
+
     if(rawFilename_.size())
     {
-        std::string dirName, baseName;
-        char oldCWD[2048];
-
-#ifdef _MSC_VER
-        if(_getcwd(oldCWD, 2048) == 0)
-        {
-            perror("getcwd");
-            vigra_fail("VolumeImportInfo: Unable to query current directory (getcwd).");
-        }
-        if(_chdir(path_.c_str()))
-        {
-            perror("chdir");
-            vigra_fail("VolumeImportInfo: Unable to change to new directory (chdir).");
-        }
-#else
-        if(getcwd(oldCWD, 2048) == 0)
-        {
-            perror("getcwd");
-            vigra_fail("VolumeImportInfo: Unable to query current directory (getcwd).");
-        }
-        if(chdir(path_.c_str()))
-        {
-            perror("chdir");
-            vigra_fail("VolumeImportInfo: Unable to change to new directory (chdir).");
-        }
-#endif
-
-        std::ifstream s(rawFilename_.c_str(), std::ios::binary);
-        vigra_precondition(s.good(), "RAW file could not be opened");
-
-        ArrayVector<T> buffer(shape_[0]);
-        detail::readVolumeImpl(volume.traverser_begin(), shape_, s, buffer, vigra::MetaInt<2>());
-
-        //vigra_precondition(s.good(), "RAW file could not be opened");
-        //s.read((char*)volume.data(), shape_[0]*shape_[1]*shape_[2]*sizeof(T));
-
-#ifdef _MSC_VER
-        if(_chdir(oldCWD))
-            perror("chdir");
-#else
-        if(chdir(oldCWD))
-            perror("chdir");
-#endif
-
-        vigra_postcondition(
-            volume.shape() == shape(), "imported volume has wrong size");
+        // the pages are read only once, while they are copied
+        MappedMultiArray<3, T> raw;
+        mapImpl(raw);
+        volume = raw;
+        threadCount = 1;
+    }
+    else if(threadCount == 1 || sliceCount < 2)
+    {
+        for (int i = 0; i < sliceCount; ++i)
+            importSlice(volume, i);
+        threadCount = 1;
     }
     else
     {
-        for (unsigned int i = 0; i < numbers_.size(); ++i)
+        // every thread decodes one slice at a time, so that the number of 
+        // decoders (and their buffers) is bounded by the thread count
+        ThreadExceptionCollector errors;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+#endif
+        for (int i = 0; i < sliceCount; ++i)
         {
-            // build the filename
-            std::string name = baseName_ + numbers_[i] + extension_;
+            try
+            {
+                if(errors.failed())
+                    continue;
+                importSlice(volume, i);
+            }
+            catch(std::exception & e)
+            {
+                errors.capture(e);
+            }
+        }
+        errors.rethrow();
+    }
+    detail::setVolumeIOStatistics<T>(statistics, volume.shape(), threadCount, startTime);
+}
 
-            // import the image
-            ImageImportInfo info (name.c_str ());
+template <class T, class Stride>
+void VolumeImportInfo::importSlice(MultiArrayView <3, T, Stride> &volume, int i) const
+{
+    // build the filename
+    std::string name = baseName_ + numbers_[i] + extension_;
 
-            // generate a basic image view to the current layer
-            MultiArrayView <2, T, Stride> view (volume.bindOuter (i));
-            vigra_precondition(view.shape() == info.shape(),
-                "importVolume(): the images have inconsistent sizes.");
+    // import the image
+    ImageImportInfo info (name.c_str ());
 
-            importImage (info, destImage(view));
-        }
-    }
+    // generate a basic image view to the current layer
+    MultiArrayView <2, T, Stride> view (volume.bindOuter (i));
+    vigra_precondition(view.shape() == info.shape(),
+        "importVolume(): the images have inconsistent sizes.");
+
+    importImage (info, destImage(view));
 }
 
 
@@ -588,6 +638,92 @@ void importVolume(VolumeImportInfo const & info, MultiArrayView <3, T, Stride> &
     info.importImpl(volume);
 }
 
+/** \brief Function for importing a 3D volume with several threads.
+
+    Same as <tt>importVolume(info, volume)</tt>, but the slices of an image 
+    sequence are decoded concurrently by <tt>threadCount</tt> threads (negative:
+    all available threads, see \ref ParallelProcessing), each 
+    writing directly into its slice of <tt>volume</tt>. Since every thread works on
+    one slice at a time, at most <tt>threadCount</tt> decoders are active 
+    simultaneously. Without OpenMP, the slices are read sequentially. 
+    Raw volumes are always read by a single thread.
+    
+    If <tt>statistics</tt> is not zero, the number of slices, the size of the 
+    volume and the elapsed time are stored there (see \ref vigra::VolumeIOStatistics).
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_impex.hxx\>
+
+    \code
+    VolumeImportInfo info("stack/slice_0000.tif");
+    MultiArray<3, UInt16> volume(info.shape());
+    
+    VolumeIOStatistics statistics;
+    importVolume(info, volume, 8, &statistics);
+    std::cout << statistics.megabytesPerSecond() << " MB/s\n";
+    \endcode
+
+    Namespace: vigra
+*/
+template <class T, class Stride>
+void importVolume(VolumeImportInfo const & info, MultiArrayView <3, T, Stride> &volume,
+                  int threadCount, VolumeIOStatistics * statistics = 0)
+{
+    info.importImpl(volume, threadCount, statistics);
+}
+
+template <class T>
+void VolumeImportInfo::mapImpl(MappedMultiArray<3, T> &volume) const
+{
+    vigra_precondition(rawFilename_.size() > 0,
+        "mapVolume(): only raw volumes (described by an info file) can be mapped.");
+
+    // relative names refer to the directory of the info file
+    std::string filename(rawFilename_);
+    if(filename[0] != '/' && filename[0] != '\\' && 
+       !(filename.size() > 1 && filename[1] == ':'))
+        filename = path_ + "/" + filename;
+
+    volume.map(filename, shape_);
+}
+
+/********************************************************/
+/*                                                      */
+/*                      mapVolume                       */
+/*                                                      */
+/********************************************************/
+
+/** \brief Map a raw volume into memory instead of importing it.
+
+    The volume must be described by an info file (see \ref importVolume()).
+    Instead of reading the raw voxel data into an array, the file is mapped into
+    memory, so that <tt>volume</tt> becomes a \ref vigra::MultiArrayView directly 
+    over the file's contents (see \ref vigra::MappedMultiArray). This takes 
+    almost no time regardless of the volume size, and only the pages 
+    that are actually accessed are read from disk. As with \ref importVolume(), 
+    the voxel type in the file must be binary compatible to <tt>T</tt>.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_impex.hxx\>
+
+    \code
+    VolumeImportInfo info("volume.info");
+    MappedMultiArray<3, UInt8> volume;
+    mapVolume(info, volume);
+    
+    std::cout << (int)volume(10, 20, 30) << "\n";
+    \endcode
+
+    Namespace: vigra
+*/
+template <class T>
+void mapVolume(VolumeImportInfo const & info, MappedMultiArray<3, T> &volume)
+{
+    info.mapImpl(volume);
+}
+
 namespace detail {
 
 template <class T>
@@ -658,6 +794,26 @@ void setRangeMapping(MultiArrayView <3, T, Tag> const & volume,
     }
 }
 
+template <class T, class Tag>
+void exportVolumeSlice(MultiArrayView <3, T, Tag> const & volume,
+                       const VolumeExportInfo & volinfo,
+                       ImageExportInfo const & prototype, int numlen, int i)
+{
+    // build the filename
+    std::stringstream stream;
+    stream << std::setfill ('0') << std::setw (numlen) << i;
+    std::string name_num;
+    stream >> name_num;
+    std::string name = std::string(volinfo.getFileNameBase()) + name_num + std::string(volinfo.getFileNameExt());
+
+    MultiArrayView <2, T, Tag> view (volume.bindOuter (i));
+
+    // export the image
+    ImageExportInfo info(prototype);
+    info.setFileName(name.c_str ());
+    exportImage(srcImageRange(view), info);
+}
+
 } // namespace detail
 
 /********************************************************/
@@ -684,30 +840,71 @@ template <class T, class Tag>
 void exportVolume (MultiArrayView <3, T, Tag> const & volume,
                    const VolumeExportInfo & volinfo)
 {
-    std::string name = std::string(volinfo.getFileNameBase()) + std::string(volinfo.getFileNameExt());
-    ImageExportInfo info(name.c_str());
-    info.setCompression(volinfo.getCompression());
-    info.setPixelType(volinfo.getPixelType());
-    detail::setRangeMapping(volume, info, typename NumericTraits<T>::isScalar());
+    exportVolume(volume, volinfo, 1);
+}
 
-    const unsigned int depth = volume.shape (2);
-    int numlen = static_cast <int> (std::ceil (std::log10 ((double)depth)));
-    for (unsigned int i = 0; i < depth; ++i)
-    {
+/** \brief Function for exporting a 3D volume with several threads.
 
-        // build the filename
-        std::stringstream stream;
-        stream << std::setfill ('0') << std::setw (numlen) << i;
-        std::string name_num;
-        stream >> name_num;
-        std::string name = std::string(volinfo.getFileNameBase()) + name_num + std::string(volinfo.getFileNameExt());
+    Same as <tt>exportVolume(volume, volinfo)</tt>, but the slices are encoded 
+    concurrently by <tt>threadCount</tt> threads (negative: all 
+    available threads, see \ref ParallelProcessing). At most <tt>threadCount</tt> 
+    encoders are active simultaneously. Without OpenMP, the slices are written 
+    sequentially. The range mapping (if any) is determined from the entire 
+    volume beforehand, so the files are identical to those written sequentially.
 
-        MultiArrayView <2, T, Tag> view (volume.bindOuter (i));
+    If <tt>statistics</tt> is not zero, the number of slices, the size of the 
+    volume and the elapsed time are stored there (see \ref vigra::VolumeIOStatistics).
 
-        // export the image
-        info.setFileName(name.c_str ());
-        exportImage(srcImageRange(view), info); 
+    <b>\#include</b>
+    \<vigra/multi_impex.hxx\>
+
+    Namespace: vigra
+*/
+template <class T, class Tag>
+void exportVolume (MultiArrayView <3, T, Tag> const & volume,
+                   const VolumeExportInfo & volinfo,
+                   int threadCount, VolumeIOStatistics * statistics = 0)
+{
+    double startTime = detail::volumeIOClock();
+    threadCount = actualThreadCount(threadCount);
+
+    std::string name = std::string(volinfo.getFileNameBase()) + std::string(volinfo.getFileNameExt());
+    ImageExportInfo prototype(name.c_str());
+    prototype.setCompression(volinfo.getCompression());
+    prototype.setPixelType(volinfo.getPixelType());
+    detail::setRangeMapping(volume, prototype, typename NumericTraits<T>::isScalar());
+
+    const int depth = volume.shape (2);
+    int numlen = static_cast <int> (std::ceil (std::log10 ((double)depth)));
+
+    if(threadCount == 1 || depth < 2)
+    {
+        for (int i = 0; i < depth; ++i)
+            detail::exportVolumeSlice(volume, volinfo, prototype, numlen, i);
+        threadCount = 1;
+    }
+    else
+    {
+        ThreadExceptionCollector errors;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(threadCount)
+#endif
+        for (int i = 0; i < depth; ++i)
+        {
+            try
+            {
+                if(errors.failed())
+                    continue;
+                detail::exportVolumeSlice(volume, volinfo, prototype, numlen, i);
+            }
+            catch(std::exception & e)
+            {
+                errors.capture(e);
+            }
+        }
+        errors.rethrow();
     }
+    detail::setVolumeIOStatistics<T>(statistics, volume.shape(), threadCount, startTime);
 }
 
 // for backward compatibility
@@ -0,0 +1,1224 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2011-2012 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_MULTI_WATERSHEDS_HXX
+#define VIGRA_MULTI_WATERSHEDS_HXX
+
+#include <queue>
+#include <vector>
+#include <functional>
+#include "multi_array.hxx"
+#include "array_vector.hxx"
+#include "bucket_queue.hxx"
+#include "union_find.hxx"
+#include "seededregiongrowing.hxx"
+#include "watersheds.hxx"
+
+namespace vigra {
+
+/** \brief Choose the neighborhood system of an N-dimensional algorithm.
+
+    <tt>DirectNeighborhood</tt> means the 2*N neighbors along the axes (4-neighborhood
+    in 2D, 6-neighborhood in 3D), <tt>IndirectNeighborhood</tt> additionally includes
+    the diagonal neighbors, i.e. 3^N-1 neighbors (8-neighborhood in 2D, 26-neighborhood in 3D).
+*/
+enum NeighborhoodType { DirectNeighborhood = 0, IndirectNeighborhood = 1 };
+
+namespace detail {
+
+    // Neighbor offsets of the given neighborhood type in scan order,
+    // so that the first half of the list points backwards.
+template <unsigned int N>
+ArrayVector<typename MultiArrayShape<N>::type>
+neighborhoodDiffs(NeighborhoodType neighborhood)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    ArrayVector<Shape> diffs;
+    Shape diff(MultiArrayIndex(-1));
+    for(;;)
+    {
+        int nonzero = 0;
+        for(unsigned int d=0; d<N; ++d)
+            if(diff[d] != 0)
+                ++nonzero;
+        if(nonzero == 1 || (nonzero > 1 && neighborhood == IndirectNeighborhood))
+            diffs.push_back(diff);
+
+        unsigned int d = 0;
+        for(; d<N; ++d)
+        {
+            if(++diff[d] <= 1)
+                break;
+            diff[d] = -1;
+        }
+        if(d == N)
+            break;
+    }
+    return diffs;
+}
+
+/* Precomputed neighbor offset tables for an array of the given shape.
+   Pixels are identified by their scan-order index. Pixels far enough from
+   the border (isInside()) have all neighbors, the others must be checked
+   individually by isValid().
+*/
+template <unsigned int N>
+class MultiArrayNeighborhood
+{
+  public:
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    MultiArrayNeighborhood(Shape const & shape, ArrayVector<Shape> const & diffs)
+    : shape_(shape),
+      diffs_(diffs),
+      offsets_(diffs.size()),
+      lower_(MultiArrayIndex(0)),
+      upper_(shape)
+    {
+        Shape stride = defaultStride<N>(shape);
+        for(unsigned int k=0; k<diffs_.size(); ++k)
+        {
+            vigra_precondition(diffs_[k] != Shape(MultiArrayIndex(0)),
+                "MultiArrayNeighborhood: neighbor offsets must be non-zero.");
+            bool symmetric = false;
+            for(unsigned int j=0; j<diffs_.size() && !symmetric; ++j)
+                symmetric = (diffs_[j] == -diffs_[k]);
+            vigra_precondition(symmetric,
+                "MultiArrayNeighborhood: neighborhood must be symmetric.");
+
+            offsets_[k] = dot(diffs_[k], stride);
+            for(unsigned int d=0; d<N; ++d)
+            {
+                lower_[d] = std::max(lower_[d], -diffs_[k][d]);
+                upper_[d] = std::min(upper_[d], shape_[d] - diffs_[k][d]);
+            }
+        }
+    }
+
+    unsigned int size() const
+    {
+        return diffs_.size();
+    }
+
+    Shape const & shape() const
+    {
+        return shape_;
+    }
+
+    Shape const & diff(unsigned int k) const
+    {
+        return diffs_[k];
+    }
+
+        // offset of neighbor k in scan order
+    MultiArrayIndex offset(unsigned int k) const
+    {
+        return offsets_[k];
+    }
+
+        // memory offsets of the neighbors in an array with the given strides
+    ArrayVector<MultiArrayIndex> offsets(Shape const & stride) const
+    {
+        ArrayVector<MultiArrayIndex> res(diffs_.size());
+        for(unsigned int k=0; k<diffs_.size(); ++k)
+            res[k] = dot(diffs_[k], stride);
+        return res;
+    }
+
+    void coordinate(MultiArrayIndex index, Shape & p) const
+    {
+        ScanOrderToCoordinate<N>::exec(index, shape_, p);
+    }
+
+    void increment(Shape & p) const
+    {
+        for(unsigned int d=0; d<N; ++d)
+        {
+            if(++p[d] < shape_[d])
+                return;
+            p[d] = 0;
+        }
+    }
+
+    bool isInside(Shape const & p) const
+    {
+        for(unsigned int d=0; d<N; ++d)
+            if(p[d] < lower_[d] || p[d] >= upper_[d])
+                return false;
+        return true;
+    }
+
+    bool isValid(Shape const & p, unsigned int k) const
+    {
+        for(unsigned int d=0; d<N; ++d)
+        {
+            MultiArrayIndex c = p[d] + diffs_[k][d];
+            if(c < 0 || c >= shape_[d])
+                return false;
+        }
+        return true;
+    }
+
+  private:
+    Shape shape_;
+    ArrayVector<Shape> diffs_;
+    ArrayVector<MultiArrayIndex> offsets_;
+    Shape lower_, upper_;
+};
+
+    // Connected components of the non-zero pixels in 'labels', labeled in place
+    // by consecutive integers. Returns the number of components.
+template <unsigned int N, class T, class S>
+unsigned int
+labelMultiArrayWithBackgroundInPlace(MultiArrayView<N, T, S> labels,
+                                     MultiArrayNeighborhood<N> const & neighborhood)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    ArrayVector<MultiArrayIndex> loffsets = neighborhood.offsets(labels.stride());
+    MultiArrayIndex count = labels.elementCount();
+    T * l = labels.data();
+    UnionFindArray<T> regions;
+
+    Shape p(MultiArrayIndex(0));
+    for(MultiArrayIndex i=0; i<count; ++i, neighborhood.increment(p))
+    {
+        MultiArrayIndex o = dot(p, labels.stride());
+        if(l[o] == 0)
+            continue;
+
+        bool inside = neighborhood.isInside(p);
+        T current = regions.nextFreeLabel();
+        for(unsigned int k=0; k<neighborhood.size(); ++k)
+        {
+            if(neighborhood.offset(k) > 0 || (!inside && !neighborhood.isValid(p, k)))
+                continue;
+            T n = l[o + loffsets[k]];
+            if(n != 0)
+                current = regions.makeUnion(n, current);
+        }
+        l[o] = regions.finalizeLabel(current);
+    }
+
+    unsigned int count_regions = regions.makeContiguous();
+
+    p = Shape(MultiArrayIndex(0));
+    for(MultiArrayIndex i=0; i<count; ++i, neighborhood.increment(p))
+    {
+        T & v = l[dot(p, labels.stride())];
+        if(v != 0)
+            v = regions[v];
+    }
+    return count_regions;
+}
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+unsigned int
+generateWatershedSeedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                                 MultiArrayView<N, T2, S2> seeds,
+                                 MultiArrayNeighborhood<N> const & neighborhood,
+                                 SeedOptions const & options)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    vigra_precondition(options.mini != SeedOptions::LevelSets ||
+                       options.thresholdIsValid<T1>(),
+        "generateWatershedSeeds(): SeedOptions.levelSets() must be specified with threshold.");
+    vigra_precondition(options.mini != SeedOptions::ExtendedMinima,
+        "generateWatershedSeeds(): Option 'extendedMinima' is not implemented for arbitrary dimensions,\n"
+        "               use the 2D or 3D versions.");
+
+    ArrayVector<MultiArrayIndex> soffsets = neighborhood.offsets(data.stride());
+    MultiArrayIndex count = data.elementCount();
+    T1 const * s = data.data();
+    T2 * l = seeds.data();
+
+    // mark the seed pixels with 1
+    Shape p(MultiArrayIndex(0));
+    for(MultiArrayIndex i=0; i<count; ++i, neighborhood.increment(p))
+    {
+        MultiArrayIndex o = dot(p, data.stride());
+        T1 v = s[o];
+        bool isSeed = true;
+        if(options.mini == SeedOptions::LevelSets)
+        {
+            isSeed = v <= options.thresh;
+        }
+        else
+        {
+            isSeed = v < options.thresh;
+            bool inside = neighborhood.isInside(p);
+            for(unsigned int k=0; k<neighborhood.size() && isSeed; ++k)
+            {
+                if(!inside && !neighborhood.isValid(p, k))
+                    continue;
+                isSeed = v < s[o + soffsets[k]];
+            }
+        }
+        l[dot(p, seeds.stride())] = isSeed ? 1 : 0;
+    }
+
+    return labelMultiArrayWithBackgroundInPlace(seeds, neighborhood);
+}
+
+    // Priority queue of the exact algorithm. As in seededRegionGrowing(),
+    // pixels with equal cost are ordered by their squared distance to the
+    // seed ('nearest') the candidate was grown from, then by insertion order.
+template <class CostType, class LabelType>
+class MultiWatershedHeap
+{
+  public:
+    static const bool useDistance = true;
+
+    struct Candidate
+    {
+        Candidate(MultiArrayIndex index, MultiArrayIndex nearest, LabelType label,
+                  CostType cost, MultiArrayIndex dist, MultiArrayIndex count)
+        : index_(index), nearest_(nearest), label_(label),
+          cost_(cost), dist_(dist), count_(count)
+        {}
+
+        bool operator>(Candidate const & other) const
+        {
+            if(other.cost_ == cost_)
+            {
+                if(other.dist_ == dist_)
+                    return other.count_ < count_;
+                return other.dist_ < dist_;
+            }
+            return other.cost_ < cost_;
+        }
+
+        MultiArrayIndex index_, nearest_;
+        LabelType label_;
+        CostType cost_;
+        MultiArrayIndex dist_, count_;
+    };
+
+    MultiWatershedHeap()
+    : count_(0)
+    {}
+
+    bool empty() const
+    {
+        return heap_.empty();
+    }
+
+    Candidate const & top() const
+    {
+        return heap_.top();
+    }
+
+    void pop()
+    {
+        heap_.pop();
+    }
+
+    void push(MultiArrayIndex index, MultiArrayIndex nearest, LabelType label,
+              CostType cost, MultiArrayIndex dist)
+    {
+        heap_.push(Candidate(index, nearest, label, cost, dist, count_++));
+    }
+
+  private:
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > heap_;
+    MultiArrayIndex count_;
+};
+
+    // Priority queue for SRGType 'QuantizedCosts': costs are rounded
+    // to integers, equal costs are processed in the order of insertion.
+template <class CostType, class LabelType>
+class MultiWatershedBuckets
+{
+  public:
+    static const bool useDistance = false;
+
+    struct Candidate
+    {
+        Candidate(MultiArrayIndex index = 0, LabelType label = 0)
+        : index_(index), nearest_(0), label_(label), cost_(0)
+        {}
+
+        MultiArrayIndex index_, nearest_;
+        LabelType label_;
+        std::ptrdiff_t cost_;
+    };
+
+    MultiWatershedBuckets()
+    : queue_(SeedRgBucketCount<CostType>::value)
+    {}
+
+    bool empty() const
+    {
+        return queue_.empty();
+    }
+
+    Candidate top() const
+    {
+        Candidate c = queue_.top();
+        c.cost_ = queue_.topPriority();
+        return c;
+    }
+
+    void pop()
+    {
+        queue_.pop();
+    }
+
+    void push(MultiArrayIndex index, MultiArrayIndex, LabelType label,
+              CostType cost, MultiArrayIndex)
+    {
+        queue_.push(Candidate(index, label), seedRgBucket(cost));
+    }
+
+  private:
+    BucketQueue<Candidate, true> queue_;
+};
+
+    // Seeded region growing on MultiArrayViews, see seededRegionGrowing() for
+    // the meaning of the arguments. The seeds are grown in place. Contour pixels
+    // are temporarily marked with the largest value of the label type.
+template <class Queue, unsigned int N, class T1, class S1, class T2, class S2,
+          class RegionStatisticsArray>
+T2
+seededRegionGrowingMultiArray(MultiArrayView<N, T1, S1> const & data,
+                              MultiArrayView<N, T2, S2> labels,
+                              MultiArrayNeighborhood<N> const & neighborhood,
+                              RegionStatisticsArray & stats,
+                              SRGType srgType,
+                              double max_cost)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    ArrayVector<MultiArrayIndex> soffsets = neighborhood.offsets(data.stride()),
+                                 loffsets = neighborhood.offsets(labels.stride());
+    MultiArrayIndex count = data.elementCount();
+    unsigned int directionCount = neighborhood.size();
+    T1 const * s = data.data();
+    T2 * l = labels.data();
+    T2 contour = NumericTraits<T2>::max(), maxRegionLabel = 0;
+    Queue queue;
+
+    // find candidate pixels for growing and fill the queue
+    Shape p(MultiArrayIndex(0)), nearest;
+    for(MultiArrayIndex i=0; i<count; ++i, neighborhood.increment(p))
+    {
+        MultiArrayIndex lo = dot(p, labels.stride());
+        if(l[lo] != 0)
+        {
+            vigra_precondition(l[lo] <= stats.maxRegionLabel() &&
+                               ((srgType & KeepContours) == 0 || l[lo] < contour),
+                "seededRegionGrowing(): Largest label exceeds size of RegionStatisticsArray.");
+            if(maxRegionLabel < l[lo])
+                maxRegionLabel = l[lo];
+            continue;
+        }
+
+        bool inside = neighborhood.isInside(p);
+        for(unsigned int k=0; k<directionCount; ++k)
+        {
+            if(!inside && !neighborhood.isValid(p, k))
+                continue;
+            T2 cneighbor = l[lo + loffsets[k]];
+            if(cneighbor != 0)
+                queue.push(i, i + neighborhood.offset(k), cneighbor,
+                           stats[cneighbor].cost(s[dot(p, data.stride())]),
+                           squaredNorm(neighborhood.diff(k)));
+        }
+    }
+
+    // perform region growing
+    while(!queue.empty())
+    {
+        typename Queue::Candidate candidate = queue.top();
+        queue.pop();
+        MultiArrayIndex index = candidate.index_;
+        T2 lab = candidate.label_;
+        double cost = candidate.cost_;
+
+        if((srgType & StopAtThreshold) != 0 && cost > max_cost)
+            break;
+
+        neighborhood.coordinate(index, p);
+        T2 * r = l + dot(p, labels.stride());
+        if(*r) // already labelled region / watershed?
+            continue;
+
+        bool inside = neighborhood.isInside(p);
+        if((srgType & KeepContours) != 0)
+        {
+            for(unsigned int k=0; k<directionCount; ++k)
+            {
+                if(!inside && !neighborhood.isValid(p, k))
+                    continue;
+                T2 cneighbor = r[loffsets[k]];
+                if(cneighbor != 0 && cneighbor != contour && cneighbor != lab)
+                {
+                    lab = contour;
+                    break;
+                }
+            }
+        }
+
+        *r = lab;
+
+        if((srgType & KeepContours) == 0 || lab != contour)
+        {
+            T1 const * v = s + dot(p, data.stride());
+
+            // update statistics
+            stats[lab](*v);
+
+            // find new candidate pixels
+            if(Queue::useDistance)
+            {
+                neighborhood.coordinate(candidate.nearest_, nearest);
+                nearest -= p;
+            }
+            for(unsigned int k=0; k<directionCount; ++k)
+            {
+                if((!inside && !neighborhood.isValid(p, k)) || r[loffsets[k]] != 0)
+                    continue;
+                queue.push(index + neighborhood.offset(k), candidate.nearest_, lab,
+                           stats[lab].cost(v[soffsets[k]]),
+                           Queue::useDistance
+                               ? squaredNorm(neighborhood.diff(k) - nearest)
+                               : 0);
+            }
+        }
+    }
+
+    if((srgType & KeepContours) != 0)
+    {
+        p = Shape(MultiArrayIndex(0));
+        for(MultiArrayIndex i=0; i<count; ++i, neighborhood.increment(p))
+        {
+            T2 & v = l[dot(p, labels.stride())];
+            if(v == contour)
+                v = 0;
+        }
+    }
+
+    return maxRegionLabel;
+}
+
+    // Counterpart of fastSeededRegionGrowing() for MultiArrayViews: pixels
+    // are labeled as soon as they are put into the bucket queue.
+template <unsigned int N, class T1, class S1, class T2, class S2,
+          class RegionStatisticsArray>
+T2
+fastSeededRegionGrowingMultiArray(MultiArrayView<N, T1, S1> const & data,
+                                  MultiArrayView<N, T2, S2> labels,
+                                  MultiArrayNeighborhood<N> const & neighborhood,
+                                  RegionStatisticsArray & stats,
+                                  SRGType srgType,
+                                  double max_cost,
+                                  std::ptrdiff_t bucket_count)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    vigra_precondition((srgType & KeepContours) == 0,
+       "fastSeededRegionGrowing(): the turbo algorithm doesn't support 'KeepContours', sorry.");
+
+    ArrayVector<MultiArrayIndex> soffsets = neighborhood.offsets(data.stride()),
+                                 loffsets = neighborhood.offsets(labels.stride());
+    MultiArrayIndex count = data.elementCount();
+    unsigned int directionCount = neighborhood.size();
+    T1 const * s = data.data();
+    T2 * l = labels.data();
+    T2 maxRegionLabel = 0;
+
+    BucketQueue<MultiArrayIndex, true> pqueue(bucket_count);
+
+    Shape p(MultiArrayIndex(0));
+    for(MultiArrayIndex i=0; i<count; ++i, neighborhood.increment(p))
+    {
+        T2 label = l[dot(p, labels.stride())];
+        if(label == 0)
+            continue;
+
+        vigra_precondition(label <= stats.maxRegionLabel(),
+            "fastSeededRegionGrowing(): Largest label exceeds size of RegionStatisticsArray.");
+        if(maxRegionLabel < label)
+            maxRegionLabel = label;
+
+        bool inside = neighborhood.isInside(p);
+        for(unsigned int k=0; k<directionCount; ++k)
+        {
+            if(!inside && !neighborhood.isValid(p, k))
+                continue;
+            if(l[dot(p, labels.stride()) + loffsets[k]] == 0)
+            {
+                std::ptrdiff_t priority = (std::ptrdiff_t)stats[label].cost(s[dot(p, data.stride())]);
+                pqueue.push(i, std::min(std::max(priority, (std::ptrdiff_t)0), bucket_count-1));
+                break;
+            }
+        }
+    }
+
+    // perform region growing
+    while(!pqueue.empty())
+    {
+        MultiArrayIndex index = pqueue.top();
+        std::ptrdiff_t cost = pqueue.topPriority();
+        pqueue.pop();
+
+        if((srgType & StopAtThreshold) != 0 && cost > max_cost)
+            break;
+
+        neighborhood.coordinate(index, p);
+        T2 * r = l + dot(p, labels.stride());
+        T1 const * v = s + dot(p, data.stride());
+        T2 label = *r;
+
+        bool inside = neighborhood.isInside(p);
+        for(unsigned int k=0; k<directionCount; ++k)
+        {
+            if((!inside && !neighborhood.isValid(p, k)) || r[loffsets[k]] != 0)
+                continue;
+            r[loffsets[k]] = label;
+            std::ptrdiff_t priority =
+                std::max((std::ptrdiff_t)stats[label].cost(v[soffsets[k]]), cost);
+            pqueue.push(index + neighborhood.offset(k), std::min(priority, bucket_count-1));
+        }
+    }
+
+    return maxRegionLabel;
+}
+
+template <unsigned int N, class T1, class S1, class T2, class S2,
+          class RegionStatisticsArray>
+unsigned int
+watershedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                     MultiArrayView<N, T2, S2> labels,
+                     MultiArrayNeighborhood<N> const & neighborhood,
+                     RegionStatisticsArray & regionstats,
+                     WatershedOptions const & options)
+{
+    if(options.bucket_count != 0)
+        return fastSeededRegionGrowingMultiArray(data, labels, neighborhood, regionstats,
+                                                 options.terminate, options.max_cost,
+                                                 options.bucket_count);
+    if((options.terminate & QuantizedCosts) != 0)
+        return seededRegionGrowingMultiArray<MultiWatershedBuckets<T1, T2> >(
+                         data, labels, neighborhood, regionstats,
+                         options.terminate, options.max_cost);
+    return seededRegionGrowingMultiArray<MultiWatershedHeap<T1, T2> >(
+                         data, labels, neighborhood, regionstats,
+                         options.terminate, options.max_cost);
+}
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+unsigned int
+watershedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                     MultiArrayView<N, T2, S2> labels,
+                     MultiArrayNeighborhood<N> const & neighborhood,
+                     WatershedOptions const & options)
+{
+    vigra_precondition(data.shape() == labels.shape(),
+        "watershedsMultiArray(): Shape mismatch between data and labels.");
+
+    if(options.seed_options.mini != SeedOptions::Unspecified)
+    {
+        // we are supposed to compute seeds
+        generateWatershedSeedsMultiArray(data, labels, neighborhood, options.seed_options);
+    }
+
+    if(options.biased_label != 0)
+    {
+        // create a statistics functor for biased region growing
+        BiasedWatershedStatistics<T1, T2> regionstats((T2)options.biased_label, options.bias);
+        return watershedsMultiArray(data, labels, neighborhood, regionstats, options);
+    }
+    else
+    {
+        // create a statistics functor for region growing
+        WatershedStatistics<T1, T2> regionstats;
+        return watershedsMultiArray(data, labels, neighborhood, regionstats, options);
+    }
+}
+
+} // namespace detail
+
+/** \addtogroup SeededRegionGrowing
+*/
+//@{
+
+/** \brief Generate seeds for watershed computation in arbitrary dimensions.
+
+    This is the \ref MultiArrayView counterpart of generateWatershedSeeds() for images.
+    Seeds are placed at the local minima of the boundary indicator <tt>data</tt>
+    (<tt>SeedOptions().minima()</tt>) or at the level set below a threshold
+    (<tt>SeedOptions().levelSets(threshold)</tt>). Minimal plateaus
+    (<tt>SeedOptions().extendedMinima()</tt>) are not supported in this version.
+    The connected components of the seed pixels are labeled in place in <tt>seeds</tt>
+    by consecutive integers, and the function returns the largest label.
+
+    The neighborhood is either given as a \ref NeighborhoodType, or as an explicit
+    list of neighbor offsets (which must contain the negation of each offset).
+
+    <b> Declarations:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        unsigned int
+        generateWatershedSeeds(MultiArrayView<N, T1, S1> const & data,
+                               MultiArrayView<N, T2, S2> seeds,
+                               NeighborhoodType neighborhood = IndirectNeighborhood,
+                               SeedOptions const & options = SeedOptions());
+
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        unsigned int
+        generateWatershedSeeds(MultiArrayView<N, T1, S1> const & data,
+                               MultiArrayView<N, T2, S2> seeds,
+                               ArrayVector<typename MultiArrayShape<N>::type> const & neighbors,
+                               SeedOptions const & options = SeedOptions());
+    }
+    \endcode
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_watersheds.hxx\><br>
+    Namespace: vigra
+
+    For detailed examples see watershedsMultiArray().
+*/
+doxygen_overloaded_function(template <...> unsigned int generateWatershedSeeds)
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+inline unsigned int
+generateWatershedSeeds(MultiArrayView<N, T1, S1> const & data,
+                       MultiArrayView<N, T2, S2> seeds,
+                       ArrayVector<typename MultiArrayShape<N>::type> const & neighbors,
+                       SeedOptions const & options = SeedOptions())
+{
+    vigra_precondition(data.shape() == seeds.shape(),
+        "generateWatershedSeeds(): Shape mismatch between input and output.");
+    return detail::generateWatershedSeedsMultiArray(data, seeds,
+                     detail::MultiArrayNeighborhood<N>(data.shape(), neighbors), options);
+}
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+inline unsigned int
+generateWatershedSeeds(MultiArrayView<N, T1, S1> const & data,
+                       MultiArrayView<N, T2, S2> seeds,
+                       NeighborhoodType neighborhood = IndirectNeighborhood,
+                       SeedOptions const & options = SeedOptions())
+{
+    return generateWatershedSeeds(data, seeds,
+                                  detail::neighborhoodDiffs<N>(neighborhood), options);
+}
+
+/** \brief Watershed segmentation of arrays of arbitrary dimension.
+
+    This is the \ref MultiArrayView counterpart of watershedsRegionGrowing():
+    the source array <tt>data</tt> is a boundary indicator, and the seeds in
+    <tt>labels</tt> are grown in place into the final segmentation. Unlike the
+    image and volume versions, the function does not copy the labels into an array
+    with border. Pixels are addressed by their scan-order index, and the neighbors
+    are found via precomputed offset tables, so that the function works for any
+    dimension (e.g. for time series of volumes) and any connectivity.
+
+    The neighborhood is either given as a \ref NeighborhoodType (default:
+    <tt>IndirectNeighborhood</tt>), or as an explicit list of neighbor offsets
+    (which must contain the negation of each offset).
+
+    All \ref WatershedOptions are supported, except that automatic seed generation
+    (see generateWatershedSeeds()) doesn't support <tt>SeedOptions().extendedMinima()</tt>.
+    As in the 2D version, plateaus are split according to the Euclidean distance
+    to the seeds. Setting <tt>WatershedOptions().srgType(QuantizedCosts)</tt> selects the
+    same algorithm with a \ref BucketQueue instead of a heap (costs are rounded to
+    integers, and plateaus are processed in breadth-first order), whereas
+    <tt>turboAlgorithm()</tt> selects the faster algorithm that labels pixels as soon
+    as they are reached (without 'KeepContours' support). Both are intended for UInt8
+    boundary indicators.
+
+    The label type <tt>T2</tt> must be large enough to hold all labels. When
+    contours are to be kept, the largest value of <tt>T2</tt> is used internally
+    as a contour marker and must not be a seed label. The function returns
+    the largest label.
+
+    <b> Declarations:</b>
+
+    \code
+    namespace vigra {
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        unsigned int
+        watershedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                             MultiArrayView<N, T2, S2> labels,
+                             NeighborhoodType neighborhood = IndirectNeighborhood,
+                             WatershedOptions const & options = WatershedOptions());
+
+        template <unsigned int N, class T1, class S1, class T2, class S2>
+        unsigned int
+        watershedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                             MultiArrayView<N, T2, S2> labels,
+                             ArrayVector<typename MultiArrayShape<N>::type> const & neighbors,
+                             WatershedOptions const & options = WatershedOptions());
+    }
+    \endcode
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/multi_watersheds.hxx\><br>
+    Namespace: vigra
+
+    \code
+    // a time series of volumes
+    MultiArray<4, UInt8> gradient(Shape4(w, h, d, t));
+    MultiArray<4, UInt32> labels(gradient.shape());
+    ... // compute boundary indicator
+
+    // generate seeds at the minima and run the turbo algorithm with
+    // 8 neighbors (2 along each axis)
+    unsigned int max_region_label =
+        watershedsMultiArray(gradient, labels, DirectNeighborhood,
+                             WatershedOptions().seedOptions(SeedOptions().minima())
+                                               .turboAlgorithm());
+    \endcode
+*/
+doxygen_overloaded_function(template <...> unsigned int watershedsMultiArray)
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+inline unsigned int
+watershedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                     MultiArrayView<N, T2, S2> labels,
+                     ArrayVector<typename MultiArrayShape<N>::type> const & neighbors,
+                     WatershedOptions const & options = WatershedOptions())
+{
+    return detail::watershedsMultiArray(data, labels,
+                     detail::MultiArrayNeighborhood<N>(data.shape(), neighbors), options);
+}
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+inline unsigned int
+watershedsMultiArray(MultiArrayView<N, T1, S1> const & data,
+                     MultiArrayView<N, T2, S2> labels,
+                     NeighborhoodType neighborhood = IndirectNeighborhood,
+                     WatershedOptions const & options = WatershedOptions())
+{
+    return watershedsMultiArray(data, labels,
+                                detail::neighborhoodDiffs<N>(neighborhood), options);
+}
+
+namespace detail {
+
+    // Queue of IncrementalWatershed: a heap or, if bucket_count > 0, a
+    // BucketQueue for integer costs. Equal costs are processed in the order
+    // of insertion.
+template <class T>
+class IncrementalWatershedQueue
+{
+    struct Entry
+    {
+        Entry(MultiArrayIndex index, T cost, MultiArrayIndex count)
+        : index_(index), cost_(cost), count_(count)
+        {}
+
+        bool operator>(Entry const & other) const
+        {
+            return other.cost_ < cost_ ||
+                   (!(cost_ < other.cost_) && other.count_ < count_);
+        }
+
+        MultiArrayIndex index_;
+        T cost_;
+        MultiArrayIndex count_;
+    };
+
+  public:
+    IncrementalWatershedQueue(std::ptrdiff_t bucket_count)
+    : buckets_(bucket_count),
+      bucket_count_(bucket_count),
+      count_(0)
+    {}
+
+    bool empty() const
+    {
+        return bucket_count_ > 0
+                   ? buckets_.empty()
+                   : heap_.empty();
+    }
+
+    void push(MultiArrayIndex index, T cost)
+    {
+        if(bucket_count_ > 0)
+        {
+            std::ptrdiff_t priority = (std::ptrdiff_t)cost;
+            buckets_.push(std::make_pair(index, cost),
+                          std::min(std::max(priority, (std::ptrdiff_t)0), bucket_count_-1));
+        }
+        else
+        {
+            heap_.push(Entry(index, cost, count_++));
+        }
+    }
+
+    void clear()
+    {
+        *this = IncrementalWatershedQueue(bucket_count_);
+    }
+
+    void pop(MultiArrayIndex & index, T & cost)
+    {
+        if(bucket_count_ > 0)
+        {
+            index = buckets_.top().first;
+            cost = buckets_.top().second;
+            buckets_.pop();
+        }
+        else
+        {
+            index = heap_.top().index_;
+            cost = heap_.top().cost_;
+            heap_.pop();
+        }
+    }
+
+  private:
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap_;
+    BucketQueue<std::pair<MultiArrayIndex, T>, true> buckets_;
+    std::ptrdiff_t bucket_count_;
+    MultiArrayIndex count_;
+};
+
+} // namespace detail
+
+/** \brief Watershed segmentation that is updated incrementally after seed edits.
+
+    In interactive applications, the user typically adds or removes a few seeds
+    at a time, and the segmentation should be updated without flooding the
+    entire array again. IncrementalWatershed keeps the state of the last flooding:
+    the label of each pixel, its priority (the cost at which the pixel was flooded,
+    i.e. the minimal highest boundary indicator value along a path from a seed), and
+    the neighbor it was flooded from. After seed edits, update() re-floods
+    only the affected pixels (the "differential image foresting transform" of
+    A.X. Falcao and F.P.G. Bergo: "<em>Interactive volume segmentation with differential
+    image foresting transforms</em>", IEEE Trans. Med. Imag. 23(9):1100-1108, 2004):
+
+    <ul>
+    <li> A new seed floods only the pixels it reaches at a lower cost than before
+         (or that were flooded through it).
+    <li> A removed seed invalidates only the pixels that were flooded from it.
+         They are then re-flooded from the surrounding regions.
+    </ul>
+
+    The result is a watershed segmentation in the sense of the turbo algorithm
+    of watershedsMultiArray(): the label of each pixel comes from a seed
+    that reaches it at minimal cost. Pixels that several seeds reach at the same
+    cost keep their previous label, so the result after edits may differ from
+    a new flooding on such plateaus.
+
+    Costs are the values of the boundary indicator <tt>data</tt> itself. If <tt>bucket_count</tt>
+    is positive, the pixels are ordered by a \ref BucketQueue, which requires integer
+    costs in the range <tt>[0, ..., bucket_count-1]</tt> (typically, UInt8 data with
+    <tt>bucket_count = 256</tt>). Otherwise, a heap is used. The <tt>data</tt> array must
+    remain valid and unchanged during the lifetime of the object. Besides the data,
+    the object holds the label and cost of each pixel and one byte for the direction
+    of the neighbor it was flooded from, so that at most 254 neighbors are supported.
+
+    <b>\#include</b> \<vigra/multi_watersheds.hxx\><br>
+    Namespace: vigra
+
+    \code
+    MultiArray<3, UInt8> boundaries(Shape3(w, h, d));
+    MultiArray<3, UInt32> seeds(boundaries.shape());
+    ... // compute boundary indicator and get initial seeds from the user
+
+    IncrementalWatershed<3, UInt8> watershed(boundaries, DirectNeighborhood, 256);
+    watershed.setSeeds(seeds);
+
+    // the user adds an object seed and removes a background seed
+    watershed.addSeed(Shape3(x1, y1, z1), 2);
+    watershed.removeSeed(Shape3(x2, y2, z2));
+    watershed.update();
+
+    ... // display watershed.labels()
+    \endcode
+*/
+template <unsigned int N, class T, class Label = UInt32>
+class IncrementalWatershed
+{
+    enum { NoPredecessor = 0, IsSeed = 255 };
+
+  public:
+        /** the boundary indicator type
+        */
+    typedef T value_type;
+
+        /** the label type
+        */
+    typedef Label label_type;
+
+        /** the shape type
+        */
+    typedef typename MultiArrayShape<N>::type shape_type;
+
+        /** Create the watershed state for the given boundary indicator.
+            No pixels are labeled before seeds have been set.
+        */
+    template <class S>
+    IncrementalWatershed(MultiArrayView<N, T, S> const & data,
+                         NeighborhoodType neighborhood = IndirectNeighborhood,
+                         std::ptrdiff_t bucket_count = 0)
+    : neighborhood_(data.shape(), detail::neighborhoodDiffs<N>(neighborhood)),
+      data_(data.data()),
+      dataStride_(data.stride()),
+      labels_(data.shape()),
+      costs_(data.shape()),
+      predecessors_(data.shape()),
+      queue_(bucket_count)
+    {
+        init();
+    }
+
+        /** Create the watershed state with an explicit list of neighbor offsets
+            (which must contain the negation of each offset).
+        */
+    template <class S>
+    IncrementalWatershed(MultiArrayView<N, T, S> const & data,
+                         ArrayVector<shape_type> const & neighbors,
+                         std::ptrdiff_t bucket_count = 0)
+    : neighborhood_(data.shape(), neighbors),
+      data_(data.data()),
+      dataStride_(data.stride()),
+      labels_(data.shape()),
+      costs_(data.shape()),
+      predecessors_(data.shape()),
+      queue_(bucket_count)
+    {
+        init();
+    }
+
+        /** Replace all seeds with the non-zero pixels of <tt>seeds</tt> and
+            flood the entire array.
+        */
+    template <class S>
+    void setSeeds(MultiArrayView<N, Label, S> const & seeds)
+    {
+        vigra_precondition(seeds.shape() == labels_.shape(),
+            "IncrementalWatershed::setSeeds(): shape mismatch.");
+
+        labels_.init(0);
+        predecessors_.init(NoPredecessor);
+        queue_.clear();
+
+        shape_type p(MultiArrayIndex(0));
+        MultiArrayIndex count = labels_.elementCount();
+        for(MultiArrayIndex i=0; i<count; ++i, neighborhood_.increment(p))
+        {
+            Label label = seeds[p];
+            if(label != 0)
+                makeSeed(i, p, label);
+        }
+        update();
+    }
+
+        /** Make pixel <tt>p</tt> a seed for region <tt>label</tt> (which must
+            be non-zero). If <tt>p</tt> is already a seed, its label is changed.
+            The segmentation is updated by the next call to update().
+        */
+    void addSeed(shape_type const & p, Label label)
+    {
+        vigra_precondition(label != 0,
+            "IncrementalWatershed::addSeed(): label must be non-zero.");
+        makeSeed(labels_.coordinateToScanOrderIndex(p), p, label);
+    }
+
+        /** Remove the seed at pixel <tt>p</tt> (if any). All pixels that were flooded
+            from this seed are unlabeled and will be re-flooded by the next
+            call to update().
+        */
+    void removeSeed(shape_type const & p)
+    {
+        MultiArrayIndex i = labels_.coordinateToScanOrderIndex(p);
+        Label * labels = labels_.data();
+        UInt8 * predecessors = predecessors_.data();
+        if(predecessors[i] != IsSeed)
+            return;
+
+        // unlabel the tree of pixels flooded from the seed, and queue
+        // the labeled pixels around it for re-flooding
+        ArrayVector<MultiArrayIndex> stack;
+        stack.push_back(i);
+        labels[i] = 0;
+        predecessors[i] = NoPredecessor;
+        shape_type q;
+        while(!stack.empty())
+        {
+            MultiArrayIndex index = stack.back();
+            stack.pop_back();
+            neighborhood_.coordinate(index, q);
+            bool inside = neighborhood_.isInside(q);
+            for(unsigned int k=0; k<neighborhood_.size(); ++k)
+            {
+                if(!inside && !neighborhood_.isValid(q, k))
+                    continue;
+                MultiArrayIndex r = index + neighborhood_.offset(k);
+                if(labels[r] == 0)
+                    continue;
+                if(predecessors[r] == opposite_[k] + 1)
+                {
+                    labels[r] = 0;
+                    predecessors[r] = NoPredecessor;
+                    stack.push_back(r);
+                }
+                else
+                {
+                    queue_.push(r, costs_.data()[r]);
+                }
+            }
+        }
+    }
+
+        /** Remove all seeds and unlabel all pixels.
+        */
+    void clearSeeds()
+    {
+        labels_.init(0);
+        predecessors_.init(NoPredecessor);
+        queue_.clear();
+    }
+
+        /** Flood the pixels affected by the seed edits since the last call.
+            Returns the number of pixels whose label or cost was (re-)assigned.
+        */
+    MultiArrayIndex update()
+    {
+        Label * labels = labels_.data();
+        T * costs = costs_.data();
+        UInt8 * predecessors = predecessors_.data();
+        MultiArrayIndex updated = 0;
+        shape_type q;
+        while(!queue_.empty())
+        {
+            MultiArrayIndex index;
+            T cost;
+            queue_.pop(index, cost);
+
+            // skip outdated entries
+            Label label = labels[index];
+            if(label == 0 || costs[index] != cost)
+                continue;
+
+            neighborhood_.coordinate(index, q);
+            bool inside = neighborhood_.isInside(q);
+            T const * d = data_ + dot(q, dataStride_);
+            for(unsigned int k=0; k<neighborhood_.size(); ++k)
+            {
+                if(!inside && !neighborhood_.isValid(q, k))
+                    continue;
+                MultiArrayIndex r = index + neighborhood_.offset(k);
+                UInt8 pred = predecessors[r];
+                if(pred == IsSeed)
+                    continue;
+                T newCost = std::max(d[dataOffsets_[k]], cost);
+                if(labels[r] == 0 || newCost < costs[r] ||
+                   (pred == opposite_[k] + 1 && (newCost != costs[r] || labels[r] != label)))
+                {
+                    labels[r] = label;
+                    costs[r] = newCost;
+                    predecessors[r] = opposite_[k] + 1;
+                    queue_.push(r, newCost);
+                    ++updated;
+                }
+            }
+        }
+        return updated;
+    }
+
+        /** The current segmentation (valid after update()). Unreachable pixels
+            have label 0.
+        */
+    MultiArrayView<N, Label> const & labels() const
+    {
+        return labels_;
+    }
+
+        /** The cost at which each labeled pixel was flooded (valid after update()).
+        */
+    MultiArrayView<N, T> const & costs() const
+    {
+        return costs_;
+    }
+
+        /** Check whether pixel <tt>p</tt> is a seed.
+        */
+    bool isSeed(shape_type const & p) const
+    {
+        return predecessors_[p] == (UInt8)IsSeed;
+    }
+
+  private:
+    void init()
+    {
+        vigra_precondition(neighborhood_.size() < IsSeed,
+            "IncrementalWatershed: too many neighbors.");
+
+        dataOffsets_ = neighborhood_.offsets(dataStride_);
+        opposite_.resize(neighborhood_.size());
+        for(unsigned int k=0; k<neighborhood_.size(); ++k)
+            for(unsigned int j=0; j<neighborhood_.size(); ++j)
+                if(neighborhood_.diff(j) == -neighborhood_.diff(k))
+                    opposite_[k] = j;
+        clearSeeds();
+    }
+
+    void makeSeed(MultiArrayIndex i, shape_type const & p, Label label)
+    {
+        labels_.data()[i] = label;
+        costs_.data()[i] = data_[dot(p, dataStride_)];
+        predecessors_.data()[i] = IsSeed;
+        queue_.push(i, costs_.data()[i]);
+    }
+
+    detail::MultiArrayNeighborhood<N> neighborhood_;
+    T const * data_;
+    shape_type dataStride_;
+    ArrayVector<MultiArrayIndex> dataOffsets_;
+    ArrayVector<UInt8> opposite_;
+    MultiArray<N, Label> labels_;
+    MultiArray<N, T> costs_;
+    MultiArray<N, UInt8> predecessors_;
+    detail::IncrementalWatershedQueue<T> queue_;
+};
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_MULTI_WATERSHEDS_HXX
@@ -0,0 +1,252 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2011-2012 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_PRIORITY_QUEUE_HXX
+#define VIGRA_PRIORITY_QUEUE_HXX
+
+#include <functional>
+#include "config.hxx"
+#include "error.hxx"
+#include "array_vector.hxx"
+
+namespace vigra {
+
+/** \brief Heap-based priority queue whose priorities can be changed.
+
+    The queue holds integer items in the range <tt>[0, ..., maxSize-1]</tt>
+    (e.g. node or edge IDs of a graph), each item at most once. In contrast to
+    <tt>std::priority_queue</tt>, the priority of an item in the queue can be
+    changed, and items can be removed from anywhere in the queue, both in
+    O(log n) time. The memory for all items is allocated in the constructor.
+
+    By default, the item with the <b>smallest</b> priority is at the top
+    (i.e. <tt>Compare</tt> defaults to <tt>std::less</tt>). Items with equal
+    priorities are returned in increasing order of their index, so that the
+    order of the queue is deterministic.
+
+    <b>\#include</b> \<vigra/priority_queue.hxx\><br>
+    Namespace: vigra
+*/
+template <class PriorityType,
+          class Compare = std::less<PriorityType> >
+class ChangeablePriorityQueue
+{
+  public:
+
+    typedef PriorityType priority_type;
+    typedef std::ptrdiff_t value_type;
+    typedef std::ptrdiff_t index_type;
+    typedef std::size_t size_type;
+
+        /** \brief Create an empty queue for the items <tt>0...maxSize-1</tt>.
+        */
+    ChangeablePriorityQueue(size_type maxSize = 0)
+    : heap_(),
+      positions_(maxSize, -1),
+      priorities_(maxSize),
+      compare_()
+    {
+        heap_.reserve(maxSize);
+    }
+
+        /** \brief Remove all items and change the maximum size.
+        */
+    void reset(size_type maxSize)
+    {
+        heap_.clear();
+        heap_.reserve(maxSize);
+        positions_.clear();
+        positions_.resize(maxSize, -1);
+        priorities_.clear();
+        priorities_.resize(maxSize);
+    }
+
+        /** \brief Remove all items.
+        */
+    void clear()
+    {
+        for(size_type k = 0; k < heap_.size(); ++k)
+            positions_[heap_[k]] = -1;
+        heap_.clear();
+    }
+
+        /** \brief Number of items in the queue.
+        */
+    size_type size() const
+    {
+        return heap_.size();
+    }
+
+        /** \brief Queue contains no items.
+        */
+    bool empty() const
+    {
+        return heap_.size() == 0;
+    }
+
+        /** \brief Item <tt>i</tt> is in the queue.
+        */
+    bool contains(index_type i) const
+    {
+        return positions_[i] >= 0;
+    }
+
+        /** \brief The item at the top.
+        */
+    index_type top() const
+    {
+        vigra_precondition(!empty(), "ChangeablePriorityQueue::top(): queue is empty.");
+        return heap_[0];
+    }
+
+        /** \brief Priority of the item at the top.
+        */
+    priority_type const & topPriority() const
+    {
+        return priorities_[top()];
+    }
+
+        /** \brief Priority of item <tt>i</tt>, which must be in the queue.
+        */
+    priority_type const & priority(index_type i) const
+    {
+        return priorities_[i];
+    }
+
+        /** \brief Insert item <tt>i</tt> with the given priority, or change its priority
+            if it is already in the queue.
+        */
+    void push(index_type i, priority_type const & priority)
+    {
+        if(contains(i))
+        {
+            bool up = higher(priority, i, priorities_[i], i);
+            priorities_[i] = priority;
+            if(up)
+                siftUp(positions_[i]);
+            else
+                siftDown(positions_[i]);
+        }
+        else
+        {
+            priorities_[i] = priority;
+            positions_[i] = (index_type)heap_.size();
+            heap_.push_back(i);
+            siftUp(positions_[i]);
+        }
+    }
+
+        /** \brief Remove the item at the top.
+        */
+    void pop()
+    {
+        remove(top());
+    }
+
+        /** \brief Remove item <tt>i</tt> (no-op if it is not in the queue).
+        */
+    void remove(index_type i)
+    {
+        index_type pos = positions_[i];
+        if(pos < 0)
+            return;
+        positions_[i] = -1;
+        index_type last = heap_.back();
+        heap_.pop_back();
+        if(last == i)
+            return;
+        heap_[pos] = last;
+        positions_[last] = pos;
+        siftUp(pos);
+        siftDown(positions_[last]);
+    }
+
+  private:
+        // item i with priority p comes before item j with priority q
+    bool higher(priority_type const & p, index_type i, priority_type const & q, index_type j) const
+    {
+        return compare_(p, q) || (!compare_(q, p) && i < j);
+    }
+
+    bool higher(index_type i, index_type j) const
+    {
+        return higher(priorities_[i], i, priorities_[j], j);
+    }
+
+    void siftUp(index_type pos)
+    {
+        index_type item = heap_[pos];
+        while(pos > 0)
+        {
+            index_type parent = (pos - 1) / 2;
+            if(!higher(item, heap_[parent]))
+                break;
+            heap_[pos] = heap_[parent];
+            positions_[heap_[pos]] = pos;
+            pos = parent;
+        }
+        heap_[pos] = item;
+        positions_[item] = pos;
+    }
+
+    void siftDown(index_type pos)
+    {
+        index_type item = heap_[pos],
+                   size = (index_type)heap_.size();
+        for(;;)
+        {
+            index_type child = 2*pos + 1;
+            if(child >= size)
+                break;
+            if(child + 1 < size && higher(heap_[child+1], heap_[child]))
+                ++child;
+            if(!higher(heap_[child], item))
+                break;
+            heap_[pos] = heap_[child];
+            positions_[heap_[pos]] = pos;
+            pos = child;
+        }
+        heap_[pos] = item;
+        positions_[item] = pos;
+    }
+
+    ArrayVector<index_type> heap_, positions_;
+    ArrayVector<priority_type> priorities_;
+    Compare compare_;
+};
+
+} // namespace vigra
+
+#endif // VIGRA_PRIORITY_QUEUE_HXX
@@ -60,6 +60,8 @@
 #include "random_forest/rf_online_prediction_set.hxx"
 #include "random_forest/rf_earlystopping.hxx"
 #include "random_forest/rf_ridge_split.hxx"
+#include "random_forest/rf_histogram_split.hxx"
+#include "threading.hxx"
 namespace vigra
 {
 
@@ -160,6 +162,25 @@ class RandomForest
      * */
     mutable MultiArray<2, double> garbage_prediction_;
 
+    /** number of rows that are passed through one tree before the 
+     * next tree is considered in predictProbabilities() (see 
+     * predictProbabilitiesBlockwise())
+     */
+    enum { PredictionBlockSize = 256 };
+
+    /** prediction without early stopping.
+     *
+     * The rows are processed in blocks of PredictionBlockSize, and each block 
+     * is passed through one tree after the other, so that the nodes of the 
+     * current tree remain in the cache. The blocks are distributed over
+     * options_.thread_count_ threads. Since the votes of each row are still 
+     * accumulated in tree order, the result is bit-identical to the
+     * row-by-row prediction.
+     */
+    template <class U, class C1, class T, class C2>
+    void predictProbabilitiesBlockwise(MultiArrayView<2, U, C1>const &   features,
+                                       MultiArrayView<2, T, C2> &        prob) const;
+
   public:
 
     //problem independent data.
@@ -291,7 +312,7 @@ class RandomForest
      */
     Options_t & set_options()
     {
-        return options;
+        return options_;
     }
 
 
@@ -913,10 +934,12 @@ void RandomForest<LabelType, PreprocessorTag>::
     
     #define RF_CHOOSER(type_) detail::Value_Chooser<type_, Default_##type_> 
     Default_Stop_t default_stop(options_);
-    typename RF_CHOOSER(Stop_t)::type stop
+    typedef typename RF_CHOOSER(Stop_t)::type ActualStop_t;
+    ActualStop_t stop
             = RF_CHOOSER(Stop_t)::choose(stop_, default_stop); 
     Default_Split_t default_split;
-    typename RF_CHOOSER(Split_t)::type split 
+    typedef typename RF_CHOOSER(Split_t)::type ActualSplit_t;
+    ActualSplit_t split 
             = RF_CHOOSER(Split_t)::choose(split_, default_split); 
     rf::visitors::StopVisiting stopvisiting;
     typedef  rf::visitors::detail::VisitorNode<
@@ -925,6 +948,9 @@ void RandomForest<LabelType, PreprocessorTag>::
     IntermedVis
         visitor(online_visitor_, RF_CHOOSER(Visitor_t)::choose(visitor_, stopvisiting));
     #undef RF_CHOOSER
+    vigra_precondition(options_.thread_count_ == 0 || !options_.prepare_online_learning_,
+        "RandomForest::learn(): online learning cannot be combined with parallel learning "
+        "(RandomForestOptions::thread_count()).");
     if(options_.prepare_online_learning_)
         online_visitor_.activate();
     else
@@ -946,6 +972,12 @@ void RandomForest<LabelType, PreprocessorTag>::
     split.set_external_parameters(ext_param_);
     stop.set_external_parameters(ext_param_);
 
+    PresortedFeatures presorted;
+    if(options_.presort_features_)
+    {
+        presorted.init(preprocessor.features(), options_.thread_count_);
+        detail::setPresortedFeatures(split, &presorted);
+    }
 
     //initialize trees.
     trees_.resize(options_.tree_count_  , DecisionTree_t(ext_param_));
@@ -959,32 +991,110 @@ void RandomForest<LabelType, PreprocessorTag>::
     visitor.visit_at_beginning(*this, preprocessor);
     // THE MAIN EFFING RF LOOP - YEAY DUDE!
     
-    for(int ii = 0; ii < (int)trees_.size(); ++ii)
+    if(options_.thread_count_ == 0)
     {
-        //initialize First region/node/stack entry
-        sampler
-            .sample();  
-        StackEntry_t
-            first_stack_entry(  sampler.sampledIndices().begin(),
-                                sampler.sampledIndices().end(),
-                                ext_param_.class_count_);
-        first_stack_entry
-            .set_oob_range(     sampler.oobIndices().begin(),
-                                sampler.oobIndices().end());
-        trees_[ii]
-            .learn(             preprocessor.features(),
-                                preprocessor.response(),
-                                first_stack_entry,
-                                split,
-                                stop,
-                                visitor,
-                                randint);
-        visitor
-            .visit_after_tree(  *this,
-                                preprocessor,
-                                sampler,
-                                first_stack_entry,
-                                ii);
+        for(int ii = 0; ii < (int)trees_.size(); ++ii)
+        {
+            //initialize First region/node/stack entry
+            sampler
+                .sample();  
+            StackEntry_t
+                first_stack_entry(  sampler.sampledIndices().begin(),
+                                    sampler.sampledIndices().end(),
+                                    ext_param_.class_count_);
+            first_stack_entry
+                .set_oob_range(     sampler.oobIndices().begin(),
+                                    sampler.oobIndices().end());
+            trees_[ii]
+                .learn(             preprocessor.features(),
+                                    preprocessor.response(),
+                                    first_stack_entry,
+                                    split,
+                                    stop,
+                                    visitor,
+                                    randint);
+            visitor
+                .visit_after_tree(  *this,
+                                    preprocessor,
+                                    sampler,
+                                    first_stack_entry,
+                                    ii);
+        }
+    }
+    else
+    {
+        typedef rf::visitors::detail::VisitorThreadCopy<IntermedVis> ThreadVisitor_t;
+
+        // Every tree gets its own random number generator. The seeds are
+        // drawn beforehand, so that the forest does not depend on the 
+        // number of threads or the order in which the trees are learned.
+        int tree_count = (int)trees_.size();
+        ArrayVector<UInt32> seeds(tree_count);
+        for(int ii = 0; ii < tree_count; ++ii)
+            seeds[ii] = random();
+
+        ThreadExceptionCollector errors;
+        #ifdef _OPENMP
+        #pragma omp parallel num_threads(actualThreadCount(options_.thread_count_))
+        #endif
+        {
+            // split, stop and visitors hold temporary state and are 
+            // therefore copied for each thread
+            ActualSplit_t   thread_split(split);
+            ActualStop_t    thread_stop(stop);
+            ThreadVisitor_t thread_visitor(visitor);
+
+            #ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+            #endif
+            for(int ii = 0; ii < tree_count; ++ii)
+            {
+                try
+                {
+                    Random_t        tree_random(seeds[ii]);
+                    RandFunctor_t   tree_randint(tree_random);
+                    Sampler<Random_t > 
+                        tree_sampler(preprocessor.strata().begin(),
+                                     preprocessor.strata().end(),
+                                     detail::make_sampler_opt(options_)
+                                            .sampleSize(ext_param().actual_msample_),
+                                     tree_random);
+                    tree_sampler
+                        .sample();  
+                    StackEntry_t
+                        first_stack_entry(  tree_sampler.sampledIndices().begin(),
+                                            tree_sampler.sampledIndices().end(),
+                                            ext_param_.class_count_);
+                    first_stack_entry
+                        .set_oob_range(     tree_sampler.oobIndices().begin(),
+                                            tree_sampler.oobIndices().end());
+                    trees_[ii]
+                        .learn(             preprocessor.features(),
+                                            preprocessor.response(),
+                                            first_stack_entry,
+                                            thread_split,
+                                            thread_stop,
+                                            thread_visitor,
+                                            tree_randint);
+                    thread_visitor
+                        .visit_after_tree(  *this,
+                                            preprocessor,
+                                            tree_sampler,
+                                            first_stack_entry,
+                                            ii);
+                }
+                catch(std::exception & e)
+                {
+                    errors.capture(e);
+                }
+            }
+
+            #ifdef _OPENMP
+            #pragma omp critical(vigra_random_forest_merge_visitors)
+            #endif
+            thread_visitor.merge_into(visitor);
+        }
+        errors.rethrow();
     }
 
     visitor.visit_at_end(*this, preprocessor);
@@ -1205,11 +1315,19 @@ void RandomForest<LabelType, PreprocessorTag>
 
     #define RF_CHOOSER(type_) detail::Value_Chooser<type_, Default_##type_> 
     Default_Stop_t default_stop(options_);
-    typename RF_CHOOSER(Stop_t)::type & stop
+    typedef typename RF_CHOOSER(Stop_t)::type ActualStop_t;
+    ActualStop_t & stop
             = RF_CHOOSER(Stop_t)::choose(stop_, default_stop); 
     #undef RF_CHOOSER 
     stop.set_external_parameters(ext_param_, tree_count());
     prob.init(NumericTraits<T>::zero());
+    // EarlyStoppStd never stops - the trees can be evaluated in any 
+    // order of rows
+    if(IsSameType<ActualStop_t, EarlyStoppStd>::value)
+    {
+        predictProbabilitiesBlockwise(features, prob);
+        return;
+    }
     /* This code was originally there for testing early stopping
      * - we wanted the order of the trees to be randomized
     if(tree_indices_.size() != 0)
@@ -1260,6 +1378,68 @@ void RandomForest<LabelType, PreprocessorTag>
 
 }
 
+template <class LabelType, class PreprocessorTag>
+template <class U, class C1, class T, class C2>
+void RandomForest<LabelType, PreprocessorTag>
+    ::predictProbabilitiesBlockwise(MultiArrayView<2, U, C1>const &  features,
+                                    MultiArrayView<2, T, C2> &       prob) const
+{
+    int row_count   = rowCount(features);
+    int block_count = (row_count + PredictionBlockSize - 1) / PredictionBlockSize;
+    int weighted    = options_.predict_weighted_;
+
+    ThreadExceptionCollector errors;
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) \
+                num_threads(actualThreadCount(options_.thread_count_)) \
+                if(options_.thread_count_ != 0 && block_count > 1)
+    #endif
+    for(int block = 0; block < block_count; ++block)
+    {
+        try
+        {
+            int begin = block * PredictionBlockSize,
+                end   = std::min(begin + PredictionBlockSize, row_count);
+
+            //totalWeight == totalVoteCount!
+            double totalWeight[PredictionBlockSize];
+            std::fill(totalWeight, totalWeight + (end - begin), 0.0);
+
+            //Let each tree classify all rows of the block...
+            for(int k=0; k<options_.tree_count_; ++k)
+            {
+                DecisionTree_t const & tree = trees_[k];
+                for(int row = begin; row < end; ++row)
+                {
+                    //get weights predicted by single tree
+                    ArrayVector<double>::const_iterator weights 
+                        = tree.predict(rowVector(features, row));
+
+                    //update votecount.
+                    for(int l=0; l<ext_param_.class_count_; ++l)
+                    {
+                        double cur_w = weights[l] * (weighted * (*(weights-1))
+                                                   + (1-weighted));
+                        prob(row, l) += (T)cur_w;
+                        //every weight in totalWeight.
+                        totalWeight[row - begin] += cur_w;
+                    }
+                }
+            }
+
+            //Normalise votes in each row by total VoteCount (totalWeight
+            for(int row = begin; row < end; ++row)
+                for(int l=0; l< ext_param_.class_count_; ++l)
+                    prob(row, l) /= detail::RequiresExplicitCast<T>::cast(totalWeight[row - begin]);
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+}
+
 template <class LabelType, class PreprocessorTag>
 template <class U, class C1, class T, class C2>
 void RandomForest<LabelType, PreprocessorTag>
@@ -1328,4 +1508,5 @@ void RandomForest<LabelType, PreprocessorTag>
 } // namespace vigra
 
 #include "random_forest/rf_algorithm.hxx"
+#include "random_forest/rf_compiled.hxx"
 #endif // VIGRA_RANDOM_FOREST_HXX
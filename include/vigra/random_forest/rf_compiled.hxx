@@ -0,0 +1,411 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef VIGRA_RF_COMPILED_HXX
+#define VIGRA_RF_COMPILED_HXX
+
+#include <cmath>
+#include <deque>
+#include <algorithm>
+#include "../array_vector.hxx"
+#include "../multi_array.hxx"
+#include "../threading.hxx"
+#include "rf_nodeproxy.hxx"
+#include "rf_common.hxx"
+
+namespace vigra
+{
+
+namespace detail
+{
+
+inline float rfNextThresholdUp(float t)
+{
+    return nextafterf(t, HUGE_VALF);
+}
+
+inline double rfNextThresholdUp(double t)
+{
+    return nextafter(t, HUGE_VAL);
+}
+
+    // smallest T that is not less than t. For features of type T, 
+    // (x < t) and (x < rfRoundThresholdUp<T>(t)) are then equivalent.
+template <class T>
+T rfRoundThresholdUp(double t)
+{
+    T res = static_cast<T>(t);
+    if(res < t)
+        res = rfNextThresholdUp(res);
+    return res;
+}
+
+} // namespace detail
+
+/** \addtogroup MachineLearning
+**/
+//@{
+
+/** \brief Read-only random forest, compiled into flat arrays for fast prediction.
+
+    The trees of a trained RandomForest (either learned or imported, e.g. 
+    with rf_import_HDF5()) are converted into a struct-of-arrays layout: 
+    feature index, threshold and the indices of both children of every 
+    node are stored in separate arrays, the nodes of each tree in breadth-first
+    order. The leaves point back to themselves and refer to a table of 
+    (possibly weighted) class votes. 
+    
+    Prediction steps groups of LaneCount samples down a tree simultaneously
+    without any branches: each step is a table lookup 
+    <tt>child[2*node + !(x[feature[node]] < threshold[node])]</tt>, 
+    and all samples take as many steps as the tree is deep. Blocks of rows are 
+    distributed over thread_count() threads (see RandomForestOptions::thread_count()).
+    
+    Only forests built from threshold splits and constant leaves (i.e. with
+    the default split functors) can be compiled. Early stopping is not supported.
+    
+    The thresholds are stored as <tt>ThresholdType</tt> and rounded up, so that 
+    the predicted probabilities are bit-identical to 
+    RandomForest::predictProbabilities() when the features are of 
+    type <tt>ThresholdType</tt>. Use <tt>ThresholdType = double</tt> for
+    <tt>double</tt> features.
+    
+    <b>\#include</b> \<vigra/random_forest.hxx\><br>
+    Namespace: vigra
+    
+    \code
+    RandomForest<int> rf;
+    rf_import_HDF5(rf, "forest.h5");
+    
+    CompiledRandomForest<int> crf(rf);
+    crf.thread_count(-1);
+    crf.predictProbabilities(features, probabilities);
+    \endcode
+*/
+template <class LabelType = double, class ThresholdType = float>
+class CompiledRandomForest
+{
+  public:
+    typedef LabelType                   Label_t;
+    typedef ThresholdType               Threshold_t;
+    typedef ProblemSpec<LabelType>      ProblemSpec_t;
+    
+        /** number of samples that are moved down a tree simultaneously.
+         */
+    enum { LaneCount = 8 };
+    
+        /** number of rows that are passed through one tree before the 
+            next tree is considered.
+        */
+    enum { BlockSize = 256 };
+
+    ProblemSpec_t           ext_param_;
+
+    // struct of arrays, one entry per node of all trees
+    ArrayVector<Int32>      feature_;
+    ArrayVector<Threshold_t> threshold_;
+    ArrayVector<Int32>      child_;      // 2 entries per node
+    ArrayVector<Int32>      leaf_;       // offset into votes_ (leaves only)
+
+    // one entry per tree
+    ArrayVector<Int32>      root_;
+    ArrayVector<Int32>      depth_;
+
+    // class_count_ votes per leaf
+    ArrayVector<double>     votes_;
+    
+    int                     thread_count_;
+
+        /** Create an empty forest. 
+        */
+    CompiledRandomForest()
+    : thread_count_(0)
+    {}
+
+        /** Compile the given forest.
+        */
+    template <class PreprocessorTag>
+    explicit CompiledRandomForest(RandomForest<LabelType, PreprocessorTag> const & rf)
+    : thread_count_(0)
+    {
+        compile(rf);
+    }
+    
+        /** Replace the current contents with the compiled version 
+            of the given forest. The thread count is taken from 
+            the options of <tt>rf</tt>.
+        */
+    template <class PreprocessorTag>
+    void compile(RandomForest<LabelType, PreprocessorTag> const & rf);
+
+        /** Number of threads used for prediction (0: serial, 
+            negative: as many as available).
+        */
+    CompiledRandomForest & thread_count(int n)
+    {
+        thread_count_ = n;
+        return *this;
+    }
+    
+    int thread_count() const
+    {
+        return thread_count_;
+    }
+    
+    int tree_count() const
+    {
+        return root_.size();
+    }
+    
+    int node_count() const
+    {
+        return feature_.size();
+    }
+
+    int class_count() const
+    {
+        return ext_param_.class_count_;
+    }
+
+    int feature_count() const
+    {
+        return ext_param_.column_count_;
+    }
+
+        /** predict the class probabilities for multiple samples
+         
+            \param features an n x feature_count() matrix
+            \param prob an n x class_count() matrix
+        */
+    template <class U, class C1, class T, class C2>
+    void predictProbabilities(MultiArrayView<2, U, C1> const & features,
+                              MultiArrayView<2, T, C2> & prob) const;
+
+        /** predict the labels of multiple samples
+         
+            \param features an n x feature_count() matrix
+            \param labels an n x 1 matrix
+        */
+    template <class U, class C1, class T, class C2>
+    void predictLabels(MultiArrayView<2, U, C1> const & features,
+                       MultiArrayView<2, T, C2> & labels) const
+    {
+        vigra_precondition(features.shape(0) == labels.shape(0),
+            "CompiledRandomForest::predictLabels(): Label array has wrong size.");
+        MultiArray<2, double> prob(MultiArrayShape<2>::type(features.shape(0), class_count()));
+        predictProbabilities(features, prob);
+        for(int k=0; k<features.shape(0); ++k)
+        {
+            LabelType label;
+            ext_param_.to_classlabel(argMax(rowVector(prob, k)), label);
+            labels(k,0) = detail::RequiresExplicitCast<T>::cast(label);
+        }
+    }
+};
+
+template <class LabelType, class ThresholdType>
+template <class PreprocessorTag>
+void CompiledRandomForest<LabelType, ThresholdType>::compile(
+                              RandomForest<LabelType, PreprocessorTag> const & rf)
+{
+    typedef detail::DecisionTree::TreeInt TreeInt;
+    
+    ext_param_ = rf.ext_param_;
+    thread_count_ = rf.options().thread_count_;
+    feature_.clear();
+    threshold_.clear();
+    child_.clear();
+    leaf_.clear();
+    root_.clear();
+    depth_.clear();
+    votes_.clear();
+    
+    int class_count = ext_param_.class_count_;
+    int weighted = rf.options().predict_weighted_;
+
+    for(int k = 0; k < rf.tree_count(); ++k)
+    {
+        detail::DecisionTree const & tree = rf.tree(k);
+        
+        // breadth-first traversal, the children of a node are stored
+        // next to each other
+        std::deque<std::pair<TreeInt, int> > queue;   // (old index, depth)
+        int root = feature_.size(), depth = 0;
+        root_.push_back(root);
+        queue.push_back(std::make_pair(TreeInt(2), 0));
+        int next_free = root + 1;
+        while(!queue.empty())
+        {
+            TreeInt index = queue.front().first;
+            int node_depth = queue.front().second,
+                node = feature_.size();
+            queue.pop_front();
+            
+            switch(tree.topology_[index])
+            {
+                case i_ThresholdNode:
+                {
+                    Node<i_ThresholdNode> n(tree.topology_, tree.parameters_, index);
+                    feature_.push_back(n.column());
+                    threshold_.push_back(detail::rfRoundThresholdUp<ThresholdType>(n.threshold()));
+                    child_.push_back(next_free);
+                    child_.push_back(next_free + 1);
+                    leaf_.push_back(-1);
+                    next_free += 2;
+                    queue.push_back(std::make_pair(n.child(0), node_depth + 1));
+                    queue.push_back(std::make_pair(n.child(1), node_depth + 1));
+                    break;
+                }
+                case e_ConstProbNode:
+                {
+                    Node<e_ConstProbNode> n(tree.topology_, tree.parameters_, index);
+                    feature_.push_back(0);
+                    threshold_.push_back(ThresholdType());
+                    child_.push_back(node);
+                    child_.push_back(node);
+                    leaf_.push_back(votes_.size());
+                    // same computation as in RandomForest::predictProbabilities()
+                    ArrayVector<double>::const_iterator weights = n.prob_begin();
+                    for(int l=0; l<class_count; ++l)
+                        votes_.push_back(weights[l] * (weighted * (*(weights-1))
+                                                       + (1-weighted)));
+                    depth = std::max(depth, node_depth);
+                    break;
+                }
+                default:
+                    vigra_precondition(false,
+                        "CompiledRandomForest::compile(): Only forests consisting of "
+                        "threshold nodes and constant probability leaves can be compiled.");
+            }
+        }
+        depth_.push_back(depth);
+    }
+}
+
+template <class LabelType, class ThresholdType>
+template <class U, class C1, class T, class C2>
+void CompiledRandomForest<LabelType, ThresholdType>::predictProbabilities(
+                              MultiArrayView<2, U, C1> const & features,
+                              MultiArrayView<2, T, C2> & prob) const
+{
+    vigra_precondition(rowCount(features) == rowCount(prob),
+      "CompiledRandomForest::predictProbabilities():"
+        " Feature matrix and probability matrix size mismatch.");
+    vigra_precondition( columnCount(features) >= ext_param_.column_count_,
+      "CompiledRandomForest::predictProbabilities():"
+        " Too few columns in feature matrix.");
+    vigra_precondition( columnCount(prob)
+                        == (MultiArrayIndex)ext_param_.class_count_,
+      "CompiledRandomForest::predictProbabilities():"
+      " Probability matrix must have as many columns as there are classes.");
+
+    prob.init(NumericTraits<T>::zero());
+
+    int row_count   = rowCount(features);
+    int block_count = (row_count + BlockSize - 1) / BlockSize;
+    int class_count = ext_param_.class_count_;
+    int tree_count  = root_.size();
+
+    Int32 const * feature    = feature_.data();
+    Threshold_t const * threshold = threshold_.data();
+    Int32 const * child      = child_.data();
+    Int32 const * leaf       = leaf_.data();
+    double const * votes     = votes_.data();
+
+    ThreadExceptionCollector errors;
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) \
+                num_threads(actualThreadCount(thread_count_)) \
+                if(thread_count_ != 0 && block_count > 1)
+    #endif
+    for(int block = 0; block < block_count; ++block)
+    {
+        try
+        {
+            int begin = block * BlockSize,
+                end   = std::min(begin + BlockSize, row_count);
+                
+            double totalWeight[BlockSize];
+            std::fill(totalWeight, totalWeight + (end - begin), 0.0);
+
+            for(int k = 0; k < tree_count; ++k)
+            {
+                for(int lane_begin = begin; lane_begin < end; lane_begin += LaneCount)
+                {
+                    int lanes = std::min((int)LaneCount, end - lane_begin);
+                    MultiArrayView<2, U, C1> x = 
+                        features.subarray(MultiArrayShape<2>::type(lane_begin, 0), 
+                                          MultiArrayShape<2>::type(lane_begin + lanes, columnCount(features)));
+                    Int32 node[LaneCount];
+                    for(int j = 0; j < LaneCount; ++j)
+                        node[j] = root_[k];
+                    
+                    // branch-free descent: leaves point to themselves
+                    for(int d = 0; d < depth_[k]; ++d)
+                        for(int j = 0; j < lanes; ++j)
+                            node[j] = child[2*node[j] + 
+                                            !(x(j, feature[node[j]]) < threshold[node[j]])];
+
+                    for(int j = 0; j < lanes; ++j)
+                    {
+                        double const * w = votes + leaf[node[j]];
+                        int row = lane_begin + j;
+                        for(int l=0; l<class_count; ++l)
+                        {
+                            prob(row, l) += (T)w[l];
+                            totalWeight[row - begin] += w[l];
+                        }
+                    }
+                }
+            }
+
+            for(int row = begin; row < end; ++row)
+                for(int l=0; l<class_count; ++l)
+                    prob(row, l) /= detail::RequiresExplicitCast<T>::cast(totalWeight[row - begin]);
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_RF_COMPILED_HXX
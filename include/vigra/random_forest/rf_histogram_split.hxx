@@ -0,0 +1,549 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_RANDOM_FOREST_HISTOGRAM_SPLIT_HXX
+#define VIGRA_RANDOM_FOREST_HISTOGRAM_SPLIT_HXX
+
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include "../array_vector.hxx"
+#include "../multi_array.hxx"
+#include "../threading.hxx"
+#include "rf_nodeproxy.hxx"
+#include "rf_split.hxx"
+
+namespace vigra
+{
+
+/** \addtogroup MachineLearning
+**/
+//@{
+
+/** \brief Quantize the columns of a feature matrix into at most 256 bins.
+
+    The bin edges of each column are placed at (approximate) quantiles of 
+    the values passed to the constructor or init(), which may be a 
+    representative subset of the training data. If a column has no more 
+    distinct values than bins, every value gets its own bin, and the 
+    quantization is lossless for these values. Sample <tt>x</tt> falls into 
+    bin <tt>b</tt> of column <tt>c</tt> if 
+    <tt>edges_[c][b-1] <= x < edges_[c][b]</tt>.
+    
+    The quantized features (typically stored as a <tt>UInt8</tt> matrix, 
+    which needs 8 times less memory than <tt>double</tt>) are used to learn
+    a RandomForest with HistogramSplit. Since quantize() can be applied to 
+    arbitrary subsets of rows, the full feature matrix never needs to be 
+    in memory as <tt>double</tt>. The learned forest predicts quantized 
+    features, or original features after dequantize().
+    
+    <b>\#include</b> \<vigra/random_forest.hxx\><br>
+    Namespace: vigra
+    
+    \code
+    FeatureQuantizer quantizer(features);
+    MultiArray<2, UInt8> bins(features.shape());
+    quantizer.quantize(features, bins);
+    
+    RandomForest<int> rf;
+    rf.learn(bins, labels, rf_default(), HistogramSplit<>());
+    rf.predictLabels(bins, predicted);
+    
+    quantizer.dequantize(rf);    // now predict on the original features
+    rf.predictLabels(features, predicted);
+    \endcode
+*/
+class FeatureQuantizer
+{
+  public:
+        /** sorted bin edges of each column
+        */
+    ArrayVector<ArrayVector<double> > edges_;
+
+    FeatureQuantizer()
+    {}
+
+    template<class T, class C>
+    FeatureQuantizer(MultiArrayView<2, T, C> const & features, int bin_count = 256)
+    {
+        init(features, bin_count);
+    }
+
+        /** Compute the bin edges of all columns of \a features.
+            \a bin_count must be in [2, 256].
+        */
+    template<class T, class C>
+    void init(MultiArrayView<2, T, C> const & features, int bin_count = 256)
+    {
+        vigra_precondition(2 <= bin_count && bin_count <= 256,
+            "FeatureQuantizer::init(): bin_count must be in [2, 256].");
+        vigra_precondition(features.shape(0) > 0,
+            "FeatureQuantizer::init(): feature matrix is empty.");
+        MultiArrayIndex row_count = features.shape(0);
+        edges_.resize(features.shape(1));
+        ArrayVector<double> values(row_count);
+        for(int c = 0; c < (int)features.shape(1); ++c)
+        {
+            for(MultiArrayIndex k = 0; k < row_count; ++k)
+                values[k] = features(k, c);
+            std::sort(values.begin(), values.end());
+            
+            ArrayVector<double> & edges = edges_[c];
+            edges.clear();
+            MultiArrayIndex distinct = 1;
+            for(MultiArrayIndex k = 1; k < row_count && distinct <= bin_count; ++k)
+                if(values[k-1] < values[k])
+                    ++distinct;
+            if(distinct <= bin_count)
+            {
+                // one bin per value
+                for(MultiArrayIndex k = 1; k < row_count; ++k)
+                    if(values[k-1] < values[k])
+                        edges.push_back((values[k-1] + values[k]) / 2.0);
+            }
+            else
+            {
+                // move the quantiles to the next change of value
+                for(int b = 1; b < bin_count; ++b)
+                {
+                    MultiArrayIndex k = std::max<MultiArrayIndex>(1, b * row_count / bin_count);
+                    k = std::upper_bound(values.begin(), values.end(), values[k-1]) - values.begin();
+                    if(k == row_count)
+                        break;
+                    double edge = (values[k-1] + values[k]) / 2.0;
+                    if(edges.size() == 0 || edges.back() < edge)
+                        edges.push_back(edge);
+                }
+            }
+        }
+    }
+
+    MultiArrayIndex featureCount() const
+    {
+        return edges_.size();
+    }
+
+        /** number of bins of column \a c.
+        */
+    int binCount(int c) const
+    {
+        return edges_[c].size() + 1;
+    }
+
+        /** bin of value \a x in column \a c.
+        */
+    template<class T>
+    int bin(int c, T x) const
+    {
+        return std::upper_bound(edges_[c].begin(), edges_[c].end(), (double)x) - edges_[c].begin();
+    }
+
+        /** Replace each entry of \a features with its bin index. 
+            \a features may contain any subset of the rows passed to init(), 
+            or entirely new samples. The columns are distributed over 
+            \a thread_count threads (see RandomForestOptions::thread_count()).
+        */
+    template<class T, class C1, class U, class C2>
+    void quantize(MultiArrayView<2, T, C1> const & features, 
+                  MultiArrayView<2, U, C2> bins, int thread_count = 0) const
+    {
+        vigra_precondition(features.shape() == bins.shape(),
+            "FeatureQuantizer::quantize(): shape mismatch between input and output.");
+        vigra_precondition(features.shape(1) == featureCount(),
+            "FeatureQuantizer::quantize(): wrong number of columns.");
+        int column_count = (int)features.shape(1);
+        #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(actualThreadCount(thread_count)) if(thread_count != 0 && column_count > 1)
+        #endif
+        for(int c = 0; c < column_count; ++c)
+            for(MultiArrayIndex k = 0; k < features.shape(0); ++k)
+                bins(k, c) = detail::RequiresExplicitCast<U>::cast(bin(c, features(k, c)));
+    }
+
+        /** Convert the thresholds of a forest learned on quantized features 
+            into thresholds on the original features. Afterwards, the forest 
+            must be applied to original (not quantized) features. This must 
+            be called only once per forest.
+        */
+    template<class RF>
+    void dequantize(RF & rf) const
+    {
+        typedef detail::DecisionTree::TreeInt TreeInt;
+        vigra_precondition(rf.column_count() == featureCount(),
+            "FeatureQuantizer::dequantize(): wrong number of columns.");
+        for(int k = 0; k < rf.tree_count(); ++k)
+        {
+            detail::DecisionTree & tree = rf.tree(k);
+            std::vector<TreeInt> stack(1, TreeInt(2));
+            while(!stack.empty())
+            {
+                TreeInt index = stack.back();
+                stack.pop_back();
+                switch(tree.topology_[index])
+                {
+                    case i_ThresholdNode:
+                    {
+                        Node<i_ThresholdNode> node(tree.topology_, tree.parameters_, index);
+                        ArrayVector<double> const & edges = edges_[node.column()];
+                        // thresholds lie between the bins: x < b + 0.5 <=> bin(x) <= b
+                        int b = (int)node.threshold();
+                        node.threshold() = b < (int)edges.size()
+                                               ? edges[b]
+                                               : std::numeric_limits<double>::infinity();
+                        stack.push_back(node.child(0));
+                        stack.push_back(node.child(1));
+                        break;
+                    }
+                    case e_ConstProbNode:
+                        break;
+                    default:
+                        vigra_precondition(false,
+                            "FeatureQuantizer::dequantize(): Only threshold nodes can be dequantized.");
+                }
+            }
+        }
+    }
+};
+
+/** \brief Split functor for quantized features, based on class histograms.
+
+    The features must be bin indices in [0, bin_count) (typically a 
+    <tt>UInt8</tt> matrix computed by FeatureQuantizer). Instead of sorting 
+    the samples of a node along each candidate column, HistogramSplit counts 
+    the classes in each bin and evaluates the loss (GiniCriterion or 
+    EntropyCriterion) at all bin boundaries, so that the cost per node and 
+    column is linear in the number of samples. The thresholds of the 
+    resulting threshold nodes lie between the bins (<tt>b + 0.5</tt>).
+    
+    The histograms of the columns tried at a node are cached. When one child
+    of that node tries the same column, the histogram of its sibling is 
+    obtained by subtraction (the histograms of both children add up to the 
+    parent's). Since every node draws its candidate columns at random, this 
+    pays off mainly when many columns are tried per node 
+    (RandomForestOptions::features_per_node()).
+    
+    Random numbers are drawn exactly like ThresholdSplit does. If the 
+    quantization was lossless, the learned trees are therefore identical to 
+    those of ThresholdSplit<BestGiniOfColumn<LossTag> > on the original 
+    features after FeatureQuantizer::dequantize().
+    
+    <b>\#include</b> \<vigra/random_forest.hxx\><br>
+    Namespace: vigra
+*/
+template<class LossTag = GiniCriterion>
+class HistogramSplit: public SplitBase<ClassificationTag>
+{
+  public:
+    typedef SplitBase<ClassificationTag> SB;
+
+    ArrayVector<Int32>          splitColumns;
+    double                      region_gini_;
+    double                      min_gini_;
+    int                         best_column_;
+    double                      best_threshold_;
+    int                         bin_count_;
+
+        /** Histograms of the columns tried at a node, for the 
+            sibling subtraction.
+        */
+    struct HistogramCache
+    {
+        // index ranges of both children
+        void const *            child_begin_[2];
+        MultiArrayIndex         child_size_[2];
+        // the child that was processed first, or -1
+        int                     first_child_;
+        ArrayVector<Int32>      columns_;
+        // bins x classes x columns_.size()
+        MultiArray<3, double>   histograms_;
+        // true when histograms_ holds the parent histogram minus that
+        // of the first child
+        ArrayVector<bool>       subtracted_;
+    };
+    std::vector<HistogramCache> cache_;
+    int                         cache_size_;
+
+    MultiArray<2, double>       histogram_;
+    ArrayVector<double>         left_, right_;
+
+        /** \a bin_count is the number of different feature values.
+        */
+    HistogramSplit(int bin_count = 256)
+    : bin_count_(bin_count),
+      cache_size_(0)
+    {}
+
+    double minGini() const
+    {
+        return min_gini_;
+    }
+
+    int bestSplitColumn() const
+    {
+        return best_column_;
+    }
+
+    double bestSplitThreshold() const
+    {
+        return best_threshold_;
+    }
+
+    template<class T>
+    void set_external_parameters(ProblemSpec<T> const & in)
+    {
+        SB::set_external_parameters(in);
+        int featureCount_ = SB::ext_param_.column_count_;
+        splitColumns.resize(featureCount_);
+        for(int k=0; k<featureCount_; ++k)
+            splitColumns[k] = k;
+        histogram_.reshape(MultiArrayShape<2>::type(bin_count_, SB::ext_param_.class_count_));
+        left_.resize(SB::ext_param_.class_count_);
+        right_.resize(SB::ext_param_.class_count_);
+        cache_.clear();
+        cache_size_ = 0;
+    }
+
+    template<class T, class C, class T2, class C2, class Region, class Random>
+    int findBestSplit(MultiArrayView<2, T, C> features,
+                      MultiArrayView<2, T2, C2>  labels,
+                      Region & region,
+                      ArrayVector<Region>& childRegions,
+                      Random & randint);
+
+  private:
+    template<class Region>
+    int findInCache(Region & region);
+
+    template<class T, class C, class T2, class C2, class Iter, class Hist>
+    void countBins(MultiArrayView<2, T, C> const & features,
+                   MultiArrayView<2, T2, C2> const & labels,
+                   int column, Iter begin, Iter end, Hist & histogram) const
+    {
+        histogram.init(0.0);
+        for(Iter i = begin; i != end; ++i)
+        {
+            UInt32 b = (UInt32)features(*i, column);
+            vigra_precondition(b < (UInt32)bin_count_,
+                "HistogramSplit::findBestSplit(): features must be bin indices in [0, bin_count) "
+                "(see FeatureQuantizer).");
+            histogram(b, labels(*i, 0)) += 1.0;
+        }
+    }
+};
+
+template<class LossTag>
+template<class Region>
+int HistogramSplit<LossTag>::findInCache(Region & region)
+{
+    // The tree is learned depth-first, so the cache entries of completed
+    // subtrees lie above the entry of the region's parent.
+    void const * begin = &*region.begin();
+    for(; cache_size_ > 0; --cache_size_)
+    {
+        HistogramCache & entry = cache_[cache_size_-1];
+        for(int j = 0; j < 2; ++j)
+            if(entry.child_begin_[j] == begin && entry.child_size_[j] == region.size())
+                return j;
+    }
+    return -1;
+}
+
+template<class LossTag>
+template<class T, class C, class T2, class C2, class Region, class Random>
+int HistogramSplit<LossTag>::findBestSplit(MultiArrayView<2, T, C> features,
+                                           MultiArrayView<2, T2, C2>  labels,
+                                           Region & region,
+                                           ArrayVector<Region>& childRegions,
+                                           Random & randint)
+{
+    typedef typename Region::IndexIterator IndexIterator;
+    typedef MultiArrayShape<3>::type Shp3;
+    typedef MultiArrayView<2, double> Histogram;
+    
+    int class_count = SB::ext_param_.class_count_;
+    ArrayVector<double> const & class_weights = SB::ext_param_.class_weights_;
+    
+    if(region.size() == 0)
+    {
+       std::cerr << "SplitFunctor::findBestSplit(): stackentry with 0 examples encountered\n"
+                    "continuing learning process...."; 
+    }
+    detail::Correction<ClassificationTag>::exec(region, labels);
+
+    // Is the region pure already?
+    double region_total = std::accumulate(region.classCounts().begin(), 
+                                          region.classCounts().end(), 0.0);
+    region_gini_ = LossTag::impurity(region.classCounts(), class_weights, region_total);
+    if(region_gini_ <= SB::ext_param_.precision_)
+        return  this->makeTerminalNode(features, labels, region, randint);
+
+    // select columns  to be tried.
+    int mtry = SB::ext_param_.actual_mtry_;
+    for(int ii = 0; ii < mtry; ++ii)
+        std::swap(splitColumns[ii], 
+                  splitColumns[ii+ randint(features.shape(1) - ii)]);
+
+    // the histograms of this node are written into the cache entry 
+    // above the parent's, which is pushed when the node is split
+    int child = findInCache(region);
+    if(cache_size_ == (int)cache_.size())
+        cache_.push_back(HistogramCache());
+    HistogramCache & current = cache_[cache_size_];
+    
+    // histograms of the parent and the sibling
+    HistogramCache * parent = child >= 0 
+                                 ? &cache_[cache_size_-1]
+                                 : 0;
+    bool first_child = parent != 0 && parent->first_child_ < 0;
+    if(first_child)
+        parent->first_child_ = child;
+    current.histograms_.reshape(Shp3(bin_count_, class_count, mtry));
+    current.columns_.resize(mtry);
+    current.subtracted_.resize(mtry);
+
+    double current_min_gini = region_gini_;
+    int    num2try          = features.shape(1);
+    for(int k=0; k<num2try; ++k)
+    {
+        int column = splitColumns[k];
+        Histogram histogram = k < mtry
+                                  ? current.histograms_.bindOuter(k)
+                                  : Histogram(histogram_);
+        if(k < mtry)
+        {
+            current.columns_[k] = column;
+            current.subtracted_[k] = false;
+        }
+
+        int p = -1;
+        if(parent != 0)
+            p = std::find(parent->columns_.begin(), parent->columns_.end(), column) 
+                      - parent->columns_.begin();
+        if(p >= 0 && p < (int)parent->columns_.size() && parent->subtracted_[p])
+        {
+            // the sibling has subtracted its histogram from the parent's
+            histogram = parent->histograms_.bindOuter(p);
+        }
+        else
+        {
+            countBins(features, labels, column, region.begin(), region.end(), histogram);
+            if(first_child && p >= 0 && p < (int)parent->columns_.size())
+            {
+                parent->histograms_.bindOuter(p) -= histogram;
+                parent->subtracted_[p] = true;
+            }
+        }
+
+        // try all boundaries between non-empty bins
+        std::fill(left_.begin(), left_.end(), 0.0);
+        std::copy(region.classCounts().begin(), region.classCounts().end(), right_.begin());
+        double left_total = 0.0;
+        for(int b = 0; b < bin_count_ - 1; ++b)
+        {
+            double bin_total = 0.0;
+            for(int l = 0; l < class_count; ++l)
+            {
+                left_[l]  += histogram(b, l);
+                right_[l] -= histogram(b, l);
+                bin_total += histogram(b, l);
+            }
+            if(bin_total == 0.0)
+                continue;
+            left_total += bin_total;
+            if(left_total >= region_total)
+                break;
+            double loss = LossTag::impurity(left_, class_weights, left_total)
+                        + LossTag::impurity(right_, class_weights, region_total - left_total);
+#ifdef CLASSIFIER_TEST
+            if(loss < current_min_gini && !closeAtTolerance(loss, current_min_gini))
+#else
+            if(loss < current_min_gini)
+#endif
+            {
+                current_min_gini = loss;
+                best_column_     = column;
+                best_threshold_  = b + 0.5;
+                childRegions[0].classCounts() = left_;
+                childRegions[1].classCounts() = right_;
+                childRegions[0].classCountsIsValid = true;
+                childRegions[1].classCountsIsValid = true;
+                num2try = mtry;
+            }
+        }
+    }
+    min_gini_ = current_min_gini;
+    
+    // did not find any suitable split
+    if(closeAtTolerance(current_min_gini, region_gini_))
+        return  this->makeTerminalNode(features, labels, region, randint);
+    
+    //create a Node for output
+    Node<i_ThresholdNode>   node(SB::t_data, SB::p_data);
+    SB::node_ = node;
+    node.threshold()    = best_threshold_;
+    node.column()       = best_column_;
+    
+    // partition the range according to the best dimension 
+    SortSamplesByDimensions<MultiArrayView<2, T, C> > 
+        sorter(features, node.column(), node.threshold());
+    IndexIterator bestSplit =
+        std::partition(region.begin(), region.end(), sorter);
+    // Save the ranges of the child stack entries.
+    childRegions[0].setRange(   region.begin()  , bestSplit       );
+    childRegions[0].rule = region.rule;
+    childRegions[0].rule.push_back(std::make_pair(1, 1.0));
+    childRegions[1].setRange(   bestSplit       , region.end()    );
+    childRegions[1].rule = region.rule;
+    childRegions[1].rule.push_back(std::make_pair(1, 1.0));
+    
+    // keep the histograms for the children
+    current.child_begin_[0] = &*childRegions[0].begin();
+    current.child_size_[0]  = childRegions[0].size();
+    current.child_begin_[1] = &*childRegions[1].begin();
+    current.child_size_[1]  = childRegions[1].size();
+    current.first_child_    = -1;
+    ++cache_size_;
+
+    return i_ThresholdNode;
+}
+
+typedef HistogramSplit<GiniCriterion>       GiniHistogramSplit;
+typedef HistogramSplit<EntropyCriterion>    EntropyHistogramSplit;
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_RANDOM_FOREST_HISTOGRAM_SPLIT_HXX
@@ -44,6 +44,7 @@
 #include "../matrix.hxx"
 #include "../random.hxx"
 #include "../functorexpression.hxx"
+#include "../threading.hxx"
 #include "rf_nodeproxy.hxx"
 //#include "rf_sampling.hxx"
 #include "rf_region.hxx"
@@ -824,6 +825,153 @@ struct LossTraits<LSQLoss, Datatype>
     typedef RegressionForestCounter<Datatype> type;
 };
 
+/** \brief Sample order along each feature column, computed once per forest.
+
+    Sorting the samples of every node along each candidate column dominates 
+    the learning time. PresortedFeatures sorts all columns of the feature 
+    matrix once. The samples of a large node are then ordered in linear time 
+    by scanning the cached order, the samples of a small node by sorting their
+    (contiguous, integer) ranks instead of comparing feature values
+    (see RandomForestOptions::presort_features()). The cache needs 
+    <tt>2*rowCount(features)*columnCount(features)</tt> 32-bit integers.
+*/
+class PresortedFeatures
+{
+  public:
+        /** order_(k, c) is the index of the sample with the k-th smallest 
+            value in column c (ties are ordered by sample index).
+        */
+    MultiArray<2, Int32> order_;
+        /** rank_(i, c) is the position of sample i in order_(., c).
+        */
+    MultiArray<2, Int32> rank_;
+
+    PresortedFeatures()
+    {}
+
+    template<class T, class C>
+    PresortedFeatures(MultiArrayView<2, T, C> const & features, int thread_count = 0)
+    {
+        init(features, thread_count);
+    }
+
+        /** Sort all columns of \a features, using \a thread_count threads
+            (see RandomForestOptions::thread_count()).
+        */
+    template<class T, class C>
+    void init(MultiArrayView<2, T, C> const & features, int thread_count = 0)
+    {
+        typedef MultiArrayView<2, T, C> DataMatrix;
+        order_.reshape(features.shape());
+        rank_.reshape(features.shape());
+        int column_count = (int)features.shape(1);
+        Int32 sample_count = (Int32)features.shape(0);
+
+        #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(actualThreadCount(thread_count)) if(thread_count != 0 && column_count > 1)
+        #endif
+        for(int c = 0; c < column_count; ++c)
+        {
+            Int32 * order = &order_(0, c);
+            for(Int32 k = 0; k < sample_count; ++k)
+                order[k] = k;
+            std::stable_sort(order, order + sample_count, 
+                             SortSamplesByDimensions<DataMatrix>(features, c));
+            for(Int32 k = 0; k < sample_count; ++k)
+                rank_(order[k], c) = k;
+        }
+    }
+
+    MultiArrayIndex sampleCount() const
+    {
+        return order_.shape(0);
+    }
+
+    MultiArrayIndex featureCount() const
+    {
+        return order_.shape(1);
+    }
+
+        /** Sort the sample indices in [begin, end) (duplicates are allowed)
+            along feature \a c. \a buffer is scratch memory whose first 
+            sampleCount() entries must be zero (they are zero again on return).
+        */
+    template<class Iter>
+    void sortRange(int c, Iter begin, Iter end, ArrayVector<Int32> & buffer) const
+    {
+        sortRangeImpl(c, begin, end, buffer);
+    }
+
+        /** Same as above, but additionally copy the feature values of the
+            sorted range into \a values (which must be a contiguous column 
+            with <tt>end - begin</tt> entries).
+        */
+    template<class Iter, class DataMatrix, class Values>
+    void sortRange(int c, Iter begin, Iter end, ArrayVector<Int32> & buffer,
+                   DataMatrix const & column, Values * values) const
+    {
+        sortRangeImpl(c, begin, end, buffer);
+        for(Iter i = begin; i != end; ++i, ++values)
+            *values = column(*i, 0);
+    }
+
+  private:
+    template<class Iter>
+    void sortRangeImpl(int c, Iter begin, Iter end, ArrayVector<Int32> & buffer) const
+    {
+        MultiArrayIndex n = end - begin, 
+                        sample_count = sampleCount();
+        if(buffer.size() < (std::size_t)(2*sample_count))
+            buffer.resize(2*sample_count, 0);
+        Int32 const * order = &order_(0, c);
+        // scanning the cached order touches up to sampleCount() entries,
+        // sorting needs about n*log(n) operations
+        if((double)n * std::log((double)n + 1.0) < (double)sample_count)
+        {
+            Int32 * ranks = buffer.begin() + sample_count;
+            Int32 * k = ranks;
+            for(Iter i = begin; i != end; ++i, ++k)
+                *k = rank_(*i, c);
+            std::sort(ranks, k);
+            k = ranks;
+            for(Iter i = begin; i != end; ++i, ++k)
+                *i = order[*k];
+        }
+        else
+        {
+            Int32 * count = buffer.begin();
+            for(Iter i = begin; i != end; ++i)
+                ++count[rank_(*i, c)];
+            for(Iter out = begin; out != end; ++order, ++count)
+            {
+                for(; *count > 0; --*count, ++out)
+                    *out = *order;
+            }
+        }
+    }
+};
+
+namespace detail
+{
+    // feature values of a range of sample indices, see
+    // BestGiniOfColumn::bestSplitOfSortedValues()
+    template<class DataSourceF_t, class I_Iter>
+    class ValuesOfRange
+    {
+        DataSourceF_t const & column_;
+        I_Iter begin_;
+      public:
+        ValuesOfRange(DataSourceF_t const & column, I_Iter begin)
+        : column_(column), begin_(begin)
+        {}
+
+        typename DataSourceF_t::value_type operator[](std::ptrdiff_t k) const
+        {
+            return column_(begin_[k], 0);
+        }
+    };
+}
+
 /** Given a column, choose a split that minimizes some loss
  */
 template<class LineSearchLossTag>
@@ -897,27 +1045,60 @@ public:
     {
         std::sort(begin, end, 
                   SortSamplesByDimensions<DataSourceF_t>(column, 0));
+        bestSplitOfSortedRange(column, labels, begin, end, region_response);
+    }
+
+    /** same as operator(), but the range begin - end must already be sorted 
+     *  by the column supplied.
+     */
+    template<   class DataSourceF_t,
+                class DataSource_t, 
+                class I_Iter, 
+                class Array>
+    void bestSplitOfSortedRange(DataSourceF_t   const & column,
+                                DataSource_t    const & labels,
+                                I_Iter                & begin, 
+                                I_Iter                & end,
+                                Array           const & region_response)
+    {
+        bestSplitOfSortedValues(detail::ValuesOfRange<DataSourceF_t, I_Iter>(column, begin),
+                                labels, begin, end, region_response);
+    }
+
+    /** same as bestSplitOfSortedRange(), but the feature values of the 
+     *  sorted range are given by <tt>values[k]</tt> (the value of sample 
+     *  <tt>begin[k]</tt>), e.g. a contiguous copy made by 
+     *  PresortedFeatures::sortRange().
+     */
+    template<   class Values,
+                class DataSource_t, 
+                class I_Iter, 
+                class Array>
+    void bestSplitOfSortedValues(Values          const & values,
+                                 DataSource_t    const & labels,
+                                 I_Iter                & begin, 
+                                 I_Iter                & end,
+                                 Array           const & region_response)
+    {
         typedef typename 
             LossTraits<LineSearchLossTag, DataSource_t>::type LineSearchLoss;
         LineSearchLoss left(labels, ext_param_); //initialize left and right region
         LineSearchLoss right(labels, ext_param_);
 
-        
-
         min_gini_ = right.init(begin, end, region_response);  
         min_threshold_ = *begin;
         min_index_     = 0;  //the starting point where to split 
-        DimensionNotEqual<DataSourceF_t> comp(column, 0); 
         
-        I_Iter iter = begin;
-        I_Iter next = std::adjacent_find(iter, end, comp);
-		//std::cerr << std::distance(begin, end) << std::endl;
-        while( next  != end)
+        std::ptrdiff_t size = end - begin, 
+                       iter = 0;
+        for(std::ptrdiff_t next = 0; next + 1 < size; ++next)
         {
-			double lr  =  right.decrement(iter, next + 1);
-			double ll  =  left.increment(iter , next + 1);
+            // only split between different values
+            if(!(values[next] != values[next + 1]))
+                continue;
+			double lr  =  right.decrement(begin + iter, begin + next + 1);
+			double ll  =  left.increment(begin + iter, begin + next + 1);
             double loss = lr +ll;
-			//std::cerr <<lr << " + "<< ll << " " << loss << " ";
 #ifdef CLASSIFIER_TEST
             if(loss < min_gini_ && !closeAtTolerance(loss, min_gini_))
 #else
@@ -931,15 +1112,11 @@ public:
 #else
                 min_gini_       = loss; 
 #endif
-                min_index_      = next - begin +1 ;
-                min_threshold_  = (double(column(*next,0)) + double(column(*(next +1), 0)))/2.0;
+                min_index_      = next + 1;
+                min_threshold_  = (double(values[next]) + double(values[next + 1]))/2.0;
             }
-            iter = next +1 ;
-            next = std::adjacent_find(iter, end, comp);
+            iter = next + 1;
         }
-		//std::cerr << std::endl << " 000 " << std::endl;
-		//int in;
-		//std::cin >> in;
     }
 
     template<class DataSource_t, class Iter, class Array>
@@ -959,6 +1136,35 @@ public:
 
 namespace detail
 {
+    // Only BestGiniOfColumn makes use of presorted features, other column
+    // decision functors sort the range themselves.
+    template<class ColumnDecisionFunctor, class Count, class DataSourceF_t,
+             class DataSource_t, class I_Iter, class Array>
+    inline void 
+    presortedColumnDecision(ColumnDecisionFunctor & functor, 
+                            PresortedFeatures const &, int, Count &,
+                            DataSourceF_t const & column, DataSource_t const & labels,
+                            I_Iter & begin, I_Iter & end, Array const & region_response)
+    {
+        functor(column, labels, begin, end, region_response);
+    }
+
+    template<class LineSearchLossTag, class Count, class DataSourceF_t,
+             class DataSource_t, class I_Iter, class Array>
+    inline void 
+    presortedColumnDecision(BestGiniOfColumn<LineSearchLossTag> & functor, 
+                            PresortedFeatures const & presorted, int c, Count & buffer,
+                            DataSourceF_t const & column, DataSource_t const & labels,
+                            I_Iter & begin, I_Iter & end, Array const & region_response)
+    {
+        // a contiguous copy of the sorted values makes the line search 
+        // much more cache friendly
+        typedef typename DataSourceF_t::value_type T;
+        ArrayVector<T> values(end - begin);
+        presorted.sortRange(c, begin, end, buffer, column, values.begin());
+        functor.bestSplitOfSortedValues(values.begin(), labels, begin, end, region_response);
+    }
+
 	template<class T>
 	struct Correction
 	{
@@ -1007,6 +1213,13 @@ class ThresholdSplit: public SplitBase<Tag>
 
     int                         bestSplitIndex;
 
+    PresortedFeatures const *   presorted_;
+    ArrayVector<Int32>          presort_buffer_;
+
+    ThresholdSplit()
+    : presorted_(0)
+    {}
+
     double minGini() const
     {
         return min_gini_[bestSplitIndex];
@@ -1034,6 +1247,20 @@ class ThresholdSplit: public SplitBase<Tag>
         min_thresholds_.resize(featureCount_);
     }
 
+    /** Use the column order cached in \a presorted (which must have been 
+     *  computed from the features passed to findBestSplit()) instead of 
+     *  sorting the samples of every node. Pass 0 to switch back to sorting.
+     *  The learned trees are the same in both cases (for regression up to
+     *  round-off). RandomForest::learn() does this automatically when 
+     *  RandomForestOptions::presort_features() is set.
+     */
+    void set_presorted_features(PresortedFeatures const * presorted)
+    {
+        presorted_ = presorted;
+        if(presorted_ != 0)
+            presort_buffer_.resize(2*presorted_->sampleCount(), 0);
+    }
+
 
     template<class T, class C, class T2, class C2, class Region, class Random>
     int findBestSplit(MultiArrayView<2, T, C> features,
@@ -1070,13 +1297,25 @@ class ThresholdSplit: public SplitBase<Tag>
         bestSplitIndex              = 0;
         double  current_min_gini    = region_gini_;
         int     num2try             = features.shape(1);
+        vigra_precondition(presorted_ == 0 || 
+                (presorted_->sampleCount() == features.shape(0) &&
+                 presorted_->featureCount() == features.shape(1)),
+            "ThresholdSplit::findBestSplit(): presorted features don't match the feature matrix.");
         for(int k=0; k<num2try; ++k)
         {
             //this functor does all the work
-            bgfunc(columnVector(features, splitColumns[k]),
-                   labels, 
-                   region.begin(), region.end(), 
-                   region.classCounts());
+            if(presorted_ != 0)
+                detail::presortedColumnDecision(bgfunc, *presorted_, 
+                                                splitColumns[k], presort_buffer_,
+                                                columnVector(features, splitColumns[k]),
+                                                labels, 
+                                                region.begin(), region.end(), 
+                                                region.classCounts());
+            else
+                bgfunc(columnVector(features, splitColumns[k]),
+                       labels, 
+                       region.begin(), region.end(), 
+                       region.classCounts());
             min_gini_[k]            = bgfunc.min_gini_; 
             min_indices_[k]         = bgfunc.min_index_;
             min_thresholds_[k]      = bgfunc.min_threshold_;
@@ -1129,6 +1368,22 @@ typedef  ThresholdSplit<BestGiniOfColumn<GiniCriterion> >                 	 Gini
 typedef  ThresholdSplit<BestGiniOfColumn<EntropyCriterion> >                 EntropySplit;
 typedef  ThresholdSplit<BestGiniOfColumn<LSQLoss>, RegressionTag>         	 RegressionSplit;
 
+namespace detail
+{
+    // Called by RandomForest::learn() if RandomForestOptions::presort_features()
+    // is set. Split functors other than ThresholdSplit don't use the cache.
+    template<class Split>
+    inline void setPresortedFeatures(Split &, PresortedFeatures const *)
+    {}
+
+    template<class ColumnDecisionFunctor, class Tag>
+    inline void setPresortedFeatures(ThresholdSplit<ColumnDecisionFunctor, Tag> & split, 
+                                     PresortedFeatures const * presorted)
+    {
+        split.set_presorted_features(presorted);
+    }
+}
+
 namespace rf
 {
 
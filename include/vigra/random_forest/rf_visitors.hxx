@@ -101,6 +101,13 @@ namespace visitors
 class VisitorBase
 {
     public:
+    /** Visitors that support parallel learning (see prepare_thread_copy()
+     * and merge()) must be copyable and redefine this as VigraTrueType.
+     * Otherwise, all threads share the same visitor object and the calls 
+     * to it are serialized.
+     */
+    typedef VigraFalseType ThreadCopy_t;
+
     bool active_;   
     bool is_active()
     {
@@ -216,6 +223,25 @@ class VisitorBase
     {
         return -1.0;
     }
+
+    /** prepare a copy of this visitor that is used by a single thread 
+     * when the trees are learned in parallel 
+     * (see RandomForestOptions::thread_count() and ThreadCopy_t).
+     *
+     * The copy is made after visit_at_beginning() and sees only the trees
+     * learned by its thread. Reset everything here that is accumulated
+     * over the trees - it will be handed back via merge().
+     */
+    void prepare_thread_copy()
+    {}
+
+    /** add the state accumulated by a thread copy (see 
+     * prepare_thread_copy()) to this visitor. Called once per thread 
+     * before visit_at_end().
+     */
+    template<class Visitor>
+    void merge(Visitor const & other)
+    {}
 };
 
 
@@ -224,6 +250,8 @@ class VisitorBase
 class StopVisiting: public VisitorBase
 {
     public:
+    typedef VigraTrueType ThreadCopy_t;
+
     bool has_value()
     {
         return true;
@@ -321,6 +349,216 @@ class VisitorNode
     }
 };
 
+/** Per-thread representative of a single visitor during parallel learning.
+ *
+ * Visitors with <tt>ThreadCopy_t == VigraTrueType</tt> are copied, all others
+ * are shared between the threads and called inside a critical section.
+ */
+template <class Visitor, class ThreadCopy = typename Visitor::ThreadCopy_t>
+class ThreadLocalVisitor;
+
+template <class Visitor>
+class ThreadLocalVisitor<Visitor, VigraTrueType>
+{
+    public:
+    
+    Visitor visitor_;
+    
+    ThreadLocalVisitor(Visitor & visitor)
+    :
+        visitor_(visitor)
+    {
+        visitor_.prepare_thread_copy();
+    }
+
+    Visitor & get()
+    {
+        return visitor_;
+    }
+
+    template<class Tree, class Split, class Region, class Feature_t, class Label_t>
+    void visit_after_split( Tree          & tree, 
+                            Split         & split,
+                            Region        & parent,
+                            Region        & leftChild,
+                            Region        & rightChild,
+                            Feature_t     & features,
+                            Label_t       & labels)
+    {
+        visitor_.visit_after_split(tree, split, 
+                                   parent, leftChild, rightChild,
+                                   features, labels);
+    }
+
+    template<class RF, class PR, class SM, class ST>
+    void visit_after_tree(RF& rf, PR & pr,  SM & sm, ST & st, int index)
+    {
+        visitor_.visit_after_tree(rf, pr, sm, st, index);
+    }
+
+    template<class TR, class IntT, class TopT,class Feat>
+    void visit_external_node(TR & tr, IntT & index, TopT & node_t,Feat & features)
+    {
+        visitor_.visit_external_node(tr, index, node_t,features);
+    }
+
+    template<class TR, class IntT, class TopT,class Feat>
+    void visit_internal_node(TR & tr, IntT & index, TopT & node_t,Feat & features)
+    {
+        visitor_.visit_internal_node(tr, index, node_t,features);
+    }
+    
+    void merge_into(Visitor & visitor) const
+    {
+        visitor.merge(visitor_);
+    }
+};
+
+template <class Visitor>
+class ThreadLocalVisitor<Visitor, VigraFalseType>
+{
+    public:
+    
+    Visitor & visitor_;
+    
+    ThreadLocalVisitor(Visitor & visitor)
+    :
+        visitor_(visitor)
+    {}
+
+    Visitor & get()
+    {
+        return visitor_;
+    }
+
+    template<class Tree, class Split, class Region, class Feature_t, class Label_t>
+    void visit_after_split( Tree          & tree, 
+                            Split         & split,
+                            Region        & parent,
+                            Region        & leftChild,
+                            Region        & rightChild,
+                            Feature_t     & features,
+                            Label_t       & labels)
+    {
+        #ifdef _OPENMP
+        #pragma omp critical(vigra_rf_shared_visitor)
+        #endif
+        visitor_.visit_after_split(tree, split, 
+                                   parent, leftChild, rightChild,
+                                   features, labels);
+    }
+
+    template<class RF, class PR, class SM, class ST>
+    void visit_after_tree(RF& rf, PR & pr,  SM & sm, ST & st, int index)
+    {
+        #ifdef _OPENMP
+        #pragma omp critical(vigra_rf_shared_visitor)
+        #endif
+        visitor_.visit_after_tree(rf, pr, sm, st, index);
+    }
+
+    template<class TR, class IntT, class TopT,class Feat>
+    void visit_external_node(TR & tr, IntT & index, TopT & node_t,Feat & features)
+    {
+        #ifdef _OPENMP
+        #pragma omp critical(vigra_rf_shared_visitor)
+        #endif
+        visitor_.visit_external_node(tr, index, node_t,features);
+    }
+
+    template<class TR, class IntT, class TopT,class Feat>
+    void visit_internal_node(TR & tr, IntT & index, TopT & node_t,Feat & features)
+    {
+        #ifdef _OPENMP
+        #pragma omp critical(vigra_rf_shared_visitor)
+        #endif
+        visitor_.visit_internal_node(tr, index, node_t,features);
+    }
+    
+    void merge_into(Visitor &) const
+    {}
+};
+
+/** Thread copy of a statically linked visitor list, used by 
+ * RandomForest::learn() when the trees are learned in parallel.
+ *
+ * The primary template handles the end of the list, the specialization
+ * below unrolls the VisitorNode objects.
+ */
+template <class Visitor>
+class VisitorThreadCopy
+: public ThreadLocalVisitor<Visitor>
+{
+    public:
+    
+    VisitorThreadCopy(Visitor & visitor)
+    :
+        ThreadLocalVisitor<Visitor>(visitor)
+    {}
+};
+
+template <class Visitor, class Next>
+class VisitorThreadCopy<VisitorNode<Visitor, Next> >
+{
+    public:
+    
+    ThreadLocalVisitor<Visitor> visitor_;
+    VisitorThreadCopy<Next>     next_;
+    
+    VisitorThreadCopy(VisitorNode<Visitor, Next> & node)
+    :
+        visitor_(node.visitor_), next_(node.next_)
+    {}
+
+    template<class Tree, class Split, class Region, class Feature_t, class Label_t>
+    void visit_after_split( Tree          & tree, 
+                            Split         & split,
+                            Region        & parent,
+                            Region        & leftChild,
+                            Region        & rightChild,
+                            Feature_t     & features,
+                            Label_t       & labels)
+    {
+        if(visitor_.get().is_active())
+            visitor_.visit_after_split(tree, split, 
+                                       parent, leftChild, rightChild,
+                                       features, labels);
+        next_.visit_after_split(tree, split, parent, leftChild, rightChild,
+                                features, labels);
+    }
+
+    template<class RF, class PR, class SM, class ST>
+    void visit_after_tree(RF& rf, PR & pr,  SM & sm, ST & st, int index)
+    {
+        if(visitor_.get().is_active())
+            visitor_.visit_after_tree(rf, pr, sm, st, index);
+        next_.visit_after_tree(rf, pr, sm, st, index);
+    }
+    
+    template<class TR, class IntT, class TopT,class Feat>
+    void visit_external_node(TR & tr, IntT & index, TopT & node_t,Feat & features)
+    {
+        if(visitor_.get().is_active())
+            visitor_.visit_external_node(tr, index, node_t,features);
+        next_.visit_external_node(tr, index, node_t,features);
+    }
+
+    template<class TR, class IntT, class TopT,class Feat>
+    void visit_internal_node(TR & tr, IntT & index, TopT & node_t,Feat & features)
+    {
+        if(visitor_.get().is_active())
+            visitor_.visit_internal_node(tr, index, node_t,features);
+        next_.visit_internal_node(tr, index, node_t,features);
+    }
+
+    void merge_into(VisitorNode<Visitor, Next> & node) const
+    {
+        if(node.visitor_.is_active())
+            visitor_.merge_into(node.visitor_);
+        next_.merge_into(node.next_);
+    }
+};
+
 } //namespace detail
 
 //////////////////////////////////////////////////////////////////////////////
@@ -772,6 +1010,8 @@ public:
 class OOB_PerTreeError:public VisitorBase
 {
 public:
+    typedef VigraTrueType ThreadCopy_t;
+
 	/** Average error of one randomized decision tree
 	 */
     double oobError;
@@ -835,7 +1075,28 @@ public:
         } 
         oobError/=totalOobCount;
     }
-    
+
+    void prepare_thread_copy()
+    {
+        oobCount.init(0);
+        oobErrorCount.init(0);
+    }
+
+    void merge(OOB_PerTreeError const & other)
+    {
+        if(other.oobCount.size() == 0)
+            return;
+        if(oobCount.size() != other.oobCount.size())
+        {
+            oobCount.resize(other.oobCount.size(), 0);
+            oobErrorCount.resize(other.oobErrorCount.size(), 0);
+        }
+        for(unsigned int l = 0; l < oobCount.size(); ++l)
+        {
+            oobCount[l] += other.oobCount[l];
+            oobErrorCount[l] += other.oobErrorCount[l];
+        }
+    }
 };
 
 /** Visitor that calculates the oob error of the ensemble
@@ -856,6 +1117,7 @@ class OOB_Error : public VisitorBase
     bool is_weighted;
     MultiArray<2,double> tmp_prob;
     public:
+    typedef VigraTrueType ThreadCopy_t;
 
     MultiArray<2, double>       prob_oob; 
 	/** Ensemble oob error rate
@@ -897,6 +1159,13 @@ class OOB_Error : public VisitorBase
         }
     }
 
+    template<class Random>
+    static void shuffle(ArrayVector<int> & indices, Random const & random)
+    {
+        UniformIntRandomFunctor<Random> randint(random);
+        std::random_shuffle(indices.begin(), indices.end(), randint);
+    }
+
     template<class RF, class PR, class SM, class ST>
     void visit_after_tree(RF& rf, PR & pr,  SM & sm, ST & st, int index)
     {
@@ -909,7 +1178,19 @@ class OOB_Error : public VisitorBase
         {
             ArrayVector<int> oob_indices;
             ArrayVector<int> cts(class_count, 0);
-            std::random_shuffle(indices.begin(), indices.end());
+            if(rf.options().thread_count_ == 0)
+            {
+                std::random_shuffle(indices.begin(), indices.end());
+            }
+            else
+            {
+                // In parallel learning, the permutation is drawn from the tree's 
+                // own generator (seeded by learn()), so that it does not depend 
+                // on the trees this thread copy has visited before.
+                for(int ii = 0; ii < rf.ext_param_.row_count_; ++ii)
+                    indices[ii] = ii;
+                shuffle(indices, sm.randomGenerator());
+            }
             for(int ii = 0; ii < rf.ext_param_.row_count_; ++ii)
             {
                 if(!sm.is_used()[indices[ii]] && cts[pr.response()(indices[ii], 0)] < 40000)
@@ -996,10 +1277,26 @@ class OOB_Error : public VisitorBase
         }
         oob_breiman = double(breimanstyle)/totalOobCount; 
     }
+
+    void prepare_thread_copy()
+    {
+        prob_oob.init(0.0);
+        oobCount.init(0.0);
+    }
+
+    void merge(OOB_Error const & other)
+    {
+        prob_oob += other.prob_oob;
+        oobCount += other.oobCount;
+    }
 };
 
 
 /** Visitor that calculates different OOB error statistics
+ *
+ * When the trees are learned in parallel (see RandomForestOptions::thread_count()),
+ * breiman_per_tree and oobroc_per_tree only reflect the trees learned by
+ * the same thread and should not be used. All other statistics are exact.
  */
 class CompleteOOBInfo : public VisitorBase
 {
@@ -1008,6 +1305,7 @@ class CompleteOOBInfo : public VisitorBase
     bool is_weighted;
     MultiArray<2,double> tmp_prob;
     public:
+    typedef VigraTrueType ThreadCopy_t;
 
     /** OOB Error rate of each individual tree
 	 */
@@ -1212,6 +1510,27 @@ class CompleteOOBInfo : public VisitorBase
         MultiArrayView<2, double> stdDev(Shp(1,1), &oob_std);
         rowStatistics(oob_per_tree, mean, stdDev);
     }
+
+    void prepare_thread_copy()
+    {
+        prob_oob.init(0.0);
+        oobCount.init(0.0);
+        oobErrorCount.init(0.0);
+        oob_per_tree.init(0.0);
+        breiman_per_tree.init(0.0);
+        oobroc_per_tree.init(0.0);
+    }
+
+    void merge(CompleteOOBInfo const & other)
+    {
+        // every tree index is only written by a single thread
+        prob_oob += other.prob_oob;
+        oobCount += other.oobCount;
+        oobErrorCount += other.oobErrorCount;
+        oob_per_tree += other.oob_per_tree;
+        breiman_per_tree += other.breiman_per_tree;
+        oobroc_per_tree += other.oobroc_per_tree;
+    }
 };
 
 /** calculate variable importance while learning.
@@ -1219,6 +1538,7 @@ class CompleteOOBInfo : public VisitorBase
 class VariableImportanceVisitor : public VisitorBase
 {
     public:
+    typedef VigraTrueType ThreadCopy_t;
 
     /** This Array has the same entries as the R - random forest variable
      *  importance.
@@ -1442,6 +1762,20 @@ class VariableImportanceVisitor : public VisitorBase
     {
         variable_importance_ /= rf.trees_.size();
     }
+
+    void prepare_thread_copy()
+    {
+        variable_importance_.init(0.0);
+    }
+
+    void merge(VariableImportanceVisitor const & other)
+    {
+        if(other.variable_importance_.size() == 0)
+            return;
+        if(variable_importance_.size() == 0)
+            variable_importance_.reshape(other.variable_importance_.shape(), 0.0);
+        variable_importance_ += other.variable_importance_;
+    }
 };
 
 /** Verbose output
@@ -1484,6 +1818,8 @@ class RandomForestProgressVisitor : public VisitorBase {
 class CorrelationVisitor : public VisitorBase
 {
     public:
+    typedef VigraTrueType ThreadCopy_t;
+
 	/** gini_missc(ii, jj) describes how well variable jj can describe a partition
 	 * created on variable ii(when variable ii was chosen)
 	 */ 
@@ -1711,6 +2047,23 @@ class CorrelationVisitor : public VisitorBase
             std::partition(parent.begin(), parent.end(), sorter);
         }
     }
+
+    void prepare_thread_copy()
+    {
+        gini_missc.init(0.0);
+        corr_noise.init(0.0);
+        corr_l.init(0.0);
+        numChoices.init(0);
+    }
+
+    void merge(CorrelationVisitor const & other)
+    {
+        gini_missc += other.gini_missc;
+        corr_noise += other.corr_noise;
+        corr_l += other.corr_l;
+        for(unsigned int ii = 0; ii < numChoices.size(); ++ii)
+            numChoices[ii] += other.numChoices[ii];
+    }
 };
 
 
@@ -373,20 +373,39 @@ VIGRA_EXPORT void dt_import_HDF5(hid_t & group_id,
 VIGRA_EXPORT void dt_export_HDF5(hid_t & group_id,
                     detail::DecisionTree const & tree,
                     std::string name);
-                    
-} //namespace detail
+
+/** write all trees into a single group: the topologies and parameters
+ * of the trees are concatenated into two chunked datasets, and 
+ * 'topology_offsets' / 'parameter_offsets' (tree_count+1 entries each)
+ * tell where each tree starts.
+ * \param singlePrecision store the parameters as float instead of double
+ * \param compression     deflate level of the datasets (0: uncompressed)
+ */
+VIGRA_EXPORT void trees_export_HDF5_compact(hid_t & group_id,
+                    ArrayVector<detail::DecisionTree> const & trees,
+                    std::string name,
+                    bool singlePrecision,
+                    int compression);
+
+/** read trees written by trees_export_HDF5_compact() and append them 
+ * to 'trees'. New trees are copies of 'prototype' whose topology and
+ * parameters are replaced. The datasets are read with one call each, 
+ * and the trees are then filled by 'threadCount' threads.
+ */
+VIGRA_EXPORT void trees_import_HDF5_compact(hid_t & group_id,
+                    ArrayVector<detail::DecisionTree> & trees,
+                    detail::DecisionTree const & prototype,
+                    std::string name,
+                    int threadCount);
 
 template<class T>
-bool rf_export_HDF5(RandomForest<T> const &rf, 
-                    std::string filename, 
-                    std::string pathname = "",
-                    bool overwriteflag = false)
+bool rf_export_HDF5_impl(RandomForest<T> const &rf, 
+                         std::string filename, 
+                         std::string pathname,
+                         bool compact,
+                         bool singlePrecision,
+                         int compression)
 { 
-    using detail::make_padded_number;
-    using detail::options_export_HDF5;
-    using detail::problemspec_export_HDF5;
-    using detail::dt_export_HDF5;
-    
     hid_t file_id;
     //if file exists load it.
     FILE* pFile = std::fopen ( filename.c_str(), "r" );
@@ -426,13 +445,20 @@ bool rf_export_HDF5(RandomForest<T> const &rf,
     //save external parameters
         problemspec_export_HDF5(group_id, rf.ext_param(), "_ext_param");
     //save trees
-    
-    int tree_count = rf.options_.tree_count_;
-    for(int ii = 0; ii < tree_count; ++ii)
+    if(compact)
     {
-        std::string treename =     "Tree_"  + 
-                                make_padded_number(ii, tree_count -1);
-        dt_export_HDF5(group_id, rf.tree(ii), treename); 
+        trees_export_HDF5_compact(group_id, rf.trees_, "_trees", 
+                                  singlePrecision, compression);
+    }
+    else
+    {
+        int tree_count = rf.options_.tree_count_;
+        for(int ii = 0; ii < tree_count; ++ii)
+        {
+            std::string treename =     "Tree_"  + 
+                                    make_padded_number(ii, tree_count -1);
+            dt_export_HDF5(group_id, rf.tree(ii), treename); 
+        }
     }
     
     //clean up the mess
@@ -443,11 +469,50 @@ bool rf_export_HDF5(RandomForest<T> const &rf,
     return 1;
 }
 
+} //namespace detail
+
+template<class T>
+bool rf_export_HDF5(RandomForest<T> const &rf, 
+                    std::string filename, 
+                    std::string pathname = "",
+                    bool overwriteflag = false)
+{ 
+    return detail::rf_export_HDF5_impl(rf, filename, pathname, false, false, 0);
+}
+
+/** Export a random forest in the compact format: instead of one group 
+    with two datasets per tree, all trees are concatenated into a few 
+    large datasets with an offset index (see detail::trees_export_HDF5_compact()).
+    This makes loading forests with many trees much faster. 
+    If <tt>singlePrecision</tt> is true, thresholds and leaf 
+    probabilities are stored as <tt>float</tt>, which halves the file size
+    but rounds the parameters. <tt>compression</tt> is the deflate level
+    (0 means no compression).
+    
+    rf_import_HDF5() recognizes the format automatically.
+*/
+template<class T>
+bool rf_export_HDF5_compact(RandomForest<T> const &rf, 
+                            std::string filename, 
+                            std::string pathname = "",
+                            bool singlePrecision = false,
+                            int compression = 0)
+{ 
+    return detail::rf_export_HDF5_impl(rf, filename, pathname, true, 
+                                       singlePrecision, compression);
+}
+
 
+/** Import a random forest written by rf_export_HDF5() or
+    rf_export_HDF5_compact(). For the compact format, the trees are filled
+    by <tt>threadCount</tt> threads (negative means "as many as available", 
+    see actualThreadCount()).
+*/
 template<class T>
 bool rf_import_HDF5(RandomForest<T> &rf, 
                     std::string filename, 
-                    std::string pathname = "")
+                    std::string pathname = "",
+                    int threadCount = 1)
 { 
     using detail::find_groups_hdf5;
     using detail::options_import_HDF5;
@@ -485,6 +550,12 @@ bool rf_import_HDF5(RandomForest<T> &rf,
     std::set<std::string>::iterator iter; 
     find_groups_hdf5(filename, pathname, tree_set);
     
+    if(tree_set.find(std::string("_trees")) != tree_set.end())
+    {
+        detail::trees_import_HDF5_compact(group_id, rf.trees_,
+                                          detail::DecisionTree(rf.ext_param_),
+                                          "_trees", threadCount);
+    }
     for(iter = tree_set.begin(); iter != tree_set.end(); ++iter)
     {
         if((*iter)[0] != '_')
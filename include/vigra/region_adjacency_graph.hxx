@@ -0,0 +1,674 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2011-2012 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_REGION_ADJACENCY_GRAPH_HXX
+#define VIGRA_REGION_ADJACENCY_GRAPH_HXX
+
+#include <algorithm>
+#include "multi_array.hxx"
+#include "array_vector.hxx"
+#include "sized_int.hxx"
+#include "threading.hxx"
+
+namespace vigra {
+
+namespace detail {
+
+    // Boundary statistics of a pair of adjacent regions. The pair (u, v)
+    // with u < v is packed into 'key' as (u << 32) | v.
+struct RagEdgeStatistics
+{
+    UInt64 key;
+    MultiArrayIndex count;
+    double sum, minimum, maximum;
+
+    RagEdgeStatistics()
+    : key(0), count(0), sum(0.0), minimum(0.0), maximum(0.0)
+    {}
+
+    void add(double value)
+    {
+        if(count == 0)
+        {
+            minimum = value;
+            maximum = value;
+        }
+        else
+        {
+            minimum = std::min(minimum, value);
+            maximum = std::max(maximum, value);
+        }
+        ++count;
+        sum += value;
+    }
+
+    void merge(RagEdgeStatistics const & other)
+    {
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+        count += other.count;
+        sum += other.sum;
+    }
+
+    bool operator<(RagEdgeStatistics const & other) const
+    {
+        return key < other.key;
+    }
+};
+
+    // Open-addressing hash table (linear probing) from region pairs to their
+    // boundary statistics. The statistics are appended to one flat array, and
+    // the slots only hold the key and the position in this array, so that the
+    // table stays small enough for the cache. Since u < v, a key of 0 never
+    // occurs and marks an empty slot. The table doubles its capacity when it
+    // becomes half full.
+class RagEdgeAccumulator
+{
+    struct Slot
+    {
+        UInt64 key;
+        std::size_t index;
+
+        Slot()
+        : key(0), index(0)
+        {}
+    };
+
+  public:
+    RagEdgeAccumulator()
+    : slots_(64),
+      shift_(64 - 6)
+    {}
+
+    void add(RagEdgeStatistics const & edge)
+    {
+        if(2*(edges_.size() + 1) > slots_.size())
+            grow();
+        Slot & slot = find(edge.key);
+        if(slot.key == 0)
+        {
+            slot.key = edge.key;
+            slot.index = edges_.size();
+            edges_.push_back(edge);
+        }
+        else
+        {
+            edges_[slot.index].merge(edge);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return edges_.size();
+    }
+
+        // append all edges to 'edges'
+    void collect(ArrayVector<RagEdgeStatistics> & edges) const
+    {
+        edges.insert(edges.end(), edges_.begin(), edges_.end());
+    }
+
+        // release the memory of the hash index, keeping the edges for collect()
+        // (no edges can be added afterwards)
+    void releaseIndex()
+    {
+        ArrayVector<Slot>().swap(slots_);
+    }
+
+        // release the memory (no edges can be added afterwards)
+    void clear()
+    {
+        ArrayVector<Slot>().swap(slots_);
+        ArrayVector<RagEdgeStatistics>().swap(edges_);
+    }
+
+  private:
+        // the slot holding 'key', or the empty slot where it must be inserted
+    Slot & find(UInt64 key)
+    {
+        std::size_t mask = slots_.size() - 1,
+                    k = (std::size_t)((key * UInt64(0x9E3779B97F4A7C15ull)) >> shift_);
+        while(slots_[k].key != key && slots_[k].key != 0)
+            k = (k + 1) & mask;
+        return slots_[k];
+    }
+
+    void grow()
+    {
+        ArrayVector<Slot> old(2*slots_.size());
+        old.swap(slots_);
+        --shift_;
+        for(std::size_t k = 0; k < old.size(); ++k)
+            if(old[k].key != 0)
+                find(old[k].key) = old[k];
+    }
+
+    ArrayVector<Slot> slots_;
+    ArrayVector<RagEdgeStatistics> edges_;
+    int shift_;
+};
+
+    // Accumulate the faces between voxels p and p + e_d whose first voxel p lies in
+    // the slab [z0, z1) along the last axis. Every face is thus visited by exactly
+    // one slab. If 'useIndicator' is false, the face values are zero.
+    // Consecutive faces along a line often belong to the same edge, so they are
+    // collected in 'pending' (one entry per direction) before going to the hash table.
+    // Likewise, voxel counts are only added to 'nodeSizes' at the end of a run.
+template <unsigned int N, class T1, class S1, class T2, class S2>
+void
+ragAccumulateSlab(MultiArrayView<N, T1, S1> const & labels,
+                  MultiArrayView<N, T2, S2> const & indicator, bool useIndicator,
+                  MultiArrayIndex z0, MultiArrayIndex z1,
+                  RagEdgeAccumulator & edges, MultiArrayIndex * nodeSizes)
+{
+    typedef typename MultiArrayShape<N>::type Shape;
+
+    Shape shape(labels.shape()),
+          lstride(labels.stride()),
+          istride(indicator.stride());
+    MultiArrayIndex width = shape[0];
+    RagEdgeStatistics pending[N];
+
+    Shape p(MultiArrayIndex(0));
+    p[N-1] = z0;
+    while(p[N-1] < z1)
+    {
+        T1 const * l = labels.data() + dot(p, lstride);
+        T2 const * e = indicator.data() + dot(p, istride);
+        UInt64 run = (UInt64)*l;
+        MultiArrayIndex runLength = 0;
+        for(MultiArrayIndex x = 0; x < width; ++x, l += lstride[0], e += istride[0])
+        {
+            UInt64 u = (UInt64)*l;
+            if(u != run)
+            {
+#ifdef _OPENMP
+                #pragma omp atomic
+#endif
+                nodeSizes[run] += runLength;
+                run = u;
+                runLength = 0;
+            }
+            ++runLength;
+            for(unsigned int d = 0; d < N; ++d)
+            {
+                if((d == 0 ? x : p[d]) + 1 >= shape[d])
+                    continue;
+                UInt64 v = (UInt64)l[lstride[d]];
+                if(u == v)
+                    continue;
+                UInt64 key = u < v ? (u << 32) | v : (v << 32) | u;
+                if(key != pending[d].key)
+                {
+                    if(pending[d].count > 0)
+                        edges.add(pending[d]);
+                    pending[d] = RagEdgeStatistics();
+                    pending[d].key = key;
+                }
+                pending[d].add(useIndicator
+                                   ? 0.5*((double)*e + (double)e[istride[d]])
+                                   : 0.0);
+            }
+        }
+#ifdef _OPENMP
+        #pragma omp atomic
+#endif
+        nodeSizes[run] += runLength;
+        if(N == 1)
+            break;
+
+        // advance to the next line along axis 0
+        unsigned int d = 1;
+        for(; d < N-1; ++d)
+        {
+            if(++p[d] < shape[d])
+                break;
+            p[d] = 0;
+        }
+        if(d == N-1)
+            ++p[N-1];
+    }
+    for(unsigned int d = 0; d < N; ++d)
+        if(pending[d].count > 0)
+            edges.add(pending[d]);
+}
+
+} // namespace detail
+
+/** \brief Region adjacency graph of a label array with boundary statistics.
+
+    <b>\#include</b> \<vigra/region_adjacency_graph.hxx\><br>
+    Namespace: vigra
+
+    The nodes of the graph are the labels <tt>0...maxLabel()</tt> of an
+    N-dimensional label array (e.g. the result of \ref watershedsMultiArray() or
+    \ref labelVolume()). Two regions are connected by an edge when they share
+    at least one face in the direct neighborhood (4-neighborhood in 2D,
+    6-neighborhood in 3D). Label 0 is a node like any other; labels that
+    do not occur in the array are isolated nodes of size 0.
+
+    For each edge, the graph records the number of faces on the common boundary,
+    and the sum, minimum and maximum of an edge indicator (e.g. the gradient
+    magnitude) along these faces. The value of a face is the average of the
+    indicator at its two voxels.
+
+    The adjacency is stored in compressed sparse row format: the neighbors of
+    each node are held in one flat array, sorted in increasing label order,
+    together with the IDs of the corresponding edges. Edges are numbered
+    <tt>0...edgeCount()-1</tt> in lexicographic order of <tt>(u(e), v(e))</tt>,
+    where <tt>u(e) < v(e)</tt>. The graph thus needs no heap allocations per
+    node or edge and can hold millions of regions.
+
+    The graph is built in one pass over the label array, which is split into
+    slabs along the last axis. When VIGRA is compiled with OpenMP, the slabs are
+    processed in parallel, and each slab accumulates its edges in a hash table
+    of its own. <tt>threadCount</tt> specifies the number of threads
+    (default: 1, negative means "as many as available", see \ref actualThreadCount()).
+    Since the slabs only depend on the array shape, and the partial statistics of
+    the slabs are always combined in slab order, the result (including the
+    floating-point sums) does not depend on the number of threads.
+
+    <b> Usage:</b>
+
+    \code
+    MultiArray<3, float> data(shape), gradient(shape);
+    MultiArray<3, UInt32> labels(shape);
+    ...
+    gaussianGradientMagnitude(srcMultiArrayRange(data), destMultiArray(gradient), 1.0);
+    watershedsMultiArray(gradient, labels);
+
+    RegionAdjacencyGraph rag(labels, gradient);
+
+    for(RegionAdjacencyGraph::index_type e = 0; e < rag.edgeCount(); ++e)
+        std::cout << rag.u(e) << " - " << rag.v(e) << ": " << rag.boundaryMean(e) << "\n";
+
+    // all neighbors of region 1
+    RegionAdjacencyGraph::neighbor_iterator n = rag.neighborsBegin(1), end = rag.neighborsEnd(1);
+    for(; n != end; ++n)
+        std::cout << *n << " ";
+    \endcode
+
+    <b> Required Interface:</b>
+
+    The label type must be an integral type, and all labels must be non-negative
+    and smaller than 2<sup>32</sup>-1. The indicator type must be convertible to
+    <tt>double</tt>.
+*/
+class RegionAdjacencyGraph
+{
+  public:
+        /** Type of the node labels.
+        */
+    typedef UInt32 label_type;
+
+        /** Type of the edge IDs and counts.
+        */
+    typedef MultiArrayIndex index_type;
+
+        /** Iterator over the neighbors of a node (dereferences to <tt>label_type</tt>).
+        */
+    typedef UInt32 const * neighbor_iterator;
+
+        /** Iterator over the IDs of the edges incident to a node (dereferences
+            to <tt>UInt32</tt>), parallel to the <tt>neighbor_iterator</tt>.
+        */
+    typedef UInt32 const * edge_iterator;
+
+        /** Create an empty graph.
+        */
+    RegionAdjacencyGraph()
+    : maxLabel_(0),
+      offsets_(1, 0),
+      nodeSizes_(1, 0)
+    {}
+
+        /** Build the adjacency graph of <tt>labels</tt> without an edge indicator.
+            The boundary sizes are computed, all other boundary statistics are zero.
+        */
+    template <unsigned int N, class T, class S>
+    explicit RegionAdjacencyGraph(MultiArrayView<N, T, S> const & labels, int threadCount = 1)
+    {
+        build(labels, threadCount);
+    }
+
+        /** Build the adjacency graph of <tt>labels</tt> with the boundary statistics
+            of <tt>indicator</tt>.
+        */
+    template <unsigned int N, class T1, class S1, class T2, class S2>
+    RegionAdjacencyGraph(MultiArrayView<N, T1, S1> const & labels,
+                         MultiArrayView<N, T2, S2> const & indicator, int threadCount = 1)
+    {
+        build(labels, indicator, threadCount);
+    }
+
+        /** Replace the graph by the adjacency graph of <tt>labels</tt>
+            without an edge indicator.
+        */
+    template <unsigned int N, class T, class S>
+    void build(MultiArrayView<N, T, S> const & labels, int threadCount = 1)
+    {
+        buildImpl(labels, labels, false, threadCount);
+    }
+
+        /** Replace the graph by the adjacency graph of <tt>labels</tt>
+            with the boundary statistics of <tt>indicator</tt>.
+        */
+    template <unsigned int N, class T1, class S1, class T2, class S2>
+    void build(MultiArrayView<N, T1, S1> const & labels,
+               MultiArrayView<N, T2, S2> const & indicator, int threadCount = 1)
+    {
+        vigra_precondition(labels.shape() == indicator.shape(),
+            "RegionAdjacencyGraph::build(): shape mismatch between labels and indicator.");
+        buildImpl(labels, indicator, true, threadCount);
+    }
+
+        /** The largest label in the array. The graph has <tt>maxLabel()+1</tt> nodes.
+        */
+    label_type maxLabel() const
+    {
+        return maxLabel_;
+    }
+
+        /** Number of nodes, i.e. <tt>maxLabel()+1</tt>.
+        */
+    index_type nodeCount() const
+    {
+        return (index_type)maxLabel_ + 1;
+    }
+
+        /** Number of edges.
+        */
+    index_type edgeCount() const
+    {
+        return (index_type)edges_.size();
+    }
+
+        /** The smaller label of edge <tt>e</tt>.
+        */
+    label_type u(index_type e) const
+    {
+        return (label_type)(edges_[e].key >> 32);
+    }
+
+        /** The larger label of edge <tt>e</tt>.
+        */
+    label_type v(index_type e) const
+    {
+        return (label_type)(edges_[e].key & 0xFFFFFFFFu);
+    }
+
+        /** Number of voxels of region <tt>label</tt>.
+        */
+    index_type nodeSize(label_type label) const
+    {
+        return nodeSizes_[label];
+    }
+
+        /** Number of neighbors of region <tt>label</tt>.
+        */
+    index_type degree(label_type label) const
+    {
+        return offsets_[label+1] - offsets_[label];
+    }
+
+        /** Iterator to the first neighbor of <tt>label</tt>.
+        */
+    neighbor_iterator neighborsBegin(label_type label) const
+    {
+        return neighbors_.begin() + offsets_[label];
+    }
+
+        /** Iterator past the last neighbor of <tt>label</tt>.
+        */
+    neighbor_iterator neighborsEnd(label_type label) const
+    {
+        return neighbors_.begin() + offsets_[label+1];
+    }
+
+        /** Iterator to the ID of the edge from <tt>label</tt> to its first neighbor.
+        */
+    edge_iterator edgesBegin(label_type label) const
+    {
+        return edgeIds_.begin() + offsets_[label];
+    }
+
+        /** Iterator past the ID of the edge from <tt>label</tt> to its last neighbor.
+        */
+    edge_iterator edgesEnd(label_type label) const
+    {
+        return edgeIds_.begin() + offsets_[label+1];
+    }
+
+        /** ID of the edge between <tt>a</tt> and <tt>b</tt> (in any order),
+            or -1 if the regions are not adjacent.
+        */
+    index_type findEdge(label_type a, label_type b) const
+    {
+        if(a > maxLabel_ || b > maxLabel_)
+            return -1;
+        neighbor_iterator begin = neighborsBegin(a), end = neighborsEnd(a),
+                          n = std::lower_bound(begin, end, b);
+        if(n == end || *n != b)
+            return -1;
+        return edgeIds_[offsets_[a] + (n - begin)];
+    }
+
+        /** Number of faces on the boundary between the regions of edge <tt>e</tt>.
+        */
+    index_type boundarySize(index_type e) const
+    {
+        return edges_[e].count;
+    }
+
+        /** Sum of the edge indicator along the boundary of edge <tt>e</tt>.
+        */
+    double boundarySum(index_type e) const
+    {
+        return edges_[e].sum;
+    }
+
+        /** Mean of the edge indicator along the boundary of edge <tt>e</tt>.
+        */
+    double boundaryMean(index_type e) const
+    {
+        return edges_[e].sum / edges_[e].count;
+    }
+
+        /** Minimum of the edge indicator along the boundary of edge <tt>e</tt>.
+        */
+    double boundaryMin(index_type e) const
+    {
+        return edges_[e].minimum;
+    }
+
+        /** Maximum of the edge indicator along the boundary of edge <tt>e</tt>.
+        */
+    double boundaryMax(index_type e) const
+    {
+        return edges_[e].maximum;
+    }
+
+  private:
+    template <unsigned int N, class T1, class S1, class T2, class S2>
+    void buildImpl(MultiArrayView<N, T1, S1> const & labels,
+                   MultiArrayView<N, T2, S2> const & indicator, bool useIndicator,
+                   int threadCount);
+
+    label_type maxLabel_;
+    ArrayVector<detail::RagEdgeStatistics> edges_;
+    ArrayVector<MultiArrayIndex> offsets_;
+    ArrayVector<UInt32> neighbors_, edgeIds_;
+    ArrayVector<MultiArrayIndex> nodeSizes_;
+};
+
+template <unsigned int N, class T1, class S1, class T2, class S2>
+void
+RegionAdjacencyGraph::buildImpl(MultiArrayView<N, T1, S1> const & labels,
+                                MultiArrayView<N, T2, S2> const & indicator, bool useIndicator,
+                                int threadCount)
+{
+    threadCount = actualThreadCount(threadCount);
+    // The slabs must not depend on the thread count, so that the floating-point
+    // sums are identical for any number of threads. At most 64 slabs keep the
+    // duplicates of edges crossing the slab faces few.
+    MultiArrayIndex depth = labels.shape(N-1),
+                    slabDepth = N == 1
+                                    ? depth  // a 1D array is a single line
+                                    : std::max<MultiArrayIndex>(1, (depth + 63) / 64);
+    int slabCount = labels.size() == 0
+                        ? 0
+                        : (int)((depth + slabDepth - 1) / slabDepth);
+
+    // pass 1: find the label range, so that the node arrays can be allocated
+    ArrayVector<T1> slabMin(slabCount), slabMax(slabCount);
+    ThreadExceptionCollector errors;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount) if(threadCount > 1)
+#endif
+    for(int b = 0; b < slabCount; ++b)
+    {
+        try
+        {
+            typedef typename MultiArrayShape<N>::type Shape;
+            Shape start(MultiArrayIndex(0)), stop(labels.shape());
+            start[N-1] = b*slabDepth;
+            stop[N-1] = std::min(start[N-1] + slabDepth, depth);
+            MultiArrayView<N, T1, S1> const slab(labels.subarray(start, stop));
+            typename MultiArrayView<N, T1, S1>::const_iterator i = slab.begin(), end = slab.end();
+            T1 mi = *i, ma = *i;
+            for(++i; i != end; ++i)
+            {
+                if(*i < mi)
+                    mi = *i;
+                else if(ma < *i)
+                    ma = *i;
+            }
+            slabMin[b] = mi;
+            slabMax[b] = ma;
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    maxLabel_ = 0;
+    for(int b = 0; b < slabCount; ++b)
+    {
+        vigra_precondition(!(slabMin[b] < T1()),
+            "RegionAdjacencyGraph::build(): labels must be non-negative.");
+        vigra_precondition((double)slabMax[b] < (double)NumericTraits<UInt32>::max(),
+            "RegionAdjacencyGraph::build(): labels must be smaller than 2^32-1.");
+        maxLabel_ = std::max(maxLabel_, (label_type)slabMax[b]);
+    }
+
+    // pass 2: accumulate the edges of each slab in a hash table of its own
+    nodeSizes_.clear();
+    nodeSizes_.resize((std::size_t)maxLabel_ + 1, 0);
+    ArrayVector<detail::RagEdgeAccumulator> accumulators(slabCount);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(threadCount) if(threadCount > 1)
+#endif
+    for(int b = 0; b < slabCount; ++b)
+    {
+        try
+        {
+            MultiArrayIndex z0 = b*slabDepth,
+                            z1 = std::min(z0 + slabDepth, depth);
+            detail::ragAccumulateSlab(labels, indicator, useIndicator, z0, z1,
+                                      accumulators[b], nodeSizes_.begin());
+            accumulators[b].releaseIndex();
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+
+    // merge the tables: pairs found in several slabs are combined in slab order
+    // (the sort must be stable for this)
+    std::size_t total = 0;
+    for(int b = 0; b < slabCount; ++b)
+        total += accumulators[b].size();
+    ArrayVector<detail::RagEdgeStatistics> all;
+    all.reserve(total);
+    for(int b = 0; b < slabCount; ++b)
+    {
+        accumulators[b].collect(all);
+        accumulators[b].clear();
+    }
+    std::stable_sort(all.begin(), all.end());
+
+    edges_.clear();
+    for(std::size_t k = 0; k < all.size(); ++k)
+    {
+        if(edges_.size() > 0 && edges_.back().key == all[k].key)
+            edges_.back().merge(all[k]);
+        else
+            edges_.push_back(all[k]);
+    }
+    vigra_precondition(edges_.size() < (std::size_t)NumericTraits<UInt32>::max(),
+        "RegionAdjacencyGraph::build(): too many edges.");
+
+    // build the CSR arrays: since the edges are sorted by (u, v), the neighbors
+    // of every node are inserted in increasing order
+    offsets_.clear();
+    offsets_.resize((std::size_t)maxLabel_ + 2, 0);
+    for(std::size_t e = 0; e < edges_.size(); ++e)
+    {
+        ++offsets_[u(e) + 1];
+        ++offsets_[v(e) + 1];
+    }
+    for(std::size_t k = 1; k < offsets_.size(); ++k)
+        offsets_[k] += offsets_[k-1];
+
+    neighbors_.resize(2*edges_.size());
+    edgeIds_.resize(2*edges_.size());
+    ArrayVector<MultiArrayIndex> fill(offsets_.begin(), offsets_.end() - 1);
+    for(std::size_t e = 0; e < edges_.size(); ++e)
+    {
+        label_type a = u(e), b = v(e);
+        neighbors_[fill[a]] = b;
+        edgeIds_[fill[a]++] = (UInt32)e;
+        neighbors_[fill[b]] = a;
+        edgeIds_[fill[b]++] = (UInt32)e;
+    }
+}
+
+} // namespace vigra
+
+#endif // VIGRA_REGION_ADJACENCY_GRAPH_HXX
@@ -0,0 +1,614 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2011-2012 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef VIGRA_REGION_AGGLOMERATION_HXX
+#define VIGRA_REGION_AGGLOMERATION_HXX
+
+#include <cfloat>
+#include <algorithm>
+#include "multi_array.hxx"
+#include "array_vector.hxx"
+#include "union_find.hxx"
+#include "priority_queue.hxx"
+#include "region_adjacency_graph.hxx"
+
+namespace vigra {
+
+/** \addtogroup RegionAgglomeration Hierarchical Region Merging
+
+    Greedy agglomeration of the regions of an over-segmentation.
+*/
+//@{
+
+/** \brief Options object for agglomerateRegions().
+
+    <b> Usage:</b>
+
+    see agglomerateRegions() for detailed examples.
+*/
+class AgglomerationOptions
+{
+  public:
+    double threshold;
+    MultiArrayIndex region_count;
+
+        /** \brief Create options object with default settings.
+
+            Defaults are: merge until a single region is left (i.e. compute
+            the complete merge tree).
+        */
+    AgglomerationOptions()
+    : threshold(DBL_MAX),
+      region_count(1)
+    {}
+
+        /** \brief Stop merging when the weight of the best edge exceeds the threshold.
+
+            Default: don't stop
+        */
+    AgglomerationOptions & stopAtThreshold(double t)
+    {
+        threshold = t;
+        return *this;
+    }
+
+        /** \brief Stop merging when only the given number of regions is left.
+
+            Only labels that actually occur in the label array are counted as regions.
+
+            Default: 1
+        */
+    AgglomerationOptions & regionCount(MultiArrayIndex count)
+    {
+        region_count = count;
+        return *this;
+    }
+};
+
+/** \brief Sequence of merges computed by agglomerateRegions().
+
+    <b>\#include</b> \<vigra/region_agglomeration.hxx\><br>
+    Namespace: vigra
+
+    The merge tree records each merge step in the order of execution. In every step,
+    two regions are combined, and the new region is represented by the smaller
+    of the two labels. The merges are executed greedily in order of non-decreasing
+    weight (the weight of a combined edge is a mean of weights that are not smaller
+    than the current one), so that the segmentation obtained by stopping at some
+    threshold is a prefix of the complete merge sequence. Segmentations for arbitrary thresholds
+    or region counts can therefore be extracted without repeating the agglomeration
+    (see \ref mapping()).
+*/
+class RegionMergeTree
+{
+  public:
+    typedef RegionAdjacencyGraph::label_type label_type;
+    typedef MultiArrayIndex index_type;
+
+        /** \brief A single merge step.
+        */
+    struct Merge
+    {
+            /** The label of the merged region (the smaller one of the two labels).
+            */
+        label_type representative;
+
+            /** The label of the region that was merged into <tt>representative</tt>.
+            */
+        label_type merged;
+
+            /** Weight of the boundary between the two regions at the time of the merge.
+            */
+        double weight;
+
+        Merge(label_type r = 0, label_type m = 0, double w = 0.0)
+        : representative(r), merged(m), weight(w)
+        {}
+    };
+
+        /** \brief Create an empty merge tree for labels <tt>0...maxLabel</tt>.
+        */
+    RegionMergeTree(label_type maxLabel = 0)
+    : maxLabel_(maxLabel)
+    {}
+
+        /** \brief Number of merge steps.
+        */
+    index_type size() const
+    {
+        return (index_type)merges_.size();
+    }
+
+        /** \brief The largest label of the initial segmentation.
+        */
+    label_type maxLabel() const
+    {
+        return maxLabel_;
+    }
+
+        /** \brief Access merge step <tt>k</tt>.
+        */
+    Merge const & operator[](index_type k) const
+    {
+        return merges_[k];
+    }
+
+        /** \brief Number of merge steps that are executed when agglomeration stops
+            at the given threshold, i.e. the index of the first merge step whose
+            weight exceeds <tt>threshold</tt>.
+        */
+    index_type mergeCount(double threshold) const
+    {
+        // the weights are non-decreasing => binary search
+        index_type begin = 0, end = size();
+        while(begin < end)
+        {
+            index_type middle = (begin + end) / 2;
+            if(merges_[middle].weight <= threshold)
+                begin = middle + 1;
+            else
+                end = middle;
+        }
+        return begin;
+    }
+
+        /** \brief Compute the label mapping after the first <tt>mergeCount</tt> merge steps.
+
+            Afterwards, <tt>labelMap[l]</tt> holds the label of the region containing the
+            initial region <tt>l</tt>, for all <tt>l</tt> in <tt>0...maxLabel()</tt>.
+            To obtain the segmentation, apply the mapping to the initial label array.
+        */
+    void mapping(index_type mergeCount, ArrayVector<label_type> & labelMap) const
+    {
+        vigra_precondition(0 <= mergeCount && mergeCount <= size(),
+            "RegionMergeTree::mapping(): mergeCount out of range.");
+        detail::UnionFindArray<label_type> regions(maxLabel_);
+        for(index_type k = 0; k < mergeCount; ++k)
+            regions.makeUnion(merges_[k].representative, merges_[k].merged);
+        labelMap.resize((std::size_t)maxLabel_ + 1);
+        for(std::size_t l = 0; l < labelMap.size(); ++l)
+            labelMap[l] = regions.find((label_type)l);
+    }
+
+        /** \brief Compute the label mapping when agglomeration stops at the given threshold.
+
+            Equivalent to <tt>mapping(mergeCount(threshold), labelMap)</tt>.
+        */
+    void mappingAtThreshold(double threshold, ArrayVector<label_type> & labelMap) const
+    {
+        mapping(mergeCount(threshold), labelMap);
+    }
+
+        /** \brief Remove all merge steps and reset the label range.
+        */
+    void clear(label_type maxLabel)
+    {
+        merges_.clear();
+        maxLabel_ = maxLabel;
+    }
+
+        /** \brief Append a merge step.
+        */
+    void push_back(Merge const & merge)
+    {
+        merges_.push_back(merge);
+    }
+
+  private:
+    label_type maxLabel_;
+    ArrayVector<Merge> merges_;
+};
+
+namespace detail {
+
+    // Open-addressing hash table (linear probing) from a pair of region slots,
+    // packed into a UInt64 key, to the ID of the edge between them. Deleted
+    // entries are marked by a tombstone and disappear when the table is rebuilt.
+class AgglomerationEdgeTable
+{
+    enum { Empty = 0 };
+    static UInt64 deleted()
+    {
+        return ~UInt64(0);
+    }
+
+    struct Slot
+    {
+        UInt64 key;
+        MultiArrayIndex edge;
+
+        Slot()
+        : key(Empty), edge(-1)
+        {}
+    };
+
+  public:
+    AgglomerationEdgeTable(std::size_t size)
+    : slots_(),
+      size_(0),
+      used_(0),
+      shift_(64 - 6)
+    {
+        std::size_t capacity = 64;
+        for(; capacity < 4*size; capacity *= 2)
+            --shift_;
+        slots_.resize(capacity);
+    }
+
+    static UInt64 key(UInt32 a, UInt32 b)
+    {
+        // slot 0 is a valid region, so shift by one to avoid Empty
+        return a < b
+                  ? ((UInt64)a << 32) | ((UInt64)b + 1)
+                  : ((UInt64)b << 32) | ((UInt64)a + 1);
+    }
+
+        // ID of the edge with the given key, or -1
+    MultiArrayIndex find(UInt64 key) const
+    {
+        std::size_t k = position(key);
+        return slots_[k].key == key
+                   ? slots_[k].edge
+                   : -1;
+    }
+
+        // 'key' must not be in the table
+    void insert(UInt64 key, MultiArrayIndex edge)
+    {
+        if(2*(used_ + 1) > slots_.size())
+            rebuild(4*(size_ + 1) > slots_.size());
+        std::size_t mask = slots_.size() - 1,
+                    k = hash(key);
+        while(slots_[k].key != Empty && slots_[k].key != deleted())
+            k = (k + 1) & mask;
+        if(slots_[k].key == Empty)
+            ++used_;
+        slots_[k].key = key;
+        slots_[k].edge = edge;
+        ++size_;
+    }
+
+    void erase(UInt64 key)
+    {
+        std::size_t k = position(key);
+        if(slots_[k].key == key)
+        {
+            slots_[k].key = deleted();
+            --size_;
+        }
+    }
+
+  private:
+    std::size_t hash(UInt64 key) const
+    {
+        return (std::size_t)((key * UInt64(0x9E3779B97F4A7C15ull)) >> shift_);
+    }
+
+        // the slot holding 'key', or the empty slot where the search ends
+    std::size_t position(UInt64 key) const
+    {
+        std::size_t mask = slots_.size() - 1,
+                    k = hash(key);
+        while(slots_[k].key != key && slots_[k].key != Empty)
+            k = (k + 1) & mask;
+        return k;
+    }
+
+    void rebuild(bool grow)
+    {
+        ArrayVector<Slot> old(grow ? 2*slots_.size() : slots_.size());
+        old.swap(slots_);
+        if(grow)
+            --shift_;
+        size_ = used_ = 0;
+        for(std::size_t k = 0; k < old.size(); ++k)
+            if(old[k].key != Empty && old[k].key != deleted())
+                insert(old[k].key, old[k].edge);
+    }
+
+    ArrayVector<Slot> slots_;
+    std::size_t size_, used_;
+    int shift_;
+};
+
+    // Greedy edge contraction. The incident edges of each region are kept in a
+    // singly linked list of half-edges (half-edge 2*e belongs to u(e), 2*e+1 to v(e)),
+    // so that the lists of two regions can be concatenated in constant time. Lists
+    // may contain half-edges of deleted edges, which are unlinked when the list is
+    // traversed. The labels of the half-edge endpoints are resolved by the union-find
+    // array. Since the union-find array always keeps the smaller label as the
+    // representative, the lists live in 'slots' that are assigned independently:
+    // when two regions are merged, only the shorter list is traversed, and the
+    // merged region takes over the slot of the longer one. An edge table maps
+    // pairs of slots to the edge between them, so that the edges to a common
+    // neighbor can be combined without searching the longer list.
+class RegionAgglomeration
+{
+    typedef RegionAdjacencyGraph::label_type label_type;
+    typedef MultiArrayIndex index_type;
+
+  public:
+    template <class WeightIterator>
+    RegionAgglomeration(RegionAdjacencyGraph const & rag, WeightIterator weights)
+    : regions_(rag.maxLabel()),
+      queue_(rag.edgeCount()),
+      edgeTable_(rag.edgeCount()),
+      weightedSum_(rag.edgeCount()),
+      boundarySize_(rag.edgeCount()),
+      target_(2*rag.edgeCount()),
+      slot_(rag.nodeCount()),
+      next_(2*rag.edgeCount(), -1),
+      head_(rag.nodeCount(), -1),
+      tail_(rag.nodeCount(), -1),
+      length_(rag.nodeCount(), 0),
+      regionCount_(0),
+      currentWeight_(-DBL_MAX)
+    {
+        for(index_type e = 0; e < rag.edgeCount(); ++e, ++weights)
+        {
+            double weight = *weights;
+            boundarySize_[e] = (double)rag.boundarySize(e);
+            weightedSum_[e] = weight * boundarySize_[e];
+            target_[2*e] = rag.v(e);
+            target_[2*e+1] = rag.u(e);
+            queue_.push(e, weight);
+            edgeTable_.insert(AgglomerationEdgeTable::key(rag.u(e), rag.v(e)), e);
+        }
+        for(label_type l = 0; l <= rag.maxLabel(); ++l)
+        {
+            if(rag.nodeSize(l) > 0)
+                ++regionCount_;
+            slot_[l] = l;
+            RegionAdjacencyGraph::edge_iterator e = rag.edgesBegin(l),
+                                                end = rag.edgesEnd(l);
+            for(; e != end; ++e)
+                append(l, l == rag.u(*e) ? 2*(index_type)*e : 2*(index_type)*e+1);
+        }
+    }
+
+    void run(RegionMergeTree & tree, AgglomerationOptions const & options)
+    {
+        while(!queue_.empty() && regionCount_ > options.region_count)
+        {
+            double weight = queue_.topPriority();
+            if(weight > options.threshold)
+                break;
+            index_type edge = queue_.top();
+            queue_.pop();
+
+            label_type a = regions_.find(target_[2*edge+1]),
+                       b = regions_.find(target_[2*edge]);
+            label_type sa = slot_[a], sb = slot_[b];
+            edgeTable_.erase(AgglomerationEdgeTable::key(sa, sb));
+
+            label_type r = regions_.makeUnion(a, b),
+                       m = r == a ? b : a;
+            tree.push_back(RegionMergeTree::Merge(r, m, weight));
+            --regionCount_;
+            currentWeight_ = weight;
+
+            if(length_[sa] < length_[sb])
+                std::swap(sa, sb);
+            mergeSlots(sa, sb);
+            slot_[r] = sa;
+        }
+    }
+
+  private:
+    void append(label_type slot, index_type h)
+    {
+        if(head_[slot] < 0)
+            head_[slot] = h;
+        else
+            next_[tail_[slot]] = h;
+        tail_[slot] = h;
+        next_[h] = -1;
+        ++length_[slot];
+    }
+
+        // Move the edges of slot 'merged' to slot 'target': edges between the two
+        // slots become internal and are deleted, edges to a common neighbor are
+        // combined with the target's edge (the weighted mean of the combined edge
+        // is updated in the queue), all others are re-keyed to the target slot.
+    void mergeSlots(label_type target, label_type merged)
+    {
+        index_type prev = -1, h = head_[merged];
+        while(h >= 0)
+        {
+            index_type next = next_[h],
+                       edge = h / 2;
+            bool keep = false;
+            if(queue_.contains(edge))
+            {
+                label_type neighbor = slot_[regions_.find(target_[h])];
+                edgeTable_.erase(AgglomerationEdgeTable::key(merged, neighbor));
+                if(neighbor == target)
+                {
+                    queue_.remove(edge);
+                }
+                else
+                {
+                    UInt64 key = AgglomerationEdgeTable::key(target, neighbor);
+                    index_type parallel = edgeTable_.find(key);
+                    if(parallel >= 0)
+                    {
+                        weightedSum_[parallel] += weightedSum_[edge];
+                        boundarySize_[parallel] += boundarySize_[edge];
+                        // the mean cannot be smaller than the current weight, except for round-off
+                        queue_.push(parallel, std::max(currentWeight_,
+                                                       weightedSum_[parallel] / boundarySize_[parallel]));
+                        queue_.remove(edge);
+                    }
+                    else
+                    {
+                        edgeTable_.insert(key, edge);
+                        keep = true;
+                    }
+                }
+            }
+            if(keep)
+            {
+                prev = h;
+            }
+            else
+            {
+                // unlink h
+                if(prev < 0)
+                    head_[merged] = next;
+                else
+                    next_[prev] = next;
+                --length_[merged];
+            }
+            h = next;
+        }
+
+        // concatenate the lists
+        if(prev >= 0)
+        {
+            if(head_[target] < 0)
+                head_[target] = head_[merged];
+            else
+                next_[tail_[target]] = head_[merged];
+            tail_[target] = prev;
+            length_[target] += length_[merged];
+        }
+        head_[merged] = tail_[merged] = -1;
+        length_[merged] = 0;
+    }
+
+    UnionFindArray<label_type> regions_;
+    ChangeablePriorityQueue<double> queue_;
+    AgglomerationEdgeTable edgeTable_;
+    ArrayVector<double> weightedSum_, boundarySize_;
+    ArrayVector<label_type> target_, slot_;
+    ArrayVector<index_type> next_, head_, tail_, length_;
+    MultiArrayIndex regionCount_;
+    double currentWeight_;
+};
+
+} // namespace detail
+
+/** \brief Greedy hierarchical merging of the regions of an over-segmentation.
+
+    <b> Declarations:</b>
+
+    \code
+    namespace vigra {
+        // use the mean boundary indicator of the region adjacency graph as edge weight
+        void
+        agglomerateRegions(RegionAdjacencyGraph const & rag, RegionMergeTree & tree,
+                           AgglomerationOptions const & options = AgglomerationOptions());
+
+        // use the given edge weights (one per edge of 'rag')
+        template <class T, class S>
+        void
+        agglomerateRegions(RegionAdjacencyGraph const & rag, MultiArrayView<1, T, S> const & edgeWeights,
+                           RegionMergeTree & tree,
+                           AgglomerationOptions const & options = AgglomerationOptions());
+    }
+    \endcode
+
+    The function repeatedly merges the two adjacent regions whose common boundary
+    has the smallest weight. When two regions are merged, their boundaries to a
+    common neighbor are combined into a single edge, whose weight is the mean of
+    the two weights, weighted by the boundary sizes (number of faces) of the edges.
+    If the weights are the mean boundary indicators (first version), the weight
+    of the combined edge is thus again the mean indicator along the combined boundary.
+    The edges are kept in a priority queue whose entries are updated in place,
+    and the regions are tracked by a union-find array.
+
+    Merging stops when the smallest weight exceeds <tt>options.threshold</tt>, or
+    when only <tt>options.region_count</tt> regions are left (see \ref AgglomerationOptions).
+    By default, all regions are merged, and the resulting merge tree can be used to
+    extract the segmentation for any threshold without recomputation (see
+    \ref RegionMergeTree::mapping()). The merge tree is replaced by the merges of this run.
+
+    <b> Usage:</b>
+
+    <b>\#include</b> \<vigra/region_agglomeration.hxx\><br>
+    Namespace: vigra
+
+    \code
+    MultiArray<3, float> gradient(shape);
+    MultiArray<3, UInt32> labels(shape);
+    ...
+    watershedsMultiArray(gradient, labels);
+
+    RegionAdjacencyGraph rag(labels, gradient);
+    RegionMergeTree tree;
+    agglomerateRegions(rag, tree);
+
+    // segmentations at several thresholds
+    ArrayVector<UInt32> labelMap;
+    for(double threshold = 1.0; threshold < 10.0; threshold += 1.0)
+    {
+        tree.mappingAtThreshold(threshold, labelMap);
+        MultiArray<3, UInt32> merged(shape);
+        for(int k = 0; k < labels.size(); ++k)
+            merged[k] = labelMap[labels[k]];
+        ...
+    }
+    \endcode
+*/
+doxygen_overloaded_function(template <...> void agglomerateRegions)
+
+template <class T, class S>
+void
+agglomerateRegions(RegionAdjacencyGraph const & rag, MultiArrayView<1, T, S> const & edgeWeights,
+                   RegionMergeTree & tree,
+                   AgglomerationOptions const & options = AgglomerationOptions())
+{
+    vigra_precondition(edgeWeights.size() == rag.edgeCount(),
+        "agglomerateRegions(): need one weight per edge.");
+    tree.clear(rag.maxLabel());
+    detail::RegionAgglomeration agglomeration(rag, edgeWeights.begin());
+    agglomeration.run(tree, options);
+}
+
+inline void
+agglomerateRegions(RegionAdjacencyGraph const & rag, RegionMergeTree & tree,
+                   AgglomerationOptions const & options = AgglomerationOptions())
+{
+    MultiArray<1, double> weights(MultiArrayShape<1>::type(rag.edgeCount()));
+    for(MultiArrayIndex e = 0; e < rag.edgeCount(); ++e)
+        weights(e) = rag.boundaryMean(e);
+    agglomerateRegions(rag, weights, tree, options);
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_REGION_AGGLOMERATION_HXX
@@ -419,6 +419,13 @@ class Sampler
         return options_.stratified_sampling;
     }
     
+        /** The random number generator used for sampling.
+         */
+    Random const & randomGenerator() const
+    {
+        return random_;
+    }
+    
         /** Whether sampling should be performed with replacement.
          */
     bool withReplacement() const
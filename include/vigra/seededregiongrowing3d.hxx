@@ -160,6 +160,27 @@ public:
     };
 };
 
+    // Feature value at an offset of the label volume (with border) in 3D.
+template <class SrcIterator, class SrcAccessor, class Diff_type>
+struct SeedRgSrcValueAt3D
+{
+    SeedRgSrcValueAt3D(SrcIterator ul, SrcAccessor a, Diff_type const & regionShape)
+    : ul_(ul), a_(a), width_(regionShape[0]), height_(regionShape[1])
+    {}
+
+    typename SrcAccessor::value_type operator()(std::ptrdiff_t offset) const
+    {
+        std::ptrdiff_t x = offset % width_,
+                       y = (offset / width_) % height_,
+                       z = offset / (width_*height_);
+        return a_(ul_, Diff_type(x - 1, y - 1, z - 1));
+    }
+
+    SrcIterator ul_;
+    SrcAccessor a_;
+    std::ptrdiff_t width_, height_;
+};
+
 } // namespace detail
 
 /** \addtogroup SeededRegionGrowing
@@ -216,6 +237,8 @@ public:
     <DT><tt>StopAtThreshold</tt> <DD> stop when the boundary indicator values exceed the 
                              threshold given by parameter <tt>max_cost</tt>.
     <DT><tt>KeepContours | StopAtThreshold</tt> <DD> keep 1-voxel wide contour and stop at given <tt>max_cost</tt>.
+    <DT><tt>QuantizedCosts</tt> <DD> can be combined with the above. Use a \ref BucketQueue instead of a heap
+                             for integer costs, see \ref seededRegionGrowing().
     </DL>
 
     The cost is determined jointly by the source array and the
@@ -352,6 +375,19 @@ seededRegionGrowing3D(SrcImageIterator srcul, Diff_type shape, SrcAccessor as,
     typedef typename Neighborhood::Direction Direction;
     int directionCount = Neighborhood::DirectionCount;
 
+    // with QuantizedCosts, candidates are stored as offsets in a bucket queue
+    typedef typename RegionStatistics::cost_type QuantizedCostType;
+    bool quantized = (srgType & QuantizedCosts) != 0;
+    BucketQueue<detail::SeedRgCandidate, true> 
+            bqueue(quantized ? detail::SeedRgBucketCount<QuantizedCostType>::value : 0);
+    ArrayVector<std::ptrdiff_t> neighborOffsets(directionCount);
+    for(int i=0; i<directionCount; i++)
+    {
+        Diff_type diff = Neighborhood::diff((Direction)i);
+        neighborOffsets[i] = diff[0]*regions.stride(0) + diff[1]*regions.stride(1) + 
+                             diff[2]*regions.stride(2);
+    }
+
     Diff_type pos(0,0,0);
 
     for(isz=srcul, irz=ir, pos[2]=0; pos[2]<d;
@@ -377,6 +413,13 @@ seededRegionGrowing3D(SrcImageIterator srcul, Diff_type shape, SrcAccessor as,
                         cneighbor = *(irx + Neighborhood::diff((Direction)i));
                         if(cneighbor > 0)
                         {
+                            if(quantized)
+                            {
+                                std::ptrdiff_t offset = &*irx - regions.data();
+                                bqueue.push(detail::SeedRgCandidate(offset, cneighbor),
+                                            detail::seedRgBucket(stats[cneighbor].cost(as(isx))));
+                                continue;
+                            }
                             CostType cost = stats[cneighbor].cost(as(isx));
 
                             Voxel * voxel =
@@ -390,7 +433,13 @@ seededRegionGrowing3D(SrcImageIterator srcul, Diff_type shape, SrcAccessor as,
     }
     
     // perform region growing
-    while(pheap.size() != 0)
+    if(quantized)
+        detail::seededRegionGrowingBucketQueue(bqueue, regions.data(), neighborOffsets,
+                    detail::SeedRgSrcValueAt3D<SrcImageIterator, SrcAccessor, Diff_type>(
+                                                                    srcul, as, regionshape),
+                    stats, srgType, max_cost);
+
+    while(pheap.size() != 0) // heap is empty with QuantizedCosts
     {
         Voxel * voxel = pheap.top();
         pheap.pop();
@@ -58,6 +58,7 @@
 #include <cstring>
 #include <vector> 
 #include "vigra/multi_array.hxx"
+#include "vigra/mapped_multi_array.hxx"
 
 namespace vigra {
  
@@ -189,6 +190,40 @@ class SIFImportInfo
 */
 VIGRA_EXPORT void readSIF(const SIFImportInfo &info, MultiArrayView<3, float, UnstridedArrayTag> array);
 
+    /** \brief Map the image data specified by the given \ref vigra::SIFImportInfo object
+                into memory.
+                
+    Instead of reading the data like \ref readSIF(), the stack is memory-mapped and 
+    <tt>array</tt> becomes a view directly over the file (see \ref vigra::MappedMultiArray). 
+    Opening a stack thus takes almost no time regardless of its size, and the 
+    images are only read from disk when they are accessed. On big-endian machines,
+    and when the header length is not a multiple of four bytes, the data must be 
+    byte-swapped or copied and are read entirely.
+    
+    <b> Declaration:</b>
+    
+    \code
+    namespace vigra {
+        void 
+        mapSIF(const SIFImportInfo &info, MappedMultiArray<3, float> & array);
+    }
+    \endcode
+    
+    <b> Usage:</b>
+    
+    <b>\#include</b> \<vigra/sifImport.hxx\><br>
+    Namespace: vigra
+    
+    \code
+	SIFImportInfo info(filename);
+	MappedMultiArray<3, float> stack;
+	mapSIF(info, stack);   // stack.shape() == Shape3(info.width(), info.height(), info.stacksize())
+	
+	MultiArrayView<2, float> frame = stack.bindOuter(10);
+    \endcode
+*/
+VIGRA_EXPORT void mapSIF(const SIFImportInfo &info, MappedMultiArray<3, float> & array);
+
 VIGRA_EXPORT std::ostream& operator<<(std::ostream& os, const SIFImportInfo& info);
 
 //@}
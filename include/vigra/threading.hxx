@@ -0,0 +1,252 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+
+#ifndef VIGRA_THREADING_HXX
+#define VIGRA_THREADING_HXX
+
+#include <string>
+#include <stdexcept>
+#include <new>
+#include "config.hxx"
+#include "error.hxx"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace vigra {
+
+/** \addtogroup ParallelProcessing Parallel Processing
+
+    Helpers for the algorithms that can distribute their work over several threads.
+    
+    Multi-threading in VIGRA is based on OpenMP and must be enabled when the 
+    client code is compiled (e.g. with <tt>-fopenmp</tt> on gcc, or by configuring
+    VIGRA's own build with <tt>WITH_OPENMP=ON</tt>). Without OpenMP, all algorithms 
+    run in the calling thread and produce the same results. 
+    
+    Algorithms that accept a thread count run serially by default, i.e. 
+    parallelism must be requested explicitly. A positive count requests that
+    many threads, zero means serial execution, and a negative count uses all
+    available threads (see actualThreadCount()).
+    
+    <b>\#include</b> \<vigra/threading.hxx\><br>
+    Namespace: vigra
+*/
+//@{
+
+    /** Number of threads available to a parallel region.
+    
+        Returns <tt>omp_get_max_threads()</tt> when compiled with OpenMP, 
+        and 1 otherwise.
+    */
+inline int defaultThreadCount()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+    /** Number of threads an algorithm should actually use when the 
+        user requested <tt>requested</tt> threads: positive values are 
+        returned unchanged, zero means serial execution (1 thread), and
+        negative values mean "as many as available" (see defaultThreadCount()). 
+        Without OpenMP, the result is always 1.
+    */
+inline int actualThreadCount(int requested)
+{
+#ifdef _OPENMP
+    return requested > 0
+               ? requested
+               : requested == 0
+                   ? 1
+                   : defaultThreadCount();
+#else
+    return 1;
+#endif
+}
+
+    /** Index of the calling thread within the current parallel region 
+        (0 outside of a parallel region or without OpenMP).
+    */
+inline int threadIndex()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/** \brief Transport an exception out of a parallel region.
+
+    Exceptions must not leave an OpenMP parallel region. Wrap the body
+    of the region in a try block and pass any exception to 
+    <tt>capture()</tt>. After the region has been left, <tt>rethrow()</tt> 
+    throws a copy of the first exception that was captured (if any). 
+    VIGRA's contract violations (e.g. \ref vigra::PreconditionViolation)
+    and <tt>std::bad_alloc</tt> keep their type, all other exceptions are 
+    rethrown as <tt>std::runtime_error</tt> with the original message.
+    
+    \code
+    ThreadExceptionCollector errors;
+    #pragma omp parallel for
+    for(int k = 0; k < n; ++k)
+    {
+        try
+        {
+            ... // work that may throw
+        }
+        catch(std::exception & e)
+        {
+            errors.capture(e);
+        }
+    }
+    errors.rethrow();
+    \endcode
+*/
+class ThreadExceptionCollector
+{
+    struct HolderBase
+    {
+        virtual ~HolderBase() {}
+        virtual void rethrow() const = 0;
+    };
+    
+    template <class E>
+    struct Holder : public HolderBase
+    {
+        Holder(E const & e)
+        : exception_(e)
+        {}
+        
+        virtual void rethrow() const
+        {
+            throw exception_;
+        }
+        
+        E exception_;
+    };
+    
+  public:
+    ThreadExceptionCollector()
+    : failed_(false),
+      exception_(0)
+    {}
+    
+    ~ThreadExceptionCollector()
+    {
+        delete exception_;
+    }
+    
+    void capture(std::exception const & e)
+    {
+#ifdef _OPENMP
+        #pragma omp critical(vigra_thread_exception_collector)
+#endif
+        {
+            if(!failed_)
+            {
+                failed_ = true;
+                exception_ = copy(e);
+            }
+        }
+    }
+    
+    void capture(char const * message)
+    {
+        capture(std::runtime_error(message));
+    }
+    
+    bool failed() const
+    {
+        bool res;
+#ifdef _OPENMP
+        #pragma omp critical(vigra_thread_exception_collector)
+#endif
+        res = failed_;
+        return res;
+    }
+    
+    void rethrow() const
+    {
+        if(failed())
+        {
+            if(exception_ == 0)
+                throw std::bad_alloc();
+            exception_->rethrow();
+        }
+    }
+    
+  private:
+    ThreadExceptionCollector(ThreadExceptionCollector const &);
+    ThreadExceptionCollector & operator=(ThreadExceptionCollector const &);
+    
+        // returns 0 if there is not even enough memory for the copy
+    static HolderBase * copy(std::exception const & e)
+    {
+        try
+        {
+            if(PreconditionViolation const * p = dynamic_cast<PreconditionViolation const *>(&e))
+                return new Holder<PreconditionViolation>(*p);
+            if(PostconditionViolation const * p = dynamic_cast<PostconditionViolation const *>(&e))
+                return new Holder<PostconditionViolation>(*p);
+            if(InvariantViolation const * p = dynamic_cast<InvariantViolation const *>(&e))
+                return new Holder<InvariantViolation>(*p);
+            if(ContractViolation const * p = dynamic_cast<ContractViolation const *>(&e))
+                return new Holder<ContractViolation>(*p);
+            if(dynamic_cast<std::bad_alloc const *>(&e))
+                return new Holder<std::bad_alloc>(std::bad_alloc());
+            return new Holder<std::runtime_error>(std::runtime_error(e.what()));
+        }
+        catch(std::bad_alloc &)
+        {
+            return 0;
+        }
+    }
+    
+    bool failed_;
+    HolderBase * exception_;
+};
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA_THREADING_HXX
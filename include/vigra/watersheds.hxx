@@ -729,7 +729,7 @@ class WatershedOptions
         */
     WatershedOptions & completeGrow()
     {
-        terminate = SRGType(CompleteGrow | (terminate & StopAtThreshold));
+        terminate = SRGType(CompleteGrow | (terminate & (StopAtThreshold | QuantizedCosts)));
         return *this;
     }
     
@@ -741,7 +741,7 @@ class WatershedOptions
         */
     WatershedOptions & keepContours()
     {
-        terminate = SRGType(KeepContours | (terminate & StopAtThreshold));
+        terminate = SRGType(KeepContours | (terminate & (StopAtThreshold | QuantizedCosts)));
         return *this;
     }
     
@@ -42,6 +42,7 @@
 #include "labelvolume.hxx"
 #include "seededregiongrowing3d.hxx"
 #include "watersheds.hxx"
+#include "threading.hxx"
 
 namespace vigra
 {
@@ -49,31 +50,33 @@ namespace vigra
 template <class SrcIterator, class SrcAccessor, class SrcShape,
           class DestIterator, class DestAccessor, class Neighborhood3D>
 int preparewatersheds3D( SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
-                         DestIterator d_Iter, DestAccessor da, Neighborhood3D)
+                         DestIterator d_Iter, DestAccessor da, Neighborhood3D,
+                         int threadCount = 1)
 {
     //basically needed for iteration and border-checks
     int w = srcShape[0], h = srcShape[1], d = srcShape[2];
-    int x,y,z, local_min_count=0;
+    int local_min_count=0;
+    int thread_count = actualThreadCount(threadCount);
         
-    //declare and define Iterators for all three dims at src
-    SrcIterator zs = s_Iter;
-    SrcIterator ys(zs);
-    SrcIterator xs(ys);
-        
-    //Declare Iterators for all three dims at dest
-    DestIterator zd = d_Iter;
-        
-    for(z = 0; z != d; ++z, ++zs.dim2(), ++zd.dim2())
+    // the slices are independent and can be processed in parallel
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(thread_count) reduction(+:local_min_count) if(thread_count > 1 && (double)w*h*d >= 100000.0)
+#endif
+    for(int z = 0; z < d; ++z)
     {
-        ys = zs;
-        DestIterator yd(zd);
+        //declare and define Iterators for all three dims at src and dest
+        SrcIterator ys = s_Iter;
+        ys.dim2() += z;
+        SrcIterator xs(ys);
+        DestIterator yd = d_Iter;
+        yd.dim2() += z;
         
-        for(y = 0; y != h; ++y, ++ys.dim1(), ++yd.dim1())
+        for(int y = 0; y != h; ++y, ++ys.dim1(), ++yd.dim1())
         {
             xs = ys;
             DestIterator xd(yd);
 
-            for(x = 0; x != w; ++x, ++xs.dim0(), ++xd.dim0())
+            for(int x = 0; x != w; ++x, ++xs.dim0(), ++xd.dim0())
             {
                 AtVolumeBorder atBorder = isAtVolumeBorder(x,y,z,w,h,d);
                 typename SrcAccessor::value_type v = sa(xs);
@@ -238,6 +241,57 @@ unsigned int watershedLabeling3D( SrcIterator s_Iter, SrcShape srcShape, SrcAcce
 }
 
 
+namespace detail {
+
+template <class Neighborhood3D>
+struct WatershedLabelingPolicy
+{
+    typedef Neighborhood3D Neighborhood;
+    
+    template <class SrcIterator, class SrcShape, class SrcAccessor,
+              class DestIterator, class DestAccessor>
+    unsigned int label(SrcIterator s, SrcShape shape, SrcAccessor sa,
+                       DestIterator d, DestAccessor da) const
+    {
+        return watershedLabeling3D(s, shape, sa, d, da, Neighborhood3D());
+    }
+    
+    template <class T>
+    bool isBackground(T const &) const
+    {
+        return false;
+    }
+    
+    template <class T>
+    bool connected(T const & u, T const & v, NeighborOffsetCirculator<Neighborhood3D> const & nc) const
+    {
+        //   Direction of NTraversr       Neighbor's direction bit is pointing
+        // = Direction of voxel           towards us?
+        return (u & nc.directionBit()) || (v & nc.oppositeDirectionBit());
+    }
+};
+
+} // namespace detail
+
+    // Same result as watershedLabeling3D(), but the volume is divided into 
+    // slabs of 'blockDepth' slices which are labeled independently (in parallel 
+    // when compiled with OpenMP) and merged afterwards, see detail::labelVolumeBlockwise().
+template <class SrcIterator, class SrcAccessor,class SrcShape,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D>
+unsigned int watershedLabeling3DBlockwise( SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
+                                           DestIterator d_Iter, DestAccessor da,
+                                           Neighborhood3D, 
+                                           int blockDepth, int threadCount = 1)
+{
+    vigra_precondition(blockDepth > 0,
+        "watershedLabeling3DBlockwise(): blockDepth must be positive.");
+    return detail::labelVolumeBlockwise(s_Iter, srcShape, sa, d_Iter, da, 
+                                        detail::WatershedLabelingPolicy<Neighborhood3D>(), 
+                                        blockDepth, threadCount);
+}
+
+
 /** \addtogroup SeededRegionGrowing
 */
 //@{
@@ -398,7 +452,8 @@ generateWatershedSeeds(triple<SrcIterator, SrcIterator, SrcAccessor> src,
                   class Neighborhood3D>
         unsigned int watersheds3D(SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
                                   DestIterator d_Iter, DestAccessor da,
-                                  Neighborhood3D neighborhood3D);
+                                  Neighborhood3D neighborhood3D,
+                                  int threadCount = 1);
     }
     \endcode
 
@@ -410,7 +465,8 @@ generateWatershedSeeds(triple<SrcIterator, SrcIterator, SrcAccessor> src,
                   class Neighborhood3D>
         unsigned int watersheds3D(triple<SrcIterator, SrcShape, SrcAccessor> src,
                                   pair<DestIterator, DestAccessor> dest,
-                                  Neighborhood3D neighborhood3D);
+                                  Neighborhood3D neighborhood3D,
+                                  int threadCount = 1);
     }
     \endcode
 
@@ -452,6 +508,13 @@ generateWatershedSeeds(triple<SrcIterator, SrcIterator, SrcAccessor> src,
     are compared. The voxel type of the input volume must be <tt>LessThanComparable</tt>.
     The function uses accessors. 
     
+    When VIGRA is compiled with OpenMP, both passes of the algorithm run in parallel:
+    the voxel orientations are computed slice by slice, and the labeling is done 
+    on independent slabs of slices whose labels are merged across the slab faces 
+    by a global union-find structure afterwards. The result is identical to
+    the serial algorithm. <tt>threadCount</tt> specifies the number of threads
+    (default: 1, negative: use \ref vigra::defaultThreadCount()).
+    
     ...probably soon in VIGRA:
     Note that VIGRA provides an alternative implementaion of the watershed transform via
     \ref seededRegionGrowing3D(). It is slower, but handles plateaus better 
@@ -511,8 +574,13 @@ template <class SrcIterator, class SrcAccessor, class SrcShape,
           class DestIterator, class DestAccessor,
           class Neighborhood3D>
 unsigned int watersheds3D( SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa,
-                           DestIterator d_Iter, DestAccessor da, Neighborhood3D neighborhood3D)
+                           DestIterator d_Iter, DestAccessor da, Neighborhood3D neighborhood3D,
+                           int threadCount = 1)
 {
+    threadCount = actualThreadCount(threadCount);
+    
+    int blockDepth = detail::labelVolumeBlockDepth(srcShape[2], threadCount);
+
     //create temporary volume to store the DAG of directions to minima
     if ((int)Neighborhood3D::DirectionCount>7){  //If we have 3D-TwentySix Neighborhood
         
@@ -520,8 +588,12 @@ unsigned int watersheds3D( SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa
 
         preparewatersheds3D( s_Iter, srcShape, sa, 
                              destMultiArray(orientationVolume).first, destMultiArray(orientationVolume).second,
-                             neighborhood3D);
-     
+                             neighborhood3D, threadCount);
+        
+        if(threadCount > 1)
+            return watershedLabeling3DBlockwise( srcMultiArray(orientationVolume).first, srcShape, srcMultiArray(orientationVolume).second,
+                                                 d_Iter, da,
+                                                 neighborhood3D, blockDepth, threadCount);
         return watershedLabeling3D( srcMultiArray(orientationVolume).first, srcShape, srcMultiArray(orientationVolume).second,
                                     d_Iter, da,
                                     neighborhood3D);
@@ -532,14 +604,28 @@ unsigned int watersheds3D( SrcIterator s_Iter, SrcShape srcShape, SrcAccessor sa
 
         preparewatersheds3D( s_Iter, srcShape, sa, 
                               destMultiArray(orientationVolume).first, destMultiArray(orientationVolume).second,
-                              neighborhood3D);
+                              neighborhood3D, threadCount);
      
+        if(threadCount > 1)
+            return watershedLabeling3DBlockwise( srcMultiArray(orientationVolume).first, srcShape, srcMultiArray(orientationVolume).second,
+                                                 d_Iter, da,
+                                                 neighborhood3D, blockDepth, threadCount);
         return watershedLabeling3D( srcMultiArray(orientationVolume).first, srcShape, srcMultiArray(orientationVolume).second,
                                     d_Iter, da,
                                     neighborhood3D);
     }
 }
 
+template <class SrcIterator, class SrcShape, class SrcAccessor,
+          class DestIterator, class DestAccessor,
+          class Neighborhood3D>
+inline unsigned int watersheds3D( vigra::triple<SrcIterator, SrcShape, SrcAccessor> src, 
+                                  vigra::pair<DestIterator, DestAccessor> dest,
+                                  Neighborhood3D neighborhood3D, int threadCount = 1)
+{
+    return watersheds3D(src.first, src.second, src.third, dest.first, dest.second, neighborhood3D, threadCount);
+}
+
 template <class SrcIterator, class SrcShape, class SrcAccessor,
           class DestIterator, class DestAccessor>
 inline unsigned int watersheds3DSix( vigra::triple<SrcIterator, SrcShape, SrcAccessor> src, 
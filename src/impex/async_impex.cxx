@@ -0,0 +1,493 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#include <deque>
+#include <stdexcept>
+#include "vigra/async_impex.hxx"
+
+#ifdef _WIN32
+# include "vigra/windows.h"
+# include <process.h>
+#else
+# include <pthread.h>
+#endif
+
+namespace vigra {
+
+namespace {
+
+// Minimal portable mutex, condition variable and thread. The rest of
+// VIGRA uses OpenMP for parallelism, but a worker that outlives the
+// call that started it cannot be expressed with OpenMP.
+#ifdef _WIN32
+
+class Mutex
+{
+  public:
+    Mutex()   { InitializeCriticalSection(&mutex_); }
+    ~Mutex()  { DeleteCriticalSection(&mutex_); }
+    void lock()   { EnterCriticalSection(&mutex_); }
+    void unlock() { LeaveCriticalSection(&mutex_); }
+
+    CRITICAL_SECTION mutex_;
+};
+
+class Condition
+{
+  public:
+    Condition()  { InitializeConditionVariable(&condition_); }
+    void wait(Mutex & mutex) { SleepConditionVariableCS(&condition_, &mutex.mutex_, INFINITE); }
+    void notifyAll()         { WakeAllConditionVariable(&condition_); }
+
+    CONDITION_VARIABLE condition_;
+};
+
+class Thread
+{
+  public:
+    Thread() : handle_(0) {}
+
+    void start(void (*function)(void *), void * argument)
+    {
+        function_ = function;
+        argument_ = argument;
+        handle_ = (HANDLE)_beginthreadex(0, 0, &Thread::run, this, 0, 0);
+        vigra_postcondition(handle_ != 0, "AsyncImageExporter: unable to start worker thread.");
+    }
+
+    void join()
+    {
+        WaitForSingleObject(handle_, INFINITE);
+        CloseHandle(handle_);
+    }
+
+  private:
+    static unsigned __stdcall run(void * self)
+    {
+        Thread * t = static_cast<Thread *>(self);
+        t->function_(t->argument_);
+        return 0;
+    }
+
+    HANDLE handle_;
+    void (*function_)(void *);
+    void * argument_;
+};
+
+#else
+
+class Mutex
+{
+  public:
+    Mutex()   { pthread_mutex_init(&mutex_, 0); }
+    ~Mutex()  { pthread_mutex_destroy(&mutex_); }
+    void lock()   { pthread_mutex_lock(&mutex_); }
+    void unlock() { pthread_mutex_unlock(&mutex_); }
+
+    pthread_mutex_t mutex_;
+};
+
+class Condition
+{
+  public:
+    Condition()  { pthread_cond_init(&condition_, 0); }
+    ~Condition() { pthread_cond_destroy(&condition_); }
+    void wait(Mutex & mutex) { pthread_cond_wait(&condition_, &mutex.mutex_); }
+    void notifyAll()         { pthread_cond_broadcast(&condition_); }
+
+    pthread_cond_t condition_;
+};
+
+class Thread
+{
+  public:
+    void start(void (*function)(void *), void * argument)
+    {
+        function_ = function;
+        argument_ = argument;
+        int res = pthread_create(&thread_, 0, &Thread::run, this);
+        vigra_postcondition(res == 0, "AsyncImageExporter: unable to start worker thread.");
+    }
+
+    void join()
+    {
+        pthread_join(thread_, 0);
+    }
+
+  private:
+    static void * run(void * self)
+    {
+        Thread * t = static_cast<Thread *>(self);
+        t->function_(t->argument_);
+        return 0;
+    }
+
+    pthread_t thread_;
+    void (*function_)(void *);
+    void * argument_;
+};
+
+#endif
+
+class Lock
+{
+  public:
+    explicit Lock(Mutex & mutex)
+    : mutex_(mutex)
+    {
+        mutex_.lock();
+    }
+
+    ~Lock()
+    {
+        mutex_.unlock();
+    }
+
+  private:
+    Mutex & mutex_;
+};
+
+} // anonymous namespace
+
+namespace detail {
+
+struct AsyncExportState
+{
+    AsyncExportState()
+    : references(0), ready(false), success(false)
+    {}
+
+    Mutex mutex;
+    Condition finished;
+    int references;
+    bool ready, success;
+    std::string message;
+};
+
+} // namespace detail
+
+/********************************************************/
+/*                                                      */
+/*                      ExportFuture                    */
+/*                                                      */
+/********************************************************/
+
+ExportFuture::ExportFuture()
+: state_(0)
+{}
+
+ExportFuture::ExportFuture(detail::AsyncExportState * state)
+: state_(state)
+{
+    Lock lock(state_->mutex);
+    ++state_->references;
+}
+
+ExportFuture::ExportFuture(ExportFuture const & other)
+: state_(other.state_)
+{
+    if(state_)
+    {
+        Lock lock(state_->mutex);
+        ++state_->references;
+    }
+}
+
+ExportFuture::~ExportFuture()
+{
+    if(!state_)
+        return;
+    bool last;
+    {
+        Lock lock(state_->mutex);
+        last = --state_->references == 0;
+    }
+    if(last)
+        delete state_;
+}
+
+ExportFuture & ExportFuture::operator=(ExportFuture const & other)
+{
+    if(state_ != other.state_)
+    {
+        ExportFuture tmp(other);
+        std::swap(state_, tmp.state_);
+    }
+    return *this;
+}
+
+bool ExportFuture::isValid() const
+{
+    return state_ != 0;
+}
+
+bool ExportFuture::isReady() const
+{
+    vigra_precondition(state_ != 0, "ExportFuture::isReady(): invalid future.");
+    Lock lock(state_->mutex);
+    return state_->ready;
+}
+
+bool ExportFuture::succeeded() const
+{
+    vigra_precondition(state_ != 0, "ExportFuture::succeeded(): invalid future.");
+    Lock lock(state_->mutex);
+    while(!state_->ready)
+        state_->finished.wait(state_->mutex);
+    return state_->success;
+}
+
+std::string ExportFuture::errorMessage() const
+{
+    vigra_precondition(state_ != 0, "ExportFuture::errorMessage(): invalid future.");
+    Lock lock(state_->mutex);
+    while(!state_->ready)
+        state_->finished.wait(state_->mutex);
+    return state_->message;
+}
+
+void ExportFuture::wait() const
+{
+    if(!succeeded())
+        throw std::runtime_error(errorMessage());
+}
+
+/********************************************************/
+/*                                                      */
+/*                 AsyncImageExporter                   */
+/*                                                      */
+/********************************************************/
+
+class AsyncImageExporterImpl
+{
+  public:
+    struct Entry
+    {
+        detail::AsyncExportJob * job;
+        ExportFuture future;
+    };
+
+    explicit AsyncImageExporterImpl(unsigned int capacity)
+    : capacity_(capacity),
+      pending_(0),
+      stop_(false)
+    {
+        worker_.start(&AsyncImageExporterImpl::work, this);
+    }
+
+    ~AsyncImageExporterImpl()
+    {
+        {
+            Lock lock(mutex_);
+            while(pending_ > 0)
+                changed_.wait(mutex_);
+            stop_ = true;
+            changed_.notifyAll();
+        }
+        worker_.join();
+    }
+
+    static void work(void * self)
+    {
+        static_cast<AsyncImageExporterImpl *>(self)->work();
+    }
+
+    void work()
+    {
+        for(;;)
+        {
+            Entry entry;
+            {
+                Lock lock(mutex_);
+                while(queue_.empty() && !stop_)
+                    changed_.wait(mutex_);
+                if(queue_.empty())
+                    return;
+                entry = queue_.front();
+                queue_.pop_front();
+            }
+
+            bool success = true;
+            std::string message;
+            try
+            {
+                entry.job->run();
+            }
+            catch(std::exception & e)
+            {
+                success = false;
+                message = e.what();
+            }
+            catch(...)
+            {
+                success = false;
+                message = "AsyncImageExporter: unknown exception.";
+            }
+            try
+            {
+                entry.job->finished(success, message);
+            }
+            catch(std::exception & e)
+            {
+                if(success)
+                    message = e.what();
+                success = false;
+            }
+            catch(...)
+            {
+                if(success)
+                    message = "AsyncImageExporter: unknown exception in callback.";
+                success = false;
+            }
+            delete entry.job;
+
+            // the copy of the data is gone, make the result visible
+            detail::AsyncExportState * state = entry.future.state_;
+            {
+                Lock lock(state->mutex);
+                state->success = success;
+                state->message = message;
+                state->ready = true;
+                state->finished.notifyAll();
+            }
+            {
+                Lock lock(mutex_);
+                --pending_;
+                changed_.notifyAll();
+            }
+        }
+    }
+
+    void reserve()
+    {
+        Lock lock(mutex_);
+        while(pending_ >= capacity_)
+            changed_.wait(mutex_);
+        ++pending_;
+    }
+
+    void release()
+    {
+        Lock lock(mutex_);
+        --pending_;
+        changed_.notifyAll();
+    }
+
+    void submit(Entry const & entry)
+    {
+        Lock lock(mutex_);
+        queue_.push_back(entry);
+        changed_.notifyAll();
+    }
+
+    void waitAll()
+    {
+        Lock lock(mutex_);
+        while(pending_ > 0)
+            changed_.wait(mutex_);
+    }
+
+    unsigned int pending()
+    {
+        Lock lock(mutex_);
+        return pending_;
+    }
+
+    unsigned int capacity_, pending_;
+    bool stop_;
+    std::deque<Entry> queue_;
+    Mutex mutex_;
+    Condition changed_;
+    Thread worker_;
+};
+
+AsyncImageExporter::AsyncImageExporter(unsigned int capacity)
+: pimpl_(0)
+{
+    vigra_precondition(capacity > 0,
+        "AsyncImageExporter(): capacity must be at least 1.");
+    pimpl_ = new AsyncImageExporterImpl(capacity);
+}
+
+AsyncImageExporter::~AsyncImageExporter()
+{
+    delete pimpl_;
+}
+
+void AsyncImageExporter::reserve()
+{
+    pimpl_->reserve();
+}
+
+void AsyncImageExporter::release()
+{
+    pimpl_->release();
+}
+
+ExportFuture AsyncImageExporter::submit(detail::AsyncExportJob * job)
+{
+    AsyncImageExporterImpl::Entry entry;
+    entry.job = job;
+    try
+    {
+        entry.future = ExportFuture(new detail::AsyncExportState);
+        pimpl_->submit(entry);
+    }
+    catch(...)
+    {
+        // the job never reached the queue
+        delete job;
+        release();
+        throw;
+    }
+    return entry.future;
+}
+
+void AsyncImageExporter::waitAll()
+{
+    pimpl_->waitAll();
+}
+
+unsigned int AsyncImageExporter::pending() const
+{
+    return pimpl_->pending();
+}
+
+unsigned int AsyncImageExporter::capacity() const
+{
+    return pimpl_->capacity_;
+}
+
+} // namespace vigra
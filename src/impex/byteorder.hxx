@@ -42,6 +42,7 @@
 #include <fstream>
 #include <algorithm>
 #include "vigra/sized_int.hxx"
+#include "vigra/byteswap.hxx"
 
 namespace vigra
 {
@@ -110,8 +111,7 @@ namespace vigra
         void convert_to_host( T * x, size_t num ) const
         {
             if (!native)
-                for( size_t i = 0; i < num; ++i )
-                    reversebytes(x[i]);
+                detail::byteSwapArray(x, num, sizeof(T));
         }
 
         template< class T >
@@ -125,8 +125,7 @@ namespace vigra
         void convert_from_host( T * x, size_t num ) const
         {
             if (!native)
-                for( size_t i = 0; i < num; ++i )
-                    reversebytes(x[i]);
+                detail::byteSwapArray(x, num, sizeof(T));
         }
 
         void convert_to_host( char & ) const {}
@@ -172,8 +171,17 @@ namespace vigra
     void write_array( std::ofstream & stream, const byteorder & bo,
                       const T * x, size_t num )
     {
-        for( size_t i = 0; i < num; ++i )
-            write_field( stream, bo, x[i] );
+        // convert and write blocks of 64 kB instead of single elements
+        const size_t block = std::max< size_t >( 1, 0x10000 / sizeof(T) );
+        std::vector< T > buffer( std::min( num, block ) );
+        for( size_t i = 0; i < num; i += block )
+        {
+            const size_t n = std::min( num - i, block );
+            std::copy( x + i, x + i + n, buffer.begin() );
+            bo.convert_from_host( &buffer[0], n );
+            stream.write( reinterpret_cast< char * >(&buffer[0]), 
+                          static_cast<std::streamsize>(sizeof(T) * n) );
+        }
     }
 
 } // namespace vigra
@@ -37,6 +37,8 @@
 
 #include "vigra/random_forest_hdf5_impex.hxx"
 #include "vigra/multi_array.hxx"
+#include "vigra/threading.hxx"
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <cstdio>
@@ -233,6 +235,160 @@ void dt_export_HDF5(    hid_t & group_id,
     H5Gclose(tree_id);
 }
 
+namespace {
+
+// write a 1D dataset in chunks of at most 64k elements, so that large
+// datasets can be compressed
+template <class U>
+void write_chunked_array_2_hdf5(hid_t id,
+                                ArrayVector<U> const & arr,
+                                std::string const & name,
+                                hid_t file_type,
+                                hid_t memory_type,
+                                int compression)
+{
+    hsize_t size = arr.size();
+    HDF5Handle dataspace(H5Screate_simple(1, &size, NULL), &H5Sclose,
+                         "write_chunked_array_2_hdf5(): unable to create dataspace");
+    HDF5Handle plist(H5Pcreate(H5P_DATASET_CREATE), &H5Pclose,
+                     "write_chunked_array_2_hdf5(): unable to create property list");
+    if(size > 0)
+    {
+        hsize_t chunk = std::min(size, (hsize_t)(1 << 16));
+        H5Pset_chunk(plist, 1, &chunk);
+        if(compression > 0)
+            H5Pset_deflate(plist, compression);
+    }
+    HDF5Handle dataset(H5Dcreate(id, name.c_str(), file_type, dataspace,
+                                 H5P_DEFAULT, plist, H5P_DEFAULT),
+                       &H5Dclose, 
+                       "write_chunked_array_2_hdf5(): unable to create dataset");
+    if(size > 0)
+        vigra_postcondition(H5Dwrite(dataset, memory_type, H5S_ALL, H5S_ALL,
+                                     H5P_DEFAULT, arr.data()) >= 0,
+                            "write_chunked_array_2_hdf5(): unable to write dataset");
+}
+
+bool check_offsets(ArrayVector<UInt64> const & offsets, UInt64 size)
+{
+    if(offsets.size() == 0 || offsets[0] != 0 || offsets.back() != size)
+        return false;
+    for(unsigned int k = 1; k < offsets.size(); ++k)
+        if(offsets[k] < offsets[k-1])
+            return false;
+    return true;
+}
+
+} // anonymous namespace
+
+void trees_export_HDF5_compact(hid_t & group_id,
+                               ArrayVector<detail::DecisionTree> const & trees,
+                               std::string name,
+                               bool singlePrecision,
+                               int compression)
+{
+    //check if ext_param was written and write it if not
+    hid_t e_id = H5Gopen (group_id, 
+                          "_ext_param", 
+                          H5P_DEFAULT);
+    if(e_id < 0)
+    {
+        if(trees.size() > 0)
+            problemspec_export_HDF5(group_id,
+                                    trees[0].ext_param_, 
+                                    "_ext_param"); 
+    }
+    else H5Gclose(e_id);
+
+    HDF5Handle trees_id(H5Gcreate(group_id, name.c_str(), 
+                                  H5P_DEFAULT, 
+                                  H5P_DEFAULT, 
+                                  H5P_DEFAULT),
+                        &H5Gclose,
+                        "trees_export_HDF5_compact(): unable to create group");
+    hid_t id = trees_id;
+
+    // concatenate all trees
+    ArrayVector<UInt64> topology_offsets(trees.size() + 1, 0),
+                        parameter_offsets(trees.size() + 1, 0);
+    for(unsigned int k = 0; k < trees.size(); ++k)
+    {
+        topology_offsets[k+1] = topology_offsets[k] + trees[k].topology_.size();
+        parameter_offsets[k+1] = parameter_offsets[k] + trees[k].parameters_.size();
+    }
+    ArrayVector<DecisionTree::TreeInt> topology;
+    ArrayVector<double> parameters;
+    topology.reserve((unsigned int)topology_offsets.back());
+    parameters.reserve((unsigned int)parameter_offsets.back());
+    for(unsigned int k = 0; k < trees.size(); ++k)
+    {
+        topology.insert(topology.end(), 
+                        trees[k].topology_.begin(), trees[k].topology_.end());
+        parameters.insert(parameters.end(), 
+                          trees[k].parameters_.begin(), trees[k].parameters_.end());
+    }
+
+    write_array_2_hdf5(id, topology_offsets, 
+                       "topology_offsets", H5T_NATIVE_UINT64);
+    write_array_2_hdf5(id, parameter_offsets, 
+                       "parameter_offsets", H5T_NATIVE_UINT64);
+    write_chunked_array_2_hdf5(id, topology, "topology", 
+                               H5T_NATIVE_INT32, H5T_NATIVE_INT32, compression);
+    // HDF5 converts the parameters to float if requested
+    write_chunked_array_2_hdf5(id, parameters, "parameters", 
+                               singlePrecision ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE,
+                               H5T_NATIVE_DOUBLE, compression);
+}
+
+void trees_import_HDF5_compact(hid_t & group_id,
+                               ArrayVector<detail::DecisionTree> & trees,
+                               detail::DecisionTree const & prototype,
+                               std::string name,
+                               int threadCount)
+{
+    HDF5Handle trees_id(H5Gopen(group_id, name.c_str(), H5P_DEFAULT),
+                        &H5Gclose,
+                        "trees_import_HDF5_compact(): unable to open group");
+    hid_t id = trees_id;
+
+    ArrayVector<UInt64> topology_offsets, parameter_offsets;
+    ArrayVector<DecisionTree::TreeInt> topology;
+    ArrayVector<double> parameters;
+    write_hdf5_2_array(id, topology_offsets, 
+                       "topology_offsets", H5T_NATIVE_UINT64);
+    write_hdf5_2_array(id, parameter_offsets, 
+                       "parameter_offsets", H5T_NATIVE_UINT64);
+    write_hdf5_2_array(id, topology, "topology", H5T_NATIVE_INT32);
+    // parameters stored as float are converted by HDF5
+    write_hdf5_2_array(id, parameters, "parameters", H5T_NATIVE_DOUBLE);
+
+    vigra_postcondition(topology_offsets.size() == parameter_offsets.size() &&
+                        check_offsets(topology_offsets, topology.size()) &&
+                        check_offsets(parameter_offsets, parameters.size()),
+                        "trees_import_HDF5_compact(): corrupt tree index");
+
+    int first = trees.size(),
+        count = topology_offsets.size() - 1;
+    trees.resize(first + count, prototype);
+
+    threadCount = actualThreadCount(threadCount);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) num_threads(threadCount) if(threadCount > 1 && count > 1)
+#endif
+    for(int k = 0; k < count; ++k)
+    {
+        DecisionTree & tree = trees[first + k];
+        tree.topology_.clear();
+        tree.topology_.insert(tree.topology_.end(),
+                              topology.begin() + topology_offsets[k], 
+                              topology.begin() + topology_offsets[k+1]);
+        tree.parameters_.clear();
+        tree.parameters_.insert(tree.parameters_.end(),
+                                parameters.begin() + parameter_offsets[k], 
+                                parameters.begin() + parameter_offsets[k+1]);
+    }
+}
+
 }} // namespace vigra::detail
 
 #endif // HasHDF5
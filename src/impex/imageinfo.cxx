@@ -543,7 +543,7 @@ std::auto_ptr<Encoder> encoder( const ImageExportInfo & info )
 // class ImageImportInfo
 
 ImageImportInfo::ImageImportInfo( const char * filename )
-    : m_filename(filename)
+    : m_filename(filename), m_level(0), m_thread_count(1)
 {
     std::auto_ptr<Decoder> decoder = getDecoder(m_filename);
 
@@ -559,6 +559,7 @@ ImageImportInfo::ImageImportInfo( const char * filename )
     m_y_res = decoder->getYResolution();
 
     m_icc_profile = decoder->getICCProfile();
+    m_region = Rect2D(Size2D(m_width, m_height));
 
     decoder->abort(); // there probably is no better way than this
 }
@@ -672,12 +673,206 @@ const ImageImportInfo::ICCProfile & ImageImportInfo::getICCProfile() const
     return m_icc_profile;
 }
 
+ImageImportInfo & ImageImportInfo::setLevel( int level )
+{
+    vigra_precondition(level >= 0 && level < 31,
+        "ImageImportInfo::setLevel(): level out of range.");
+    m_level = level;
+    m_region = Rect2D(Size2D(((m_width - 1) >> level) + 1,
+                             ((m_height - 1) >> level) + 1));
+    return *this;
+}
+
+int ImageImportInfo::getLevel() const
+{
+    return m_level;
+}
+
+ImageImportInfo & ImageImportInfo::setRegion( Rect2D const & region )
+{
+    Rect2D levelRect(Size2D(((m_width - 1) >> m_level) + 1,
+                            ((m_height - 1) >> m_level) + 1));
+    vigra_precondition(!region.isEmpty() && levelRect.contains(region),
+        "ImageImportInfo::setRegion(): region must be non-empty and inside the image.");
+    m_region = region;
+    return *this;
+}
+
+Rect2D ImageImportInfo::getRegion() const
+{
+    return m_region;
+}
+
+ImageImportInfo & ImageImportInfo::setThreadCount( int count )
+{
+    m_thread_count = count;
+    return *this;
+}
+
+int ImageImportInfo::getThreadCount() const
+{
+    return m_thread_count;
+}
+
+namespace {
+
+// Region-of-interest and level support for codecs that cannot do this
+// natively: scanlines above the region are read and dropped, columns are
+// skipped by shifting the scanline pointer and enlarging the pixel offset,
+// and the codec is aborted after the last row of the region.
+class SubimageDecoder : public Decoder
+{
+    std::auto_ptr<Decoder> decoder_;
+    Diff2D upperLeft_;
+    Size2D size_;
+    unsigned int step_, scanline_, rowsRead_, bytesPerSample_;
+
+  public:
+
+    // output pixel (x, y) is pixel upperLeft + step*(x, y) of 'decoder'
+    SubimageDecoder(std::auto_ptr<Decoder> decoder, Diff2D const & upperLeft,
+                    Size2D const & size, unsigned int step)
+    : decoder_(decoder),
+      upperLeft_(upperLeft),
+      size_(size),
+      step_(step),
+      scanline_(0),
+      rowsRead_(0),
+      bytesPerSample_(0)
+    {
+        std::string pixeltype = decoder_->getPixelType();
+        if(pixeltype == "UINT8" || pixeltype == "INT8")
+            bytesPerSample_ = 1;
+        else if(pixeltype == "UINT16" || pixeltype == "INT16")
+            bytesPerSample_ = 2;
+        else if(pixeltype == "UINT32" || pixeltype == "INT32" || pixeltype == "FLOAT")
+            bytesPerSample_ = 4;
+        else if(pixeltype == "DOUBLE")
+            bytesPerSample_ = 8;
+        else
+            vigra_precondition(false,
+                "decoder(): region-of-interest import is not supported for pixel type " + pixeltype + ".");
+        iccProfile_ = decoder_->getICCProfile();
+    }
+
+    void init( const std::string & filename )
+    {
+        decoder_->init(filename);
+    }
+
+    void close()
+    {
+        // codecs may complain when closed before the end of the file
+        if(rowsRead_ == decoder_->getHeight())
+            decoder_->close();
+        else
+            decoder_->abort();
+    }
+
+    void abort()
+    {
+        decoder_->abort();
+    }
+
+    std::string getFileType() const
+    {
+        return decoder_->getFileType();
+    }
+
+    std::string getPixelType() const
+    {
+        return decoder_->getPixelType();
+    }
+
+    unsigned int getWidth() const
+    {
+        return size_.x;
+    }
+
+    unsigned int getHeight() const
+    {
+        return size_.y;
+    }
+
+    unsigned int getNumBands() const
+    {
+        return decoder_->getNumBands();
+    }
+
+    unsigned int getNumExtraBands() const
+    {
+        return decoder_->getNumExtraBands();
+    }
+
+    Diff2D getPosition() const
+    {
+        return decoder_->getPosition();
+    }
+
+    float getXResolution() const
+    {
+        return decoder_->getXResolution();
+    }
+
+    float getYResolution() const
+    {
+        return decoder_->getYResolution();
+    }
+
+    Size2D getCanvasSize() const
+    {
+        return decoder_->getCanvasSize();
+    }
+
+    unsigned int getOffset() const
+    {
+        return decoder_->getOffset() * step_;
+    }
+
+    const void * currentScanlineOfBand( unsigned int band ) const
+    {
+        return static_cast<const char *>(decoder_->currentScanlineOfBand(band)) +
+                 upperLeft_.x * decoder_->getOffset() * bytesPerSample_;
+    }
+
+    void nextScanline()
+    {
+        const unsigned int row = upperLeft_.y + step_ * scanline_++;
+        for(; rowsRead_ <= row; ++rowsRead_)
+            decoder_->nextScanline();
+    }
+};
+
+} // anonymous namespace
+
 // return a decoder for a given ImageImportInfo object
 std::auto_ptr<Decoder> decoder( const ImageImportInfo & info )
 {
     std::string filetype = info.getFileType();
     validate_filetype(filetype);
-    return getDecoder( std::string( info.getFileName() ), filetype );
+    std::auto_ptr<Decoder> dec = getDecoder( std::string( info.getFileName() ), filetype );
+    dec->setThreadCount(info.getThreadCount());
+
+    const int level = info.getLevel();
+    const Rect2D region = info.getRegion();
+    if(level == 0 || dec->setLevel(level))
+    {
+        // the codec delivers the requested level, crop it if necessary
+        if(region == Rect2D(Size2D(dec->getWidth(), dec->getHeight())) ||
+           dec->setRegion(region.upperLeft(), region.size()))
+            return dec;
+        return std::auto_ptr<Decoder>(
+                   new SubimageDecoder(dec, region.upperLeft(), region.size(), 1));
+    }
+
+    // subsample the original image, but decode only the part covered by the region
+    const int step = 1 << level;
+    Diff2D upperLeft(region.left() * step, region.top() * step);
+    Size2D size((region.width() - 1) * step + 1, (region.height() - 1) * step + 1);
+    if(dec->setRegion(upperLeft, size))
+        upperLeft = Diff2D(0, 0);
+    return std::auto_ptr<Decoder>(
+               new SubimageDecoder(dec, upperLeft, region.size(), step));
 }
 
 // class VolumeExportInfo
@@ -182,6 +182,7 @@ namespace vigra
         auto_file file;
         void_vector<JSAMPLE> bands;
         unsigned int width, height, components, scanline;
+        bool started;
 
         // icc profile, if available
         UInt32 iccProfileLength;
@@ -194,6 +195,8 @@ namespace vigra
         // methods
 
         void init();
+        bool setLevel( unsigned int level );
+        void start();
     };
 
     JPEGDecoderImpl::JPEGDecoderImpl( const std::string & filename )
@@ -202,7 +205,8 @@ namespace vigra
 #else
         : file( filename.c_str(), "r" ),
 #endif
-          bands(0), scanline(0), iccProfileLength(0), iccProfilePtr(NULL)
+          bands(0), scanline(0), started(false),
+          iccProfileLength(0), iccProfilePtr(NULL)
     {
         // setup setjmp() error handling
         info.err = jpeg_std_error( ( jpeg_error_mgr * ) &err );
@@ -232,10 +236,11 @@ namespace vigra
             iccProfilePtr = iccBuf;
         }
 
-        // start the decompression
+        // compute the output size (decompression is started lazily,
+        // so that setLevel() can still change the scaling)
         if (setjmp(err.buf))
-            vigra_fail( "error in jpeg_start_decompress()" );
-        jpeg_start_decompress(&info);
+            vigra_fail( "error in jpeg_calc_output_dimensions()" );
+        jpeg_calc_output_dimensions(&info);
 
         // transfer interesting header information
         width = info.output_width;
@@ -244,6 +249,35 @@ namespace vigra
 
         // alloc memory for a single scanline
         bands.resize( width * components );
+    }
+
+    bool JPEGDecoderImpl::setLevel( unsigned int level )
+    {
+        vigra_precondition( !started,
+            "JPEGDecoder::setLevel(): must be called before the first scanline is read." );
+
+        // libjpeg scales the inverse DCT by 1/2, 1/4 and 1/8, which is
+        // much cheaper than decoding the full image
+        if ( level > 3 )
+            return false;
+        info.scale_num = 1;
+        info.scale_denom = 1 << level;
+        if (setjmp(err.buf))
+            vigra_fail( "error in jpeg_calc_output_dimensions()" );
+        jpeg_calc_output_dimensions(&info);
+
+        width = info.output_width;
+        height = info.output_height;
+        bands.resize( width * components );
+        return true;
+    }
+
+    void JPEGDecoderImpl::start()
+    {
+        if (setjmp(err.buf))
+            vigra_fail( "error in jpeg_start_decompress()" );
+        jpeg_start_decompress(&info);
+        started = true;
 
         // set colorspace
         info.jpeg_color_space = components == 1 ? JCS_GRAYSCALE : JCS_RGB;
@@ -303,6 +337,11 @@ namespace vigra
         return pimpl->components;
     }
 
+    bool JPEGDecoder::setLevel( unsigned int level )
+    {
+        return pimpl->setLevel(level);
+    }
+
     const void * JPEGDecoder::currentScanlineOfBand( unsigned int band ) const
     {
         return pimpl->bands.data() + band;
@@ -310,6 +349,9 @@ namespace vigra
 
     void JPEGDecoder::nextScanline()
     {
+        if ( !pimpl->started )
+            pimpl->start();
+
         // check if there are scanlines left at all, eventually read one
         JSAMPLE * band = pimpl->bands.data();
         if ( pimpl->info.output_scanline < pimpl->info.output_height ) {
@@ -321,6 +363,9 @@ namespace vigra
 
     void JPEGDecoder::close()
     {
+        if ( !pimpl->started )
+            return;
+
         // finish any pending decompression
         if (setjmp(pimpl->err.buf))
             vigra_fail( "error in jpeg_finish_decompress()" );
@@ -72,6 +72,8 @@ namespace vigra {
         std::string getPixelType() const;
         unsigned int getOffset() const;
 
+        bool setLevel( unsigned int );
+
         void init( const std::string & );
         void close();
         void abort();
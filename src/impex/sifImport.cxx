@@ -262,6 +262,16 @@ void readSIF(const SIFImportInfo &info, MultiArrayView<3, float, UnstridedArrayT
     
 }
 
+void mapSIF(const SIFImportInfo &info, MappedMultiArray<3, float> & array)
+{
+    vigra_precondition(sizeof(float) == 4, "SIF files can only be mapped into MultiArrayView<float32>. On your machine a float has more than 4 bytes.");
+
+    // SIF file is little-endian
+    array.map(info.getFileName(), 
+              MultiArrayShape<3>::type(info.width(), info.height(), info.stacksize()), 
+              info.getOffset(), MappedMultiArray<3, float>::LittleEndian);
+}
+
 
 std::ostream& operator<<(std::ostream& os, const SIFImportInfo& info)
 {
@@ -61,11 +61,15 @@
 #endif
 
 #include "vigra/sized_int.hxx"
+#include "vigra/array_vector.hxx"
+#include "vigra/threading.hxx"
 #include "error.hxx"
 #include "tiff.hxx"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 
 extern "C"
 {
@@ -180,6 +184,8 @@ namespace vigra {
 
         TIFFCodecImpl();
         ~TIFFCodecImpl();
+
+        void freeStripBuffer();
     };
 
     TIFFCodecImpl::TIFFCodecImpl()
@@ -198,6 +204,14 @@ namespace vigra {
    }
 
     TIFFCodecImpl::~TIFFCodecImpl()
+    {
+        freeStripBuffer();
+
+        if ( tiff != 0 )
+            TIFFClose(tiff);
+    }
+
+    void TIFFCodecImpl::freeStripBuffer()
     {
         if ( planarconfig == PLANARCONFIG_SEPARATE ) {
             if ( stripbuffer != 0 ) {
@@ -213,29 +227,68 @@ namespace vigra {
                 delete[] stripbuffer;
             }
         }
-
-        if ( tiff != 0 )
-            TIFFClose(tiff);
+        stripbuffer = 0;
     }
 
+    // Files whose strips are larger than this are decoded with the
+    // scanline interface, so that reading them does not hog memory.
+    static const double maxBlockwiseStripSize = 16.0*1024.0*1024.0;
+
     class TIFFDecoderImpl : public TIFFCodecImpl
     {
         friend class TIFFDecoder;
 
+        std::string filename;
+        tdir_t directory;
+
+        // blockwise decoding of whole tiles or strips with
+        // TIFFReadEncodedTile() / TIFFReadEncodedStrip()
+        bool blockwise, tiled;
+        uint32 block_width, block_height;
+
+        // region of interest
+        uint32 region_x, region_y, region_width, region_height;
+
+        // decoded rows [buffer_begin, buffer_end) of the region,
+        // one plane after the other
+        ArrayVector<UInt8> region_buffer, block_buffers;
+        uint32 buffer_begin, buffer_end, current_row;
+        unsigned int buffer_plane_size;
+
+        // additional handles for the decoding threads
+        int thread_count;
+        std::vector<TIFF *> thread_tiffs;
+
         std::string get_pixeltype_by_sampleformat() const;
         std::string get_pixeltype_by_datatype() const;
 
+        unsigned int numPlanes() const;
+        unsigned int bytesPerPixelOfPlane() const;
+        void readBlockRows( uint32 row );
+        void readBlock( TIFF * handle, uint32 x0, uint32 y0, unsigned int plane,
+                        UInt8 * scratch );
+
     public:
 
         TIFFDecoderImpl( const std::string & filename );
+        ~TIFFDecoderImpl();
 
         void init();
+        bool setLevel( unsigned int level );
+        bool setRegion( const Diff2D & upperLeft, const Size2D & size );
+        void setThreadCount( int count );
 
         const void * currentScanlineOfBand( unsigned int band ) const;
         void nextScanline();
     };
 
     TIFFDecoderImpl::TIFFDecoderImpl( const std::string & filename )
+    : filename(filename), directory(0),
+      blockwise(false), tiled(false),
+      block_width(0), block_height(0),
+      region_x(0), region_y(0), region_width(0), region_height(0),
+      buffer_begin(0), buffer_end(0), current_row(0), buffer_plane_size(0),
+      thread_count(1)
     {
         tiff = TIFFOpen( filename.c_str(), "r" );
 
@@ -247,6 +300,12 @@ namespace vigra {
         }
     }
 
+    TIFFDecoderImpl::~TIFFDecoderImpl()
+    {
+        for( unsigned int i = 0; i < thread_tiffs.size(); ++i )
+            TIFFClose(thread_tiffs[i]);
+    }
+
     std::string TIFFDecoderImpl::get_pixeltype_by_sampleformat() const
     {
         uint16 sampleformat;
@@ -322,6 +381,10 @@ namespace vigra {
 
     void TIFFDecoderImpl::init()
     {
+        // forget the settings of a previously read directory
+        freeStripBuffer();
+        planarconfig = PLANARCONFIG_CONTIG;
+
         // read width and height
         TIFFGetField( tiff, TIFFTAG_IMAGEWIDTH, &width );
         TIFFGetField( tiff, TIFFTAG_IMAGELENGTH, &height );
@@ -537,6 +600,36 @@ namespace vigra {
             iccProfile.swap(iccData);
         }
 
+        region_x = region_y = 0;
+        region_width = width;
+        region_height = height;
+
+        // decode whole tiles or strips when the samples are byte-aligned
+        // and libtiff returns them in the layout of the scanline interface
+        tiled = TIFFIsTiled(tiff) != 0;
+        blockwise = bits_per_sample % 8 == 0 &&
+                    ( photometric == PHOTOMETRIC_MINISWHITE ||
+                      photometric == PHOTOMETRIC_MINISBLACK ||
+                      photometric == PHOTOMETRIC_RGB ||
+                      photometric == PHOTOMETRIC_PALETTE );
+        if ( tiled ) {
+            vigra_precondition( blockwise,
+                "TIFFDecoderImpl::init(): tiled images with this sample"
+                " layout are not supported." );
+            TIFFGetField( tiff, TIFFTAG_TILEWIDTH, &block_width );
+            TIFFGetField( tiff, TIFFTAG_TILELENGTH, &block_height );
+        } else {
+            block_width = width;
+            if ( !TIFFGetFieldDefaulted( tiff, TIFFTAG_ROWSPERSTRIP,
+                                         &block_height ) ||
+                 block_height > height )
+                block_height = height;
+            if ( (double)block_height * TIFFScanlineSize(tiff) > maxBlockwiseStripSize )
+                blockwise = false;
+        }
+        if ( blockwise )
+            return;
+
         // allocate data buffers
         // mihal 27-10-2004: use scanline interface instead of strip interface
         //const unsigned int stripsize = TIFFStripSize(tiff);
@@ -563,9 +656,208 @@ namespace vigra {
         stripindex = stripheight;
     }
 
+    bool TIFFDecoderImpl::setLevel( unsigned int level )
+    {
+        vigra_precondition( scanline == 0,
+            "TIFFDecoder::setLevel(): must be called before the first scanline is read." );
+        if ( level == 0 )
+            return true;
+        if ( level >= 32 )
+            return false;
+
+        // look for a directory of the requested size and sample layout,
+        // as stored in pyramidal (e.g. whole-slide) TIFF files
+        const uint32 level_width  = ( ( width - 1 ) >> level ) + 1,
+                     level_height = ( ( height - 1 ) >> level ) + 1;
+        const uint16 base_samples_per_pixel = samples_per_pixel;
+        const std::string base_pixeltype = pixeltype;
+        const tdir_t count = TIFFNumberOfDirectories( tiff );
+        for ( tdir_t dir = directory + 1; dir < count; ++dir ) {
+            uint32 w = 0, h = 0;
+            if ( !TIFFSetDirectory( tiff, dir ) )
+                break;
+            TIFFGetField( tiff, TIFFTAG_IMAGEWIDTH, &w );
+            TIFFGetField( tiff, TIFFTAG_IMAGELENGTH, &h );
+            if ( w != level_width || h != level_height )
+                continue;
+            try {
+                init();
+            } catch ( std::exception & ) {
+                continue;
+            }
+            if ( samples_per_pixel == base_samples_per_pixel &&
+                 pixeltype == base_pixeltype ) {
+                directory = dir;
+                return true;
+            }
+        }
+
+        // not found: go back to the full resolution image
+        TIFFSetDirectory( tiff, directory );
+        init();
+        return false;
+    }
+
+    bool TIFFDecoderImpl::setRegion( const Diff2D & upperLeft, const Size2D & size )
+    {
+        vigra_precondition( scanline == 0,
+            "TIFFDecoder::setRegion(): must be called before the first scanline is read." );
+        vigra_precondition( upperLeft.x >= 0 && upperLeft.y >= 0 &&
+                            size.x > 0 && size.y > 0 &&
+                            (uint32)(upperLeft.x + size.x) <= width &&
+                            (uint32)(upperLeft.y + size.y) <= height,
+            "TIFFDecoder::setRegion(): region must be non-empty and inside the image." );
+
+        // sub-byte samples cannot be addressed at arbitrary columns
+        if ( bits_per_sample % 8 != 0 && upperLeft.x != 0 )
+            return false;
+
+        region_x = upperLeft.x;
+        region_y = upperLeft.y;
+        region_width = size.x;
+        region_height = size.y;
+        return true;
+    }
+
+    void TIFFDecoderImpl::setThreadCount( int count )
+    {
+        thread_count = count;
+    }
+
+    unsigned int TIFFDecoderImpl::numPlanes() const
+    {
+        return planarconfig == PLANARCONFIG_SEPARATE ? samples_per_pixel : 1;
+    }
+
+    unsigned int TIFFDecoderImpl::bytesPerPixelOfPlane() const
+    {
+        return ( bits_per_sample / 8 ) *
+            ( planarconfig == PLANARCONFIG_SEPARATE ? 1 : samples_per_pixel );
+    }
+
+    void TIFFDecoderImpl::readBlock( TIFF * handle, uint32 x0, uint32 y0,
+                                     unsigned int plane, UInt8 * scratch )
+    {
+        const unsigned int pixel_size = bytesPerPixelOfPlane();
+        const unsigned int region_stride = region_width * pixel_size;
+        UInt8 * dest = region_buffer.begin() + plane * buffer_plane_size
+                       + ( y0 - buffer_begin ) * region_stride;
+
+        // full-width strips are decoded straight into the region buffer
+        tsize_t size;
+        if ( tiled )
+            size = TIFFReadEncodedTile( handle,
+                       TIFFComputeTile( handle, x0, y0, 0, plane ),
+                       scratch, (tsize_t)-1 );
+        else
+            size = TIFFReadEncodedStrip( handle,
+                       TIFFComputeStrip( handle, y0, plane ),
+                       scratch != 0 ? scratch : dest, (tsize_t)-1 );
+        if ( size < 0 )
+            vigra_fail( "TIFFDecoderImpl::readBlock(): unable to decode tile or strip." );
+
+        if ( scratch == 0 )
+            return;
+
+        // copy the part of the block that overlaps the region
+        const uint32 rows = std::min( block_height, height - y0 );
+        const uint32 xbegin = std::max( x0, region_x ),
+                     xend   = std::min( x0 + block_width, region_x + region_width );
+        const unsigned int block_stride = block_width * pixel_size;
+        const UInt8 * src = scratch + ( xbegin - x0 ) * pixel_size;
+        dest += ( xbegin - region_x ) * pixel_size;
+        for ( uint32 y = 0; y < rows; ++y, src += block_stride, dest += region_stride )
+            std::memcpy( dest, src, ( xend - xbegin ) * pixel_size );
+    }
+
+    void TIFFDecoderImpl::readBlockRows( uint32 row )
+    {
+        // decode as many rows of blocks as there are threads
+        const int threads = actualThreadCount( thread_count );
+        const uint32 region_end = region_y + region_height;
+        buffer_begin = row - row % block_height;
+        const uint32 block_rows = std::min<uint32>( threads,
+            ( region_end - buffer_begin + block_height - 1 ) / block_height );
+        buffer_end = std::min( buffer_begin + block_rows * block_height, height );
+
+        const unsigned int planes = numPlanes();
+        const unsigned int pixel_size = bytesPerPixelOfPlane();
+        buffer_plane_size = block_rows * block_height * region_width * pixel_size;
+        if ( region_buffer.size() < planes * buffer_plane_size )
+            region_buffer.resize( planes * buffer_plane_size );
+
+        const uint32 first_column = region_x / block_width,
+                     block_columns = ( region_x + region_width - 1 ) / block_width
+                                     - first_column + 1;
+        const int blocks = block_rows * block_columns * planes;
+        const int n = std::min( threads, blocks );
+
+        // blocks that do not fit into the region buffer are decoded
+        // into a scratch buffer per thread first
+        const bool direct = !tiled && region_x == 0 && region_width == width;
+        const unsigned int block_size = direct
+                                          ? 0
+                                          : tiled ? TIFFTileSize(tiff) : TIFFStripSize(tiff);
+        if ( block_buffers.size() < n * block_size )
+            block_buffers.resize( n * block_size );
+
+        // libtiff handles must not be shared between threads
+        while ( (int)thread_tiffs.size() < n - 1 ) {
+            TIFF * handle = TIFFOpen( filename.c_str(), "r" );
+            vigra_precondition( handle != 0,
+                "TIFFDecoderImpl::readBlockRows(): unable to reopen file." );
+            thread_tiffs.push_back( handle );
+            vigra_precondition( TIFFSetDirectory( handle, directory ) != 0,
+                "TIFFDecoderImpl::readBlockRows(): unable to select directory." );
+        }
+
+        ThreadExceptionCollector errors;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(n) if(n > 1)
+#endif
+        for ( int k = 0; k < blocks; ++k )
+        {
+            if ( errors.failed() )
+                continue;
+            try
+            {
+                const int t = threadIndex();
+                const unsigned int plane = k % planes;
+                const uint32 column = first_column + ( k / planes ) % block_columns;
+                const uint32 block_row = k / ( planes * block_columns );
+                readBlock( t == 0 ? tiff : thread_tiffs[t-1],
+                           column * block_width,
+                           buffer_begin + block_row * block_height, plane,
+                           direct ? 0 : block_buffers.begin() + t * block_size );
+            }
+            catch ( std::exception & e )
+            {
+                errors.capture( e );
+            }
+        }
+        errors.rethrow();
+
+        // invert grayscale images that interpret 0 as white
+        if ( samples_per_pixel == 1 && pixeltype == "UINT8" &&
+             photometric == PHOTOMETRIC_MINISWHITE ) {
+            UInt8 * buf = region_buffer.begin();
+            UInt8 * end = buf + ( buffer_end - buffer_begin ) * region_width;
+            for ( ; buf != end; ++buf )
+                *buf = 0xff - *buf;
+        }
+    }
+
     const void *
     TIFFDecoderImpl::currentScanlineOfBand( unsigned int band ) const
     {
+        if ( blockwise ) {
+            const UInt8 * const buf = region_buffer.begin()
+                + ( current_row - buffer_begin ) * region_width * bytesPerPixelOfPlane();
+            if ( planarconfig == PLANARCONFIG_SEPARATE )
+                return buf + band * buffer_plane_size;
+            else
+                return buf + band * ( bits_per_sample / 8 );
+        }
         if ( bits_per_sample == 1 ) {
             UInt8 * const buf
                 = static_cast< UInt8 * >(stripbuffer[0]);
@@ -575,11 +867,11 @@ namespace vigra {
             if ( planarconfig == PLANARCONFIG_SEPARATE ) {
                 UInt8 * const buf
                     = static_cast< UInt8 * >(stripbuffer[band]);
-                return buf + ( stripindex * width ) * ( bits_per_sample / 8 );
+                return buf + ( stripindex * width + region_x ) * ( bits_per_sample / 8 );
             } else {
                 UInt8 * const buf
                     = static_cast< UInt8 * >(stripbuffer[0]);
-                return buf + ( band + stripindex * width * samples_per_pixel )
+                return buf + ( band + ( stripindex * width + region_x ) * samples_per_pixel )
                     * ( bits_per_sample / 8 );
             }
         }
@@ -587,22 +879,29 @@ namespace vigra {
 
     void TIFFDecoderImpl::nextScanline()
     {
+        if ( blockwise ) {
+            current_row = region_y + scanline++;
+            if ( current_row < buffer_begin || current_row >= buffer_end )
+                readBlockRows( current_row );
+            return;
+        }
+
         // eventually read a new strip
         if ( ++stripindex >= stripheight ) {
             stripindex = 0;
 
-            if ( planarconfig == PLANARCONFIG_SEPARATE ) {
-                // mihal 27-10-2004: modified to use scanline interface
-                //const tsize_t size = TIFFStripSize(tiff);
-                const tsize_t size = TIFFScanlineSize(tiff);
-                for( unsigned int i = 0; i < samples_per_pixel; ++i )
-                    // mihal 27-10-2004: use scanline interface
-                    //TIFFReadEncodedStrip( tiff, strip++, stripbuffer[i],
-                    //                      size );
-                    TIFFReadScanline(tiff, stripbuffer[i], scanline++, size);
-            } else {
-                TIFFReadScanline( tiff, stripbuffer[0], scanline++, 0);
+            // compressed strips can only be decoded sequentially,
+            // so the rows above the region are read and discarded
+            const unsigned int planes = numPlanes();
+            if ( scanline == 0 ) {
+                for ( uint32 row = 0; row < region_y; ++row )
+                    for ( unsigned int i = 0; i < planes; ++i )
+                        TIFFReadScanline( tiff, stripbuffer[i], row, i );
             }
+            // mihal 27-10-2004: use scanline interface
+            const uint32 row = region_y + scanline++;
+            for ( unsigned int i = 0; i < planes; ++i )
+                TIFFReadScanline( tiff, stripbuffer[i], row, i );
 
             // XXX handle bilevel images
 
@@ -645,12 +944,12 @@ namespace vigra {
 
     unsigned int TIFFDecoder::getWidth() const
     {
-        return pimpl->width;
+        return pimpl->region_width;
     }
 
     unsigned int TIFFDecoder::getHeight() const
     {
-        return pimpl->height;
+        return pimpl->region_height;
     }
 
     unsigned int TIFFDecoder::getNumBands() const
@@ -694,6 +993,21 @@ namespace vigra {
             1 : pimpl->samples_per_pixel;
     }
 
+    bool TIFFDecoder::setLevel( unsigned int level )
+    {
+        return pimpl->setLevel(level);
+    }
+
+    bool TIFFDecoder::setRegion( const Diff2D & upperLeft, const Size2D & size )
+    {
+        return pimpl->setRegion(upperLeft, size);
+    }
+
+    void TIFFDecoder::setThreadCount( int count )
+    {
+        pimpl->setThreadCount(count);
+    }
+
     const void * TIFFDecoder::currentScanlineOfBand( unsigned int band ) const
     {
         return pimpl->currentScanlineOfBand(band);
@@ -90,6 +90,10 @@ namespace vigra {
         std::string getPixelType() const;
         unsigned int getOffset() const;
 
+        bool setLevel( unsigned int );
+        bool setRegion( const Diff2D &, const Size2D & );
+        void setThreadCount( int );
+
         void init( const std::string & );
         void close();
         void abort();
@@ -0,0 +1,87 @@
+//We need to undefine NDEBUG so that we have TIC, TOC available!
+#undef NDEBUG
+
+#include <iostream>
+#include <vigra/timing.hxx>
+USETICTOC;
+#include <vigra/random_forest.hxx>
+
+using namespace vigra;
+
+template <class RF, class Stop>
+double predictionSpeed(RF const & rf, MultiArray<2, double> const & features,
+                       MultiArray<2, double> & prob, Stop & stop, int repetitions)
+{
+    TIC;
+    for(int k = 0; k < repetitions; ++k)
+        rf.predictProbabilities(features, prob, stop);
+    double msec = TOCN;
+    return repetitions * features.shape(0) / (msec / 1000.0);
+}
+
+int main(int argc, char ** argv)
+{
+    typedef MultiArrayShape<2>::type Shp;
+    MultiArray<2, double> features(Shp(20000, 50), 0.0);
+    MultiArray<2, int>    labels(Shp(20000, 1), 0);
+
+    RandomMT19937 random(1); 
+
+    for(int ii = 0; ii < features.shape(0); ++ii)
+    {
+        for(int jj = 0; jj < features.shape(1); ++jj)
+        {
+            features(ii, jj) = random.uniform53();
+        }
+        labels(ii, 0) = features(ii, 0) + 0.2*random.normal() > 0.5; 
+    }
+    
+    RandomForest<int> rf(RandomForestOptions().tree_count(100));
+    rf.learn(features, labels, rf_default(), rf_default(), rf_default(), random);
+
+    MultiArray<2, double> prob_rowwise(Shp(features.shape(0), rf.class_count())),
+                          prob_blockwise(prob_rowwise.shape()),
+                          prob_parallel(prob_rowwise.shape()),
+                          prob_compiled(prob_rowwise.shape());
+    int repetitions = 3;
+
+    // StopBase never stops, but is not recognized as a trivial stopping 
+    // criterion and therefore enforces row-by-row prediction 
+    StopBase rowwise;
+    EarlyStoppStd blockwise(rf.options());
+
+    rf.set_options().thread_count(0);
+    std::cerr << "Row-by-row prediction:      " 
+              << predictionSpeed(rf, features, prob_rowwise, rowwise, repetitions)
+              << " samples/s" << std::endl;
+    std::cerr << "Blockwise prediction:       " 
+              << predictionSpeed(rf, features, prob_blockwise, blockwise, repetitions)
+              << " samples/s" << std::endl;
+    rf.set_options().thread_count(-1);
+    std::cerr << "Blockwise parallel (" << defaultThreadCount() << " threads): " 
+              << predictionSpeed(rf, features, prob_parallel, blockwise, repetitions)
+              << " samples/s" << std::endl;
+
+
+    CompiledRandomForest<int, double> compiled(rf);
+    compiled.thread_count(-1);
+    TIC;
+    for(int k = 0; k < repetitions; ++k)
+        compiled.predictProbabilities(features, prob_compiled);
+    double msec = TOCN;
+    std::cerr << "Compiled forest (" << defaultThreadCount() << " threads):   " 
+              << repetitions * features.shape(0) / (msec / 1000.0)
+              << " samples/s" << std::endl;
+
+    if(prob_rowwise != prob_blockwise || prob_rowwise != prob_parallel)
+    {
+        std::cerr << "Error: blockwise prediction differs from row-by-row prediction." << std::endl;
+        return 1;
+    }
+    if(prob_rowwise != prob_compiled)
+    {
+        std::cerr << "Error: compiled forest prediction differs from row-by-row prediction." << std::endl;
+        return 1;
+    }
+    return 0;
+}
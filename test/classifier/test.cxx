@@ -49,6 +49,7 @@
 #include <unittest.hxx>
 #include <vector>
 #include <limits>
+#include <set>
 //#include "data/RF_results.hxx"
 #include "data/RF_data.hxx"
 #include "test_visitors.hxx"
@@ -713,6 +714,316 @@ struct ClassifierTest
         std::cerr << "DONE!\n\n";
 	}
 
+/**
+        ClassifierTest::RFparallelTest():
+    Learns the Random Forest with a single and with several threads. Since every 
+    tree uses its own random number generator, the resulting forests must be 
+    identical. The visitor statistics must agree after the thread copies 
+    have been merged.
+**/
+    void RFparallelTest()
+    {
+        std::cerr << "RFparallelTest(): Learning on Datasets\n";
+        for(int ii = 0; ii < data.size() ; ii++)
+        {
+            rf::visitors::OOB_PerTreeError      oob_v1, oob_v4;
+            rf::visitors::OOB_Error             breiman_v1, breiman_v4;
+            rf::visitors::VariableImportanceVisitor var_imp1(1), var_imp4(1);
+
+            vigra::RandomForest<> RF1(vigra::RandomForestOptions()
+                                          .tree_count(32).thread_count(1));
+            vigra::RandomForest<> RF4(vigra::RandomForestOptions()
+                                          .tree_count(32).thread_count(4));
+            RF1.learn(  data.features(ii),
+                        data.labels(ii),
+                        create_visitor(oob_v1, breiman_v1, var_imp1),
+                        rf_default(),
+                        rf_default(),
+                        vigra::RandomMT19937(1));
+            RF4.learn(  data.features(ii),
+                        data.labels(ii),
+                        create_visitor(oob_v4, breiman_v4, var_imp4),
+                        rf_default(),
+                        rf_default(),
+                        vigra::RandomMT19937(1));
+
+            shouldEqual(RF1.tree_count(), RF4.tree_count());
+            for(int k = 0; k < RF1.tree_count(); ++k)
+            {
+                shouldEqual(RF1.tree(k).topology_, RF4.tree(k).topology_);
+                shouldEqual(RF1.tree(k).parameters_, RF4.tree(k).parameters_);
+            }
+            shouldEqual(oob_v1.oobError, oob_v4.oobError);
+            shouldEqual(breiman_v1.oobCount, breiman_v4.oobCount);
+            shouldEqualTolerance(breiman_v1.oob_breiman, breiman_v4.oob_breiman, 1e-10);
+            shouldEqual(var_imp1.variable_importance_.shape(), 
+                        var_imp4.variable_importance_.shape());
+            for(int k = 0; k < var_imp1.variable_importance_.size(); ++k)
+                shouldEqualTolerance(var_imp1.variable_importance_[k], 
+                                     var_imp4.variable_importance_[k], 1e-10);
+        }
+
+        {
+            // OOB_Error uses at most 40000 OOB samples per class, drawn
+            // at random, when the OOB set is much larger than the bootstrap sample
+            typedef MultiArrayShape<2>::type Shp;
+            int rows = 100000;
+            MultiArray<2, double> features(Shp(rows, 2));
+            MultiArray<2, int>    labels(Shp(rows, 1));
+            vigra::RandomMT19937  random(3);
+            for(int k = 0; k < rows; ++k)
+            {
+                features(k, 0) = random.uniform();
+                features(k, 1) = random.uniform();
+                labels(k, 0) = features(k, 0) + 0.2*features(k, 1) > 0.6 ? 1 : 0;
+            }
+
+            rf::visitors::OOB_Error breiman_v1, breiman_v4;
+            vigra::RandomForest<> RF1(vigra::RandomForestOptions()
+                                          .tree_count(4).samples_per_tree(500).thread_count(1));
+            vigra::RandomForest<> RF4(vigra::RandomForestOptions()
+                                          .tree_count(4).samples_per_tree(500).thread_count(4));
+            RF1.learn(features, labels, create_visitor(breiman_v1),
+                      rf_default(), rf_default(), vigra::RandomMT19937(1));
+            RF4.learn(features, labels, create_visitor(breiman_v4),
+                      rf_default(), rf_default(), vigra::RandomMT19937(1));
+
+            shouldEqual(breiman_v1.oobCount, breiman_v4.oobCount);
+            shouldEqualTolerance(breiman_v1.oob_breiman, breiman_v4.oob_breiman, 1e-10);
+        }
+
+        try
+        {
+            double features[] = {0, 0, 1, 1,
+                                 0, 1, 0, 1};
+            int    labels[] = {1, 0, 0, 1};
+            vigra::RandomForest<> RF(vigra::RandomForestOptions()
+                                         .prepare_online_learning(true).thread_count(2));
+            RF.learn(MultiArrayView<2, double>(MultiArrayShape<2>::type(4,2), features),
+                     MultiArrayView<2, int>(MultiArrayShape<2>::type(4,1), labels));
+            failTest("RandomForest::learn() failed to throw exception.");
+        }
+        catch(vigra::PreconditionViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nRandomForest::learn(): online learning cannot be combined");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+        std::cerr << "DONE!\n\n";
+    }
+
+/**
+        ClassifierTest::RFcompiledTest():
+    Compiles the learned forests into CompiledRandomForest and checks that 
+    the predicted probabilities are bit-identical, both for double features 
+    (with double thresholds) and float features (with float thresholds).
+**/
+    void RFcompiledTest()
+    {
+        std::cerr << "RFcompiledTest(): Learning on Datasets\n";
+        for(int ii = 0; ii < data.size() ; ii++)
+        {
+            typedef MultiArrayShape<2>::type Shp;
+            Shp prob_shape(data.features(ii).shape(0), data.ClassIter(ii).size());
+            {
+                vigra::RandomForest<> RF(vigra::RandomForestOptions().tree_count(32));
+                RF.learn(data.features(ii), data.labels(ii),
+                         rf_default(), rf_default(), rf_default(),
+                         vigra::RandomMT19937(1));
+
+                vigra::CompiledRandomForest<double, double> CRF(RF);
+                shouldEqual(CRF.tree_count(), RF.tree_count());
+                
+                MultiArray<2, double> prob(prob_shape), cprob(prob_shape);
+                RF.predictProbabilities(data.features(ii), prob);
+                CRF.predictProbabilities(data.features(ii), cprob);
+                should(prob == cprob);
+
+                CRF.thread_count(4);
+                cprob.init(0.0);
+                CRF.predictProbabilities(data.features(ii), cprob);
+                should(prob == cprob);
+
+                MultiArray<2, double> labels(Shp(prob_shape[0], 1)), clabels(labels.shape());
+                RF.predictLabels(data.features(ii), labels);
+                CRF.predictLabels(data.features(ii), clabels);
+                should(labels == clabels);
+            }
+            {
+                MultiArray<2, float> features(data.features(ii));
+                vigra::RandomForest<> RF(vigra::RandomForestOptions()
+                                            .tree_count(32).predict_weighted());
+                RF.learn(features, data.labels(ii),
+                         rf_default(), rf_default(), rf_default(),
+                         vigra::RandomMT19937(1));
+
+                vigra::CompiledRandomForest<> CRF(RF);
+                MultiArray<2, double> prob(prob_shape), cprob(prob_shape);
+                RF.predictProbabilities(features, prob);
+                CRF.predictProbabilities(features, cprob);
+                should(prob == cprob);
+            }
+        }
+        std::cerr << "DONE!\n\n";
+    }
+
+/**
+        ClassifierTest::RFpresortTest():
+    Learns forests with and without presorted feature columns and checks
+    that the trees are identical.
+**/
+    void RFpresortTest()
+    {
+        std::cerr << "RFpresortTest(): Learning on Datasets\n";
+        for(int ii = 0; ii < data.size() ; ii++)
+        {
+            vigra::RandomForest<> RF(vigra::RandomForestOptions().tree_count(16));
+            vigra::RandomForest<> RFsorted(vigra::RandomForestOptions()
+                                             .tree_count(16).presort_features(true));
+            vigra::RandomForest<> RFparallel(vigra::RandomForestOptions()
+                                             .tree_count(16).presort_features(true)
+                                             .thread_count(4));
+            RF.learn(data.features(ii), data.labels(ii),
+                     rf_default(), rf_default(), rf_default(),
+                     vigra::RandomMT19937(1));
+            RFsorted.learn(data.features(ii), data.labels(ii),
+                           rf_default(), rf_default(), rf_default(),
+                           vigra::RandomMT19937(1));
+            RFparallel.learn(data.features(ii), data.labels(ii),
+                             rf_default(), rf_default(), rf_default(),
+                             vigra::RandomMT19937(1));
+            for(int k = 0; k < RF.tree_count(); ++k)
+            {
+                shouldEqual(RF.tree(k).topology_, RFsorted.tree(k).topology_);
+                shouldEqual(RF.tree(k).parameters_, RFsorted.tree(k).parameters_);
+            }
+
+            // the parallel forest uses different random numbers, compare
+            // with a forest learned in parallel without presorting
+            vigra::RandomForest<> RFparallel2(vigra::RandomForestOptions()
+                                             .tree_count(16).thread_count(1));
+            RFparallel2.learn(data.features(ii), data.labels(ii),
+                              rf_default(), rf_default(), rf_default(),
+                              vigra::RandomMT19937(1));
+            for(int k = 0; k < RF.tree_count(); ++k)
+            {
+                shouldEqual(RFparallel.tree(k).topology_, RFparallel2.tree(k).topology_);
+                shouldEqual(RFparallel.tree(k).parameters_, RFparallel2.tree(k).parameters_);
+            }
+        }
+
+        // duplicate indices (from sampling with replacement) are preserved
+        double column[] = {3.0, 1.0, 2.0, 1.0, 0.5, 4.0};
+        MultiArrayView<2, double> features(MultiArrayShape<2>::type(6, 1), column);
+        PresortedFeatures presorted(features);
+        int order[] = {4, 1, 3, 2, 0, 5};
+        shouldEqualSequence(presorted.order_.begin(), presorted.order_.end(), order);
+
+        ArrayVector<Int32> count(6, 0);
+        Int32 indices[] = {5, 1, 2, 5, 0, 2, 4};
+        Int32 sorted[]  = {4, 1, 2, 2, 0, 5, 5};
+        presorted.sortRange(0, indices, indices+7, count);
+        shouldEqualSequence(indices, indices+7, sorted);
+        should(std::count(count.begin(), count.begin()+6, 0) == 6);
+        std::cerr << "DONE!\n\n";
+    }
+
+/**
+        ClassifierTest::RFhistogramTest():
+    Learns forests with HistogramSplit on quantized features. If the 
+    quantization is lossless, the trees must have the same structure and
+    predictions as those learned with GiniSplit.
+**/
+    void RFhistogramTest()
+    {
+        typedef MultiArrayShape<2>::type Shp;
+        {
+            double column[] = {0.5, 0.5, 1.0, 3.0};
+            MultiArrayView<2, double> features(Shp(4, 1), column);
+            FeatureQuantizer quantizer(features);
+            shouldEqual(quantizer.binCount(0), 3);
+            shouldEqual(quantizer.edges_[0][0], 0.75);
+            shouldEqual(quantizer.edges_[0][1], 2.0);
+            MultiArray<2, UInt8> bins(features.shape());
+            quantizer.quantize(features, bins);
+            UInt8 desired[] = {0, 0, 1, 2};
+            shouldEqualSequence(bins.begin(), bins.end(), desired);
+            shouldEqual(quantizer.bin(0, 10.0), 2);
+            shouldEqual(quantizer.bin(0, -1.0), 0);
+
+            MultiArray<2, double> ramp(Shp(100, 1));
+            linearSequence(ramp.begin(), ramp.end());
+            quantizer.init(ramp, 4);
+            shouldEqual(quantizer.binCount(0), 4);
+            shouldEqual(quantizer.edges_[0][0], 24.5);
+        }
+
+        std::cerr << "RFhistogramTest(): Learning on Datasets\n";
+        for(int ii = 0; ii < data.size() ; ii++)
+        {
+            FeatureQuantizer quantizer(data.features(ii));
+            MultiArray<2, UInt8> bins(data.features(ii).shape());
+            quantizer.quantize(data.features(ii), bins);
+
+            bool lossless = true;
+            for(int c = 0; c < columnCount(data.features(ii)); ++c)
+            {
+                std::set<double> values(columnVector(data.features(ii), c).begin(),
+                                        columnVector(data.features(ii), c).end());
+                lossless = lossless && (int)values.size() == quantizer.binCount(c);
+            }
+
+            Shp prob_shape(data.features(ii).shape(0), data.ClassIter(ii).size());
+            for(int all = 0; all < 2; ++all)
+            {
+                vigra::RandomForestOptions options;
+                options.tree_count(16);
+                if(all)
+                    options.features_per_node(RF_ALL);
+                vigra::RandomForest<> RF(options), RFhist(options);
+                RF.learn(data.features(ii), data.labels(ii),
+                         rf_default(), rf_default(), rf_default(),
+                         vigra::RandomMT19937(1));
+                RFhist.learn(bins, data.labels(ii),
+                             rf_default(), GiniHistogramSplit(), rf_default(),
+                             vigra::RandomMT19937(1));
+
+                if(lossless)
+                {
+                    // the thresholds differ (bin boundaries vs. midpoints 
+                    // between the values in the node), everything else is the same
+                    for(int k = 0; k < RF.tree_count(); ++k)
+                    {
+                        detail::DecisionTree tree(RF.tree(k)), 
+                                             & htree = RFhist.tree(k);
+                        shouldEqual(tree.topology_, htree.topology_);
+                        std::vector<int> stack(1, 2);
+                        while(!stack.empty())
+                        {
+                            int n = stack.back();
+                            stack.pop_back();
+                            if(tree.topology_[n] != i_ThresholdNode)
+                                continue;
+                            Node<i_ThresholdNode> node(tree.topology_, tree.parameters_, n);
+                            node.threshold() = 
+                                Node<i_ThresholdNode>(htree.topology_, htree.parameters_, n).threshold();
+                            stack.push_back(node.child(0));
+                            stack.push_back(node.child(1));
+                        }
+                        shouldEqual(tree.parameters_, htree.parameters_);
+                    }
+                }
+
+                MultiArray<2, double> hprob(prob_shape), dprob(prob_shape);
+                RFhist.predictProbabilities(bins, hprob);
+                quantizer.dequantize(RFhist);
+                RFhist.predictProbabilities(data.features(ii), dprob);
+                should(hprob == dprob);
+            }
+        }
+        std::cerr << "DONE!\n\n";
+    }
+
     void RFwrongLabelTest()
     {
         double rawfeatures [] = 
@@ -780,6 +1091,51 @@ struct ClassifierTest
             }
             std::cerr << "done!\n";
     }
+
+    /** checks the compact hdf5 format
+     */
+    void HDF5CompactImpexTest()
+    {
+        for(int ii = 0; ii <data.size() ; ii++)
+        {
+            std::string filename = data.names(ii) + "_rf_compact.hdf5",
+                        filename_single = data.names(ii) + "_rf_compact_single.hdf5";
+            std::remove(filename.c_str());
+            std::remove(filename_single.c_str());
+            vigra::RandomForest<> RF(vigra::RandomForestOptions()
+                                         .tree_count(100));
+            RF.learn(data.features(ii), data.labels(ii));
+            rf_export_HDF5_compact(RF, filename);
+            rf_export_HDF5_compact(RF, filename_single, "single", true, 6);
+
+            vigra::RandomForest<> RF2;
+            rf_import_HDF5(RF2, filename, "", 4);
+            should(RF.ext_param_== RF2.ext_param_);
+            should(RF.options_ ==  RF2.options_);
+            shouldEqual(RF.trees_.size(), RF2.trees_.size());
+            for(int jj = 0; jj < int(RF.trees_.size()); ++jj)
+            {
+                should(RF.trees_[jj].topology_ == 
+                       RF2.trees_[jj].topology_);
+                should(RF.trees_[jj].parameters_ ==
+                       RF2.trees_[jj].parameters_);
+            }
+
+            vigra::RandomForest<> RF3;
+            rf_import_HDF5(RF3, filename_single, "single");
+            shouldEqual(RF.trees_.size(), RF3.trees_.size());
+            for(int jj = 0; jj < int(RF.trees_.size()); ++jj)
+            {
+                should(RF.trees_[jj].topology_ == 
+                       RF3.trees_[jj].topology_);
+                shouldEqual(RF.trees_[jj].parameters_.size(),
+                            RF3.trees_[jj].parameters_.size());
+                for(int kk = 0; kk < int(RF.trees_[jj].parameters_.size()); ++kk)
+                    shouldEqual(RF3.trees_[jj].parameters_[kk], 
+                                (double)(float)RF.trees_[jj].parameters_[kk]);
+            }
+        }
+    }
 #endif
 //};
 
@@ -919,6 +1275,10 @@ struct ClassifierTestSuite
     : vigra::test_suite("ClassifierTestSuite")
     {
         add( testCase( &ClassifierTest::RFdefaultTest));
+        add( testCase( &ClassifierTest::RFparallelTest));
+        add( testCase( &ClassifierTest::RFcompiledTest));
+        add( testCase( &ClassifierTest::RFpresortTest));
+        add( testCase( &ClassifierTest::RFhistogramTest));
 		add( testCase( &ClassifierTest::RFRegressionTest));
 		add( testCase( &ClassifierTest::MultidimensionalRFRegressionTest));
 #ifndef FAST
@@ -938,6 +1298,7 @@ struct ClassifierTestSuite
         add( testCase( &ClassifierTest::RFSplitFunctorTest));
 #ifdef HasHDF5
 		add( testCase( &ClassifierTest::HDF5ImpexTest));
+		add( testCase( &ClassifierTest::HDF5CompactImpexTest));
 #endif
 		 
     }
@@ -41,6 +41,7 @@
 #include "unittest.hxx"
 #include "vigra/hdf5impex.hxx"
 #include "vigra/multi_array.hxx"
+#include "vigra/multi_blockwise.hxx"
 
 using namespace vigra;
 
@@ -835,6 +836,307 @@ public:
 
 
 
+    void testHDF5BlockwiseFilter()
+    {
+        typedef MultiArrayShape<3>::type Shape3;
+        typedef MultiArrayShape<4>::type Shape4;
+
+        MultiArray<3, float> data(Shape3(30, 25, 20));
+        for(int k = 0; k < data.size(); ++k)
+            data[k] = (float)((k * 7919) % 256);
+
+        std::string file_name("testfile_HDF5File_blockwise.hdf5");
+        HDF5File file(file_name, HDF5File::New);
+        file.write("/raw", data);
+
+        HDF5BlockSource<3, float> source(file, "/raw");
+        shouldEqual(source.shape(), data.shape());
+
+        // scalar result
+        MultiArray<3, float> smooth(data.shape()), smoothBlockwise(data.shape());
+        gaussianSmoothMultiArray(srcMultiArrayRange(data), destMultiArray(smooth), 1.5);
+
+        file.createDataset<3, float>("/smooth", data.shape(), 0.0f, Shape3(8, 8, 8));
+        HDF5BlockSink<3, float> smoothSink(file, "/smooth");
+        blockwiseFilterMultiArray(source, smoothSink, GaussianSmoothBlockFilter(1.5), Shape3(12, 10, 7));
+        file.read("/smooth", smoothBlockwise);
+        should(smoothBlockwise == smooth);
+
+        // vector valued result in a dataset with a band dimension
+        typedef TinyVector<float, 3> Vector;
+        MultiArray<3, Vector> grad(data.shape()), gradBlockwise(data.shape());
+        gaussianGradientMultiArray(srcMultiArrayRange(data), destMultiArray(grad), 1.0);
+
+        file.createDataset<4, float>("/gradient", Shape4(3, 30, 25, 20), 0.0f);
+        HDF5BlockSink<3, Vector> gradSink(file, "/gradient");
+        blockwiseFilterMultiArray(source, gradSink, GaussianGradientBlockFilter(1.0), Shape3(16, 16, 16));
+        file.read("/gradient", gradBlockwise);
+        should(gradBlockwise == grad);
+
+        HDF5BlockSource<3, Vector> gradSource(file, "/gradient");
+        shouldEqual(gradSource.shape(), data.shape());
+        MultiArray<3, Vector> gradBlock(Shape3(4, 5, 6));
+        gradSource.readBlock(Shape3(3, 2, 1), gradBlock);
+        should(gradBlock == grad.subarray(Shape3(3, 2, 1), Shape3(7, 7, 7)));
+    }
+
+    void testHDF5ChunkCache()
+    {
+        typedef MultiArrayShape<3>::type Shape3;
+
+        MultiArray<3, float> data(Shape3(30, 25, 20));
+        for(int k = 0; k < data.size(); ++k)
+            data[k] = (float)((k * 7919) % 256);
+
+        std::string file_name("testfile_HDF5File_chunkcache.hdf5");
+        HDF5File file(file_name, HDF5File::New);
+        file.write("/raw", data, Shape3(8, 8, 4), 5);
+        
+        shouldEqual(file.chunkCacheSize(), 0u);
+        file.setChunkCacheSize(1 << 20);
+        shouldEqual(file.chunkCacheSize(), (std::size_t)(1 << 20));
+
+        // block covers 2x2x2 chunks
+        MultiArray<3, float> block(Shape3(10, 5, 6));
+        file.readBlock("/raw", Shape3(3, 4, 1), block.shape(), block);
+        should(block == data.subarray(Shape3(3, 4, 1), Shape3(13, 9, 7)));
+        shouldEqual(file.chunkCacheMisses(), 8u);
+        shouldEqual(file.chunkCacheHits(), 0u);
+
+        // overlapping block: 1x2x2 new chunks
+        file.readBlock("/raw", Shape3(12, 7, 2), block.shape(), block);
+        should(block == data.subarray(Shape3(12, 7, 2), Shape3(22, 12, 8)));
+        shouldEqual(file.chunkCacheMisses(), 12u);
+        shouldEqual(file.chunkCacheHits(), 4u);
+
+        // chunks at the dataset border are smaller than the nominal chunk shape
+        MultiArray<3, float> border(Shape3(7, 6, 3));
+        file.readBlock("/raw", Shape3(23, 19, 17), border.shape(), border);
+        should(border == data.subarray(Shape3(23, 19, 17), Shape3(30, 25, 20)));
+
+        // writing discards the affected chunks
+        MultiArray<3, float> patch(Shape3(4, 4, 4), 1000.0f);
+        file.writeBlock("/raw", Shape3(5, 5, 2), patch);
+        data.subarray(Shape3(5, 5, 2), Shape3(9, 9, 6)).init(1000.0f);
+        file.readBlock("/raw", Shape3(3, 4, 1), block.shape(), block);
+        should(block == data.subarray(Shape3(3, 4, 1), Shape3(13, 9, 7)));
+
+        // a tiny cache keeps at most one chunk but still returns correct data
+        file.setChunkCacheSize(8*8*4*sizeof(float));
+        file.readBlock("/raw", Shape3(12, 7, 2), block.shape(), block);
+        should(block == data.subarray(Shape3(12, 7, 2), Shape3(22, 12, 8)));
+
+        // read-ahead along z: after the first slab, all chunks are already in the cache
+        file.setChunkCacheSize(1 << 20);
+        file.clearChunkCache();
+        file.resetChunkCacheStatistics();
+        file.setReadAhead("/raw", 2, 1);
+        MultiArray<3, float> slab(Shape3(30, 25, 4));
+        for(int z = 0; z < 20; z += 4)
+        {
+            file.readBlock("/raw", Shape3(0, 0, z), slab.shape(), slab);
+            should(slab == data.subarray(Shape3(0, 0, z), Shape3(30, 25, z+4)));
+        }
+        shouldEqual(file.chunkCacheMisses(), 16u);
+        shouldEqual(file.chunkCachePrefetches(), 64u);
+        shouldEqual(file.chunkCacheHits(), 64u);
+
+        // overwriting the dataset invalidates the cache
+        data += 1.0f;
+        file.write("/raw", data, Shape3(8, 8, 4), 5);
+        file.readBlock("/raw", Shape3(0, 0, 4), slab.shape(), slab);
+        should(slab == data.subarray(Shape3(0, 0, 4), Shape3(30, 25, 8)));
+    }
+
+    void testHDF5ParallelCompression()
+    {
+        typedef MultiArrayShape<3>::type Shape3;
+        typedef MultiArrayShape<2>::type Shape2;
+
+        // the shape is not divisible by the chunk shape
+        MultiArray<3, int> data(Shape3(37, 21, 10));
+        for(int k = 0; k < data.size(); ++k)
+            data[k] = (k * 7919) % 1000;
+        MultiArray<2, TinyVector<double, 3> > rgb(Shape2(50, 33));
+        for(int k = 0; k < rgb.size(); ++k)
+            rgb[k] = TinyVector<double, 3>(k, 0.5*k, -k);
+
+        std::string file_name("testfile_HDF5File_parallel_compression.hdf5");
+        {
+            HDF5File file(file_name, HDF5File::New);
+            shouldEqual(file.threadCount(), 1);
+            file.setThreadCount(4);
+            shouldEqual(file.threadCount(), 4);
+            file.write("/data", data, Shape3(8, 8, 4), 6);
+            file.write("/rgb", rgb, Shape2(16, 16), 6);
+            file.write("/uncompressed", data, Shape3(8, 8, 4));
+        }
+
+        HDF5File file(file_name, HDF5File::Open);
+        for(int threads = 1; threads <= 4; threads += 3)
+        {
+            file.setThreadCount(threads);
+
+            MultiArray<3, int> in(data.shape());
+            file.read("/data", in);
+            should(in == data);
+
+            MultiArray<2, TinyVector<double, 3> > rgbIn(rgb.shape());
+            file.read("/rgb", rgbIn);
+            should(rgbIn == rgb);
+
+            MultiArray<3, int> un(data.shape());
+            file.read("/uncompressed", un);
+            should(un == data);
+
+            // reading with type conversion
+            MultiArray<3, double> converted(data.shape());
+            file.read("/data", converted);
+            should(converted == data);
+        }
+
+        // partially written datasets
+        MultiArray<3, int> block(Shape3(8, 8, 4), 42), in(data.shape());
+        file.createDataset<3, int>("/sparse", data.shape(), 5, Shape3(8, 8, 4), 6);
+        file.writeBlock("/sparse", Shape3(8, 0, 4), block);
+        file.setThreadCount(4);
+        file.read("/sparse", in);
+        should(in.subarray(Shape3(8, 0, 4), Shape3(16, 8, 8)) == block);
+        shouldEqual(in(0,0,0), 5);
+        shouldEqual(in(36,20,9), 5);
+
+#ifdef VIGRA_HDF5_DIRECT_CHUNK_IO
+        // the parallel code paths transfer every chunk directly, the serial ones don't
+        std::size_t writes = file.directChunkWrites(), reads = file.directChunkReads();
+        file.write("/direct", data, Shape3(8, 8, 4), 6);
+        shouldEqual(file.directChunkWrites() - writes, 45u);
+        shouldEqual(countStoredChunks(file, "/direct", data.shape(), Shape3(8, 8, 4)), 45);
+        in.init(0);
+        file.read("/direct", in);
+        should(in == data);
+        shouldEqual(file.directChunkReads() - reads, 45u);
+
+        file.setThreadCount(1);
+        file.write("/serial", data, Shape3(8, 8, 4), 6);
+        in.init(0);
+        file.read("/serial", in);
+        should(in == data);
+        shouldEqual(file.directChunkWrites() - writes, 45u);
+        shouldEqual(file.directChunkReads() - reads, 45u);
+#endif
+    }
+
+#ifdef VIGRA_HDF5_DIRECT_CHUNK_IO
+    static int countStoredChunks(HDF5File & file, std::string name, 
+                                 MultiArrayShape<3>::type shape, MultiArrayShape<3>::type chunkShape)
+    {
+        HDF5Handle dataset(file.getDatasetHandle(name), &H5Dclose, "countStoredChunks(): unable to open dataset.");
+        int count = 0;
+        for(int z = 0; z < shape[2]; z += chunkShape[2])
+            for(int y = 0; y < shape[1]; y += chunkShape[1])
+                for(int x = 0; x < shape[0]; x += chunkShape[0])
+                {
+                    hsize_t offset[3] = { (hsize_t)z, (hsize_t)y, (hsize_t)x }, size = 0;
+                    if(H5Dget_chunk_storage_size(dataset, offset, &size) >= 0 && size > 0)
+                        ++count;
+                }
+        return count;
+    }
+#endif
+
+    void testHDF5Array()
+    {
+        typedef MultiArrayShape<3>::type Shape3;
+        typedef MultiArrayShape<2>::type Shape2;
+
+        MultiArray<3, float> data(Shape3(30, 25, 20));
+        for(int k = 0; k < data.size(); ++k)
+            data[k] = (float)((k * 7919) % 256);
+
+        std::string file_name("testfile_HDF5Array.hdf5");
+        HDF5File file(file_name, HDF5File::New);
+        file.write("/raw", data, Shape3(8, 8, 4), 5);
+        file.write("/contiguous", data);
+        MultiArray<3, float> original(data);
+
+        {
+            // the cache holds at most 4 chunks
+            HDF5Array<3, float> array(file, "/raw", 4*8*8*4*sizeof(float));
+            shouldEqual(array.shape(), data.shape());
+            shouldEqual(array.chunkShape(), Shape3(8, 8, 4));
+            shouldEqual(array.getItem(Shape3(29, 24, 19)), data(29, 24, 19));
+            shouldEqual(array.getItem(Shape3(3, 4, 5)), data(3, 4, 5));
+            shouldEqual(array.chunksRead(), 2u);
+
+            // block spanning 2x2x2 chunks with eviction
+            MultiArray<3, float> block(Shape3(10, 5, 6));
+            array.readBlock(Shape3(3, 4, 1), block);
+            should(block == data.subarray(Shape3(3, 4, 1), Shape3(13, 9, 7)));
+            shouldEqual(array.cachedChunks(), 4u);
+
+            // modifications are visible immediately and written back on eviction
+            array.setItem(Shape3(3, 4, 5), -1.0f);
+            data(3, 4, 5) = -1.0f;
+            shouldEqual(array.getItem(Shape3(3, 4, 5)), -1.0f);
+            MultiArray<3, float> patch(Shape3(12, 9, 5), 1000.0f);
+            array.writeBlock(Shape3(15, 15, 12), patch);
+            data.subarray(Shape3(15, 15, 12), Shape3(27, 24, 17)).init(1000.0f);
+            array.readBlock(Shape3(3, 4, 1), block);
+            should(block == data.subarray(Shape3(3, 4, 1), Shape3(13, 9, 7)));
+
+            // the chunk at (16, 16, 12) is entirely overwritten and need not be read
+            std::size_t reads = array.chunksRead();
+            array.writeBlock(Shape3(16, 16, 12), patch.subarray(Shape3(), Shape3(8, 8, 4)));
+            shouldEqual(array.chunksRead(), reads);
+
+            // views
+            HDF5ArrayView<2, float, 3> slice = array.bind<2>(13);
+            shouldEqual(slice.shape(), Shape2(30, 25));
+            MultiArray<2, float> s(slice.shape());
+            slice.readBlock(Shape2(), s);
+            should(s == data.bind<2>(13));
+
+            HDF5ArrayView<1, float, 3> line = array.subarray(Shape3(2, 3, 4), Shape3(28, 20, 18)).bind<0>(5).bind<0>(7);
+            shouldEqual(line.shape(), MultiArrayShape<1>::type(14));
+            for(int k=0; k<14; ++k)
+                shouldEqual(line.getItem(MultiArrayShape<1>::type(k)), data(7, 10, 4+k));
+            line.setItem(MultiArrayShape<1>::type(3), 5.0f);
+            data(7, 10, 7) = 5.0f;
+
+            MultiArray<2, float> plane(Shape2(4, 5), 7.0f);
+            array.bind<1>(2).writeBlock(Shape2(1, 2), plane);
+            data.bind<1>(2).subarray(Shape2(1, 2), Shape2(5, 7)).init(7.0f);
+            
+            array.flush();
+            MultiArray<3, float> in(data.shape());
+            file.read("/raw", in);
+            should(in == data);
+        }
+
+        {
+            // contiguous datasets are split into blocks
+            HDF5Array<3, float> array(file, "/contiguous", 1 << 20, Shape3(16, 16, 16));
+            shouldEqual(array.chunkShape(), Shape3(16, 16, 16));
+            
+            // point operators and filters run blockwise over the lazy array
+            using namespace vigra::functor;
+            transformMultiArrayBlockwise(array, array, Arg1()*Param(2.0f), Shape3(16, 16, 16));
+            
+            file.createDataset<3, float>("/smoothed", data.shape(), 0.0f, Shape3(8, 8, 8));
+            HDF5Array<3, float> smoothed(file, "/smoothed");
+            blockwiseFilterMultiArray(array, smoothed, GaussianSmoothBlockFilter(1.0), Shape3(16, 16, 8));
+        }
+        MultiArray<3, float> in(data.shape()), doubled(data.shape()), reference(data.shape());
+        file.read("/contiguous", in);
+        doubled = original;
+        doubled *= 2.0f;
+        should(in == doubled);
+
+        gaussianSmoothMultiArray(srcMultiArrayRange(doubled), destMultiArray(reference), 1.0);
+        file.read("/smoothed", in);
+        shouldEqualSequenceTolerance(in.begin(), in.end(), reference.begin(), 1e-5);
+    }
+
     void testHDF5FileChunks()
     {
         //write some data and read it again. Only spot test general functionality.
@@ -1206,6 +1508,10 @@ struct HDF5ImportExportTestSuite : public vigra::test_suite
         // HDF5File tests
         add(testCase(&HDF5ExportImportTest::testHDF5FileDataAccess));
         add(testCase(&HDF5ExportImportTest::testHDF5FileBlockAccess));
+        add(testCase(&HDF5ExportImportTest::testHDF5BlockwiseFilter));
+        add(testCase(&HDF5ExportImportTest::testHDF5ChunkCache));
+        add(testCase(&HDF5ExportImportTest::testHDF5ParallelCompression));
+        add(testCase(&HDF5ExportImportTest::testHDF5Array));
         add(testCase(&HDF5ExportImportTest::testHDF5FileChunks));
         add(testCase(&HDF5ExportImportTest::testHDF5FileCompression));
         add(testCase(&HDF5ExportImportTest::testHDF5FileBrowsing));
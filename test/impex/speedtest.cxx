@@ -0,0 +1,159 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2012 by Ullrich Koethe                       */
+/*                                                                      */
+/*    This file is part of the VIGRA computer vision library.           */
+/*    The VIGRA Website is                                              */
+/*        http://hci.iwr.uni-heidelberg.de/vigra/                       */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+//We need to undefine NDEBUG so that we have TIC, TOC available!
+#undef NDEBUG
+
+#include <iostream>
+#include <cstdio>
+#include <vigra/timing.hxx>
+USETICTOC;
+#include <vigra/byteswap.hxx>
+#include <vigra/sized_int.hxx>
+#include <vigra/array_vector.hxx>
+#include <vigra/stdimage.hxx>
+#include <vigra/impex.hxx>
+
+using namespace vigra;
+
+// the element-by-element swap used by the codecs before byteSwapArray()
+template <class T>
+void referenceSwap(T * data, std::size_t count)
+{
+    for(std::size_t k = 0; k < count; ++k)
+    {
+        UInt8 * c = reinterpret_cast<UInt8 *>(data + k);
+        std::reverse(c, c + sizeof(T));
+    }
+}
+
+double gigabytesPerSecond(double bytes, double msec)
+{
+    return bytes / (1024.0*1024.0*1024.0) / (msec / 1000.0);
+}
+
+template <class T>
+bool swapSpeed(const char * name, int repetitions)
+{
+    // 1 MB fits into the cache, so that memory bandwidth doesn't dominate
+    std::size_t count = (1 << 20) / sizeof(T);
+    ArrayVector<T> data(count), reference(count);
+    for(std::size_t k = 0; k < count; ++k)
+        data[k] = reference[k] = (T)(k * 2654435761u);
+
+    // call through pointers, so that the compiler cannot merge the repetitions
+    void (* volatile reference_swap)(T *, std::size_t) = &referenceSwap<T>;
+    void (* volatile swap)(void *, std::size_t, std::size_t) = &detail::byteSwapArray;
+
+    TIC;
+    for(int k = 0; k < repetitions; ++k)
+        reference_swap(reference.data(), count);
+    double msecReference = TOCN;
+    TIC;
+    for(int k = 0; k < repetitions; ++k)
+        swap(data.data(), count, sizeof(T));
+    double msec = TOCN;
+
+    double bytes = (double)repetitions * count * sizeof(T);
+    std::cerr << "byteSwapArray " << name << ": " 
+              << gigabytesPerSecond(bytes, msec) << " GB/s (element-wise: " 
+              << gigabytesPerSecond(bytes, msecReference) << " GB/s)" << std::endl;
+    return data == reference;
+}
+
+template <class Image>
+bool codecSpeed(const char * name, const char * filename, Image const & image, int repetitions)
+{
+    Image result(image.size());
+    TIC;
+    for(int k = 0; k < repetitions; ++k)
+        exportImage(srcImageRange(image), ImageExportInfo(filename));
+    double msecExport = TOCN;
+    TIC;
+    for(int k = 0; k < repetitions; ++k)
+        importImage(ImageImportInfo(filename), destImage(result));
+    double msecImport = TOCN;
+    std::remove(filename);
+
+    double bytes = (double)repetitions * image.width() * image.height() * sizeof(typename Image::value_type);
+    std::cerr << name << ": export " << gigabytesPerSecond(bytes, msecExport) 
+              << " GB/s, import " << gigabytesPerSecond(bytes, msecImport) << " GB/s" << std::endl;
+    if(!std::equal(image.begin(), image.end(), result.begin()))
+    {
+        std::cerr << "Error: " << name << " image changed during export and import." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    int repetitions = 5;
+    bool ok = true;
+
+    ok = swapSpeed<UInt16>("16 bit", 1001) && ok;
+    ok = swapSpeed<UInt32>("32 bit", 1001) && ok;
+    ok = swapSpeed<UInt64>("64 bit", 1001) && ok;
+    if(!ok)
+    {
+        std::cerr << "Error: byteSwapArray() differs from element-wise swap." << std::endl;
+        return 1;
+    }
+
+    // the codecs that convert byte order with read_array()/write_array():
+    // PNM is always big endian, so that 16-bit data are swapped on little-endian 
+    // hosts. VIFF files are written in host byte order, so that these rows measure
+    // the codec without swapping (baseline).
+    int w = 2048, h = 2048;
+    BImage bimage(w, h);
+    UInt16Image usimage(w, h);
+    SImage simage(w, h);
+    FImage fimage(w, h);
+    for(int k = 0; k < w*h; ++k)
+    {
+        bimage.begin()[k] = (UInt8)(k * 7);
+        usimage.begin()[k] = (UInt16)(k * 2654435761u);
+        simage.begin()[k] = (Int16)(k * 2654435761u);
+        fimage.begin()[k] = (float)(k % 1000) / 7.0f;
+    }
+
+    ok = codecSpeed("PNM  UINT16 (swapped on little endian)", "speedtest.pgm", usimage, repetitions) && ok;
+    ok = codecSpeed("VIFF INT16  (native order, no swap)   ", "speedtest.xv", simage, repetitions) && ok;
+    ok = codecSpeed("VIFF FLOAT  (native order, no swap)   ", "speedtest.xv", fimage, repetitions) && ok;
+    ok = codecSpeed("SUN  UINT8                            ", "speedtest.ras", bimage, repetitions) && ok;
+    ok = codecSpeed("BMP  UINT8                            ", "speedtest.bmp", bimage, repetitions) && ok;
+    return ok ? 0 : 1;
+}
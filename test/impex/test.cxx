@@ -42,6 +42,10 @@
 #include "unittest.hxx"
 #include "vigra/multi_array.hxx"
 
+#if defined(HasTIFF)
+#include <tiffio.h>
+#endif
+
 using namespace vigra;
 
 template <class Image>
@@ -60,6 +64,86 @@ void failCodec(Image const & img, ImageExportInfo const & info)
     }
 }
 
+template <class Image>
+void checkRegionAndLevel(Image const & img, const char * filename)
+{
+    exportImage (srcImageRange (img), ImageExportInfo (filename));
+
+    ImageImportInfo info (filename);
+    Rect2D region (Point2D (7, 19), Size2D (50, 33));
+
+    // region at full resolution
+    info.setRegion (region);
+    Image res (region.size ());
+    importImage (info, destImage (res));
+    for (int y = 0; y < region.height (); ++y)
+        for (int x = 0; x < region.width (); ++x)
+            should (res (x, y) == img (x + region.left (), y + region.top ()));
+
+    // level 2 (every 4th pixel, because the codecs tested here have no native levels)
+    info.setLevel (2);
+    shouldEqual (info.getRegion ().size (),
+                 Size2D ((img.width () + 3) / 4, (img.height () + 3) / 4));
+    Image level (info.getRegion ().size ());
+    importImage (info, destImage (level));
+    for (int y = 0; y < level.height (); ++y)
+        for (int x = 0; x < level.width (); ++x)
+            should (level (x, y) == img (4 * x, 4 * y));
+
+    // region of level 1
+    info.setLevel (1).setRegion (region);
+    importImage (info, destImage (res));
+    for (int y = 0; y < region.height (); ++y)
+        for (int x = 0; x < region.width (); ++x)
+            should (res (x, y) == img (2 * (x + region.left ()), 2 * (y + region.top ())));
+
+    try
+    {
+        info.setRegion (Rect2D (Point2D (0, 0), img.size ()));
+        failTest ("no exception thrown");
+    }
+    catch (PreconditionViolation &)
+    {}
+}
+
+#if defined(HasTIFF)
+// Write 'levels' pyramid levels of 'img' as directories of one TIFF file.
+// The reduced levels store the inverted pixels, so that they can be told
+// apart from the image that the generic fallback computes by subsampling.
+void writeTIFFPyramid (BImage const & img, const char * filename, int levels)
+{
+    TIFF * tiff = TIFFOpen (filename, "w");
+    should (tiff != 0);
+    for (int level = 0; level < levels; ++level)
+    {
+        uint32 w = ((img.width () - 1) >> level) + 1,
+               h = ((img.height () - 1) >> level) + 1;
+        TIFFSetField (tiff, TIFFTAG_IMAGEWIDTH, w);
+        TIFFSetField (tiff, TIFFTAG_IMAGELENGTH, h);
+        TIFFSetField (tiff, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField (tiff, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField (tiff, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField (tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField (tiff, TIFFTAG_ROWSPERSTRIP, 16);
+        if (level > 0)
+            TIFFSetField (tiff, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+
+        ArrayVector<UInt8> row (w);
+        for (uint32 y = 0; y < h; ++y)
+        {
+            for (uint32 x = 0; x < w; ++x)
+                row[x] = level == 0
+                            ? img (x, y)
+                            : 255 - img (x << level, y << level);
+            should (TIFFWriteScanline (tiff, row.begin (), y, 0) == 1);
+        }
+        should (TIFFWriteDirectory (tiff) == 1);
+    }
+    TIFFClose (tiff);
+}
+#endif
+
 class ByteImageExportImportTest
 {
     typedef vigra::BImage Image;
@@ -277,6 +361,113 @@ public:
         testFile ("res.xv");
     }
 
+    void testRegionAndLevel ()
+    {
+        checkRegionAndLevel (img, "res.pgm");
+        checkRegionAndLevel (img, "res.xv");
+#if defined(HasTIFF)
+        checkRegionAndLevel (img, "res.tif");
+#endif
+    }
+
+    void testJPEGLevel ()
+    {
+#if !defined(HasJPEG)
+        failCodec(img, vigra::ImageExportInfo ("res.jpg"));
+#else
+        exportImage (srcImageRange (img), vigra::ImageExportInfo ("res.jpg").setCompression ("JPEG QUALITY=100"));
+        vigra::ImageImportInfo info ("res.jpg");
+        Image full (info.size ());
+        importImage (info, destImage (full));
+
+        for (int level = 1; level <= 2; ++level)
+        {
+            // decoded by libjpeg's scaled inverse DCT
+            int step = 1 << level;
+            info.setLevel (level);
+            shouldEqual (info.getRegion ().size (),
+                         Size2D ((full.width () + step - 1) / step, (full.height () + step - 1) / step));
+            Image res (info.getRegion ().size ());
+            importImage (info, destImage (res));
+
+            // compare with the block averages of the full resolution image
+            double sumOfDifferences = 0.0;
+            for (int y = 0; y < res.height (); ++y)
+            {
+                for (int x = 0; x < res.width (); ++x)
+                {
+                    double mean = 0.0;
+                    int count = 0;
+                    for (int j = y * step; j < std::min ((y + 1) * step, full.height ()); ++j)
+                        for (int i = x * step; i < std::min ((x + 1) * step, full.width ()); ++i, ++count)
+                            mean += full (i, j);
+                    mean /= count;
+                    double diff = std::abs (res (x, y) - mean);
+                    should (diff < 32.0);
+                    sumOfDifferences += diff;
+                }
+            }
+            should (sumOfDifferences / (res.width () * res.height ()) < 2.0);
+        }
+
+        // a region of level 1 is cut from the complete level 1
+        vigra::ImageImportInfo levelInfo ("res.jpg");
+        levelInfo.setLevel (1);
+        Image level (levelInfo.getRegion ().size ());
+        importImage (levelInfo, destImage (level));
+
+        Rect2D region (Point2D (5, 9), Size2D (20, 30));
+        info.setLevel (1).setRegion (region);
+        Image res (region.size ());
+        importImage (info, destImage (res));
+        for (int y = 0; y < region.height (); ++y)
+            for (int x = 0; x < region.width (); ++x)
+                shouldEqual (res (x, y), level (x + region.left (), y + region.top ()));
+#endif
+    }
+
+    void testTIFFPyramid ()
+    {
+#if !defined(HasTIFF)
+        failCodec(img, vigra::ImageExportInfo ("res.tif"));
+#else
+        writeTIFFPyramid (img, "res.tif", 3);
+        vigra::ImageImportInfo info ("res.tif");
+        shouldEqual (info.size (), img.size ());
+
+        // levels 1 and 2 are read from their directories
+        for (int level = 1; level <= 2; ++level)
+        {
+            int step = 1 << level;
+            info.setLevel (level);
+            shouldEqual (info.getRegion ().size (),
+                         Size2D ((img.width () + step - 1) / step, (img.height () + step - 1) / step));
+            Image res (info.getRegion ().size ());
+            importImage (info, destImage (res));
+            for (int y = 0; y < res.height (); ++y)
+                for (int x = 0; x < res.width (); ++x)
+                    shouldEqual (res (x, y), 255 - img (step * x, step * y));
+        }
+
+        // a region of a stored level
+        Rect2D region (Point2D (7, 19), Size2D (50, 33));
+        info.setLevel (1).setRegion (region);
+        Image res (region.size ());
+        importImage (info, destImage (res));
+        for (int y = 0; y < region.height (); ++y)
+            for (int x = 0; x < region.width (); ++x)
+                shouldEqual (res (x, y), 255 - img (2 * (x + region.left ()), 2 * (y + region.top ())));
+
+        // level 3 is not stored => subsampled full resolution image
+        info.setLevel (3);
+        Image level3 (info.getRegion ().size ());
+        importImage (info, destImage (level3));
+        for (int y = 0; y < level3.height (); ++y)
+            for (int x = 0; x < level3.width (); ++x)
+                shouldEqual (level3 (x, y), img (8 * x, 8 * y));
+#endif
+    }
+
     void testVIFF2 ()
     {
         vigra::ImageExportInfo exportinfo ("res.foo");
@@ -441,6 +632,43 @@ public:
 #endif
     }
 
+    void testTIFFRegion ()
+    {
+#if defined(HasTIFF)
+        exportImage (srcImageRange (img),
+                     vigra::ImageExportInfo ("res.tif").
+                     setCompression ("LZW"));
+
+        vigra::ImageImportInfo info ("res.tif");
+        shouldEqual (info.getRegion (), vigra::Rect2D (info.size ()));
+
+        vigra::Rect2D region (vigra::Point2D (13, 27), vigra::Size2D (61, 45));
+        info.setRegion (region);
+        shouldEqual (info.getRegion (), region);
+        shouldEqual (info.width (), img.width ());
+
+        for (int threads = 1; threads <= 4; threads *= 2)
+        {
+            info.setThreadCount (threads);
+
+            Image res (region.size ());
+            importImage (info, destImage (res));
+
+            for (int y = 0; y < region.height (); ++y)
+                for (int x = 0; x < region.width (); ++x)
+                    should (res (x, y) == img (x + region.left (), y + region.top ()));
+        }
+
+        try
+        {
+            info.setRegion (vigra::Rect2D (vigra::Point2D (10, 10), img.size ()));
+            failTest ("no exception thrown");
+        }
+        catch (vigra::PreconditionViolation &)
+        {}
+#endif
+    }
+
     void testBMP ()
     {
         testFile ("res.bmp");
@@ -501,6 +729,15 @@ public:
         testFile ("res.xv");
     }
 
+    void testRegionAndLevel ()
+    {
+        checkRegionAndLevel (img, "res.ppm");
+        checkRegionAndLevel (img, "res.bmp");
+#if defined(HasTIFF)
+        checkRegionAndLevel (img, "res.tif");
+#endif
+    }
+
     void testVIFF2 ()
     {
         exportImage (srcImageRange (img),
@@ -1457,11 +1694,16 @@ struct ImageImportExportTestSuite : public vigra::test_suite
         add(testCase(&ByteImageExportImportTest::testSUN));
         add(testCase(&ByteImageExportImportTest::testVIFF1));
         add(testCase(&ByteImageExportImportTest::testVIFF2));
+        add(testCase(&ByteImageExportImportTest::testRegionAndLevel));
+        add(testCase(&ByteImageExportImportTest::testJPEGLevel));
+        add(testCase(&ByteImageExportImportTest::testTIFFPyramid));
 
         // rgb byte images
         add(testCase(&ByteRGBImageExportImportTest::testGIF));
         add(testCase(&ByteRGBImageExportImportTest::testJPEG));
         add(testCase(&ByteRGBImageExportImportTest::testTIFF));
+        add(testCase(&ByteRGBImageExportImportTest::testTIFFRegion));
+        add(testCase(&ByteRGBImageExportImportTest::testRegionAndLevel));
         add(testCase(&ByteRGBImageExportImportTest::testBMP));
         add(testCase(&ByteRGBImageExportImportTest::testPPM));
         add(testCase(&ByteRGBImageExportImportTest::testPNM));
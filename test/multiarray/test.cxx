@@ -33,9 +33,11 @@
 /*                                                                      */
 /************************************************************************/
 
+#include <cstdio>
 #include "unittest.hxx"
 #include "vigra/multi_array.hxx"
 #include "vigra/multi_impex.hxx"
+#include "vigra/async_impex.hxx"
 #include "vigra/basicimageview.hxx"
 #include "vigra/navigator.hxx"
 #include "vigra/multi_pointoperators.hxx"
@@ -1093,6 +1095,261 @@ struct MultiImpexTest
         shouldEqual(result(0,1,3), 4);
 #endif // _WIN32
     }
+
+    void testParallelImpex()
+    {
+        // enough slices to keep several threads busy
+        MultiArray<3, float> volume(Shape(20, 15, 17));
+        for(int k=0; k<volume.size(); ++k)
+            volume[k] = (float)((k*37) % 251) - 100.0f;
+
+        VolumeIOStatistics statistics;
+        exportVolume(volume, VolumeExportInfo("impex/parallel", ".xv"), 4, &statistics);
+        shouldEqual(statistics.slices, 17);
+        should(statistics.threads >= 1);
+        shouldEqualTolerance(statistics.megabytes, volume.size()*sizeof(float) / (1024.0*1024.0), 1e-10);
+        should(statistics.seconds >= 0.0);
+
+        VolumeImportInfo info("impex/parallel", ".xv");
+        shouldEqual(info.shape(), volume.shape());
+        MultiArray<3, float> result(info.shape());
+        VolumeIOStatistics importStatistics;
+        importVolume(info, result, -1, &importStatistics);
+        shouldEqual(importStatistics.slices, 17);
+        should(result == volume);
+
+        // sequential and parallel import agree
+        MultiArray<3, float> sequential(info.shape());
+        importVolume(info, sequential);
+        should(sequential == result);
+
+        // a volume of the wrong shape is rejected before the loop
+        MultiArray<3, float> wrongShape(Shape(20, 15, 16));
+        try
+        {
+            importVolume(info, wrongShape, 4);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation &)
+        {}
+
+        // errors in a slice in the middle of the stack are rethrown after the loop
+        MultiArray<2, float> wrongSlice(MultiArrayShape<2>::type(20, 14));
+        exportImage(srcImageRange(wrongSlice), ImageExportInfo("impex/parallel08.xv"));
+        try
+        {
+            importVolume(info, result, 4);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & e)
+        {
+            std::string message(e.what());
+            should(message.find("importVolume(): the images have inconsistent sizes.") != std::string::npos);
+        }
+
+        // the serial overload reports the same error
+        try
+        {
+            importVolume(info, result);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & e)
+        {
+            std::string message(e.what());
+            should(message.find("importVolume(): the images have inconsistent sizes.") != std::string::npos);
+        }
+
+        std::remove("impex/parallel08.xv");
+        try
+        {
+            importVolume(info, result, 4);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & e)
+        {
+            std::string message(e.what());
+            should(message.find("Unable to open file 'impex/parallel08.xv'.") != std::string::npos);
+        }
+    }
+
+    void testRawVolume()
+    {
+        {
+            std::ofstream raw("impex/test_raw.raw", std::ios::binary);
+            raw.write((char const *)array.data(), array.size());
+            std::ofstream info("impex/test_raw.info");
+            info << "# raw test volume\n"
+                 << "filename = test_raw.raw\n"
+                 << "width = 2\nheight = 3\ndepth = 4\n"
+                 << "datatype = UNSIGNED_CHAR\n";
+        }
+        
+        VolumeImportInfo info("impex/test_raw.info");
+        shouldEqual(info.shape(), Shape(2,3,4));
+        
+        Array result(info.shape());
+        importVolume(info, result);
+        should(result == array);
+        
+        MappedMultiArray<3, unsigned char> mapped;
+        mapVolume(info, mapped);
+        should(mapped.isMapped());
+        shouldEqual(mapped.shape(), Shape(2,3,4));
+        should(mapped == array);
+        
+        // changes are private to the mapping
+        mapped(1,2,3) = 0;
+        importVolume(info, result);
+        should(result == array);
+    }
+
+    void testMappedMultiArray()
+    {
+        typedef MultiArrayShape<2>::type Shape2;
+        
+        MultiArray<2, UInt16> data(Shape2(5, 7));
+        for(int k=0; k<data.size(); ++k)
+            data[k] = (UInt16)(k*1031);
+        MultiArray<2, UInt16> swapped(data.shape());
+        for(int k=0; k<data.size(); ++k)
+            swapped[k] = (UInt16)((data[k] >> 8) | (data[k] << 8));
+        
+        {
+            std::ofstream raw("impex/test_mapped.raw", std::ios::binary);
+            raw.write("abc", 3);
+            raw.write((char const *)data.data(), data.size()*sizeof(UInt16));
+        }
+        
+        typedef MappedMultiArray<2, UInt16> Mapped;
+        Mapped mapped("impex/test_mapped.raw", Shape2(5, 7), 3);
+        should(!mapped.isMapped());  // misaligned: the data are copied
+        should(mapped == data);
+        
+        // file is interpreted in the other byte order
+        Mapped::ByteOrder other = (*(UInt8 const *)&data[1] == (data[1] & 0xff))
+                                      ? Mapped::BigEndian
+                                      : Mapped::LittleEndian;
+        mapped.map("impex/test_mapped.raw", Shape2(5, 7), 3, other);
+        should(mapped == swapped);
+        
+        // aligned data are mapped directly
+        {
+            std::ofstream raw("impex/test_mapped.raw", std::ios::binary);
+            raw.write("abcd", 4);
+            raw.write((char const *)data.data(), data.size()*sizeof(UInt16));
+        }
+        mapped.map("impex/test_mapped.raw", Shape2(5, 7), 4);
+        should(mapped.isMapped());
+        should(mapped == data);
+        MultiArrayView<1, UInt16, StridedArrayTag> column = mapped.bindInner(2);
+        shouldEqual(column(3), data(2, 3));
+        mapped.map("impex/test_mapped.raw", Shape2(5, 7), 4, other);
+        should(mapped.isMapped());
+        should(mapped == swapped);
+        
+        mapped.unmap();
+        shouldEqual(mapped.size(), 0);
+        
+        // file too short
+        try
+        {
+            mapped.map("impex/test_mapped.raw", Shape2(5, 8), 4);
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & e)
+        {
+            std::string expected("\nPrecondition violation!\nMappedMultiArray::map(): file 'impex/test_mapped.raw' is too short");
+            std::string message(e.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+    }
+    
+    struct CountExports
+    {
+        int * succeeded, * failed;
+        
+        void operator()(bool success, std::string const &) const
+        {
+            if(success)
+                ++*succeeded;
+            else
+                ++*failed;
+        }
+    };
+    
+    void testAsyncExport()
+    {
+        typedef MultiArrayShape<2>::type Shape2;
+        
+        int succeeded = 0, failed = 0;
+        CountExports count = { &succeeded, &failed };
+        
+        MultiArray<3, float> volume(Shape(9, 8, 5));
+        for(int k=0; k<volume.size(); ++k)
+            volume[k] = (float)((k*17) % 101);
+        
+        ExportFuture volumeFuture, failure;
+        std::vector<ExportFuture> futures;
+        {
+            AsyncImageExporter exporter(2);
+            shouldEqual(exporter.capacity(), 2u);
+            
+            for(int k=0; k<volume.shape(2); ++k)
+            {
+                BasicImageView<float> slice = makeBasicImageView(volume.bindOuter(k));
+                char name[100];
+                std::sprintf(name, "impex/async%d.xv", k);
+                futures.push_back(exporter.exportImage(srcImageRange(slice), ImageExportInfo(name), count));
+                should(exporter.pending() <= exporter.capacity());
+            }
+            
+            // the data are copied: modifying the source doesn't affect the export
+            MultiArray<3, float> changing(volume);
+            volumeFuture = exporter.exportVolume(changing, VolumeExportInfo("impex/async_volume", ".xv"));
+            changing.init(0.0f);
+            
+            BasicImageView<float> slice = makeBasicImageView(volume.bindOuter(0));
+            failure = exporter.exportImage(srcImageRange(slice), ImageExportInfo("impex/async.unknown"), count);
+            
+            exporter.waitAll();
+            shouldEqual(exporter.pending(), 0u);
+        }
+        
+        shouldEqual(succeeded, 5);
+        shouldEqual(failed, 1);
+        for(unsigned int k=0; k<futures.size(); ++k)
+        {
+            should(futures[k].isReady());
+            futures[k].wait();
+            
+            char name[100];
+            std::sprintf(name, "impex/async%d.xv", k);
+            ImageImportInfo info(name);
+            MultiArray<2, float> result(Shape2(info.width(), info.height()));
+            BasicImageView<float> resultView = makeBasicImageView(result);
+            importImage(info, destImage(resultView));
+            should(result == volume.bindOuter(k));
+        }
+        
+        should(volumeFuture.succeeded());
+        VolumeImportInfo info("impex/async_volume", ".xv");
+        MultiArray<3, float> result(info.shape());
+        importVolume(info, result);
+        should(result == volume);
+        
+        should(failure.isReady());
+        should(!failure.succeeded());
+        should(failure.errorMessage().size() > 0);
+        try
+        {
+            failure.wait();
+            failTest("no exception thrown");
+        }
+        catch(std::runtime_error &)
+        {}
+        
+        should(!ExportFuture().isValid());
+    }
 };
 
 template <class IMAGE>
@@ -1853,6 +2110,10 @@ struct MultiArrayTestSuite
         add( testCase( &MultiArrayTest::test_copy_int_float ) );
 
         add( testCase( &MultiImpexTest::testImpex ) );
+        add( testCase( &MultiImpexTest::testParallelImpex ) );
+        add( testCase( &MultiImpexTest::testRawVolume ) );
+        add( testCase( &MultiImpexTest::testMappedMultiArray ) );
+        add( testCase( &MultiImpexTest::testAsyncExport ) );
 	}
 };
 
@@ -39,6 +39,8 @@
 #include "unittest.hxx"
 #include "vigra/multi_array.hxx"
 #include "vigra/multi_convolution.hxx"
+#include "vigra/multi_blockwise.hxx"
+#include "vigra/multi_feature_bank.hxx"
 #include "vigra/basicimageview.hxx"
 #include "vigra/convolution.hxx" 
 #include "vigra/navigator.hxx"
@@ -463,6 +465,208 @@ struct MultiArraySeparableConvolutionTest
         test_gradient1( srcImage, false );
         test_gradient1( srcImage, true );
     }
+
+    void test_lineByLine()
+    {
+        // the tiled (and possibly parallel) implementation must give
+        // the same result as convolving each line separately
+        Image3D src(Size3(37, 21, 19));
+        makeRandom(src);
+
+        BorderTreatmentMode modes[] = { BORDER_TREATMENT_REFLECT, BORDER_TREATMENT_REPEAT,
+                                        BORDER_TREATMENT_WRAP, BORDER_TREATMENT_CLIP,
+                                        BORDER_TREATMENT_AVOID };
+        for(int m = 0; m < 5; ++m)
+        {
+            Kernel1D<double> kernel;
+            kernel.initGaussianDerivative(1.5, 1);
+            kernel.setBorderTreatment(modes[m]);
+            if(modes[m] == BORDER_TREATMENT_CLIP)
+                kernel.initGaussian(1.5);
+            kernel.setBorderTreatment(modes[m]);
+
+            for(int d = 0; d < 3; ++d)
+            {
+                Image3D res(src.shape(), 1.0f), ref(src.shape(), 1.0f);
+
+                convolveMultiArrayOneDimension(srcMultiArrayRange(src), destMultiArray(res),
+                                               d, kernel);
+
+                typedef MultiArrayNavigator<Image3D::traverser, 3> Navigator;
+                Navigator snav(src.traverser_begin(), src.shape(), d);
+                Navigator dnav(ref.traverser_begin(), src.shape(), d);
+                for(; snav.hasMore(); snav++, dnav++)
+                {
+                    ArrayVector<PixelType> line(snav.begin(), snav.end());
+                    convolveLine(srcIterRange(line.begin(), line.end(), StandardConstAccessor<PixelType>()),
+                                 destIter(dnav.begin(), StandardValueAccessor<PixelType>()), kernel1d(kernel));
+                }
+
+                shouldEqualSequence(res.begin(), res.end(), ref.begin());
+            }
+        }
+
+        // short lines which are not multiples of the tile size
+        Image3D small(Size3(5, 11, 3)), res(small.shape()), ref(small.shape());
+        makeRandom(small);
+        Kernel1D<float> kernel;
+        kernel.initBinomial(1);
+        separableConvolveMultiArray(srcMultiArrayRange(small), destMultiArray(res), kernel);
+        for(int z = 0; z < 3; ++z)
+        {
+            BasicImageView<PixelType> sslice = makeBasicImageView(small.bindOuter(z));
+            BasicImageView<PixelType> dslice = makeBasicImageView(ref.bindOuter(z));
+            convolveImage(srcImageRange(sslice), destImage(dslice), kernel, kernel);
+        }
+        typedef MultiArrayNavigator<Image3D::traverser, 3> Navigator;
+        for(Navigator nav(ref.traverser_begin(), ref.shape(), 2); nav.hasMore(); nav++)
+        {
+            ArrayVector<PixelType> line(nav.begin(), nav.end());
+            convolveLine(srcIterRange(line.begin(), line.end(), StandardConstAccessor<PixelType>()),
+                         destIter(nav.begin(), StandardValueAccessor<PixelType>()), kernel1d(kernel));
+        }
+        shouldEqualSequence(res.begin(), res.end(), ref.begin());
+    }
+
+    void test_threadCount()
+    {
+        // large enough for the tiles to be distributed over several threads
+        Image3D src(Size3(60, 50, 40));
+        makeRandom(src);
+
+        Image3D ref(src.shape());
+        gaussianSmoothMultiArray(srcMultiArrayRange(src), destMultiArray(ref), 2.0, 1);
+
+        typedef MultiArray<3, TinyVector<PixelType, 6> > TensorVolume;
+        TensorVolume hessianRef(src.shape()), tensorRef(src.shape());
+        hessianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(hessianRef), 1.5, 1);
+        structureTensorMultiArray(srcMultiArrayRange(src), destMultiArray(tensorRef), 1.0, 2.0, 1);
+
+        int threadCounts[] = { 0, 2, 3, 8, -1 };
+        for(int k = 0; k < 5; ++k)
+        {
+            Image3D res(src.shape());
+            gaussianSmoothMultiArray(srcMultiArrayRange(src), destMultiArray(res), 2.0, threadCounts[k]);
+            shouldEqualSequence(res.begin(), res.end(), ref.begin());
+
+            TensorVolume hessian(src.shape()), tensor(src.shape());
+            hessianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(hessian), 1.5, threadCounts[k]);
+            shouldEqualSequence(hessian.begin(), hessian.end(), hessianRef.begin());
+            structureTensorMultiArray(srcMultiArrayRange(src), destMultiArray(tensor), 1.0, 2.0, threadCounts[k]);
+            shouldEqualSequence(tensor.begin(), tensor.end(), tensorRef.begin());
+        }
+    }
+
+    void test_blockwise()
+    {
+        Image3D src(Size3(45, 38, 21));
+        makeRandom(src);
+        Size3 blockShape(16, 11, 8);
+
+        Image3D smooth(src.shape()), smoothBlockwise(src.shape());
+        gaussianSmoothMultiArray(srcMultiArrayRange(src), destMultiArray(smooth), 2.0);
+        gaussianSmoothMultiArrayBlockwise(src, smoothBlockwise, 2.0, blockShape);
+        shouldEqualSequence(smoothBlockwise.begin(), smoothBlockwise.end(), smooth.begin());
+
+        // blocks smaller than the halo
+        smoothBlockwise.init(0.0);
+        gaussianSmoothMultiArrayBlockwise(src, smoothBlockwise, 2.0, Size3(3, 5, 2));
+        shouldEqualSequence(smoothBlockwise.begin(), smoothBlockwise.end(), smooth.begin());
+
+        Image3x3 grad(src.shape()), gradBlockwise(src.shape());
+        gaussianGradientMultiArray(srcMultiArrayRange(src), destMultiArray(grad), 1.5);
+        gaussianGradientMultiArrayBlockwise(src, gradBlockwise, 1.5, blockShape);
+        shouldEqualSequence(gradBlockwise.begin(), gradBlockwise.end(), grad.begin());
+
+        typedef MultiArray<3, TinyVector<PixelType, 6> > TensorArray;
+        TensorArray hessian(src.shape()), hessianBlockwise(src.shape());
+        hessianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(hessian), 1.5);
+        hessianOfGaussianMultiArrayBlockwise(src, hessianBlockwise, 1.5, blockShape);
+        shouldEqualSequence(hessianBlockwise.begin(), hessianBlockwise.end(), hessian.begin());
+
+        TensorArray st(src.shape()), stBlockwise(src.shape());
+        structureTensorMultiArray(srcMultiArrayRange(src), destMultiArray(st), 1.0, 2.0);
+        structureTensorMultiArrayBlockwise(src, stBlockwise, 1.0, 2.0, blockShape);
+        shouldEqualSequence(stBlockwise.begin(), stBlockwise.end(), st.begin());
+
+        // the halo covers the kernels of all passes
+        shouldEqual(GaussianSmoothBlockFilter(2.0).halo(), 6);
+        shouldEqual(StructureTensorBlockFilter(1.0, 2.0).halo(), 
+                    GaussianGradientBlockFilter(1.0).halo() + 6);
+    }
+
+    void test_featureBank()
+    {
+        typedef MultiArrayFeatureBank<3> FeatureBank;
+        typedef MultiArray<2, PixelType> Matrix;
+        typedef MultiArray<3, TinyVector<PixelType, 6> > TensorArray;
+
+        Image3D src(Size3(23, 19, 17));
+        makeRandom(src);
+
+        FeatureBank bank;
+        bank.add(FeatureBank::GaussianSmoothing, 1.0)
+            .add(FeatureBank::GaussianGradientMagnitude, 1.0)
+            .add(FeatureBank::HessianOfGaussianEigenvalues, 1.0)
+            .add(FeatureBank::LaplacianOfGaussian, 1.0)
+            .add(FeatureBank::LaplacianOfGaussian, 2.0)
+            .addStructureTensorEigenvalues(1.0, 2.0)
+            .add(FeatureBank::GaussianSmoothing, 2.0);
+        shouldEqual(bank.size(), 7);
+        shouldEqual(bank.featureCount(), 11);
+
+        Matrix features(Matrix::difference_type(src.size(), bank.featureCount()));
+        bank.compute(src, features);
+
+        Image3D ref(src.shape());
+        gaussianSmoothMultiArray(srcMultiArrayRange(src), destMultiArray(ref), 1.0);
+        shouldEqualSequenceTolerance(ref.begin(), ref.end(), features.bindOuter(0).begin(), 1e-5);
+
+        gaussianSmoothMultiArray(srcMultiArrayRange(src), destMultiArray(ref), 2.0);
+        shouldEqualSequenceTolerance(ref.begin(), ref.end(), features.bindOuter(10).begin(), 1e-5);
+
+        Image3x3 grad(src.shape());
+        gaussianGradientMultiArray(srcMultiArrayRange(src), destMultiArray(grad), 1.0);
+        transformMultiArray(srcMultiArrayRange(grad), destMultiArray(ref), norm(Arg1()));
+        shouldEqualSequence(ref.begin(), ref.end(), features.bindOuter(1).begin());
+
+        TensorArray hessian(src.shape());
+        Image3x3 eigenvalues(src.shape());
+        hessianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(hessian), 1.0);
+        tensorEigenvaluesMultiArray(srcMultiArrayRange(hessian), destMultiArray(eigenvalues));
+        for(int i = 0; i < eigenvalues.size(); ++i)
+            for(int k = 0; k < 3; ++k)
+                shouldEqual(eigenvalues[i][k], features(i, 2+k));
+
+        laplacianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(ref), 1.0);
+        shouldEqualSequence(ref.begin(), ref.end(), features.bindOuter(5).begin());
+        laplacianOfGaussianMultiArray(srcMultiArrayRange(src), destMultiArray(ref), 2.0);
+        shouldEqualSequence(ref.begin(), ref.end(), features.bindOuter(6).begin());
+
+        TensorArray st(src.shape());
+        structureTensorMultiArray(srcMultiArrayRange(src), destMultiArray(st), 1.0, 2.0);
+        tensorEigenvaluesMultiArray(srcMultiArrayRange(st), destMultiArray(eigenvalues));
+        for(int i = 0; i < eigenvalues.size(); ++i)
+            for(int k = 0; k < 3; ++k)
+                shouldEqual(eigenvalues[i][k], features(i, 7+k));
+
+        // the scratch arrays are reused, results must not change
+        Matrix again(features.shape());
+        bank.compute(src, again);
+        should(again == features);
+
+        try
+        {
+            bank.compute(src, Matrix(Matrix::difference_type(src.size(), 3)));
+            failTest("no exception thrown");
+        }
+        catch(PreconditionViolation & c)
+        {
+            std::string expected("\nPrecondition violation!\nMultiArrayFeatureBank::compute(): feature matrix has wrong shape.");
+            std::string message(c.what());
+            should(0 == expected.compare(message.substr(0,expected.size())));
+        }
+    }
 };                //-- struct MultiArraySeparableConvolutionTest
 
 //--------------------------------------------------------
@@ -483,6 +687,10 @@ struct MultiArraySeparableConvolutionTestSuite
                 add( testCase( &MultiArraySeparableConvolutionTest::test_hessian ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::test_structureTensor ) );
                 add( testCase( &MultiArraySeparableConvolutionTest::test_gradient_magnitude ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::test_lineByLine ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::test_threadCount ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::test_blockwise ) );
+                add( testCase( &MultiArraySeparableConvolutionTest::test_featureBank ) );
         }
 }; // struct MultiArraySeparableConvolutionTestSuite
 
@@ -277,6 +277,33 @@ struct SeededRegionGrowing3DTest
 
     }
 
+    void quantizedCostsTest()
+    {
+        // the squared distances are integers, so quantization is exact
+        IntVolume res(vol1);
+
+        vigra::ArrayOfRegionStatistics<DirectCostFunctor> cost(2);
+        seededRegionGrowing3D(srcMultiArrayRange(distvol1), srcMultiArray(vol1),
+                              destMultiArray(res), cost,
+                              SRGType(KeepContours | QuantizedCosts));
+
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    shouldEqual(res(x,y,z), z < 2 ? 1 : z > 2 ? 2 : 0);
+
+        IntVolume res2(vol1);
+        seededRegionGrowing3D(srcMultiArrayRange(distvol1), srcMultiArray(vol1),
+                              destMultiArray(res2), cost,
+                              SRGType(CompleteGrow | QuantizedCosts));
+
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    if(z != 2)
+                        shouldEqual(res2(x,y,z), z < 2 ? 1 : 2);
+    }
+
     void simpleTest()
     {
         IntVolume res(vol3);
@@ -305,6 +332,7 @@ struct SeededRegionGrowing3DTestSuite
     {
         add( testCase( &SeededRegionGrowing3DTest::voronoiTest));
         add( testCase( &SeededRegionGrowing3DTest::voronoiTestWithBorder));
+        add( testCase( &SeededRegionGrowing3DTest::quantizedCostsTest));
         add( testCase( &SeededRegionGrowing3DTest::simpleTest));
     }
 };
@@ -106,6 +106,22 @@ public:
 		// compare
 		should (in_data == reference_data);
 	}
+	
+	// memory-mapped import must give the same results as readSIF
+	void testSifMap() {
+		const char * files[] = { "testSif_4_16_30001.sif", "testSif_4_13_30000.sif", "testSif_4_6_30000.sif" };
+		for(int k=0; k<3; ++k)
+		{
+			SIFImportInfo infoSIF(files[k]);
+			MultiArray<3,float> in_data(MultiArrayShape<3>::type(infoSIF.width(), infoSIF.height(), infoSIF.stacksize()));
+			readSIF(infoSIF, in_data);
+			
+			MappedMultiArray<3, float> mapped;
+			mapSIF(infoSIF, mapped);
+			shouldEqual(mapped.shape(), in_data.shape());
+			should (mapped == in_data);
+		}
+	}
 
 };
 
@@ -120,6 +136,7 @@ struct SifImportTestSuite : public vigra::test_suite
 		add(testCase(&SifImportTest::testSifImport_4_16));
 		add(testCase(&SifImportTest::testSifImport_4_13));
 		add(testCase(&SifImportTest::testSifImport_4_6));
+		add(testCase(&SifImportTest::testSifMap));
  
 	}
 };
@@ -366,6 +366,53 @@ struct LabelingTest
         }
     }
 
+    void checkBlockwise(bool eight_neighbors)
+    {
+        IImage img(21, 37), res(21, 37), bgRes(21, 37), blockRes(21, 37);
+        // few distinct values => many regions crossing the strip boundaries
+        srand(42);
+        for(IImage::ScanOrderIterator i = img.begin(); i != img.end(); ++i)
+            *i = rand() % 3;
+        std::equal_to<int> equal;
+
+        unsigned int count = labelImage(srcImageRange(img), destImage(res), eight_neighbors);
+        bgRes.init(-1);
+        unsigned int bgCount = labelImageWithBackground(srcImageRange(img), destImage(bgRes), eight_neighbors, 0);
+
+        static const int heights[] = { 1, 2, 5, 36, 37, 50 };
+        for(int k=0; k<6; ++k)
+        {
+            blockRes.init(-1);
+            shouldEqual(count, detail::labelImageBlockwise(img.upperLeft(), img.lowerRight(), img.accessor(),
+                                        blockRes.upperLeft(), blockRes.accessor(), eight_neighbors,
+                                        detail::LabelImagePolicy<std::equal_to<int> >(equal),
+                                        heights[k], 4));
+            shouldEqualSequence(blockRes.begin(), blockRes.end(), res.begin());
+
+            blockRes.init(-1);
+            shouldEqual(bgCount, detail::labelImageBlockwise(img.upperLeft(), img.lowerRight(), img.accessor(),
+                                        blockRes.upperLeft(), blockRes.accessor(), eight_neighbors,
+                                        detail::LabelImageWithBackgroundPolicy<int, std::equal_to<int> >(0, equal),
+                                        heights[k], 4));
+            shouldEqualSequence(blockRes.begin(), blockRes.end(), bgRes.begin());
+        }
+
+        blockRes.init(-1);
+        shouldEqual(count, labelImageParallel(srcImageRange(img), destImage(blockRes), eight_neighbors, 4));
+        shouldEqualSequence(blockRes.begin(), blockRes.end(), res.begin());
+
+        blockRes.init(-1);
+        shouldEqual(bgCount, labelImageWithBackgroundParallel(srcImageRange(img), destImage(blockRes), 
+                                                              eight_neighbors, 0, 4));
+        shouldEqualSequence(blockRes.begin(), blockRes.end(), bgRes.begin());
+    }
+
+    void labelingBlockwiseTest()
+    {
+        checkBlockwise(false);
+        checkBlockwise(true);
+    }
+
     Image img1, img2, img3, img4;
 };
 
@@ -1524,6 +1571,66 @@ struct RegionGrowingTest
         shouldEqualSequence(res.begin(), res.end(), reference);
     }
 
+    void quantizedCostsTest()
+    {
+        // scale the distances so that rounding to the bucket index
+        // preserves their order up to 0.05 pixels
+        Image scaled(img.size()), res(img.size());
+        transformImage(srcImageRange(img), destImage(scaled),
+                       linearIntensityTransform(10.0, 0.0));
+
+        vigra::ArrayOfRegionStatistics<DirectCostFunctor> cost(2);
+        seededRegionGrowing(srcImageRange(scaled), srcImage(seeds),
+                            destImage(res), cost, QuantizedCosts);
+
+        int x,y;
+        for(y=0; y<7; ++y)
+        {
+            for(x=0; x<7; ++x)
+            {
+                double dist1 = VIGRA_CSTD::sqrt((2.0 - x)*(2.0 - x) +
+                                         (2.0 - y)*(2.0 - y));
+                double dist2 = VIGRA_CSTD::sqrt((5.0 - x)*(5.0 - x) +
+                                         (5.0 - y)*(5.0 - y));
+                double desired = (dist1 <= dist2) ? 1 : 2;
+
+                if(VIGRA_CSTD::fabs(dist1 - dist2) > 0.1)
+                    shouldEqual(res(x,y), desired);
+            }
+        }
+
+        Image::value_type reference[] = {
+            1, 1, 1, 1, 1, 1, 1,
+            1, 1, 1, 1, 1, 1, 0,
+            1, 1, 1, 1, 1, 0, 2,
+            1, 1, 1, 1, 0, 2, 2,
+            1, 1, 1, 0, 2, 2, 2,
+            1, 1, 0, 2, 2, 2, 2,
+            1, 0, 2, 2, 2, 2, 2
+        };
+
+        seededRegionGrowing(srcImageRange(scaled), srcImage(seeds),
+                            destImage(res), cost,
+                            SRGType(KeepContours | QuantizedCosts));
+        shouldEqualSequence(res.begin(), res.end(), reference);
+
+        // pixels farther than 1.5 from their seed remain unlabeled
+        seededRegionGrowing(srcImageRange(scaled), srcImage(seeds),
+                            destImage(res), cost,
+                            SRGType(StopAtThreshold | QuantizedCosts),
+                            FourNeighborCode(), 15.0);
+        for(y=0; y<7; ++y)
+        {
+            for(x=0; x<7; ++x)
+            {
+                if(img(x,y) <= 1.45)
+                    should(res(x,y) != 0.0);
+                else if(img(x,y) >= 1.55)
+                    shouldEqual(res(x,y), 0.0);
+            }
+        }
+    }
+
     Image img, seeds;
 };
 
@@ -2011,6 +2118,7 @@ struct SimpleAnalysisTestSuite
         add( testCase( &LabelingTest::labelingFourWithBackgroundTest1));
         add( testCase( &LabelingTest::labelingFourWithBackgroundTest2));
         add( testCase( &LabelingTest::labelingEightWithBackgroundTest));
+        add( testCase( &LabelingTest::labelingBlockwiseTest));
         add( testCase( &EdgeDetectionTest::edgeDetectionTest));
         add( testCase( &EdgeDetectionTest::edgeToCrackEdgeTest));
         add( testCase( &EdgeDetectionTest::removeShortEdgesTest));
@@ -2038,6 +2146,7 @@ struct SimpleAnalysisTestSuite
         add( testCase( &WatershedsTest::watersheds4Test));
         add( testCase( &RegionGrowingTest::voronoiTest));
         add( testCase( &RegionGrowingTest::voronoiWithBorderTest));
+        add( testCase( &RegionGrowingTest::quantizedCostsTest));
         add( testCase( &InterestOperatorTest::cornerResponseFunctionTest));
         add( testCase( &InterestOperatorTest::foerstnerCornerTest));
         add( testCase( &InterestOperatorTest::rohrCornerTest));
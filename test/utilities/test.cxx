@@ -37,12 +37,15 @@
 #include <iterator>
 #include <algorithm>
 #include <queue>
+#include <cstdlib>
 #include "unittest.hxx"
 #include "vigra/accessor.hxx"
 #include "vigra/array_vector.hxx"
 #include "vigra/copyimage.hxx"
 #include "vigra/sized_int.hxx"
 #include "vigra/bucket_queue.hxx"
+#include "vigra/priority_queue.hxx"
+#include "vigra/threading.hxx"
 
 using namespace vigra;
 
@@ -372,6 +375,83 @@ struct BucketQueueTest
     }
 };
 
+struct ChangeablePriorityQueueTest
+{
+    void testQueue()
+    {
+        static const double data[] = { 1.1, 4.4, 12.2, 2.2, 3.6, 4.5, 2.2 };
+        ChangeablePriorityQueue<double> queue(10);
+        for(int k=0; k<7; ++k)
+            queue.push(k, data[k]);
+
+        shouldEqual(7u, queue.size());
+        should(queue.contains(6));
+        should(!queue.contains(7));
+        shouldEqual(0, queue.top());
+        shouldEqual(1.1, queue.topPriority());
+
+        queue.push(2, 0.5);  // decrease
+        queue.push(0, 5.0);  // increase
+        queue.remove(5);
+        queue.remove(8);     // not in the queue
+        should(!queue.contains(5));
+        shouldEqual(6u, queue.size());
+        shouldEqual(5.0, queue.priority(0));
+
+        // equal priorities are returned in the order of the items
+        static const int order[] = { 2, 3, 6, 4, 1, 0 };
+        for(int k=0; k<6; ++k)
+        {
+            shouldEqual(order[k], queue.top());
+            queue.pop();
+        }
+        should(queue.empty());
+
+        ChangeablePriorityQueue<double, std::greater<double> > descending(10);
+        for(int k=0; k<7; ++k)
+            descending.push(k, data[k]);
+        shouldEqual(2, descending.top());
+        descending.clear();
+        should(descending.empty());
+        should(!descending.contains(2));
+    }
+
+    void testRandom()
+    {
+        srand(42);
+        int size = 200;
+        ChangeablePriorityQueue<int> queue(size);
+        ArrayVector<int> priorities(size, -1);
+        for(int k=0; k<2000; ++k)
+        {
+            int i = rand() % size;
+            if(rand() % 4 == 0)
+            {
+                queue.remove(i);
+                priorities[i] = -1;
+            }
+            else
+            {
+                priorities[i] = rand() % 100;
+                queue.push(i, priorities[i]);
+            }
+        }
+
+        int last = -1, lastItem = -1;
+        while(!queue.empty())
+        {
+            int i = queue.top();
+            shouldEqual(priorities[i], queue.topPriority());
+            should(last < priorities[i] || (last == priorities[i] && lastItem < i));
+            last = priorities[i];
+            lastItem = i;
+            priorities[i] = -1;
+            queue.pop();
+        }
+        shouldEqual(std::count(priorities.begin(), priorities.end(), -1), size);
+    }
+};
+
 struct SizedIntTest
 {
     void testSizedInt()
@@ -387,6 +467,98 @@ struct SizedIntTest
     }
 };
 
+struct ThreadingTest
+{
+    void testThreadCount()
+    {
+        shouldEqual(actualThreadCount(0), 1);
+        shouldEqual(actualThreadCount(1), 1);
+#ifdef _OPENMP
+        shouldEqual(actualThreadCount(3), 3);
+#else
+        shouldEqual(actualThreadCount(3), 1);
+#endif
+        shouldEqual(actualThreadCount(-1), defaultThreadCount());
+    }
+
+    void testExceptionCollector()
+    {
+        {
+            ThreadExceptionCollector errors;
+            should(!errors.failed());
+            errors.rethrow();
+        }
+        {
+            // only the first exception is kept, and it keeps its type
+            ThreadExceptionCollector errors;
+            errors.capture(PreconditionViolation("first"));
+            errors.capture(std::runtime_error("second"));
+            should(errors.failed());
+            try
+            {
+                errors.rethrow();
+                failTest("no exception thrown");
+            }
+            catch(PreconditionViolation & e)
+            {
+                std::string message(e.what());
+                shouldEqual(message, std::string(PreconditionViolation("first").what()));
+            }
+        }
+        {
+            ThreadExceptionCollector errors;
+            errors.capture(std::bad_alloc());
+            try
+            {
+                errors.rethrow();
+                failTest("no exception thrown");
+            }
+            catch(std::bad_alloc &)
+            {}
+        }
+        {
+            ThreadExceptionCollector errors;
+            errors.capture(std::range_error("out of range"));
+            try
+            {
+                errors.rethrow();
+                failTest("no exception thrown");
+            }
+            catch(std::runtime_error & e)
+            {
+                shouldEqual(std::string(e.what()), std::string("out of range"));
+            }
+        }
+        {
+            int failures = 0;
+            ThreadExceptionCollector errors;
+#ifdef _OPENMP
+            #pragma omp parallel for num_threads(4) reduction(+:failures)
+#endif
+            for(int k = 0; k < 100; ++k)
+            {
+                try
+                {
+                    vigra_invariant(k % 10 != 3, "failure in loop");
+                }
+                catch(std::exception & e)
+                {
+                    errors.capture(e);
+                    ++failures;
+                }
+            }
+            shouldEqual(failures, 10);
+            try
+            {
+                errors.rethrow();
+                failTest("no exception thrown");
+            }
+            catch(InvariantViolation &)
+            {}
+        }
+    }
+};
+
 struct MetaprogrammingTest
 {
     struct TrueResult {};
@@ -483,7 +655,11 @@ struct UtilitiesTestSuite
         add( testCase( &BucketQueueTest::testAscending));
         add( testCase( &BucketQueueTest::testDescendingMapped));
         add( testCase( &BucketQueueTest::testAscendingMapped));
+        add( testCase( &ChangeablePriorityQueueTest::testQueue));
+        add( testCase( &ChangeablePriorityQueueTest::testRandom));
         add( testCase( &SizedIntTest::testSizedInt));
+        add( testCase( &ThreadingTest::testThreadCount));
+        add( testCase( &ThreadingTest::testExceptionCollector));
         add( testCase( &MetaprogrammingTest::testInt));
         add( testCase( &MetaprogrammingTest::testLogic));
         add( testCase( &MetaprogrammingTest::testTypeTools));
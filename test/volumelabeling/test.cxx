@@ -36,9 +36,14 @@
 #include <iostream>
 #include <functional>
 #include <cmath>
+#include <stdlib.h>
 #include "unittest.hxx"
 
 #include "vigra/labelvolume.hxx"
+#include "vigra/region_adjacency_graph.hxx"
+#include "vigra/region_agglomeration.hxx"
+#include <map>
+#include <set>
 
 using namespace vigra;
 
@@ -383,11 +388,401 @@ struct VolumeLabelingTest
 
 	}
 
+    template <class Neighborhood3D>
+    void checkBlockwise(Neighborhood3D neighborhood)
+    {
+        IntVolume vol(IntVolume::difference_type(19,13,23));
+        // few distinct values => many regions crossing the slab faces
+        srand(42);
+        for(IntVolume::iterator i = vol.begin(); i != vol.end(); ++i)
+            *i = rand() % 3;
+
+        IntVolume res(vol.shape()), blockRes(vol.shape());
+        std::equal_to<int> equal;
+
+        unsigned int count = labelVolume(srcMultiArrayRange(vol), destMultiArray(res), neighborhood);
+        unsigned int bgCount = 0;
+        IntVolume bgRes(vol.shape());
+        bgCount = labelVolumeWithBackground(srcMultiArrayRange(vol), destMultiArray(bgRes), neighborhood, 0);
+
+        static const int depths[] = { 1, 2, 5, 22, 23, 40 };
+        for(int k=0; k<6; ++k)
+        {
+            blockRes.init(-1);
+            shouldEqual(count, detail::labelVolumeBlockwise(vol.traverser_begin(), vol.shape(), 
+                                        StandardConstValueAccessor<int>(), 
+                                        blockRes.traverser_begin(), StandardValueAccessor<int>(),
+                                        detail::LabelVolumePolicy<Neighborhood3D, std::equal_to<int> >(equal),
+                                        depths[k], 4));
+            should(blockRes == res);
+
+            blockRes.init(-1);
+            shouldEqual(bgCount, detail::labelVolumeBlockwise(vol.traverser_begin(), vol.shape(), 
+                                        StandardConstValueAccessor<int>(), 
+                                        blockRes.traverser_begin(), StandardValueAccessor<int>(),
+                                        detail::LabelVolumeWithBackgroundPolicy<Neighborhood3D, int, std::equal_to<int> >(0, equal),
+                                        depths[k], 4));
+            should(blockRes == bgRes);
+        }
+
+        blockRes.init(-1);
+        shouldEqual(count, labelVolumeParallel(srcMultiArrayRange(vol), destMultiArray(blockRes), neighborhood, 4));
+        should(blockRes == res);
+
+        blockRes.init(-1);
+        shouldEqual(bgCount, labelVolumeWithBackgroundParallel(srcMultiArrayRange(vol), destMultiArray(blockRes), 
+                                                               neighborhood, 0, 4));
+        should(blockRes == bgRes);
+    }
+
+    void labelingBlockwiseTest()
+    {
+        checkBlockwise(NeighborCode3DSix());
+        checkBlockwise(NeighborCode3DTwentySix());
+    }
+
     IntVolume vol1, vol2, vol3;
     DoubleVolume vol4, vol5, vol6;
 };
 
 
+struct RegionAdjacencyGraphTest
+{
+    typedef MultiArrayShape<3>::type Shape3;
+    typedef std::map<std::pair<int, int>, detail::RagEdgeStatistics> EdgeMap;
+
+        // brute force reference: visit all faces of the direct neighborhood
+    template <class T1, class S1, class T2, class S2>
+    static void referenceEdges(MultiArrayView<3, T1, S1> const & labels,
+                               MultiArrayView<3, T2, S2> const & indicator, EdgeMap & edges)
+    {
+        Shape3 shape(labels.shape());
+        for(int z = 0; z < shape[2]; ++z)
+        for(int y = 0; y < shape[1]; ++y)
+        for(int x = 0; x < shape[0]; ++x)
+        {
+            Shape3 p(x, y, z);
+            for(int d = 0; d < 3; ++d)
+            {
+                Shape3 q(p);
+                ++q[d];
+                if(q[d] == shape[d] || labels[p] == labels[q])
+                    continue;
+                int u = std::min<int>(labels[p], labels[q]),
+                    v = std::max<int>(labels[p], labels[q]);
+                edges[std::make_pair(u, v)].add(0.5*((double)indicator[p] + (double)indicator[q]));
+            }
+        }
+    }
+
+    template <class T1, class S1, class T2, class S2>
+    void checkGraph(MultiArrayView<3, T1, S1> const & labels,
+                    MultiArrayView<3, T2, S2> const & indicator,
+                    RegionAdjacencyGraph const & rag)
+    {
+        EdgeMap edges;
+        referenceEdges(labels, indicator, edges);
+
+        shouldEqual(rag.edgeCount(), (MultiArrayIndex)edges.size());
+        RegionAdjacencyGraph::index_type e = 0;
+        for(EdgeMap::iterator i = edges.begin(); i != edges.end(); ++i, ++e)
+        {
+            shouldEqual((int)rag.u(e), i->first.first);
+            shouldEqual((int)rag.v(e), i->first.second);
+            shouldEqual(rag.findEdge(rag.u(e), rag.v(e)), e);
+            shouldEqual(rag.findEdge(rag.v(e), rag.u(e)), e);
+            shouldEqual(rag.boundarySize(e), i->second.count);
+            shouldEqualTolerance(rag.boundarySum(e), i->second.sum, 1e-10);
+            shouldEqualTolerance(rag.boundaryMean(e), i->second.sum / i->second.count, 1e-10);
+            shouldEqual(rag.boundaryMin(e), i->second.minimum);
+            shouldEqual(rag.boundaryMax(e), i->second.maximum);
+        }
+
+        MultiArrayIndex degreeSum = 0, sizeSum = 0;
+        for(RegionAdjacencyGraph::label_type l = 0; l <= rag.maxLabel(); ++l)
+        {
+            degreeSum += rag.degree(l);
+            sizeSum += rag.nodeSize(l);
+            shouldEqual(rag.nodeSize(l), 
+                        (MultiArrayIndex)std::count(labels.begin(), labels.end(), (T1)l));
+
+            RegionAdjacencyGraph::neighbor_iterator n = rag.neighborsBegin(l);
+            RegionAdjacencyGraph::edge_iterator ei = rag.edgesBegin(l);
+            for(; n != rag.neighborsEnd(l); ++n, ++ei)
+            {
+                if(n != rag.neighborsBegin(l))
+                    should(n[-1] < *n);
+                shouldEqual(rag.findEdge(l, *n), (MultiArrayIndex)*ei);
+            }
+            should(ei == rag.edgesEnd(l));
+        }
+        shouldEqual(degreeSum, 2*rag.edgeCount());
+        shouldEqual(sizeSum, labels.size());
+    }
+
+    void testSimple()
+    {
+        static const int in[] = { 1, 1, 2,
+                                  1, 3, 2,
+                                  3, 3, 2 };
+        MultiArray<2, int> labels(MultiArrayShape<2>::type(3, 3), in);
+
+        RegionAdjacencyGraph rag(labels);
+        shouldEqual(rag.maxLabel(), 3u);
+        shouldEqual(rag.nodeCount(), 4);
+        shouldEqual(rag.edgeCount(), 3);
+        shouldEqual(rag.u(0), 1u);
+        shouldEqual(rag.v(0), 2u);
+        shouldEqual(rag.boundarySize(0), 1);
+        shouldEqual(rag.u(1), 1u);
+        shouldEqual(rag.v(1), 3u);
+        shouldEqual(rag.boundarySize(1), 3);
+        shouldEqual(rag.u(2), 2u);
+        shouldEqual(rag.v(2), 3u);
+        shouldEqual(rag.boundarySize(2), 2);
+        shouldEqual(rag.boundaryMean(2), 0.0);
+
+        shouldEqual(rag.nodeSize(0), 0);
+        shouldEqual(rag.nodeSize(1), 3);
+        shouldEqual(rag.degree(0), 0);
+        shouldEqual(rag.degree(3), 2);
+        shouldEqual(rag.findEdge(0, 1), -1);
+        shouldEqual(rag.findEdge(3, 2), 2);
+        shouldEqual(rag.findEdge(3, 7), -1);
+
+        MultiArray<2, double> indicator(labels.shape());
+        for(int k = 0; k < 9; ++k)
+            indicator[k] = k;
+        rag.build(labels, indicator);
+        shouldEqual(rag.edgeCount(), 3);
+        // faces (1,1)-(2,1) and (1,2)-(2,2) between regions 3 and 2
+        shouldEqual(rag.boundarySize(2), 2);
+        shouldEqual(rag.boundaryMin(2), 4.5);
+        shouldEqual(rag.boundaryMax(2), 7.5);
+        shouldEqual(rag.boundaryMean(2), 6.0);
+    }
+
+    void testRandom()
+    {
+        MultiArray<3, UInt32> labels(Shape3(17, 11, 23));
+        MultiArray<3, double> indicator(labels.shape());
+        srand(42);
+        // constant runs along x, so that boundaries are not everywhere
+        for(int k = 0; k < labels.size(); ++k)
+        {
+            labels[k] = (k % 3 == 0)
+                           ? rand() % 50
+                           : labels[k-1];
+            // not exactly representable => the sums depend on the summation order
+            indicator[k] = (rand() % 1000) / 7.0;
+        }
+
+        checkGraph(labels, indicator, RegionAdjacencyGraph(labels, indicator, 1));
+        checkGraph(labels, indicator, RegionAdjacencyGraph(labels, indicator, 4));
+
+        // the result must not depend on the thread count, not even by round-off
+        RegionAdjacencyGraph rag1(labels, indicator, 1);
+        for(int threads = 2; threads <= 8; ++threads)
+        {
+            RegionAdjacencyGraph ragN(labels, indicator, threads);
+            shouldEqual(rag1.edgeCount(), ragN.edgeCount());
+            for(int e = 0; e < rag1.edgeCount(); ++e)
+            {
+                shouldEqual(rag1.u(e), ragN.u(e));
+                shouldEqual(rag1.v(e), ragN.v(e));
+                shouldEqual(rag1.boundarySize(e), ragN.boundarySize(e));
+                shouldEqual(rag1.boundarySum(e), ragN.boundarySum(e));
+                shouldEqual(rag1.boundaryMean(e), ragN.boundaryMean(e));
+                shouldEqual(rag1.boundaryMin(e), ragN.boundaryMin(e));
+                shouldEqual(rag1.boundaryMax(e), ragN.boundaryMax(e));
+            }
+        }
+
+        // strided views
+        Shape3 start(1, 2, 3), stop(15, 10, 20);
+        checkGraph(labels.subarray(start, stop), indicator.subarray(start, stop),
+                   RegionAdjacencyGraph(labels.subarray(start, stop), 
+                                        indicator.subarray(start, stop), 3));
+    }
+
+    void testLabelVolume()
+    {
+        MultiArray<3, int> vol(Shape3(20, 20, 20)), labels(vol.shape());
+        srand(7);
+        for(int k = 0; k < vol.size(); ++k)
+            vol[k] = rand() % 2;
+        unsigned int count = labelVolumeSix(srcMultiArrayRange(vol), destMultiArray(labels));
+
+        RegionAdjacencyGraph rag(labels, vol);
+        shouldEqual(rag.maxLabel(), count);
+        shouldEqual(rag.nodeSize(0), 0);
+        checkGraph(labels, vol, rag);
+        // adjacent regions always have different values
+        for(int e = 0; e < rag.edgeCount(); ++e)
+        {
+            shouldEqual(rag.boundaryMin(e), 0.5);
+            shouldEqual(rag.boundaryMax(e), 0.5);
+        }
+    }
+};
+
+
+struct RegionAgglomerationTest
+{
+    typedef RegionAdjacencyGraph::label_type Label;
+    typedef std::map<std::pair<Label, Label>, std::pair<double, double> > EdgeMap;
+
+        // brute force reference: search the best edge in every step
+    static void referenceMerges(RegionAdjacencyGraph const & rag, ArrayVector<double> const & weights,
+                                ArrayVector<RegionMergeTree::Merge> & merges)
+    {
+        EdgeMap edges; // (u, v) => (weighted sum, boundary size)
+        for(int e = 0; e < rag.edgeCount(); ++e)
+            edges[std::make_pair(rag.u(e), rag.v(e))] = 
+                std::make_pair(weights[e]*rag.boundarySize(e), (double)rag.boundarySize(e));
+
+        while(edges.size() > 0)
+        {
+            EdgeMap::iterator best = edges.begin();
+            for(EdgeMap::iterator i = edges.begin(); i != edges.end(); ++i)
+                if(i->second.first / i->second.second < best->second.first / best->second.second)
+                    best = i;
+            Label r = best->first.first, m = best->first.second;
+            merges.push_back(RegionMergeTree::Merge(r, m, best->second.first / best->second.second));
+            edges.erase(best);
+
+            EdgeMap updated;
+            for(EdgeMap::iterator i = edges.begin(); i != edges.end(); ++i)
+            {
+                Label u = i->first.first == m ? r : i->first.first,
+                      v = i->first.second == m ? r : i->first.second;
+                std::pair<double, double> & edge = updated[std::make_pair(std::min(u, v), std::max(u, v))];
+                edge.first += i->second.first;
+                edge.second += i->second.second;
+            }
+            edges.swap(updated);
+        }
+    }
+
+    void testSimple()
+    {
+        // regions 1 and 2 share one face, 1 and 3 share one face, 2 and 3 share three faces
+        static const int in[] = { 1, 2, 2, 2,
+                                  3, 3, 3, 3 };
+        MultiArray<2, int> labels(MultiArrayShape<2>::type(4, 2), in);
+        RegionAdjacencyGraph rag(labels);
+        shouldEqual(rag.edgeCount(), 3);
+
+        MultiArray<1, double> weights(MultiArrayShape<1>::type(3));
+        weights(rag.findEdge(1, 2)) = 1.0;
+        weights(rag.findEdge(1, 3)) = 4.0;
+        weights(rag.findEdge(2, 3)) = 8.0;
+
+        RegionMergeTree tree;
+        agglomerateRegions(rag, weights, tree);
+        shouldEqual(tree.maxLabel(), 3u);
+        shouldEqual(tree.size(), 2);
+        shouldEqual(tree[0].representative, 1u);
+        shouldEqual(tree[0].merged, 2u);
+        shouldEqual(tree[0].weight, 1.0);
+        shouldEqual(tree[1].representative, 1u);
+        shouldEqual(tree[1].merged, 3u);
+        // the combined edge is weighted by the boundary sizes
+        shouldEqual(tree[1].weight, (4.0*1 + 8.0*3) / 4);
+
+        shouldEqual(tree.mergeCount(0.5), 0);
+        shouldEqual(tree.mergeCount(1.0), 1);
+        shouldEqual(tree.mergeCount(6.0), 1);
+        shouldEqual(tree.mergeCount(7.0), 2);
+
+        ArrayVector<Label> labelMap;
+        tree.mappingAtThreshold(2.0, labelMap);
+        shouldEqual(labelMap.size(), 4u);
+        shouldEqual(labelMap[0], 0u);
+        shouldEqual(labelMap[1], 1u);
+        shouldEqual(labelMap[2], 1u);
+        shouldEqual(labelMap[3], 3u);
+
+        // stopping criteria
+        agglomerateRegions(rag, weights, tree, AgglomerationOptions().stopAtThreshold(6.0));
+        shouldEqual(tree.size(), 1);
+        agglomerateRegions(rag, weights, tree, AgglomerationOptions().regionCount(3));
+        shouldEqual(tree.size(), 0);
+        agglomerateRegions(rag, weights, tree, AgglomerationOptions().regionCount(2));
+        shouldEqual(tree.size(), 1);
+
+        // default weights are the mean boundary indicator
+        MultiArray<2, double> indicator(labels.shape());
+        for(int k = 0; k < 8; ++k)
+            indicator[k] = k;
+        rag.build(labels, indicator);
+        agglomerateRegions(rag, tree);
+        shouldEqual(tree.size(), 2);
+        shouldEqual(tree[0].representative, 1u);
+        shouldEqual(tree[0].merged, 2u);
+        shouldEqual(tree[0].weight, 0.5);
+        shouldEqual(tree[1].weight, (2.0 + 3.0 + 4.0 + 5.0) / 4);
+    }
+
+    void testRandom()
+    {
+        MultiArray<3, UInt32> labels(MultiArrayShape<3>::type(20, 20, 20));
+        MultiArray<3, float> indicator(labels.shape());
+        srand(42);
+        // blocks of 4x4x4 voxels with random labels
+        for(int z = 0; z < 20; ++z)
+        for(int y = 0; y < 20; ++y)
+        for(int x = 0; x < 20; ++x)
+        {
+            labels(x, y, z) = ((z/4)*5 + y/4)*5 + x/4 + 1;
+            indicator(x, y, z) = (float)(rand() % 1000);
+        }
+        labels[7] = 200; // an isolated voxel and unused labels in between
+        RegionAdjacencyGraph rag(labels, indicator);
+
+        ArrayVector<double> weights(rag.edgeCount());
+        for(int e = 0; e < rag.edgeCount(); ++e)
+            weights[e] = rag.boundaryMean(e);
+        ArrayVector<RegionMergeTree::Merge> reference;
+        referenceMerges(rag, weights, reference);
+
+        RegionMergeTree tree;
+        agglomerateRegions(rag, tree);
+        shouldEqual(tree.size(), (MultiArrayIndex)reference.size());
+        shouldEqual(tree.size(), 125); // 126 regions
+        for(int k = 0; k < tree.size(); ++k)
+        {
+            shouldEqual(tree[k].representative, reference[k].representative);
+            shouldEqual(tree[k].merged, reference[k].merged);
+            shouldEqualTolerance(tree[k].weight, reference[k].weight, 1e-10);
+            if(k > 0)
+                should(tree[k-1].weight <= tree[k].weight);
+        }
+
+        // threshold sweeps agree with separate runs
+        for(double threshold = 450.0; threshold < 550.0; threshold += 10.0)
+        {
+            RegionMergeTree partial;
+            agglomerateRegions(rag, partial, AgglomerationOptions().stopAtThreshold(threshold));
+            shouldEqual(partial.size(), tree.mergeCount(threshold));
+
+            ArrayVector<Label> labelMap, partialMap;
+            tree.mappingAtThreshold(threshold, labelMap);
+            partial.mapping(partial.size(), partialMap);
+            should(labelMap == partialMap);
+        }
+
+        RegionMergeTree partial;
+        agglomerateRegions(rag, partial, AgglomerationOptions().regionCount(10));
+        shouldEqual(partial.size(), 116);
+        ArrayVector<Label> labelMap;
+        partial.mapping(partial.size(), labelMap);
+        std::set<Label> regions;
+        for(int k = 0; k < labels.size(); ++k)
+            regions.insert(labelMap[labels[k]]);
+        shouldEqual(regions.size(), 10u);
+    }
+};
 
 struct VolumeLabelingTestSuite
 : public vigra::test_suite
@@ -405,6 +800,14 @@ struct VolumeLabelingTestSuite
         add( testCase( &VolumeLabelingTest::labelingTwentySixTest3));
         add( testCase( &VolumeLabelingTest::labelingTwentySixWithBackgroundTest1));
 		add( testCase( &VolumeLabelingTest::labelingAllTest));
+        add( testCase( &VolumeLabelingTest::labelingBlockwiseTest));
+
+        add( testCase( &RegionAdjacencyGraphTest::testSimple));
+        add( testCase( &RegionAdjacencyGraphTest::testRandom));
+        add( testCase( &RegionAdjacencyGraphTest::testLabelVolume));
+
+        add( testCase( &RegionAgglomerationTest::testSimple));
+        add( testCase( &RegionAgglomerationTest::testRandom));
     }
 };
 
@@ -39,6 +39,7 @@
 #include "unittest.hxx"
 
 #include "vigra/watersheds3d.hxx"
+#include "vigra/multi_watersheds.hxx"
 #include "vigra/multi_array.hxx"
 #include "list"
 
@@ -457,8 +458,417 @@ struct Watersheds3dTest
     }
 
 
+    template <class Neighborhood3D>
+    void checkWatersheds3dBlockwise(Neighborhood3D neighborhood)
+    {
+        int w=23,h=17,d=29;
+        IntVolume vol(IntVolume::difference_type(w,h,d));
+
+        // few grey values => many plateaus crossing the slab faces
+        srand(42);
+        for(IntVolume::iterator iter=vol.begin(); iter!=vol.end(); ++iter)
+            *iter = rand() % 5;
+
+        IntVolume orientation(vol.shape()), labels(vol.shape()), blockLabels(vol.shape());
+        preparewatersheds3D(vol.traverser_begin(), vol.shape(), StandardConstValueAccessor<int>(),
+                            orientation.traverser_begin(), StandardValueAccessor<int>(), neighborhood);
+        unsigned int count = watershedLabeling3D(orientation.traverser_begin(), vol.shape(), StandardConstValueAccessor<int>(),
+                                                 labels.traverser_begin(), StandardValueAccessor<int>(), neighborhood);
+
+        static const int depths[] = { 1, 2, 3, 7, 28, 29, 50 };
+        for(int k=0; k<7; ++k)
+        {
+            blockLabels.init(0);
+            unsigned int blockCount = watershedLabeling3DBlockwise(orientation.traverser_begin(), vol.shape(), 
+                                                                   StandardConstValueAccessor<int>(),
+                                                                   blockLabels.traverser_begin(), 
+                                                                   StandardValueAccessor<int>(),
+                                                                   neighborhood, depths[k], 4);
+            shouldEqual(blockCount, count);
+            should(blockLabels == labels);
+        }
+
+        blockLabels.init(0);
+        unsigned int parallelCount = watersheds3D(srcMultiArrayRange(vol), destMultiArray(blockLabels), 
+                                                  neighborhood, 4);
+        count = watersheds3D(srcMultiArrayRange(vol), destMultiArray(labels), neighborhood, 1);
+        shouldEqual(parallelCount, count);
+        should(blockLabels == labels);
+    }
+
+    void testWatersheds3dBlockwise()
+    {
+        checkWatersheds3dBlockwise(NeighborCode3DSix());
+        checkWatersheds3dBlockwise(NeighborCode3DTwentySix());
+    }
+
+};
+
+struct MultiWatershedsTest
+{
+    typedef MultiArrayShape<2>::type Shape2;
+    typedef MultiArrayShape<3>::type Shape3;
+    typedef MultiArrayShape<4>::type Shape4;
+
+    void testSeeds()
+    {
+        int w = 31, h = 27;
+        MultiArray<2, double> data(Shape2(w, h));
+        MultiArray<2, int> seeds(data.shape());
+        DImage image(w, h);
+        IImage ref(w, h);
+
+        srand(17);
+        for(int y=0; y<h; ++y)
+            for(int x=0; x<w; ++x)
+                image(x,y) = data(x,y) = rand() % 100;
+
+        SeedOptions options[] = { SeedOptions().minima(),
+                                  SeedOptions().minima().threshold(30.0),
+                                  SeedOptions().levelSets(20.0) };
+        for(int k=0; k<3; ++k)
+        {
+            ref.init(0);
+            unsigned int count = generateWatershedSeeds(srcImageRange(image), destImage(ref),
+                                                        FourNeighborCode(), options[k]);
+            shouldEqual(generateWatershedSeeds(data, seeds, DirectNeighborhood, options[k]), count);
+            shouldEqualSequence(seeds.begin(), seeds.end(), ref.begin());
+
+            ref.init(0);
+            count = generateWatershedSeeds(srcImageRange(image), destImage(ref),
+                                           EightNeighborCode(), options[k]);
+            shouldEqual(generateWatershedSeeds(data, seeds, IndirectNeighborhood, options[k]), count);
+            shouldEqualSequence(seeds.begin(), seeds.end(), ref.begin());
+        }
+
+        try
+        {
+            generateWatershedSeeds(data, seeds, IndirectNeighborhood, SeedOptions().extendedMinima());
+            failTest("generateWatershedSeeds(): no exception thrown for extendedMinima().");
+        }
+        catch(vigra::PreconditionViolation &)
+        {}
+    }
+
+    void checkVoronoi4D(NeighborhoodType neighborhood)
+    {
+        Shape4 shape(6, 5, 4, 3), s1(1, 1, 0, 0), s2(4, 3, 3, 2);
+        MultiArray<4, double> data(shape);
+        MultiArray<4, unsigned int> labels(shape);
+        ArrayVector<double> dist1, dist2;
+
+        for(int i=0; i<data.size(); ++i)
+        {
+            Shape4 p = data.scanOrderIndexToCoordinate(i);
+            dist1.push_back(std::sqrt((double)squaredNorm(p - s1)));
+            dist2.push_back(std::sqrt((double)squaredNorm(p - s2)));
+            data[i] = std::min(dist1.back(), dist2.back());
+        }
+        labels[s1] = 1;
+        labels[s2] = 2;
+
+        shouldEqual(watershedsMultiArray(data, labels, neighborhood), 2u);
+        for(int i=0; i<data.size(); ++i)
+        {
+            if(std::fabs(dist1[i] - dist2[i]) > 1e-10)
+                shouldEqual(labels[i], dist1[i] < dist2[i] ? 1u : 2u);
+        }
+    }
+
+    void testVoronoi4D()
+    {
+        checkVoronoi4D(DirectNeighborhood);
+        checkVoronoi4D(IndirectNeighborhood);
+    }
+
+    void testOptions()
+    {
+        // two seeds separated by the plane z == 2
+        Shape3 shape(5, 5, 5);
+        MultiArray<3, UInt8> data(shape);
+        MultiArray<3, int> seeds(shape), labels(shape);
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    data(x,y,z) = (x-2)*(x-2) + (y-2)*(y-2) + std::min(z*z, (z-4)*(z-4));
+        seeds(2,2,0) = 1;
+        seeds(2,2,4) = 2;
+
+        WatershedOptions options[] = { WatershedOptions(),
+                                       WatershedOptions().srgType(QuantizedCosts),
+                                       WatershedOptions().turboAlgorithm() };
+        for(int k=0; k<3; ++k)
+        {
+            for(int n=0; n<2; ++n)
+            {
+                labels = seeds;
+                shouldEqual(watershedsMultiArray(data, labels, NeighborhoodType(n), options[k]), 2u);
+                for(int z=0; z<5; ++z)
+                    for(int y=0; y<5; ++y)
+                        for(int x=0; x<5; ++x)
+                            if(z != 2)
+                                shouldEqual(labels(x,y,z), z < 2 ? 1 : 2);
+
+                labels = seeds;
+                watershedsMultiArray(data, labels, NeighborhoodType(n),
+                                     WatershedOptions(options[k]).stopAtThreshold(3.0));
+                for(int z=0; z<5; ++z)
+                    for(int y=0; y<5; ++y)
+                        for(int x=0; x<5; ++x)
+                            if(k < 2)
+                                shouldEqual(labels(x,y,z) != 0, data(x,y,z) <= 3);
+                            else // the turbo algorithm also labels the next pixel
+                                should(labels(x,y,z) != 0 || data(x,y,z) > 3);
+            }
+        }
+
+        labels = seeds;
+        watershedsMultiArray(data, labels, DirectNeighborhood, WatershedOptions().keepContours());
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    shouldEqual(labels(x,y,z), z < 2 ? 1 : z > 2 ? 2 : 0);
+
+        labels = seeds;
+        watershedsMultiArray(data, labels, DirectNeighborhood,
+                             WatershedOptions().keepContours().srgType(SRGType(KeepContours | QuantizedCosts)));
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    shouldEqual(labels(x,y,z), z < 2 ? 1 : z > 2 ? 2 : 0);
+
+        // completeGrow() and keepContours() must not reset the other flags
+        shouldEqual(WatershedOptions().srgType(QuantizedCosts).keepContours().terminate,
+                    SRGType(KeepContours | QuantizedCosts));
+        shouldEqual(WatershedOptions().srgType(QuantizedCosts).stopAtThreshold(3.0).completeGrow().terminate,
+                    SRGType(CompleteGrow | StopAtThreshold | QuantizedCosts));
+
+        labels = seeds;
+        watershedsMultiArray(data, labels, DirectNeighborhood,
+                             WatershedOptions().srgType(QuantizedCosts).keepContours());
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    shouldEqual(labels(x,y,z), z < 2 ? 1 : z > 2 ? 2 : 0);
+
+        // the background (label 1) is preferred in the biased watershed
+        labels = seeds;
+        watershedsMultiArray(data, labels, DirectNeighborhood, WatershedOptions().biasLabel(1, 0.5));
+        for(int z=0; z<5; ++z)
+            for(int y=0; y<5; ++y)
+                for(int x=0; x<5; ++x)
+                    if(z != 3 && z != 4)
+                        shouldEqual(labels(x,y,z), 1);
+
+        try
+        {
+            watershedsMultiArray(data, labels, DirectNeighborhood,
+                                 WatershedOptions().keepContours().turboAlgorithm());
+            failTest("watershedsMultiArray(): no exception thrown for turbo algorithm with contours.");
+        }
+        catch(vigra::PreconditionViolation &)
+        {}
+    }
+
+    void testStridedAndCustom()
+    {
+        Shape3 shape(13, 11, 9);
+        MultiArray<3, UInt8> data(shape);
+        MultiArray<3, UInt32> labels(shape);
+        MultiArray<3, UInt8> bigData(shape + Shape3(2,2,2));
+        MultiArray<3, UInt32> bigLabels(shape + Shape3(2,2,2));
+
+        srand(23);
+        for(int i=0; i<data.size(); ++i)
+            data[i] = rand() % 32;
+
+        WatershedOptions options[] = { WatershedOptions().keepContours(),
+                                       WatershedOptions().srgType(QuantizedCosts),
+                                       WatershedOptions().turboAlgorithm() };
+        for(int k=0; k<3; ++k)
+        {
+            options[k].seedOptions(SeedOptions().minima().threshold(8.0));
+            labels.init(0);
+            unsigned int count = watershedsMultiArray(data, labels, IndirectNeighborhood, options[k]);
+            should(count > 1);
+
+            // views with a border must give the same result
+            bigData.init(255);
+            bigLabels.init(0);
+            MultiArrayView<3, UInt8> subData = bigData.subarray(Shape3(1,1,1), shape + Shape3(1,1,1));
+            MultiArrayView<3, UInt32> subLabels = bigLabels.subarray(Shape3(1,1,1), shape + Shape3(1,1,1));
+            subData = data;
+            shouldEqual(watershedsMultiArray(subData, subLabels, IndirectNeighborhood, options[k]), count);
+            should(subLabels == labels);
+            shouldEqual(bigLabels(0,0,0), 0u);
+        }
+
+        // neighbors along the x-axis only: each row grows on its own
+        ArrayVector<Shape3> neighbors;
+        neighbors.push_back(Shape3(-1, 0, 0));
+        neighbors.push_back(Shape3(1, 0, 0));
+        labels.init(0);
+        for(int z=0; z<shape[2]; ++z)
+            for(int y=0; y<shape[1]; ++y)
+                labels(shape[0] / 2, y, z) = 1 + y + shape[1]*z;
+        watershedsMultiArray(data, labels, neighbors);
+        for(int z=0; z<shape[2]; ++z)
+            for(int y=0; y<shape[1]; ++y)
+                for(int x=0; x<shape[0]; ++x)
+                    shouldEqual(labels(x,y,z), (UInt32)(1 + y + shape[1]*z));
+
+        neighbors.pop_back();
+        try
+        {
+            watershedsMultiArray(data, labels, neighbors);
+            failTest("watershedsMultiArray(): no exception thrown for asymmetric neighborhood.");
+        }
+        catch(vigra::PreconditionViolation &)
+        {}
+    }
 };
 
+struct IncrementalWatershedTest
+{
+    typedef MultiArrayShape<3>::type Shape3;
+
+    // check that the result is an optimal flooding: each pixel is reached
+    // at minimal cost and has a neighbor with the same label on its path
+    template <class T, class WS>
+    void checkFlooding(MultiArrayView<3, T> const & data, WS const & ws,
+                       ArrayVector<Shape3> const & neighbors)
+    {
+        Shape3 shape = data.shape();
+        for(int i=0; i<data.size(); ++i)
+        {
+            Shape3 p = data.scanOrderIndexToCoordinate(i);
+            shouldEqual(ws.labels()[p] != 0, true);
+            if(ws.isSeed(p))
+            {
+                shouldEqual(ws.costs()[p], data[p]);
+                continue;
+            }
+            bool hasPath = false;
+            for(unsigned int k=0; k<neighbors.size(); ++k)
+            {
+                Shape3 q = p + neighbors[k];
+                if(q[0] < 0 || q[1] < 0 || q[2] < 0 ||
+                   q[0] >= shape[0] || q[1] >= shape[1] || q[2] >= shape[2])
+                    continue;
+                T cost = std::max(data[p], ws.costs()[q]);
+                should(ws.costs()[p] <= cost);
+                if(cost == ws.costs()[p] && ws.labels()[q] == ws.labels()[p])
+                    hasPath = true;
+            }
+            should(hasPath);
+        }
+    }
+
+    template <class T>
+    void checkEdits(NeighborhoodType neighborhood, std::ptrdiff_t bucket_count)
+    {
+        Shape3 shape(20, 18, 16);
+        MultiArray<3, T> data(shape);
+        MultiArray<3, UInt32> seeds(shape), ref(shape);
+        ArrayVector<Shape3> neighbors = detail::neighborhoodDiffs<3>(neighborhood);
+
+        srand(5);
+        for(int i=0; i<data.size(); ++i)
+            data[i] = (T)(rand() % 16); // many plateaus
+        for(int k=0; k<30; ++k)
+            seeds[rand() % seeds.size()] = 1 + k % 5;
+
+        IncrementalWatershed<3, T> ws(data, neighborhood, bucket_count);
+        ws.setSeeds(seeds);
+        checkFlooding(data, ws, neighbors);
+        shouldEqual(ws.update(), 0);
+
+        if(bucket_count > 0)
+        {
+            // without edits, the result equals the turbo watershed
+            ref = seeds;
+            watershedsMultiArray(data, ref, neighborhood, WatershedOptions().turboAlgorithm());
+            should(ref == ws.labels());
+        }
+
+        for(int round=0; round<3; ++round)
+        {
+            for(int k=0; k<4; ++k)
+            {
+                int i = rand() % seeds.size();
+                seeds[i] = 1 + rand() % 6;
+                ws.addSeed(seeds.scanOrderIndexToCoordinate(i), seeds[i]);
+            }
+            for(int k=0, removed=0; k<seeds.size() && removed<3; ++k)
+            {
+                int i = (k * 7919) % seeds.size();
+                if(seeds[i] == 0 || rand() % 2 == 0)
+                    continue;
+                seeds[i] = 0;
+                ws.removeSeed(seeds.scanOrderIndexToCoordinate(i));
+                ++removed;
+            }
+            MultiArrayIndex updated = ws.update();
+            should(updated > 0 && updated < data.size());
+            checkFlooding(data, ws, neighbors);
+
+            // the costs of an optimal flooding are unique
+            IncrementalWatershed<3, T> fresh(data, neighborhood, bucket_count);
+            fresh.setSeeds(seeds);
+            should(fresh.costs() == ws.costs());
+            for(int i=0; i<seeds.size(); ++i)
+                if(seeds[i] != 0)
+                    shouldEqual(ws.labels()[i], seeds[i]);
+        }
+    }
+
+    void testEdits()
+    {
+        checkEdits<UInt8>(DirectNeighborhood, 256);
+        checkEdits<UInt8>(IndirectNeighborhood, 256);
+        checkEdits<float>(DirectNeighborhood, 0);
+        checkEdits<float>(IndirectNeighborhood, 0);
+    }
+
+    void testBasins()
+    {
+        // two basins separated by the wall x == 4
+        Shape3 shape(9, 4, 3);
+        MultiArray<3, UInt8> data(shape);
+        MultiArray<3, UInt32> seeds(shape);
+        for(int z=0; z<3; ++z)
+            for(int y=0; y<4; ++y)
+                for(int x=0; x<9; ++x)
+                    data(x,y,z) = x == 4 ? 100 : std::abs(x - 4);
+        seeds(0,0,0) = 1;
+
+        IncrementalWatershed<3, UInt8> ws(data, DirectNeighborhood, 256);
+        ws.setSeeds(seeds);
+        for(int i=0; i<data.size(); ++i)
+            shouldEqual(ws.labels()[i], 1u);
+
+        // the new seed conquers the right basin only
+        ws.addSeed(Shape3(8,3,2), 2);
+        shouldEqual(ws.update(), 4*4*3 - 1);
+        for(int z=0; z<3; ++z)
+            for(int y=0; y<4; ++y)
+                for(int x=0; x<9; ++x)
+                    shouldEqual(ws.labels()(x,y,z), x < 4 ? 1u : x > 4 ? 2u : ws.labels()(x,y,z));
+
+        // and gives it back when removed
+        ws.removeSeed(Shape3(8,3,2));
+        should(!ws.isSeed(Shape3(8,3,2)));
+        ws.update();
+        for(int i=0; i<data.size(); ++i)
+            shouldEqual(ws.labels()[i], 1u);
+        shouldEqual(ws.costs()(8,3,2), 100);
+
+        ws.clearSeeds();
+        shouldEqual(ws.update(), 0);
+        for(int i=0; i<data.size(); ++i)
+            shouldEqual(ws.labels()[i], 0u);
+    }
+};
 
 struct SimpleAnalysisTestSuite
 : public vigra::test_suite
@@ -472,6 +882,13 @@ struct SimpleAnalysisTestSuite
         add( testCase( &Watersheds3dTest::testWatersheds3dSix2));
         add( testCase( &Watersheds3dTest::testWatersheds3dGradient1));
         add( testCase( &Watersheds3dTest::testWatersheds3dGradient2));
+        add( testCase( &Watersheds3dTest::testWatersheds3dBlockwise));
+        add( testCase( &MultiWatershedsTest::testSeeds));
+        add( testCase( &MultiWatershedsTest::testVoronoi4D));
+        add( testCase( &MultiWatershedsTest::testOptions));
+        add( testCase( &MultiWatershedsTest::testStridedAndCustom));
+        add( testCase( &IncrementalWatershedTest::testEdits));
+        add( testCase( &IncrementalWatershedTest::testBasins));
     }
 };
 